@@ -100,20 +100,47 @@ void update_ship_data(struct ships* ship_data, int ship_idx, int segment, int x,
     }
 }
 
+// Small reentrant PRNG (xorshift32); a zero state is bumped to a fixed seed
+unsigned int xorshift32(unsigned int* state) {
+    unsigned int x = *state ? *state : 2463534242u;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
 // Autoplacing warships
+#define PLACE_ATTEMPT_LIMIT 1000
+
 void place_ships(Field field, struct ships* ship_data) {
-    srand(time(NULL));
+    unsigned int seed = (unsigned int)time(NULL);
+    place_ships_r(field, ship_data, &seed);
+}
 
+// Same placement, drawing from the caller's state so threads don't share rand()
+void place_ships_r(Field field, struct ships* ship_data, unsigned int* seed) {
     int ship_lengths[] = {4, 3, 3, 2, 2, 2, 1, 1, 1, 1};
     int ship_placed = 0;
 
     for (int ship_idx = 0; ship_idx < 10; ship_idx++) {
         int n = ship_lengths[ship_idx];
         int placed = 0;
+        int attempts = 0;
 
         while (!placed) {
-            int outer_x = rand() % (FIELD_SIZE - n - 1);
-            int outer_y = rand() % (FIELD_SIZE - n - 1);
+            /* Earlier ships can leave no free (n+2)x(n+2) box at all;
+               start the whole fleet over instead of spinning forever. */
+            if (++attempts > PLACE_ATTEMPT_LIMIT) {
+                create_game_field(field);
+                initialize_ships(ship_data);
+                ship_placed = 0;
+                ship_idx = -1;
+                break;
+            }
+
+            int outer_x = (int)(xorshift32(seed) >> 1) % (FIELD_SIZE - n - 1);
+            int outer_y = (int)(xorshift32(seed) >> 1) % (FIELD_SIZE - n - 1);
 
             int collision = 0;
             for (int i = outer_x; i < outer_x + n + 2 && !collision; i++) {
@@ -125,7 +152,7 @@ void place_ships(Field field, struct ships* ship_data) {
             }
 
             if (!collision) {
-                int side = rand() % 4 + 1;
+                int side = (int)(xorshift32(seed) >> 1) % 4 + 1;
                 int inner_x = outer_x + 1;
                 int inner_y = outer_y + 1;
 
@@ -374,9 +401,12 @@ int simple_shot(char field[12][12], struct ships* ship_data, const std::string&
     if (!convert_coordinates(coord_string, &x, &y)) {
         return -1;
     }
+    return shot_at(field, ship_data, x + 1, y + 1);
+}
 
-    x++;
-    y++;
+// x, y are 1-based field indices; 1 hit, 0 miss, -1 already shot or off the board
+int shot_at(char field[12][12], struct ships* ship_data, int x, int y) {
+    if (x < 1 || x > PLAYABLE_SIZE || y < 1 || y > PLAYABLE_SIZE) return -1;
 
     if (field[x][y] == 1) {
         field[x][y] = 3;
@@ -597,3 +627,37 @@ int all_ships_sunk(struct ships* ship_data) {
 
     return 1; // All ships sunk
 }
+
+// Writes FIELD_PAYLOAD_SIZE chars (no terminator)
+void encode_field(Field field, char* out) {
+    int idx = 0;
+    for (int i = 1; i <= PLAYABLE_SIZE; i++) {
+        for (int j = 1; j <= PLAYABLE_SIZE; j++) {
+            out[idx++] = '0' + (field[i][j] & 0x07);
+        }
+    }
+}
+
+// Returns 0 without touching the field if the payload is too short
+int decode_field(const char* in, Field field) {
+    if (strlen(in) < FIELD_PAYLOAD_SIZE) return 0;
+    int idx = 0;
+    for (int i = 1; i <= PLAYABLE_SIZE; i++) {
+        for (int j = 1; j <= PLAYABLE_SIZE; j++) {
+            char c = in[idx++];
+            field[i][j] = (c >= '0' && c <= '3') ? (c - '0') : 0;
+        }
+    }
+    return 1;
+}
+
+// Opponent's view of a field: only misses (2) and hits (3) are visible
+void build_fog_field(Field dest, Field src) {
+    for (int i = 1; i <= PLAYABLE_SIZE; i++) {
+        for (int j = 1; j <= PLAYABLE_SIZE; j++) {
+            char v = src[i][j];
+            if (v == 2 || v == 3) dest[i][j] = v;
+            else dest[i][j] = 0;
+        }
+    }
+}
@@ -16,9 +16,16 @@
 
 #define FIELD_SIZE 12
 #define PLAYABLE_SIZE 10
+#define FIELD_PAYLOAD_SIZE (PLAYABLE_SIZE * PLAYABLE_SIZE)
 #define LEADERBOARD_FILE "leaderboard.txt"
+// Capacity; override at build time (BATTLESHIP_MAX_CLIENTS in CMake)
+#ifndef MAX_SESSIONS
 #define MAX_SESSIONS 10
+#endif
+#ifndef MAX_CLIENTS
 #define MAX_CLIENTS 20
+#endif
+#define RESUME_TOKEN_SIZE 33
 
 // Packet type (fixed size PACKET_SIZE bytes)
 typedef struct {
@@ -53,6 +60,8 @@ struct client_info {
     char nickname[64];
     Field field;
     struct ships ship_data;
+    char resume_token[RESUME_TOKEN_SIZE]; // handed out on join, used by RESUME
+    time_t detached_at;                   // non-zero while the seat is held without a connection
 };
 
 struct game_session {
@@ -60,6 +69,7 @@ struct game_session {
     client_info* player1;
     client_info* player2;
     int game_started;
+    int game_finished;
     int current_turn; // 1 or 2
 };
 
@@ -68,6 +78,8 @@ void create_game_field(Field field);
 void initialize_ships(struct ships* ship_data);
 void update_ship_data(struct ships* ship_data, int ship_idx, int segment, int x, int y);
 void place_ships(Field field, struct ships* ship_data);
+void place_ships_r(Field field, struct ships* ship_data, unsigned int* seed);
+unsigned int xorshift32(unsigned int* state);
 
 // Manual placement functions
 int convert_coordinates(const std::string& coord_string, int* x, int* y);
@@ -75,12 +87,18 @@ int place_ship_manual(Field field, struct ships* ship_data, const std::string& p
 
 // Shooting mechanics
 int simple_shot(Field field, struct ships* ship_data, const std::string& coord_string);
+int shot_at(Field field, struct ships* ship_data, int x, int y);
 void update_ship_hit(struct ships* ship_data, int x, int y);
 void ship_explosion(Field field, struct ships* ship_data);
 int check_ship_sunk(unsigned char hit_array[], int length);
 void mark_ship_area(Field field, unsigned char ship_coords[], int length);
 int all_ships_sunk(struct ships* ship_data);
 
+// Field wire encoding: one '0'..'3' char per playable cell, row by row
+void encode_field(Field field, char* out);
+int decode_field(const char* in, Field field);
+void build_fog_field(Field dest, Field src);
+
 // Display functions
 void update_leaderboard(const char* nickname);
 void print_full_field(Field field);
@@ -0,0 +1,320 @@
+#include "battleship_admin.h"
+#include "battleship_trace.h"
+#include "battleship_windows.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+/* One command in flight at a time: the admin thread is the only producer */
+enum { ADMIN_IDLE = 0, ADMIN_PENDING, ADMIN_ANSWERED };
+
+static std::mutex g_mutex;
+static std::condition_variable g_cv;
+static int g_state = ADMIN_IDLE;                    // guarded by g_mutex
+static char g_command[ADMIN_COMMAND_SIZE];          // guarded by g_mutex
+static unsigned int g_serial = 0;                   // guarded by g_mutex
+static std::string g_reply;                         // guarded by g_mutex
+
+static std::atomic<bool> g_running{false};
+static int g_listen_sock = -1;
+static int g_wake_pipe[2] = {-1, -1};
+static char g_path[256];
+
+// Start of the value for key in "cmd k1=v1 k2=v2", or NULL
+static const char* find_arg(const char* command, const char* key) {
+    size_t klen = strlen(key);
+    const char* p = strchr(command, ' ');
+    while (p) {
+        while (*p == ' ') p++;
+        if (strncmp(p, key, klen) == 0 && p[klen] == '=') return p + klen + 1;
+        p = strchr(p, ' ');
+    }
+    return NULL;
+}
+
+long long admin_arg_int(const char* command, const char* key, long long fallback) {
+    const char* v = find_arg(command, key);
+    return (v && *v && *v != ' ') ? atoll(v) : fallback;
+}
+
+int admin_arg_str(const char* command, const char* key, char* out, int size) {
+    const char* v = find_arg(command, key);
+    if (!v || size <= 0) return 0;
+    int n = 0;
+    while (v[n] && v[n] != ' ' && n < size - 1) {
+        out[n] = v[n];
+        n++;
+    }
+    out[n] = '\0';
+    return 1;
+}
+
+int admin_page_limit(const char* command) {
+    long long limit = admin_arg_int(command, "limit", ADMIN_PAGE_DEFAULT);
+    if (limit < 1) limit = 1;
+    if (limit > ADMIN_PAGE_MAX) limit = ADMIN_PAGE_MAX;
+    return (int)limit;
+}
+
+void admin_appendf(std::string* out, const char* fmt, ...) {
+    char line[512];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    if (n < 0) return;
+    out->append(line, (size_t)n < sizeof(line) ? (size_t)n : sizeof(line) - 1);
+}
+
+#ifndef _WIN32
+
+static int send_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n <= 0) {
+            if (n == -1 && errno == EINTR) continue;
+            return -1;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static void wake_poll_loop() {
+    char b = 1;
+    /* A full pipe already means "command waiting"; nothing to retry */
+    if (write(g_wake_pipe[1], &b, 1) < 0) return;
+}
+
+/* Hands one command to the loop and waits for its answer */
+static void ask_loop(const char* command, std::string* reply) {
+    std::unique_lock<std::mutex> lk(g_mutex);
+    strncpy(g_command, command, sizeof(g_command) - 1);
+    g_command[sizeof(g_command) - 1] = '\0';
+    g_serial++;
+    g_state = ADMIN_PENDING;
+    wake_poll_loop();
+
+    bool answered = g_cv.wait_for(lk, std::chrono::milliseconds(ADMIN_REPLY_TIMEOUT_MS),
+                                  [] { return g_state == ADMIN_ANSWERED; });
+    if (answered) {
+        reply->swap(g_reply);
+        g_reply.clear();
+    } else {
+        reply->assign("ERROR server loop did not answer\n");
+    }
+    g_state = ADMIN_IDLE;
+}
+
+static int answer(int fd, char* line) {
+    size_t l = strlen(line);
+    if (l > 0 && line[l - 1] == '\r') line[--l] = '\0';
+    if (l == 0) return 0;
+    std::string reply;
+    ask_loop(line, &reply);
+    reply.append("\n");
+    return send_all(fd, reply.data(), reply.size());
+}
+
+struct admin_conn {
+    int fd;
+    int len;
+    long long last_ms;              // last command or connect
+    char buf[ADMIN_COMMAND_SIZE];
+};
+
+static long long steady_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* Reads what the connection has and answers every complete line. Lines
+   longer than ADMIN_COMMAND_SIZE are cut. Returns -1 once it is closed. */
+static int serve_connection(struct admin_conn* c) {
+    int n = (int)recv(c->fd, c->buf + c->len, sizeof(c->buf) - 1 - c->len, 0);
+    if (n <= 0) return (n == -1 && errno == EINTR) ? 0 : -1;
+    c->len += n;
+    c->buf[c->len] = '\0';
+    c->last_ms = steady_ms();
+
+    char* line = c->buf;
+    char* nl;
+    while ((nl = strchr(line, '\n')) != NULL) {
+        *nl = '\0';
+        if (answer(c->fd, line) == -1) return -1;
+        line = nl + 1;
+    }
+    c->len = (int)strlen(line);
+    memmove(c->buf, line, (size_t)c->len + 1);
+    if (c->len == (int)sizeof(c->buf) - 1) {
+        if (answer(c->fd, c->buf) == -1) return -1;
+        c->len = 0;
+    }
+    return 0;
+}
+
+/* Polls the listener and up to ADMIN_MAX_CONNECTIONS consoles, so an idle
+   one does not lock the others out; consoles quiet for ADMIN_IDLE_TIMEOUT_MS
+   are closed. Commands still go to the loop one at a time. */
+static void admin_thread() {
+    trace_thread_name("admin");
+    struct admin_conn conns[ADMIN_MAX_CONNECTIONS];
+    int count = 0;
+
+    while (g_running) {
+        struct pollfd pfds[ADMIN_MAX_CONNECTIONS + 1];
+        pfds[0].fd = count < ADMIN_MAX_CONNECTIONS ? g_listen_sock : -1;
+        pfds[0].events = POLLIN;
+        pfds[0].revents = 0;
+        for (int i = 0; i < count; i++) {
+            pfds[i + 1].fd = conns[i].fd;
+            pfds[i + 1].events = POLLIN;
+            pfds[i + 1].revents = 0;
+        }
+        int ready = poll(pfds, (nfds_t)count + 1, 1000);
+        if (ready < 0) continue;
+
+        long long now = steady_ms();
+        /* Back to front: a closed console is replaced by the last one */
+        for (int i = count - 1; i >= 0; i--) {
+            int closed;
+            if (ready > 0 && pfds[i + 1].revents) closed = serve_connection(&conns[i]) == -1;
+            else closed = now - conns[i].last_ms >= ADMIN_IDLE_TIMEOUT_MS;
+            if (closed) {
+                close(conns[i].fd);
+                conns[i] = conns[--count];
+            }
+        }
+
+        if (ready > 0 && (pfds[0].revents & POLLIN)) {
+            int fd = accept(g_listen_sock, NULL, NULL);
+            if (fd == -1) continue;
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+            /* A console that stops reading its answers is dropped, not waited on */
+            struct timeval tv = {ADMIN_REPLY_TIMEOUT_MS / 1000, (ADMIN_REPLY_TIMEOUT_MS % 1000) * 1000};
+            setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+            conns[count].fd = fd;
+            conns[count].len = 0;
+            conns[count].last_ms = now;
+            count++;
+        }
+    }
+    for (int i = 0; i < count; i++) close(conns[i].fd);
+}
+
+int admin_start(const char* path) {
+    if (g_running) return 0;
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path) || strlen(path) >= sizeof(g_path)) return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) return -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    /* Owner only: the console shows every player's board. The socket file
+       takes its mode from the umask at bind(), and a daemon runs with 0 */
+    mode_t old_mask = umask(077);
+    int bound = bind(fd, (struct sockaddr*)&addr, sizeof(addr));
+    umask(old_mask);
+    if (bound == -1 || listen(fd, 4) == -1) {
+        close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+    if (pipe(g_wake_pipe) == -1) {
+        close(fd);
+        unlink(path);
+        return -1;
+    }
+    for (int i = 0; i < 2; i++) {
+        fcntl(g_wake_pipe[i], F_SETFL, fcntl(g_wake_pipe[i], F_GETFL, 0) | O_NONBLOCK);
+        fcntl(g_wake_pipe[i], F_SETFD, FD_CLOEXEC);
+    }
+
+    g_listen_sock = fd;
+    strcpy(g_path, path);
+    g_running = true;
+    /* Detached: the server exits from several places and never joins */
+    std::thread(admin_thread).detach();
+    return 0;
+}
+
+void admin_stop() {
+    if (!g_running) return;
+    g_running = false;
+    unlink(g_path);
+}
+
+int admin_wake_fd() {
+    return g_wake_pipe[0];
+}
+
+void admin_serve(admin_handler_fn handler) {
+    char buf[64];
+    while (g_wake_pipe[0] != -1 && read(g_wake_pipe[0], buf, sizeof(buf)) > 0) {
+    }
+
+    char command[ADMIN_COMMAND_SIZE];
+    unsigned int serial;
+    {
+        std::lock_guard<std::mutex> lk(g_mutex);
+        if (g_state != ADMIN_PENDING) return;
+        memcpy(command, g_command, sizeof(command));
+        serial = g_serial;
+    }
+
+    /* Built outside the lock; the admin thread may have given up by the
+       time it is done, then the answer is dropped */
+    std::string reply;
+    handler(command, &reply);
+    {
+        std::lock_guard<std::mutex> lk(g_mutex);
+        if (g_state != ADMIN_PENDING || serial != g_serial) return;
+        g_reply.swap(reply);
+        g_state = ADMIN_ANSWERED;
+    }
+    g_cv.notify_all();
+}
+
+#else
+
+int admin_start(const char* path) {
+    (void)path;
+    return -1;
+}
+
+void admin_stop() {
+}
+
+int admin_wake_fd() {
+    return -1;
+}
+
+void admin_serve(admin_handler_fn handler) {
+    (void)handler;
+}
+
+#endif
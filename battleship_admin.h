@@ -0,0 +1,51 @@
+#ifndef BATTLESHIP_ADMIN_H
+#define BATTLESHIP_ADMIN_H
+
+#include <string>
+
+/* Read-only admin console on a local Unix socket. A thread of its own
+   serves up to ADMIN_MAX_CONNECTIONS admin connections and reads one
+   command per line, so a slow or stuck admin client never touches the
+   poll loop; a connection idle for ADMIN_IDLE_TIMEOUT_MS is closed. Each command is handed
+   to the loop through a wake fd (poll it next to the client sockets) and
+   answered from there with admin_serve(), where the game state can be
+   read without locks. The answer goes back to the admin thread, which
+   writes it out followed by an empty line.
+
+     echo "sessions state=playing limit=20" | socat - UNIX-CONNECT:/tmp/battleship_admin.sock
+
+   Handlers keep each answer to one page (ADMIN_PAGE_MAX lines) and stop
+   scanning after ADMIN_SCAN_BUDGET entries, ending the page with
+   "next from=N" so the caller can continue. Not available on Windows. */
+
+#define ADMIN_COMMAND_SIZE 256
+#define ADMIN_PAGE_DEFAULT 50
+#define ADMIN_PAGE_MAX 1000
+#define ADMIN_SCAN_BUDGET 20000         // entries looked at per request
+#define ADMIN_REPLY_TIMEOUT_MS 2000     // the loop is stuck: give up on the request
+#define ADMIN_MAX_CONNECTIONS 8
+#define ADMIN_IDLE_TIMEOUT_MS 60000
+
+typedef void (*admin_handler_fn)(const char* command, std::string* out);
+
+/* Starts listening on path (replacing a stale socket file). Returns 0, or
+   -1 if the socket or the wake pipe cannot be made. */
+int admin_start(const char* path);
+// Stops accepting and removes the socket file.
+void admin_stop();
+
+// Readable while a command is waiting; -1 when not started.
+int admin_wake_fd();
+/* Answers the waiting command, if any, with handler. Called by the loop
+   when admin_wake_fd() is readable. */
+void admin_serve(admin_handler_fn handler);
+
+/* "key=value" lookups in a command's arguments, for handlers. The string
+   form returns 1 and copies the value if the key is present, else 0. */
+long long admin_arg_int(const char* command, const char* key, long long fallback);
+int admin_arg_str(const char* command, const char* key, char* out, int size);
+// limit=N, clamped to 1..ADMIN_PAGE_MAX
+int admin_page_limit(const char* command);
+void admin_appendf(std::string* out, const char* fmt, ...);
+
+#endif // BATTLESHIP_ADMIN_H
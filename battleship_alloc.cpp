@@ -0,0 +1,124 @@
+#include "battleship_alloc.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+
+static const char* const k_tag_names[ALLOC_TAGS] = {
+    "other", "protocol", "session", "leaderboard", "queues"
+};
+
+const char* alloc_tag_name(int tag) {
+    return (tag >= 0 && tag < ALLOC_TAGS) ? k_tag_names[tag] : k_tag_names[ALLOC_OTHER];
+}
+
+#ifdef BATTLESHIP_ALLOC_ACCOUNTING
+
+struct tag_counters {
+    std::atomic<uint64_t> allocs;
+    std::atomic<uint64_t> frees;
+    std::atomic<uint64_t> bytes;
+    std::atomic<int64_t> live_bytes;
+};
+
+static struct tag_counters g_tags[ALLOC_TAGS];
+static thread_local int t_tag = ALLOC_OTHER;
+static thread_local uint64_t t_allocs = 0;
+
+/* In front of every block: the size and tag a free has to give back.
+   The max_align_t member keeps the block behind it aligned as malloc's. */
+union alloc_header {
+    struct {
+        size_t size;
+        int tag;
+    } h;
+    std::max_align_t align;
+};
+
+int alloc_tag_enter(int tag) {
+    int previous = t_tag;
+    t_tag = tag;
+    return previous;
+}
+
+void alloc_tag_leave(int previous) {
+    t_tag = previous;
+}
+
+uint64_t alloc_thread_count() {
+    return t_allocs;
+}
+
+void alloc_read(int tag, struct alloc_stats* out) {
+    memset(out, 0, sizeof(*out));
+    if (tag < 0 || tag >= ALLOC_TAGS) return;
+    out->allocs = g_tags[tag].allocs.load(std::memory_order_relaxed);
+    out->frees = g_tags[tag].frees.load(std::memory_order_relaxed);
+    out->bytes = g_tags[tag].bytes.load(std::memory_order_relaxed);
+    out->live_bytes = g_tags[tag].live_bytes.load(std::memory_order_relaxed);
+}
+
+static void* counted_alloc(size_t size) {
+    union alloc_header* hdr = (union alloc_header*)malloc(sizeof(union alloc_header) + size);
+    if (!hdr) return NULL;
+    int tag = t_tag;
+    hdr->h.size = size;
+    hdr->h.tag = tag;
+    t_allocs++;
+    g_tags[tag].allocs.fetch_add(1, std::memory_order_relaxed);
+    g_tags[tag].bytes.fetch_add(size, std::memory_order_relaxed);
+    g_tags[tag].live_bytes.fetch_add((int64_t)size, std::memory_order_relaxed);
+    return hdr + 1;
+}
+
+static void counted_free(void* p) {
+    if (!p) return;
+    union alloc_header* hdr = (union alloc_header*)p - 1;
+    int tag = hdr->h.tag;
+    g_tags[tag].frees.fetch_add(1, std::memory_order_relaxed);
+    g_tags[tag].live_bytes.fetch_sub((int64_t)hdr->h.size, std::memory_order_relaxed);
+    free(hdr);
+}
+
+// The standard loop: ask the new-handler for memory until it gives up
+static void* counted_new(size_t size) {
+    while (1) {
+        void* p = counted_alloc(size ? size : 1);
+        if (p) return p;
+        std::new_handler handler = std::get_new_handler();
+        if (!handler) throw std::bad_alloc();
+        handler();
+    }
+}
+
+static void* counted_new_nothrow(size_t size) noexcept {
+    try {
+        return counted_new(size);
+    } catch (...) {
+        return NULL;
+    }
+}
+
+void* operator new(size_t size) { return counted_new(size); }
+void* operator new[](size_t size) { return counted_new(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return counted_new_nothrow(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return counted_new_nothrow(size); }
+
+void operator delete(void* p) noexcept { counted_free(p); }
+void operator delete[](void* p) noexcept { counted_free(p); }
+void operator delete(void* p, size_t) noexcept { counted_free(p); }
+void operator delete[](void* p, size_t) noexcept { counted_free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { counted_free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { counted_free(p); }
+
+#else
+
+void alloc_read(int tag, struct alloc_stats* out) {
+    (void)tag;
+    memset(out, 0, sizeof(*out));
+}
+
+#endif
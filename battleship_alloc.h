@@ -0,0 +1,57 @@
+#ifndef BATTLESHIP_ALLOC_H
+#define BATTLESHIP_ALLOC_H
+
+#include <stdint.h>
+
+/* Heap accounting per subsystem. Built with BATTLESHIP_ALLOC_ACCOUNTING
+   (cmake -DBATTLESHIP_ALLOC_ACCOUNTING=ON; always on in battleship_bench)
+   battleship_alloc.cpp replaces the global operator new and delete with
+   versions that count allocations, bytes and live bytes under the tag the
+   allocating thread is in. Code marks its subsystem with
+   alloc_tag_enter()/alloc_tag_leave(); untagged work counts as "other".
+   A free is charged to the tag that made the allocation.
+
+   Without the option the tag calls are empty inlines and nothing is
+   replaced. Over-aligned new (align_val_t) is not counted. */
+
+enum alloc_tag {
+    ALLOC_OTHER = 0,
+    ALLOC_PROTOCOL,             // packet handling in the poll loop
+    ALLOC_SESSION,              // sessions and game rules (placement, shots)
+    ALLOC_LEADERBOARD,
+    ALLOC_QUEUES,               // hosted-bot job and result queues
+    ALLOC_TAGS
+};
+
+struct alloc_stats {
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t bytes;             // allocated in total
+    int64_t live_bytes;
+};
+
+#ifdef BATTLESHIP_ALLOC_ACCOUNTING
+
+static inline int alloc_accounting_enabled() { return 1; }
+
+// Returns the previous tag for alloc_tag_leave()
+int alloc_tag_enter(int tag);
+void alloc_tag_leave(int previous);
+
+// Allocations made by the calling thread so far
+uint64_t alloc_thread_count();
+
+#else
+
+static inline int alloc_accounting_enabled() { return 0; }
+static inline int alloc_tag_enter(int tag) { (void)tag; return 0; }
+static inline void alloc_tag_leave(int previous) { (void)previous; }
+static inline uint64_t alloc_thread_count() { return 0; }
+
+#endif
+
+// All zero without accounting
+void alloc_read(int tag, struct alloc_stats* out);
+const char* alloc_tag_name(int tag);
+
+#endif // BATTLESHIP_ALLOC_H
@@ -0,0 +1,398 @@
+/* Microbenchmarks for the battleship.cpp game core.
+   Each benchmark is calibrated so one sample takes at least --min-sample-ms,
+   warmed up for --warmup-ms, then timed over --samples samples. Results are
+   nanoseconds per operation (min/median/mean/stddev/max) and heap
+   allocations per operation (this binary always counts them, see
+   battleship_alloc.h); --json prints one JSON document instead of the
+   table. */
+
+#include "battleship.h"
+#include "battleship_density.h"
+#include "battleship_alloc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+struct bench_config {
+    int samples;
+    double warmup_ms;
+    double min_sample_ms;
+    const char* filter;
+    int json;
+};
+
+// One timed batch: runs the benchmark iters times, returns operations done
+typedef long long (*bench_fn)(long long iters);
+
+struct bench_case {
+    const char* name;
+    bench_fn fn;
+};
+
+struct bench_result {
+    const char* name;
+    long long iters;
+    long long ops_per_sample;
+    double min_ns, median_ns, mean_ns, stddev_ns, max_ns;
+    double allocs_per_op;       // over the timed samples, calling thread only
+};
+
+static struct bench_config g_cfg;
+
+// Results are folded into this so the optimizer can't drop the work
+static volatile unsigned long long g_sink;
+
+/* Fixtures, built once in setup_fixtures() */
+static const char* const k_rows = "ABCDEFGHIK";
+static std::string g_coords[FIELD_PAYLOAD_SIZE];
+static int g_shot_order[FIELD_PAYLOAD_SIZE];
+static Field g_fresh_field;                 // ships placed, no shots
+static struct ships g_fresh_ships;
+static Field g_midgame_field;               // roughly 60% of the board shot
+static struct ships g_midgame_ships;
+static Field g_sunk_field;                  // every cell shot
+static struct ships g_sunk_ships;
+static char g_payload[FIELD_PAYLOAD_SIZE + 1];
+static Field g_fog_opening;                 // shooter's views of one fixed layout
+static Field g_fog_midgame;
+static Field g_fog_endgame;
+
+// Standard fleet for place_ship_manual, in placement order
+static const char* const k_manual_fleet[10] = {
+    "A1-A4", "C1-C3", "C5-C7", "E1-E2", "E4-E5",
+    "E7-E8", "G1", "G3", "G5", "G7"
+};
+
+static double elapsed_ns(std::chrono::steady_clock::time_point start) {
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+static unsigned int g_rng = 2463534242u;
+static unsigned int next_rand() {
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 17;
+    g_rng ^= g_rng << 5;
+    return g_rng;
+}
+
+static void shoot_cells(Field field, struct ships* ship_data, int count) {
+    for (int i = 0; i < count; i++) {
+        simple_shot(field, ship_data, g_coords[g_shot_order[i]]);
+    }
+}
+
+static void setup_fixtures() {
+    for (int i = 0; i < FIELD_PAYLOAD_SIZE; i++) {
+        char buf[8];
+        snprintf(buf, sizeof(buf), "%c%d", k_rows[i / PLAYABLE_SIZE], i % PLAYABLE_SIZE + 1);
+        g_coords[i] = buf;
+        g_shot_order[i] = i;
+    }
+    for (int i = FIELD_PAYLOAD_SIZE - 1; i > 0; i--) {
+        std::swap(g_shot_order[i], g_shot_order[next_rand() % (unsigned)(i + 1)]);
+    }
+
+    create_game_field(g_fresh_field);
+    initialize_ships(&g_fresh_ships);
+    place_ships(g_fresh_field, &g_fresh_ships);
+
+    memcpy(g_midgame_field, g_fresh_field, sizeof(Field));
+    g_midgame_ships = g_fresh_ships;
+    shoot_cells(g_midgame_field, &g_midgame_ships, 60);
+
+    memcpy(g_sunk_field, g_fresh_field, sizeof(Field));
+    g_sunk_ships = g_fresh_ships;
+    shoot_cells(g_sunk_field, &g_sunk_ships, FIELD_PAYLOAD_SIZE);
+
+    encode_field(g_midgame_field, g_payload);
+    g_payload[FIELD_PAYLOAD_SIZE] = '\0';
+
+    /* Density cost depends on the position, so these use a seeded layout */
+    Field density_field;
+    struct ships density_ships;
+    unsigned int seed = 12345;
+    create_game_field(density_field);
+    initialize_ships(&density_ships);
+    place_ships_r(density_field, &density_ships, &seed);
+    create_game_field(g_fog_opening);
+    build_fog_field(g_fog_opening, density_field);
+    shoot_cells(density_field, &density_ships, 25);
+    create_game_field(g_fog_midgame);
+    build_fog_field(g_fog_midgame, density_field);
+    for (int i = 25; i < 70; i++) simple_shot(density_field, &density_ships, g_coords[g_shot_order[i]]);
+    create_game_field(g_fog_endgame);
+    build_fog_field(g_fog_endgame, density_field);
+}
+
+/* Benchmarks */
+
+static long long bm_place_ships(long long iters) {
+    Field field;
+    struct ships ship_data;
+    /* place_ships() reseeds from time(NULL), so every call within a second
+       would time the same layout; walk through fresh layouts instead */
+    static unsigned int seed = 2463534242u;
+    for (long long n = 0; n < iters; n++) {
+        create_game_field(field);
+        initialize_ships(&ship_data);
+        place_ships_r(field, &ship_data, &seed);
+        g_sink += (unsigned char)field[5][5];
+    }
+    return iters;
+}
+
+static long long bm_place_ship_manual(long long iters) {
+    Field field;
+    struct ships ship_data;
+    for (long long n = 0; n < iters; n++) {
+        int ships_placed[4] = {0, 0, 0, 0};
+        create_game_field(field);
+        initialize_ships(&ship_data);
+        for (int s = 0; s < 10; s++) {
+            g_sink += place_ship_manual(field, &ship_data, k_manual_fleet[s], ships_placed);
+        }
+    }
+    return iters * 10;
+}
+
+static long long bm_convert_coordinates(long long iters) {
+    for (long long n = 0; n < iters; n++) {
+        for (int i = 0; i < FIELD_PAYLOAD_SIZE; i++) {
+            int x, y;
+            g_sink += convert_coordinates(g_coords[i], &x, &y) + x + y;
+        }
+    }
+    return iters * FIELD_PAYLOAD_SIZE;
+}
+
+// A whole board's worth of shots in random order, from a fresh copy
+static long long bm_simple_shot(long long iters) {
+    Field field;
+    struct ships ship_data;
+    for (long long n = 0; n < iters; n++) {
+        memcpy(field, g_fresh_field, sizeof(Field));
+        ship_data = g_fresh_ships;
+        for (int i = 0; i < FIELD_PAYLOAD_SIZE; i++) {
+            g_sink += simple_shot(field, &ship_data, g_coords[g_shot_order[i]]);
+        }
+    }
+    return iters * FIELD_PAYLOAD_SIZE;
+}
+
+static long long bm_ship_explosion(long long iters) {
+    Field field;
+    memcpy(field, g_midgame_field, sizeof(Field));
+    struct ships ship_data = g_midgame_ships;
+    for (long long n = 0; n < iters; n++) {
+        ship_explosion(field, &ship_data);
+        g_sink += (unsigned char)field[n % PLAYABLE_SIZE + 1][1];
+    }
+    return iters;
+}
+
+static long long bm_all_ships_sunk_afloat(long long iters) {
+    for (long long n = 0; n < iters; n++) {
+        g_sink += all_ships_sunk(&g_midgame_ships);
+    }
+    return iters;
+}
+
+static long long bm_all_ships_sunk_sunk(long long iters) {
+    for (long long n = 0; n < iters; n++) {
+        g_sink += all_ships_sunk(&g_sunk_ships);
+    }
+    return iters;
+}
+
+static long long bm_build_fog_field(long long iters) {
+    Field fog;
+    for (long long n = 0; n < iters; n++) {
+        build_fog_field(fog, g_midgame_field);
+        g_sink += (unsigned char)fog[n % PLAYABLE_SIZE + 1][5];
+    }
+    return iters;
+}
+
+static long long bm_encode_field(long long iters) {
+    char out[FIELD_PAYLOAD_SIZE];
+    for (long long n = 0; n < iters; n++) {
+        encode_field(g_midgame_field, out);
+        g_sink += (unsigned char)out[n % FIELD_PAYLOAD_SIZE];
+    }
+    return iters;
+}
+
+static long long bm_decode_field(long long iters) {
+    Field field;
+    for (long long n = 0; n < iters; n++) {
+        g_sink += decode_field(g_payload, field);
+        g_sink += (unsigned char)field[n % PLAYABLE_SIZE + 1][3];
+    }
+    return iters;
+}
+
+static long long run_density(Field fog, long long iters) {
+    struct density_options opt;
+    struct density_result r;
+    density_default_options(&opt);
+    for (long long n = 0; n < iters; n++) {
+        opt.seed = (unsigned int)n + 1;
+        g_sink += density_compute(fog, &opt, &r) + (unsigned long long)r.fleets;
+    }
+    return iters;
+}
+
+static long long bm_density_opening(long long iters) {
+    return run_density(g_fog_opening, iters);
+}
+
+static long long bm_density_midgame(long long iters) {
+    return run_density(g_fog_midgame, iters);
+}
+
+static long long bm_density_endgame(long long iters) {
+    return run_density(g_fog_endgame, iters);
+}
+
+static const struct bench_case k_cases[] = {
+    {"place_ships", bm_place_ships},
+    {"place_ship_manual", bm_place_ship_manual},
+    {"convert_coordinates", bm_convert_coordinates},
+    {"simple_shot", bm_simple_shot},
+    {"ship_explosion", bm_ship_explosion},
+    {"all_ships_sunk/afloat", bm_all_ships_sunk_afloat},
+    {"all_ships_sunk/sunk", bm_all_ships_sunk_sunk},
+    {"build_fog_field", bm_build_fog_field},
+    {"encode_field", bm_encode_field},
+    {"decode_field", bm_decode_field},
+    {"density/opening", bm_density_opening},
+    {"density/midgame", bm_density_midgame},
+    {"density/endgame", bm_density_endgame},
+};
+
+/* Harness */
+
+static struct bench_result run_case(const struct bench_case* bc) {
+    struct bench_result r;
+    memset(&r, 0, sizeof(r));
+    r.name = bc->name;
+
+    // Calibrate: grow the batch until one sample is long enough to time
+    long long iters = 1;
+    while (1) {
+        auto start = std::chrono::steady_clock::now();
+        bc->fn(iters);
+        double ns = elapsed_ns(start);
+        if (ns >= g_cfg.min_sample_ms * 1e6 || iters >= (1LL << 40)) break;
+        double scale = ns > 0 ? (g_cfg.min_sample_ms * 1e6 * 1.2) / ns : 10.0;
+        iters = (long long)(iters * std::min(10.0, std::max(2.0, scale)));
+    }
+
+    // Warm caches, branch predictors and the CPU clock
+    auto warm_start = std::chrono::steady_clock::now();
+    while (elapsed_ns(warm_start) < g_cfg.warmup_ms * 1e6) {
+        bc->fn(iters);
+    }
+
+    std::vector<double> per_op;
+    per_op.reserve(g_cfg.samples);
+    long long ops = 0;
+    long long total_ops = 0;
+    uint64_t allocs = alloc_thread_count();
+    for (int s = 0; s < g_cfg.samples; s++) {
+        auto start = std::chrono::steady_clock::now();
+        ops = bc->fn(iters);
+        double ns = elapsed_ns(start);
+        per_op.push_back(ns / (double)ops);
+        total_ops += ops;
+    }
+    allocs = alloc_thread_count() - allocs;
+
+    std::sort(per_op.begin(), per_op.end());
+    double sum = 0;
+    for (double v : per_op) sum += v;
+    double mean = sum / per_op.size();
+    double var = 0;
+    for (double v : per_op) var += (v - mean) * (v - mean);
+
+    size_t mid = per_op.size() / 2;
+    r.iters = iters;
+    r.ops_per_sample = ops;
+    r.min_ns = per_op.front();
+    r.max_ns = per_op.back();
+    r.median_ns = (per_op.size() % 2) ? per_op[mid] : (per_op[mid - 1] + per_op[mid]) / 2;
+    r.mean_ns = mean;
+    r.stddev_ns = per_op.size() > 1 ? sqrt(var / (per_op.size() - 1)) : 0;
+    r.allocs_per_op = total_ops > 0 ? (double)allocs / (double)total_ops : 0;
+    return r;
+}
+
+static void print_usage(const char* prog) {
+    printf("Usage: %s [--filter SUBSTR] [--samples N] [--warmup-ms MS]\n"
+           "          [--min-sample-ms MS] [--json] [--list]\n", prog);
+}
+
+int main(int argc, char* argv[]) {
+    g_cfg.samples = 30;
+    g_cfg.warmup_ms = 100;
+    g_cfg.min_sample_ms = 5;
+    g_cfg.filter = NULL;
+    g_cfg.json = 0;
+    int ncases = (int)(sizeof(k_cases) / sizeof(k_cases[0]));
+
+    for (int i = 1; i < argc; i++) {
+        const char* a = argv[i];
+        const char* v = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (strcmp(a, "--filter") == 0 && v) { g_cfg.filter = v; i++; }
+        else if (strcmp(a, "--samples") == 0 && v) { g_cfg.samples = std::max(1, atoi(v)); i++; }
+        else if (strcmp(a, "--warmup-ms") == 0 && v) { g_cfg.warmup_ms = atof(v); i++; }
+        else if (strcmp(a, "--min-sample-ms") == 0 && v) { g_cfg.min_sample_ms = atof(v); i++; }
+        else if (strcmp(a, "--json") == 0) { g_cfg.json = 1; }
+        else if (strcmp(a, "--list") == 0) {
+            for (int c = 0; c < ncases; c++) printf("%s\n", k_cases[c].name);
+            return 0;
+        }
+        else { print_usage(argv[0]); return strcmp(a, "--help") == 0 ? 0 : 1; }
+    }
+
+    setup_fixtures();
+
+    std::vector<struct bench_result> results;
+    if (!g_cfg.json) {
+        printf("%-24s %12s %10s %10s %10s %10s %10s %10s\n",
+               "benchmark", "ops/sample", "min ns", "median ns", "mean ns", "stddev", "max ns", "allocs/op");
+    }
+    for (int c = 0; c < ncases; c++) {
+        if (g_cfg.filter && !strstr(k_cases[c].name, g_cfg.filter)) continue;
+        struct bench_result r = run_case(&k_cases[c]);
+        results.push_back(r);
+        if (!g_cfg.json) {
+            printf("%-24s %12lld %10.2f %10.2f %10.2f %10.2f %10.2f %10.3f\n", r.name, r.ops_per_sample,
+                   r.min_ns, r.median_ns, r.mean_ns, r.stddev_ns, r.max_ns, r.allocs_per_op);
+            fflush(stdout);
+        }
+    }
+
+    if (g_cfg.json) {
+        printf("{\"samples\": %d, \"warmup_ms\": %.1f, \"min_sample_ms\": %.1f, \"benchmarks\": [",
+               g_cfg.samples, g_cfg.warmup_ms, g_cfg.min_sample_ms);
+        for (size_t i = 0; i < results.size(); i++) {
+            const struct bench_result& r = results[i];
+            printf("%s\n  {\"name\": \"%s\", \"iters\": %lld, \"ops_per_sample\": %lld, "
+                   "\"min_ns\": %.3f, \"median_ns\": %.3f, \"mean_ns\": %.3f, "
+                   "\"stddev_ns\": %.3f, \"max_ns\": %.3f, \"allocs_per_op\": %.3f}",
+                   i ? "," : "", r.name, r.iters, r.ops_per_sample,
+                   r.min_ns, r.median_ns, r.mean_ns, r.stddev_ns, r.max_ns, r.allocs_per_op);
+        }
+        printf("\n]}\n");
+    }
+    return 0;
+}
@@ -0,0 +1,192 @@
+#include "battleship_bot_pool.h"
+#include "battleship_strategy.h"
+#include "battleship_trace.h"
+#include "battleship_alloc.h"
+#include "battleship_windows.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/* Shot strategy per level, and the one used once a deadline has passed */
+static const char* const k_level_names[BOT_LEVELS] = {"easy", "medium", "hard"};
+static const char* const k_level_strategies[BOT_LEVELS] = {"random", "parity", "density"};
+static const char* const k_fallback_strategy = "hunt";
+
+struct queued_job {
+    struct bot_job job;
+    long long deadline_us;
+};
+
+static std::mutex g_pool_mutex;
+static std::condition_variable g_pool_cv;
+static std::deque<queued_job> g_jobs;               // guarded by g_pool_mutex
+static std::vector<struct bot_result> g_results;    // guarded by g_pool_mutex
+static int g_in_flight = 0;                         // guarded by g_pool_mutex
+static std::atomic<bool> g_running{false};
+static std::vector<std::thread> g_workers;         // owned by the poll loop thread
+static int g_wake_pipe[2] = {-1, -1};
+
+static long long now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void wake_poll_loop() {
+#ifndef _WIN32
+    char b = 1;
+    /* A full pipe already means "results waiting"; nothing to retry */
+    if (write(g_wake_pipe[1], &b, 1) < 0) return;
+#endif
+}
+
+static void compute_move(const queued_job* q, struct bot_result* r) {
+    const struct bot_job* job = &q->job;
+    long long started = now_us();
+    unsigned int rng = job->seed ? job->seed : 1;
+    Field fog;
+    memcpy(fog, job->fog, sizeof(fog));
+
+    r->slot = job->slot;
+    r->serial = job->serial;
+    r->late = started >= q->deadline_us;
+    const struct shot_strategy* s = find_shot_strategy(r->late ? k_fallback_strategy
+                                                               : k_level_strategies[job->level]);
+    uint64_t trace_start = trace_now_ns();
+    /* A search that runs out of time mid-move falls back on its own */
+    if (s->shoot_timed) {
+        if (!s->shoot_timed(fog, &rng, q->deadline_us, &r->x, &r->y)) r->late = 1;
+    } else {
+        s->shoot(fog, &rng, &r->x, &r->y);
+    }
+    trace_complete(TRACE_BOT_MOVE, 0, job->slot, trace_start, trace_now_ns());
+    r->compute_us = now_us() - started;
+}
+
+static void worker_thread_func() {
+    trace_thread_name("bot worker");
+    while (g_running) {
+        queued_job q;
+        {
+            std::unique_lock<std::mutex> lk(g_pool_mutex);
+            g_pool_cv.wait(lk, [] { return !g_jobs.empty() || !g_running; });
+            if (!g_running) return;
+            q = g_jobs.front();
+            g_jobs.pop_front();
+        }
+
+        struct bot_result r;
+        compute_move(&q, &r);
+
+        {
+            std::lock_guard<std::mutex> lk(g_pool_mutex);
+            int outer_tag = alloc_tag_enter(ALLOC_QUEUES);
+            g_results.push_back(r);
+            alloc_tag_leave(outer_tag);
+        }
+        wake_poll_loop();
+    }
+}
+
+int bot_pool_start(int threads) {
+    if (g_running || threads <= 0) return g_running ? 0 : -1;
+#ifndef _WIN32
+    if (pipe(g_wake_pipe) == -1) {
+        perror("pipe");
+        return -1;
+    }
+    for (int i = 0; i < 2; i++) {
+        fcntl(g_wake_pipe[i], F_SETFL, fcntl(g_wake_pipe[i], F_GETFL, 0) | O_NONBLOCK);
+        fcntl(g_wake_pipe[i], F_SETFD, FD_CLOEXEC);
+    }
+#endif
+    g_running = true;
+    for (int i = 0; i < threads; i++) {
+        g_workers.emplace_back(worker_thread_func);
+    }
+    return 0;
+}
+
+void bot_pool_stop() {
+    {
+        std::lock_guard<std::mutex> lk(g_pool_mutex);
+        g_running = false;
+        g_in_flight -= (int)g_jobs.size();
+        g_jobs.clear();
+    }
+    g_pool_cv.notify_all();
+    for (std::thread& t : g_workers) t.join();
+    g_workers.clear();
+}
+
+int bot_pool_running() {
+    return g_running ? 1 : 0;
+}
+
+int bot_pool_submit(const struct bot_job* job) {
+    if (!g_running || job->level < 0 || job->level >= BOT_LEVELS) return -1;
+    queued_job q;
+    q.job = *job;
+    q.deadline_us = now_us() + (long long)job->budget_ms * 1000;
+    {
+        std::lock_guard<std::mutex> lk(g_pool_mutex);
+        int outer_tag = alloc_tag_enter(ALLOC_QUEUES);
+        g_jobs.push_back(q);
+        alloc_tag_leave(outer_tag);
+        g_in_flight++;
+    }
+    g_pool_cv.notify_one();
+    return 0;
+}
+
+int bot_pool_pending() {
+    std::lock_guard<std::mutex> lk(g_pool_mutex);
+    return g_in_flight;
+}
+
+int bot_pool_collect(struct bot_result* out, int max) {
+#ifndef _WIN32
+    char buf[64];
+    while (g_wake_pipe[0] != -1 && read(g_wake_pipe[0], buf, sizeof(buf)) > 0) {
+    }
+#endif
+    std::lock_guard<std::mutex> lk(g_pool_mutex);
+    int n = 0;
+    while (n < max && n < (int)g_results.size()) {
+        out[n] = g_results[n];
+        n++;
+    }
+    g_results.erase(g_results.begin(), g_results.begin() + n);
+    g_in_flight -= n;
+    /* Whatever did not fit is picked up on the next call */
+    if (!g_results.empty()) wake_poll_loop();
+    return n;
+}
+
+int bot_pool_wake_fd() {
+    return g_wake_pipe[0];
+}
+
+int bot_level_parse(const char* name) {
+    for (int i = 0; i < BOT_LEVELS; i++) {
+        if (strcmp(name, k_level_names[i]) == 0) return i;
+    }
+    return -1;
+}
+
+const char* bot_level_name(int level) {
+    if (level < 0 || level >= BOT_LEVELS) return "?";
+    return k_level_names[level];
+}
@@ -0,0 +1,65 @@
+#ifndef BATTLESHIP_BOT_POOL_H
+#define BATTLESHIP_BOT_POOL_H
+
+#include "battleship.h"
+
+/* Move computation for server-hosted bots. The poll loop hands each move
+   (the bot's fog of the enemy board and a deadline) to a pool of worker
+   threads and picks the answer up from a result queue later, so a slow
+   search never holds up the other sessions. The wake fd turns readable
+   whenever results are waiting; poll it next to the client sockets.
+
+   A job still queued when its deadline passes is answered with a cheap
+   hunt/target shot instead of the level's own strategy, and a search
+   still running at the deadline gives up the same way, so a backlog of
+   hard bots degrades their play rather than the server's latency. */
+
+#define BOT_MOVE_DEADLINE_MS 100
+#define BOT_DEFAULT_THREADS 2
+
+enum bot_level {
+    BOT_EASY = 0,       // uniform random shots
+    BOT_MEDIUM,         // hunt/target on a checkerboard
+    BOT_HARD,           // probability density
+    BOT_LEVELS
+};
+
+struct bot_job {
+    int slot;                   // client slot of the bot, echoed back
+    unsigned int serial;        // echoed back so stale answers can be dropped
+    int level;
+    int budget_ms;              // deadline, counted from submission
+    unsigned int seed;
+    Field fog;                  // build_fog_field() values
+};
+
+struct bot_result {
+    int slot;
+    unsigned int serial;
+    int x, y;                   // 1-based field indices, as for shot_at()
+    int late;                   // deadline missed: fallback shot
+    long long compute_us;
+};
+
+// Starts the workers. Returns 0, or -1 if the wake pipe cannot be made.
+int bot_pool_start(int threads);
+/* Drops queued moves and joins the workers once their current move is
+   done. Call before the process exits. */
+void bot_pool_stop();
+int bot_pool_running();
+
+// Queues a move. Returns 0, or -1 if the pool is not running.
+int bot_pool_submit(const struct bot_job* job);
+// Moves both queued and finished but not yet collected.
+int bot_pool_pending();
+/* Takes up to max finished moves and drains the wake fd. Returns how many
+   were written to out. */
+int bot_pool_collect(struct bot_result* out, int max);
+// Readable while results are waiting; -1 on Windows (poll with a timeout).
+int bot_pool_wake_fd();
+
+// "easy", "medium", "hard". Returns -1 for anything else.
+int bot_level_parse(const char* name);
+const char* bot_level_name(int level);
+
+#endif // BATTLESHIP_BOT_POOL_H
@@ -0,0 +1,126 @@
+#include "battleship_capture.h"
+
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include <chrono>
+#include <unordered_map>
+
+#define CAPTURE_BUFFER_SIZE (1 << 20)
+#define CAPTURE_FLUSH_MS 1000
+
+static FILE* g_capture = NULL;
+static std::chrono::steady_clock::time_point g_capture_start;
+static std::chrono::steady_clock::time_point g_last_flush;
+static std::unordered_map<int, uint32_t> g_conn_by_fd;
+static uint32_t g_next_conn = 1;
+
+static uint64_t capture_now_us() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - g_capture_start).count();
+}
+
+static void write_record(uint32_t conn, uint32_t kind, const packet_t* p) {
+    struct capture_record rec;
+    rec.t_us = capture_now_us();
+    rec.conn = conn;
+    rec.kind = kind;
+    fwrite(&rec, sizeof(rec), 1, g_capture);
+    if (p) fwrite(p, sizeof(*p), 1, g_capture);
+}
+
+int capture_open(const char* path, unsigned int seed, int seeded) {
+    if (g_capture) return 0;
+    g_capture = fopen(path, "wb");
+    if (!g_capture) {
+        fprintf(stderr, "Failed to open capture file '%s': %s\n", path, strerror(errno));
+        return -1;
+    }
+    setvbuf(g_capture, NULL, _IOFBF, CAPTURE_BUFFER_SIZE);
+
+    struct capture_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CAPTURE_MAGIC, sizeof(header.magic));
+    header.version = CAPTURE_VERSION;
+    header.packet_size = PACKET_SIZE;
+    header.start_unix_ms = (uint64_t)time(NULL) * 1000;
+    header.seed = seed;
+    header.seeded = seeded ? 1 : 0;
+    fwrite(&header, sizeof(header), 1, g_capture);
+
+    g_capture_start = std::chrono::steady_clock::now();
+    g_last_flush = g_capture_start;
+    return 0;
+}
+
+void capture_close() {
+    if (!g_capture) return;
+    fclose(g_capture);
+    g_capture = NULL;
+    g_conn_by_fd.clear();
+}
+
+int capture_enabled() {
+    return g_capture != NULL;
+}
+
+void capture_connect(int fd) {
+    if (!g_capture) return;
+    uint32_t conn = g_next_conn++;
+    g_conn_by_fd[fd] = conn;
+    write_record(conn, CAPTURE_CONNECT, NULL);
+}
+
+void capture_frame(int fd, const packet_t* p) {
+    if (!g_capture) return;
+    auto it = g_conn_by_fd.find(fd);
+    if (it == g_conn_by_fd.end()) return;
+    write_record(it->second, CAPTURE_FRAME, p);
+}
+
+void capture_disconnect(int fd) {
+    if (!g_capture) return;
+    auto it = g_conn_by_fd.find(fd);
+    if (it == g_conn_by_fd.end()) return;
+    write_record(it->second, CAPTURE_CLOSE, NULL);
+    g_conn_by_fd.erase(it);
+}
+
+void capture_flush() {
+    if (!g_capture) return;
+    auto now = std::chrono::steady_clock::now();
+    if (now - g_last_flush < std::chrono::milliseconds(CAPTURE_FLUSH_MS)) return;
+    fflush(g_capture);
+    g_last_flush = now;
+}
+
+FILE* capture_reader_open(const char* path, struct capture_header* header) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "Failed to open capture '%s': %s\n", path, strerror(errno));
+        return NULL;
+    }
+    if (fread(header, sizeof(*header), 1, f) != 1 ||
+        memcmp(header->magic, CAPTURE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != CAPTURE_VERSION || header->packet_size != PACKET_SIZE) {
+        fprintf(stderr, "'%s' is not a compatible capture file\n", path);
+        fclose(f);
+        return NULL;
+    }
+    return f;
+}
+
+int capture_read(FILE* f, struct capture_record* rec, packet_t* p) {
+    if (fread(rec, sizeof(*rec), 1, f) != 1) return feof(f) ? 0 : -1;
+    if (rec->kind == CAPTURE_FRAME) {
+        // A frame cut short by a crash ends the capture
+        if (fread(p, sizeof(*p), 1, f) != 1) return 0;
+        p->command[PACKET_COMMAND_SIZE - 1] = '\0';
+        p->arg1[PACKET_ARG_SIZE_1 - 1] = '\0';
+        p->arg2[PACKET_ARG_SIZE_2 - 1] = '\0';
+    } else if (rec->kind != CAPTURE_CONNECT && rec->kind != CAPTURE_CLOSE) {
+        return -1;
+    }
+    return 1;
+}
@@ -0,0 +1,57 @@
+#ifndef BATTLESHIP_CAPTURE_H
+#define BATTLESHIP_CAPTURE_H
+
+#include "battleship.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* Traffic capture: every inbound connection, frame and disconnect the
+   server sees, with a microsecond timestamp, for battleship_replay.
+   The file is a capture_header followed by capture_record entries in
+   host byte order; CAPTURE_FRAME records carry one packet_t after them.
+   Connections are numbered in accept order, since fds get reused.
+   The header keeps the server's RNG seed: replay only follows the
+   recording when the replayed server starts from the same one. */
+
+#define CAPTURE_MAGIC "BSCAP001"
+#define CAPTURE_VERSION 2
+
+enum {
+    CAPTURE_CONNECT = 1,
+    CAPTURE_FRAME,
+    CAPTURE_CLOSE
+};
+
+struct capture_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t packet_size;
+    uint64_t start_unix_ms;
+    uint32_t seed;          // placement RNG state when recording started
+    uint32_t seeded;        // 1: started with --seed, so resume tokens came from it too
+};
+
+struct capture_record {
+    uint64_t t_us;          // since capture_open
+    uint32_t conn;
+    uint32_t kind;
+};
+
+/* Recording (server side). seed is the server's RNG state at this point;
+   seeded says whether resume tokens are drawn from it as well. */
+int capture_open(const char* path, unsigned int seed, int seeded);
+void capture_close();
+int capture_enabled();
+void capture_connect(int fd);
+void capture_frame(int fd, const packet_t* p);
+void capture_disconnect(int fd);
+// Pushes buffered records to disk; cheap to call every loop iteration.
+void capture_flush();
+
+/* Reading (replay side). capture_read returns 1 per record, 0 at the end
+   and -1 on a damaged file; p is filled for CAPTURE_FRAME. */
+FILE* capture_reader_open(const char* path, struct capture_header* header);
+int capture_read(FILE* f, struct capture_record* rec, packet_t* p);
+
+#endif // BATTLESHIP_CAPTURE_H
@@ -0,0 +1,478 @@
+/* Network-impairment proxy for testing the server against bad links.
+   Listens on -l PORT and forwards every connection to -h HOST -p PORT,
+   degrading both directions on the way:
+     --latency/--jitter  delay each segment (order is kept, as on TCP)
+     --bandwidth         per-connection, per-direction byte rate cap
+     --chunk MIN:MAX     re-cut the stream into random segment sizes, so
+                         packets arrive split across and merged within reads
+     --stall PROB:MS     after a read from the server, stop reading that
+                         connection for MS with probability PROB: a client
+                         that stops draining its socket
+     --buffer/--rcvbuf   how much the proxy holds before pushing back
+   Everything is driven by one poll loop; Ctrl+C prints totals. */
+
+#include "battleship.h"
+#include "battleship_windows.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <netinet/tcp.h>
+#endif
+
+#define PROXY_READ_SIZE 4096
+
+struct proxy_config {
+    int listen_port;
+    const char* host;
+    int port;
+    int latency_ms;
+    int jitter_ms;
+    long long bandwidth;    // bytes/s, 0: unlimited
+    int chunk_min;
+    int chunk_max;          // 0: forward reads as they come
+    double stall_prob;
+    int stall_ms;
+    int buffer;
+    int rcvbuf;
+    unsigned int seed;
+    double report_sec;
+};
+
+struct segment {
+    long long due_us;
+    std::string data;
+    size_t off;
+};
+
+/* One direction of a proxied connection */
+struct flow {
+    int from;
+    int to;
+    std::deque<struct segment> queue;
+    size_t queued;
+    long long last_due_us;
+    long long bw_next_us;
+    long long stalled_until_us;
+    int eof;
+    int shut;
+    long long bytes;
+};
+
+struct link {
+    int client_fd;
+    int server_fd;
+    struct flow up;         // client -> server
+    struct flow down;       // server -> client
+    int dead;
+};
+
+struct proxy_stats {
+    long long accepted;
+    long long refused;
+    long long closed;
+    long long segments;
+    long long partial_writes;
+    long long stalls;
+    long long bytes_up;
+    long long bytes_down;
+    size_t max_queued;
+};
+
+static struct proxy_config g_cfg;
+static struct proxy_stats g_stats;
+static struct sockaddr_in g_upstream;
+static unsigned int g_rng;
+static volatile sig_atomic_t g_stop = 0;
+
+static long long now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static unsigned int next_rand() {
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 17;
+    g_rng ^= g_rng << 5;
+    return g_rng;
+}
+
+static double next_unit() {
+    return (next_rand() & 0xffffff) / (double)0x1000000;
+}
+
+static int set_nonblocking(int fd) {
+#ifdef _WIN32
+    u_long mode = 1;
+    return ioctlsocket((SOCKET)fd, FIONBIO, &mode);
+#else
+    int flags = fcntl(fd, F_GETFL, 0);
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+#endif
+}
+
+static int would_block() {
+#ifdef _WIN32
+    int e = WSAGetLastError();
+    return e == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
+
+static void handle_sigint(int sig) {
+    (void)sig;
+    g_stop = 1;
+}
+
+static void flow_init(struct flow* f, int from, int to) {
+    f->from = from;
+    f->to = to;
+    f->queued = 0;
+    f->last_due_us = 0;
+    f->bw_next_us = 0;
+    f->stalled_until_us = 0;
+    f->eof = 0;
+    f->shut = 0;
+    f->bytes = 0;
+}
+
+static int flow_wants_read(const struct flow* f, long long now) {
+    return !f->eof && f->queued < (size_t)g_cfg.buffer && now >= f->stalled_until_us;
+}
+
+static int flow_wants_write(const struct flow* f, long long now) {
+    return !f->queue.empty() && now >= f->queue.front().due_us && now >= f->bw_next_us;
+}
+
+// Earliest time this flow has something to do, or LLONG_MAX
+static long long flow_wake(const struct flow* f) {
+    long long wake = LLONG_MAX;
+    if (!f->queue.empty()) wake = std::max(f->queue.front().due_us, f->bw_next_us);
+    if (!f->eof && f->stalled_until_us) wake = std::min(wake, f->stalled_until_us);
+    return wake;
+}
+
+static void flow_enqueue(struct flow* f, const char* data, int len, long long now) {
+    int pos = 0;
+    while (pos < len) {
+        int n = len - pos;
+        if (g_cfg.chunk_max > 0) {
+            int span = g_cfg.chunk_max - g_cfg.chunk_min + 1;
+            n = std::min(n, g_cfg.chunk_min + (int)(next_rand() % (unsigned)span));
+        }
+        struct segment s;
+        long long delay = g_cfg.latency_ms * 1000LL;
+        if (g_cfg.jitter_ms > 0) delay += (long long)(next_rand() % (unsigned)(g_cfg.jitter_ms * 1000 + 1));
+        /* Jitter varies spacing, never order: the byte stream is TCP */
+        s.due_us = std::max(now + delay, f->last_due_us);
+        s.data.assign(data + pos, n);
+        s.off = 0;
+        f->last_due_us = s.due_us;
+        f->queued += n;
+        f->queue.push_back(s);
+        g_stats.segments++;
+        pos += n;
+    }
+    g_stats.max_queued = std::max(g_stats.max_queued, f->queued);
+}
+
+/* Returns -1 when the connection is gone */
+static int flow_read(struct flow* f, int stallable, long long now) {
+    char buf[PROXY_READ_SIZE];
+    int room = std::min((int)sizeof(buf), g_cfg.buffer - (int)f->queued);
+    if (room <= 0) return 0;
+    int n = recv(f->from, buf, room, 0);
+    if (n == 0) {
+        f->eof = 1;
+        return 0;
+    }
+    if (n < 0) return would_block() ? 0 : -1;
+
+    f->bytes += n;
+    flow_enqueue(f, buf, n, now);
+    if (stallable && g_cfg.stall_prob > 0 && next_unit() < g_cfg.stall_prob) {
+        f->stalled_until_us = now + g_cfg.stall_ms * 1000LL;
+        g_stats.stalls++;
+    }
+    return 0;
+}
+
+static int flow_write(struct flow* f, long long now) {
+    while (flow_wants_write(f, now)) {
+        struct segment* s = &f->queue.front();
+        int left = (int)(s->data.size() - s->off);
+        int n = send(f->to, s->data.data() + s->off, left, 0);
+        if (n < 0) return would_block() ? 0 : -1;
+        if (n < left) g_stats.partial_writes++;
+        s->off += n;
+        f->queued -= n;
+        if (g_cfg.bandwidth > 0) {
+            f->bw_next_us = std::max(now, f->bw_next_us) + n * 1000000LL / g_cfg.bandwidth;
+        }
+        if (s->off < s->data.size()) return 0;
+        f->queue.pop_front();
+    }
+    /* Half-close once everything the peer sent has been delivered */
+    if (f->eof && f->queue.empty() && !f->shut) {
+        shutdown(f->to, 1);
+        f->shut = 1;
+    }
+    return 0;
+}
+
+static void link_close(struct link* l) {
+    if (l->dead) return;
+    g_stats.bytes_up += l->up.bytes;
+    g_stats.bytes_down += l->down.bytes;
+    sock_close(l->client_fd);
+    sock_close(l->server_fd);
+    l->dead = 1;
+    g_stats.closed++;
+}
+
+static void accept_client(int listener, std::vector<struct link*>& links) {
+    int client = (int)accept(listener, NULL, NULL);
+    if (client == -1) return;
+
+    int server = (int)socket(AF_INET, SOCK_STREAM, 0);
+    if (server == -1 || connect(server, (struct sockaddr*)&g_upstream, sizeof(g_upstream)) == -1) {
+        if (server != -1) sock_close(server);
+        sock_close(client);
+        g_stats.refused++;
+        return;
+    }
+    int one = 1;
+    setsockopt(client, IPPROTO_TCP, TCP_NODELAY, (const char*)&one, sizeof(one));
+    setsockopt(server, IPPROTO_TCP, TCP_NODELAY, (const char*)&one, sizeof(one));
+    if (g_cfg.rcvbuf > 0) {
+        /* A small window makes a stalled reader push back on the server sooner */
+        setsockopt(server, SOL_SOCKET, SO_RCVBUF, (const char*)&g_cfg.rcvbuf, sizeof(g_cfg.rcvbuf));
+    }
+    set_nonblocking(client);
+    set_nonblocking(server);
+
+    struct link* l = new struct link;
+    l->client_fd = client;
+    l->server_fd = server;
+    l->dead = 0;
+    flow_init(&l->up, client, server);
+    flow_init(&l->down, server, client);
+    links.push_back(l);
+    g_stats.accepted++;
+}
+
+static void print_stats(const std::vector<struct link*>& links) {
+    long long up = g_stats.bytes_up, down = g_stats.bytes_down;
+    for (const struct link* l : links) {
+        up += l->up.bytes;
+        down += l->down.bytes;
+    }
+    printf("links=%zu accepted=%lld refused=%lld closed=%lld bytes up=%lld down=%lld "
+           "segments=%lld partial_writes=%lld stalls=%lld max_queued=%zu\n",
+           links.size(), g_stats.accepted, g_stats.refused, g_stats.closed, up, down,
+           g_stats.segments, g_stats.partial_writes, g_stats.stalls, g_stats.max_queued);
+    fflush(stdout);
+}
+
+static int parse_pair(const char* s, double* a, double* b) {
+    const char* colon = strchr(s, ':');
+    if (!colon) return -1;
+    *a = atof(s);
+    *b = atof(colon + 1);
+    return 0;
+}
+
+static void print_usage(const char* prog) {
+    printf("Usage: %s -l LISTEN_PORT [-h HOST] -p PORT [--latency MS] [--jitter MS]\n"
+           "          [--bandwidth BYTES_PER_S] [--chunk MIN:MAX] [--stall PROB:MS]\n"
+           "          [--buffer BYTES] [--rcvbuf BYTES] [--seed N] [--report SEC]\n", prog);
+}
+
+int main(int argc, char* argv[]) {
+    g_cfg.listen_port = 0;
+    g_cfg.host = "127.0.0.1";
+    g_cfg.port = 0;
+    g_cfg.latency_ms = 0;
+    g_cfg.jitter_ms = 0;
+    g_cfg.bandwidth = 0;
+    g_cfg.chunk_min = 0;
+    g_cfg.chunk_max = 0;
+    g_cfg.stall_prob = 0;
+    g_cfg.stall_ms = 0;
+    g_cfg.buffer = 64 * 1024;
+    g_cfg.rcvbuf = 0;
+    g_cfg.seed = 12345;
+    g_cfg.report_sec = 5;
+
+    for (int i = 1; i < argc; i++) {
+        const char* a = argv[i];
+        const char* v = (i + 1 < argc) ? argv[i + 1] : NULL;
+        double x, y;
+        if (strcmp(a, "-l") == 0 && v) { g_cfg.listen_port = atoi(v); i++; }
+        else if (strcmp(a, "-h") == 0 && v) { g_cfg.host = v; i++; }
+        else if ((strcmp(a, "-p") == 0 || strcmp(a, "--port") == 0) && v) { g_cfg.port = atoi(v); i++; }
+        else if (strcmp(a, "--latency") == 0 && v) { g_cfg.latency_ms = atoi(v); i++; }
+        else if (strcmp(a, "--jitter") == 0 && v) { g_cfg.jitter_ms = atoi(v); i++; }
+        else if (strcmp(a, "--bandwidth") == 0 && v) { g_cfg.bandwidth = atoll(v); i++; }
+        else if (strcmp(a, "--chunk") == 0 && v && parse_pair(v, &x, &y) == 0) {
+            g_cfg.chunk_min = std::max(1, (int)x);
+            g_cfg.chunk_max = std::max(g_cfg.chunk_min, (int)y);
+            i++;
+        }
+        else if (strcmp(a, "--stall") == 0 && v && parse_pair(v, &x, &y) == 0) {
+            g_cfg.stall_prob = x;
+            g_cfg.stall_ms = (int)y;
+            i++;
+        }
+        else if (strcmp(a, "--buffer") == 0 && v) { g_cfg.buffer = atoi(v); i++; }
+        else if (strcmp(a, "--rcvbuf") == 0 && v) { g_cfg.rcvbuf = atoi(v); i++; }
+        else if (strcmp(a, "--seed") == 0 && v) { g_cfg.seed = (unsigned int)strtoul(v, NULL, 10); i++; }
+        else if (strcmp(a, "--report") == 0 && v) { g_cfg.report_sec = atof(v); i++; }
+        else { print_usage(argv[0]); return strcmp(a, "--help") == 0 ? 0 : 1; }
+    }
+    if (g_cfg.listen_port <= 0 || g_cfg.port <= 0 || g_cfg.buffer <= 0) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    g_rng = g_cfg.seed ? g_cfg.seed : 1;
+
+#ifdef _WIN32
+    if (!init_winsock()) {
+        fprintf(stderr, "Failed to initialize Winsock\n");
+        return 1;
+    }
+#else
+    signal(SIGPIPE, SIG_IGN);
+#endif
+    signal(SIGINT, handle_sigint);
+    signal(SIGTERM, handle_sigint);
+
+    struct hostent* hp = gethostbyname(g_cfg.host);
+    if (!hp) {
+        fprintf(stderr, "Unknown host: %s\n", g_cfg.host);
+        return 1;
+    }
+    memset(&g_upstream, 0, sizeof(g_upstream));
+    g_upstream.sin_family = AF_INET;
+    memcpy(&g_upstream.sin_addr, hp->h_addr_list[0], hp->h_length);
+    g_upstream.sin_port = htons(g_cfg.port);
+
+    int listener = (int)socket(AF_INET, SOCK_STREAM, 0);
+    int opt = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (const char*)&opt, sizeof(opt));
+    struct sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    local.sin_port = htons(g_cfg.listen_port);
+    if (bind(listener, (struct sockaddr*)&local, sizeof(local)) == -1 || listen(listener, SOMAXCONN) == -1) {
+        fprintf(stderr, "Failed to listen on port %d\n", g_cfg.listen_port);
+        return 1;
+    }
+    printf("Proxying 127.0.0.1:%d -> %s:%d (latency %dms, jitter %dms, bandwidth %lld B/s, "
+           "chunk %d:%d, stall %.3f:%dms)\n",
+           g_cfg.listen_port, g_cfg.host, g_cfg.port, g_cfg.latency_ms, g_cfg.jitter_ms,
+           g_cfg.bandwidth, g_cfg.chunk_min, g_cfg.chunk_max, g_cfg.stall_prob, g_cfg.stall_ms);
+    fflush(stdout);
+
+    std::vector<struct link*> links;
+    std::vector<struct pollfd> pfds;
+    std::vector<int> owner;     // link index per pollfd, -1 for the listener
+    long long next_report = now_us() + (long long)(g_cfg.report_sec * 1e6);
+
+    while (!g_stop) {
+        long long now = now_us();
+        long long wake = now + 100000;
+        if (g_cfg.report_sec > 0) {
+            if (now >= next_report) {
+                print_stats(links);
+                next_report = now + (long long)(g_cfg.report_sec * 1e6);
+            }
+            wake = std::min(wake, next_report);
+        }
+
+        pfds.clear();
+        owner.clear();
+        struct pollfd p;
+        p.fd = listener;
+        p.events = POLLIN;
+        p.revents = 0;
+        pfds.push_back(p);
+        owner.push_back(-1);
+        for (size_t i = 0; i < links.size(); i++) {
+            struct link* l = links[i];
+            struct flow* flows[2] = {&l->up, &l->down};
+            for (struct flow* f : flows) {
+                /* Each flow polls its source for reading and its sink for writing */
+                if (flow_wants_read(f, now)) {
+                    p.fd = f->from;
+                    p.events = POLLIN;
+                    pfds.push_back(p);
+                    owner.push_back((int)i);
+                }
+                if (flow_wants_write(f, now)) {
+                    p.fd = f->to;
+                    p.events = POLLOUT;
+                    pfds.push_back(p);
+                    owner.push_back((int)i);
+                }
+                wake = std::min(wake, flow_wake(f));
+            }
+        }
+
+        int timeout = (int)std::max(0LL, (wake - now + 999) / 1000);
+        int ready = poll(pfds.data(), (unsigned long)pfds.size(), timeout);
+        if (ready < 0 && !would_block()) break;
+        now = now_us();
+
+        if (pfds[0].revents & POLLIN) accept_client(listener, links);
+
+        /* Service every link whose fds fired, or whose timers came due */
+        std::vector<char> touched(links.size(), 0);
+        for (size_t k = 1; k < pfds.size(); k++) {
+            if (pfds[k].revents && owner[k] < (int)touched.size()) touched[owner[k]] = 1;
+        }
+        for (size_t i = 0; i < touched.size(); i++) {
+            struct link* l = links[i];
+            int err = 0;
+            if (touched[i]) {
+                if (flow_wants_read(&l->up, now)) err |= flow_read(&l->up, 0, now);
+                if (flow_wants_read(&l->down, now)) err |= flow_read(&l->down, 1, now);
+            }
+            err |= flow_write(&l->up, now);
+            err |= flow_write(&l->down, now);
+            /* Done when a side failed, or both directions have drained to EOF */
+            if (err || (l->up.shut && l->down.shut)) link_close(l);
+        }
+
+        size_t w = 0;
+        for (size_t i = 0; i < links.size(); i++) {
+            if (links[i]->dead) delete links[i];
+            else links[w++] = links[i];
+        }
+        links.resize(w);
+    }
+
+    for (struct link* l : links) {
+        link_close(l);
+        delete l;
+    }
+    links.clear();
+    sock_close(listener);
+    print_stats(links);
+#ifdef _WIN32
+    cleanup_winsock();
+#endif
+    return 0;
+}
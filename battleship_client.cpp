@@ -22,7 +22,14 @@
 #endif
 
 // Globals
-static int sockfd = -1;
+static std::atomic<int> sockfd{-1};
+static std::string g_host;
+static int g_port = 0;
+
+/* Reconnect: after a dropped connection the socket thread dials back in
+   and sends RESUME with the token the server handed out on join. */
+#define RECONNECT_WINDOW_SEC 60
+static std::atomic<bool> g_resuming{false};
 
 /* Client local state */
 struct client_info my_client;
@@ -30,6 +37,8 @@ struct client_info enemy_client;
 struct game_session current_session;
 static int game_started = 0;
 static int my_turn = 0;
+static char g_resume_token[RESUME_TOKEN_SIZE] = "";   // guarded by g_token_mutex
+static std::mutex g_token_mutex;    // set by the main thread, read by the socket thread
 
 /* Threads + queues */
 static std::thread g_stdin_thread;
@@ -43,6 +52,10 @@ static std::mutex g_packet_mutex;
 static std::condition_variable g_packet_cv;
 static std::queue<packet_t> g_packet_queue;
 static std::atomic<bool> g_socket_running{false};
+static std::mutex g_send_mutex;     // the socket thread sends too (PONG, RESUME)
+
+static int connect_to_server(const char *host, int port, int quiet);
+static void socket_cleanup_and_exit();
 
 /* Forward declarations of UI functions */
 void client_session_selection_ui();
@@ -89,6 +102,7 @@ static void client_send_command(const char *command, const char *arg1, const cha
     if (command) strncpy(pkt.command, command, PACKET_COMMAND_SIZE - 1);
     if (arg1) strncpy(pkt.arg1, arg1, PACKET_ARG_SIZE_1 - 1);
     if (arg2) strncpy(pkt.arg2, arg2, PACKET_ARG_SIZE_2 - 1);
+    std::lock_guard<std::mutex> lk(g_send_mutex);
     send_packet_fd(sockfd, &pkt);
 }
 
@@ -125,20 +139,77 @@ static void stop_stdin_thread() {
     if (g_stdin_thread.joinable()) g_stdin_thread.join();
 }
 
+static void set_resume_token(const char* token) {
+    std::lock_guard<std::mutex> lk(g_token_mutex);
+    strncpy(g_resume_token, token, sizeof(g_resume_token) - 1);
+    g_resume_token[sizeof(g_resume_token) - 1] = '\0';
+}
+
+// Copies the token into out; 0 if there is none
+static int get_resume_token(char* out) {
+    std::lock_guard<std::mutex> lk(g_token_mutex);
+    memcpy(out, g_resume_token, RESUME_TOKEN_SIZE);
+    return out[0] != '\0';
+}
+
 /* --- socket receiver thread --- */
 
+/* Returns 1 once a new connection is up and RESUME has been sent */
+static int try_resume_connection() {
+    char token[RESUME_TOKEN_SIZE];
+    if (!get_resume_token(token) || !g_socket_running.load()) return 0;
+
+    printf("\nConnection lost, trying to resume the game...\n");
+    fflush(stdout);
+    /* Under the send lock: the main thread must never send on an fd that
+       is closed (or already reused); meanwhile its sends fail on -1 */
+    {
+        std::lock_guard<std::mutex> lk(g_send_mutex);
+        sock_close(sockfd);
+        sockfd = -1;
+    }
+
+    int delay_ms = 250;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(RECONNECT_WINDOW_SEC);
+    while (g_socket_running.load() && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
+        int fd = connect_to_server(g_host.c_str(), g_port, 1);
+        if (fd != -1) {
+            // RESUME goes out first, before any queued main-thread send
+            packet_t pkt;
+            memset(&pkt, 0, sizeof(pkt));
+            strncpy(pkt.command, "RESUME", PACKET_COMMAND_SIZE - 1);
+            strncpy(pkt.arg1, token, PACKET_ARG_SIZE_1 - 1);
+            std::lock_guard<std::mutex> lk(g_send_mutex);
+            sockfd = fd;
+            g_resuming = true;
+            send_packet_fd(fd, &pkt);
+            return 1;
+        }
+        if (delay_ms < 4000) delay_ms *= 2;
+    }
+    printf("Could not reach the server again.\n");
+    return 0;
+}
+
 static void socket_thread_func() {
     packet_t pkt;
     while (g_socket_running.load()) {
         memset(&pkt, 0, sizeof(pkt));
         int got = recv_packet_fd(sockfd, &pkt);
         if (got <= 0) {
+            if (try_resume_connection()) continue;
             // signal main thread about disconnect by pushing a special packet if desired
             g_socket_running.store(false);
             // notify main thread
             g_packet_cv.notify_all();
             break;
         }
+        /* Answered here so a player sitting at a prompt still looks alive */
+        if (strcmp(pkt.command, "PING") == 0) {
+            client_send_command("PONG", pkt.arg1, NULL);
+            continue;
+        }
         {
             std::lock_guard<std::mutex> lk(g_packet_mutex);
             g_packet_queue.push(pkt);
@@ -156,6 +227,11 @@ static void start_socket_thread() {
 static void stop_socket_thread() {
     if (!g_socket_running.load()) return;
     g_socket_running.store(false);
+    // Unblock recv() so the thread sees the flag instead of reconnecting
+    {
+        std::lock_guard<std::mutex> lk(g_send_mutex);
+        if (sockfd != -1) shutdown(sockfd, 2);
+    }
     if (g_socket_thread.joinable()) g_socket_thread.join();
 }
 
@@ -216,7 +292,8 @@ static int read_line_with_packet_processing(char *out, size_t out_size) {
 /* Session selection: prints prompt and waits for user line */
 void client_session_selection_ui() {
     printf("\n=== SESSION SELECTION ===\n");
-    printf("Session list updates automatically. Please type the session number you want to join, or 'auto' for automatic assignment: ");
+    printf("Session list updates automatically. Please type the session number you want to join, or 'auto' for automatic assignment.\n");
+    printf("Type 'bot', 'bot easy' or 'bot hard' to play against the server: ");
     fflush(stdout);
 
     char input[128];
@@ -235,6 +312,13 @@ void client_session_selection_ui() {
         if (strcmp(input, "auto") == 0) {
             client_send_command("JOIN_SESSION", "-1", NULL);
             return;
+        } else if (strncmp(input, "bot", 3) == 0) {
+            const char* level = input + 3;
+            while (*level == ' ') level++;
+            char tmp[32];
+            snprintf(tmp, sizeof(tmp), "bot%s%s", *level ? ":" : "", level);
+            client_send_command("JOIN_SESSION", "-1", tmp);
+            return;
         } else {
             int session_num = atoi(input);
             if (session_num >= 0 && session_num < MAX_SESSIONS) {
@@ -369,12 +453,9 @@ void client_manual_placement_ui() {
         // Accept "done" or "finish" (case-insensitive)
         if (portable_strcasecmp(input, "done") == 0 || portable_strcasecmp(input, "finish") == 0) {
             if (total_remaining() == 0) {
-                char packed[PLAYABLE_SIZE * PLAYABLE_SIZE + 1];
-                int idx = 0;
-                for (int i = 1; i <= PLAYABLE_SIZE; ++i)
-                    for (int j = 1; j <= PLAYABLE_SIZE; ++j)
-                        packed[idx++] = '0' + (field[i][j] & 0x07);
-                packed[idx] = '\0';
+                char packed[FIELD_PAYLOAD_SIZE + 1];
+                encode_field(field, packed);
+                packed[FIELD_PAYLOAD_SIZE] = '\0';
                 client_send_command("FIELD_UPLOAD", packed, NULL);
                 client_send_command("SHIP_PLACED", "manual", NULL);
                 return;
@@ -472,15 +553,9 @@ void client_manual_placement_ui() {
         if (total_remaining() == 0) {
             printf("All ships placed successfully!\n");
             print_field(field);
-            char packed[PLAYABLE_SIZE * PLAYABLE_SIZE + 1];
-            int id = 0;
-            for (int i = 1; i <= PLAYABLE_SIZE; ++i) {
-                for (int j = 1; j <= PLAYABLE_SIZE; ++j) {
-                    char ch = '0' + (field[i][j] & 0x07);
-                    packed[id++] = ch;
-                }
-            }
-            packed[id] = '\0';
+            char packed[FIELD_PAYLOAD_SIZE + 1];
+            encode_field(field, packed);
+            packed[FIELD_PAYLOAD_SIZE] = '\0';
             client_send_command("FIELD_UPLOAD", packed, NULL);
             client_send_command("SHIP_PLACED", "manual", NULL);
             return;
@@ -507,6 +582,55 @@ void client_shooting_ui(struct game_session* session, int player_number) {
     client_send_command("SHOT", input, NULL);
 }
 
+/* Rebuilds the local view from a STATE_SYNC after reconnecting.
+   a1: own board + enemy fog, a2: "session;player;turn;state;opponent" */
+static void handle_state_sync(const char *a1, const char *a2) {
+    int session_id = -1, player = 0, turn = 1;
+    char state = 'L';
+    if (sscanf(a2, "%d;%d;%d;%c", &session_id, &player, &turn, &state) < 4) {
+        printf("Malformed state sync from server\n");
+        return;
+    }
+
+    current_session.id = session_id;
+    current_session.current_turn = turn;
+    my_client.session_id = session_id;
+    my_client.player_number = player;
+    enemy_client.player_number = (player == 1) ? 2 : 1;
+    if (strlen(a1) >= 2 * FIELD_PAYLOAD_SIZE) {
+        decode_field(a1, my_client.field);
+        decode_field(a1 + FIELD_PAYLOAD_SIZE, enemy_client.field);
+    }
+
+    printf("Resumed game session %d as Player %d\n", session_id, player);
+    if (state == 'G') {
+        game_started = 1;
+        if (player == 1) {
+            current_session.player1 = &my_client;
+            current_session.player2 = &enemy_client;
+        } else {
+            current_session.player2 = &my_client;
+            current_session.player1 = &enemy_client;
+        }
+        current_session.game_started = 1;
+        if (turn == player) {
+            my_turn = 1;
+            printf("\n=== YOUR TURN ===\n");
+            client_shooting_ui(&current_session, player);
+        } else {
+            my_turn = 0;
+            print_game_session(&current_session, player);
+            printf("\n=== OPPONENT'S TURN ===\nWaiting for opponent's move...\n");
+        }
+    } else if (state == 'P') {
+        client_place_ships_ui();
+    } else if (state == 'W') {
+        printf("Waiting for opponent to place ships...\n");
+    } else {
+        printf("Waiting for opponent...\n");
+    }
+}
+
 /* --- Packet handling (called only from main thread) --- */
 void handle_packet(const packet_t *p) {
     if (!p) return;
@@ -520,6 +644,12 @@ void handle_packet(const packet_t *p) {
     strncpy(a1, p->arg1, PACKET_ARG_SIZE_1 - 1);
     strncpy(a2, p->arg2, PACKET_ARG_SIZE_2 - 1);
 
+    // A resuming connection first gets the lobby greeting; skip it
+    if (g_resuming.load() && (strcmp(cmd, "WELCOME") == 0 || strcmp(cmd, "SESSION_LIST") == 0 ||
+                              strcmp(cmd, "LEADERBOARD") == 0)) {
+        return;
+    }
+
     if (strcmp(cmd, "SESSION_LIST") == 0) {
         printf("\n=== AVAILABLE SESSIONS ===\n%s\n", a1);
         fflush(stdout);
@@ -532,6 +662,15 @@ void handle_packet(const packet_t *p) {
         my_client.ready = 0;
         create_game_field(my_client.field);
         initialize_ships(&my_client.ship_data);
+    } else if (strcmp(cmd, "RESUME_TOKEN") == 0) {
+        set_resume_token(a1);
+    } else if (strcmp(cmd, "STATE_SYNC") == 0) {
+        g_resuming = false;
+        handle_state_sync(a1, a2);
+    } else if (strcmp(cmd, "OPPONENT_AWAY") == 0) {
+        printf("Opponent lost connection, waiting up to %s seconds for them to return...\n", a1);
+    } else if (strcmp(cmd, "OPPONENT_RECONNECTED") == 0) {
+        printf("Opponent %s reconnected.\n", a1);
     } else if (strcmp(cmd, "SESSION_CREATED") == 0) {
         current_session.id = atoi(a1);
         printf("Joined game session %d\n", current_session.id);
@@ -570,25 +709,9 @@ void handle_packet(const packet_t *p) {
         printf("Game started! You are Player %d\n", my_client.player_number);
         print_game_session(&current_session, my_client.player_number);
     } else if (strcmp(cmd, "FIELD_UPDATE") == 0) {
-        if (strlen(a1) >= PLAYABLE_SIZE * PLAYABLE_SIZE) {
-            int idx = 0;
-            for (int i = 1; i <= PLAYABLE_SIZE; i++) {
-                for (int j = 1; j <= PLAYABLE_SIZE; j++) {
-                    char c = a1[idx++];
-                    my_client.field[i][j] = (c >= '0' && c <= '3') ? (c - '0') : 0;
-                }
-            }
-        }
+        decode_field(a1, my_client.field);
     } else if (strcmp(cmd, "ENEMY_FOG_UPDATE") == 0) {
-        if (strlen(a1) >= PLAYABLE_SIZE * PLAYABLE_SIZE) {
-            int idx = 0;
-            for (int i = 1; i <= PLAYABLE_SIZE; i++) {
-                for (int j = 1; j <= PLAYABLE_SIZE; j++) {
-                    char c = a1[idx++];
-                    enemy_client.field[i][j] = (c >= '0' && c <= '3') ? (c - '0') : 0;
-                }
-            }
-        }
+        decode_field(a1, enemy_client.field);
     } else if (strcmp(cmd, "YOUR_TURN") == 0) {
         my_turn = 1;
         current_session.current_turn = my_client.player_number;
@@ -619,17 +742,27 @@ void handle_packet(const packet_t *p) {
     } else if (strcmp(cmd, "OPPONENT_DISCONNECTED") == 0) {
         printf("Opponent disconnected. You win!\n");
         exit(0);
+    } else if (strcmp(cmd, "SERVER_RESTARTING") == 0) {
+        /* Not the end: the server keeps the seat, and the socket thread
+           reconnects with RESUME when the connection drops */
+        printf("\nServer is restarting, the game resumes when it is back...\n");
     } else if (strcmp(cmd, "GAME_OVER") == 0) {
         printf("\n=== GAME OVER ===\n");
         if (strcmp(a1, "WIN") == 0) printf("You won!\n");
         else if (strcmp(a1, "LOSE") == 0) printf("You lost.\n");
         else printf("Game ended: %s\n", a1);
+        set_resume_token("");
         stop_stdin_thread();
         stop_socket_thread();
         sock_close(sockfd);
         exit(0);
     } else if (strcmp(cmd, "ERROR") == 0) {
         printf("Server error: %s\n", a1);
+        if (strcmp(a1, "RESUME_REJECTED") == 0) {
+            printf("The game could not be resumed.\n");
+            socket_cleanup_and_exit();
+            exit(0);
+        }
     } else {
         // Unknown command: print raw
         printf("SERVER: %s %s %s\n", cmd, a1, a2);
@@ -638,6 +771,35 @@ void handle_packet(const packet_t *p) {
 
 /* --- Socket connect and threads management --- */
 
+/* Returns a connected socket or -1; quiet suppresses error output */
+static int connect_to_server(const char *host, int port, int quiet) {
+    struct sockaddr_in server;
+    struct hostent *hp;
+
+    int fd = (int)socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1) {
+        if (!quiet) perror("socket");
+        return -1;
+    }
+    memset(&server, 0, sizeof(server));
+    server.sin_family = AF_INET;
+    hp = gethostbyname(host);
+    if (!hp) {
+        if (!quiet) fprintf(stderr, "Unknown host: %s\n", host);
+        sock_close(fd);
+        return -1;
+    }
+    memcpy(&server.sin_addr, hp->h_addr_list[0], hp->h_length);
+    server.sin_port = htons(port);
+
+    if (connect(fd, (struct sockaddr*)&server, sizeof(server)) == -1) {
+        if (!quiet) perror("connect");
+        sock_close(fd);
+        return -1;
+    }
+    return fd;
+}
+
 static void socket_cleanup_and_exit() {
     stop_stdin_thread();
     stop_socket_thread();
@@ -705,28 +867,11 @@ int main(int argc, char *argv[]) {
     signal(SIGINT, on_sigint);
 
     // Create socket and connect
-    struct sockaddr_in server;
-    struct hostent *hp;
-
-    sockfd = (int)socket(AF_INET, SOCK_STREAM, 0);
-    if (sockfd == -1) {
-        perror("socket");
-        return 1;
-    }
-    server.sin_family = AF_INET;
-    hp = gethostbyname(host);
-    if (!hp) {
-        fprintf(stderr, "Unknown host: %s\n", host);
-        sock_close(sockfd);
-        return 1;
-    }
-    memcpy(&server.sin_addr, hp->h_addr_list[0], hp->h_length);
-    server.sin_port = htons(port);
-
+    g_host = host;
+    g_port = port;
     printf("Connecting to server %s:%d...\n", host, port);
-    if (connect(sockfd, (struct sockaddr*)&server, sizeof(server)) == -1) {
-        perror("connect");
-        sock_close(sockfd);
+    sockfd = connect_to_server(host, port, 0);
+    if (sockfd == -1) {
         return 1;
     }
     printf("Connected.\n");
@@ -0,0 +1,274 @@
+#include "battleship_client_lib.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <netinet/tcp.h>
+#endif
+
+#define CLIENT_READ_SIZE (8 * PACKET_SIZE)
+
+enum {
+    CONN_CONNECTING = 0,
+    CONN_OPEN,
+    CONN_CLOSED
+};
+
+struct client_conn {
+    struct client_loop* loop;
+    int fd;
+    int state;
+    struct client_callbacks cb;
+    void* user;
+    char inbuf[PACKET_SIZE];
+    int in_len;
+    std::string outbuf;
+    int connect_error;      // connect() failed outright; reported on the next run
+};
+
+struct client_loop {
+    std::vector<struct client_conn*> conns;
+    std::vector<struct pollfd> pfds;
+    std::vector<struct client_conn*> polled;
+    int open;
+};
+
+static int sock_error() {
+#ifdef _WIN32
+    return WSAGetLastError();
+#else
+    return errno;
+#endif
+}
+
+static int would_block() {
+#ifdef _WIN32
+    int e = WSAGetLastError();
+    return e == WSAEWOULDBLOCK || e == WSAEINPROGRESS;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINPROGRESS || errno == EINTR;
+#endif
+}
+
+static int set_nonblocking(int fd) {
+#ifdef _WIN32
+    u_long mode = 1;
+    return ioctlsocket((SOCKET)fd, FIONBIO, &mode);
+#else
+    int flags = fcntl(fd, F_GETFL, 0);
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+#endif
+}
+
+static void conn_release(struct client_conn* c) {
+    if (c->state == CONN_CLOSED) return;
+    sock_close(c->fd);
+    c->fd = -1;
+    c->state = CONN_CLOSED;
+    c->outbuf.clear();
+    c->loop->open--;
+}
+
+// Closed from the network side: tell the owner
+static void conn_fail(struct client_conn* c, int error) {
+    if (c->state == CONN_CLOSED) return;
+    conn_release(c);
+    if (c->cb.on_close) c->cb.on_close(c, error, c->user);
+}
+
+/* Writes as much of the queue as the socket takes. Errors are left for
+   poll() to report, so this never calls back into the owner. */
+static void conn_flush(struct client_conn* c) {
+    while (c->state == CONN_OPEN && !c->outbuf.empty()) {
+        int n = send(c->fd, c->outbuf.data(), (int)c->outbuf.size(), 0);
+        if (n <= 0) return;
+        c->outbuf.erase(0, (size_t)n);
+    }
+}
+
+static void conn_read(struct client_conn* c) {
+    char buf[CLIENT_READ_SIZE];
+    int n = recv(c->fd, buf, sizeof(buf), 0);
+    if (n == 0) {
+        conn_fail(c, 0);
+        return;
+    }
+    if (n < 0) {
+        if (!would_block()) conn_fail(c, sock_error());
+        return;
+    }
+    int off = 0;
+    /* The owner may close c from on_packet; stop delivering once it does */
+    while (off < n && c->state == CONN_OPEN) {
+        int take = n - off;
+        if (take > PACKET_SIZE - c->in_len) take = PACKET_SIZE - c->in_len;
+        memcpy(c->inbuf + c->in_len, buf + off, take);
+        c->in_len += take;
+        off += take;
+        if (c->in_len == PACKET_SIZE) {
+            packet_t p;
+            memcpy(&p, c->inbuf, sizeof(p));
+            p.command[PACKET_COMMAND_SIZE - 1] = '\0';
+            p.arg1[PACKET_ARG_SIZE_1 - 1] = '\0';
+            p.arg2[PACKET_ARG_SIZE_2 - 1] = '\0';
+            c->in_len = 0;
+            if (strcmp(p.command, "PING") == 0) {
+                client_send(c, "PONG", p.arg1, NULL);
+                continue;
+            }
+            if (c->cb.on_packet) c->cb.on_packet(c, &p, c->user);
+        }
+    }
+}
+
+struct client_loop* client_loop_create() {
+    struct client_loop* loop = new struct client_loop;
+    loop->open = 0;
+    return loop;
+}
+
+void client_loop_destroy(struct client_loop* loop) {
+    if (!loop) return;
+    for (struct client_conn* c : loop->conns) {
+        conn_release(c);
+        delete c;
+    }
+    delete loop;
+}
+
+int client_loop_count(const struct client_loop* loop) {
+    return loop->open;
+}
+
+int client_loop_run(struct client_loop* loop, int timeout_ms) {
+    loop->pfds.clear();
+    loop->polled.clear();
+    for (size_t i = 0; i < loop->conns.size(); i++) {
+        struct client_conn* c = loop->conns[i];
+        if (c->connect_error) conn_fail(c, c->connect_error);
+        if (c->state == CONN_CLOSED) continue;
+        struct pollfd p;
+        p.fd = c->fd;
+        p.events = POLLIN;
+        if (c->state == CONN_CONNECTING || !c->outbuf.empty()) p.events |= POLLOUT;
+        p.revents = 0;
+        loop->pfds.push_back(p);
+        loop->polled.push_back(c);
+    }
+
+    int ready = 0;
+    if (loop->pfds.empty()) {
+        if (timeout_ms > 0) usleep((unsigned int)timeout_ms * 1000);
+    } else {
+        ready = poll(loop->pfds.data(), (unsigned long)loop->pfds.size(), timeout_ms);
+        if (ready < 0 && !would_block()) return -1;
+    }
+
+    for (size_t k = 0; ready > 0 && k < loop->pfds.size(); k++) {
+        struct client_conn* c = loop->polled[k];
+        short revents = loop->pfds[k].revents;
+        if (!revents || c->state == CONN_CLOSED) continue;
+
+        if (c->state == CONN_CONNECTING) {
+            int err = 0;
+            socklen_t len = sizeof(err);
+            getsockopt(c->fd, SOL_SOCKET, SO_ERROR, (char*)&err, &len);
+            if (err != 0 || (revents & (POLLERR | POLLNVAL))) {
+                conn_fail(c, err ? err : ECONNREFUSED);
+                continue;
+            }
+            c->state = CONN_OPEN;
+            if (c->cb.on_connect) c->cb.on_connect(c, c->user);
+        }
+        if (c->state == CONN_OPEN && (revents & (POLLIN | POLLHUP | POLLERR))) conn_read(c);
+        if (c->state == CONN_OPEN && (revents & POLLNVAL)) conn_fail(c, EBADF);
+    }
+
+    /* Push out whatever the callbacks queued, then reap closed connections */
+    size_t w = 0;
+    for (size_t i = 0; i < loop->conns.size(); i++) {
+        struct client_conn* c = loop->conns[i];
+        conn_flush(c);
+        if (c->state == CONN_CLOSED) delete c;
+        else loop->conns[w++] = c;
+    }
+    loop->conns.resize(w);
+    return loop->open;
+}
+
+int client_resolve(const char* host, int port, struct sockaddr_in* addr) {
+    struct hostent* hp = gethostbyname(host);
+    if (!hp) return -1;
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    memcpy(&addr->sin_addr, hp->h_addr_list[0], hp->h_length);
+    addr->sin_port = htons(port);
+    return 0;
+}
+
+struct client_conn* client_connect(struct client_loop* loop, const struct sockaddr_in* addr,
+                                   const struct client_callbacks* callbacks, void* user) {
+    int fd = (int)socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1) return NULL;
+    set_nonblocking(fd);
+    /* Turns are several small packets; don't let Nagle hold them */
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const char*)&one, sizeof(one));
+
+    struct client_conn* c = new struct client_conn;
+    c->loop = loop;
+    c->fd = fd;
+    c->state = CONN_CONNECTING;
+    c->cb = *callbacks;
+    c->user = user;
+    c->in_len = 0;
+    c->connect_error = 0;
+    loop->conns.push_back(c);
+    loop->open++;
+
+    /* Even an instant connect completes through poll(), so on_connect
+       always fires; failures are reported from client_loop_run() too */
+    if (connect(fd, (const struct sockaddr*)addr, sizeof(*addr)) == -1 && !would_block()) {
+        c->connect_error = sock_error();
+    }
+    return c;
+}
+
+int client_send_packet(struct client_conn* c, const packet_t* p) {
+    if (c->state == CONN_CLOSED) return -1;
+    c->outbuf.append((const char*)p, sizeof(*p));
+    /* Send right away when the socket can take it; saves a poll round */
+    if (c->outbuf.size() == sizeof(*p)) conn_flush(c);
+    return 0;
+}
+
+int client_send(struct client_conn* c, const char* command, const char* arg1, const char* arg2) {
+    packet_t p;
+    memset(&p, 0, sizeof(p));
+    if (command) strncpy(p.command, command, PACKET_COMMAND_SIZE - 1);
+    if (arg1) strncpy(p.arg1, arg1, PACKET_ARG_SIZE_1 - 1);
+    if (arg2) strncpy(p.arg2, arg2, PACKET_ARG_SIZE_2 - 1);
+    return client_send_packet(c, &p);
+}
+
+void client_close(struct client_conn* c) {
+    conn_release(c);
+}
+
+void* client_user(const struct client_conn* c) {
+    return c->user;
+}
+
+int client_is_connected(const struct client_conn* c) {
+    return c->state == CONN_OPEN;
+}
+
+size_t client_pending(const struct client_conn* c) {
+    return c->outbuf.size();
+}
@@ -0,0 +1,69 @@
+#ifndef BATTLESHIP_CLIENT_LIB_H
+#define BATTLESHIP_CLIENT_LIB_H
+
+#include "battleship.h"
+#include "battleship_windows.h"
+
+/* libbattleship_client: non-blocking protocol connections for bots.
+   One client_loop drives any number of connections from a single poll();
+   packets arrive through callbacks and sends are queued, so a bot can
+   pipeline several requests without waiting for replies:
+
+     struct client_loop* loop = client_loop_create();
+     struct client_callbacks cb = {on_connect, on_packet, on_close};
+     struct client_conn* c = client_connect(loop, &addr, &cb, my_bot);
+     client_send(c, "SET_NICK", "bot1", NULL);
+     client_send(c, "JOIN_SESSION", "auto", NULL);
+     while (running) client_loop_run(loop, timeout_ms);
+
+   Sends may be queued before the connection is established. Everything
+   runs on the thread that calls client_loop_run(); nothing is locked.
+   On Windows the caller initializes Winsock. */
+
+struct client_loop;
+struct client_conn;
+
+struct client_callbacks {
+    // The TCP connection is established. May be NULL.
+    void (*on_connect)(struct client_conn* c, void* user);
+    // One complete packet from the server, strings NUL-terminated.
+    // Heartbeat PINGs are answered by the library and not delivered.
+    void (*on_packet)(struct client_conn* c, const packet_t* p, void* user);
+    /* The server closed the connection (error 0) or it failed (errno /
+       WSA error). Not called for client_close(). c is freed afterwards. */
+    void (*on_close)(struct client_conn* c, int error, void* user);
+};
+
+struct client_loop* client_loop_create();
+// Closes every remaining connection without callbacks.
+void client_loop_destroy(struct client_loop* loop);
+
+/* Polls for up to timeout_ms (-1: until something happens), dispatches
+   callbacks and flushes queued sends. Returns the number of open
+   connections, or -1 if poll() failed. */
+int client_loop_run(struct client_loop* loop, int timeout_ms);
+int client_loop_count(const struct client_loop* loop);
+
+// Fills addr for host:port. Returns 0, or -1 if the host is unknown.
+int client_resolve(const char* host, int port, struct sockaddr_in* addr);
+
+/* Starts a non-blocking connect. Returns NULL if no socket could be
+   created; a refused connection is reported through on_close. */
+struct client_conn* client_connect(struct client_loop* loop, const struct sockaddr_in* addr,
+                                   const struct client_callbacks* callbacks, void* user);
+
+// Queues one packet. Returns 0, or -1 if the connection is closed.
+int client_send(struct client_conn* c, const char* command, const char* arg1, const char* arg2);
+int client_send_packet(struct client_conn* c, const packet_t* p);
+
+/* Closes the connection now, dropping unsent data. Safe from inside a
+   callback: no further callbacks arrive for c, and it is freed by the
+   loop once the current client_loop_run() returns. */
+void client_close(struct client_conn* c);
+
+void* client_user(const struct client_conn* c);
+int client_is_connected(const struct client_conn* c);
+// Bytes queued but not yet accepted by the kernel
+size_t client_pending(const struct client_conn* c);
+
+#endif // BATTLESHIP_CLIENT_LIB_H
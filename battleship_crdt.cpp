@@ -0,0 +1,877 @@
+#include "battleship_crdt.h"
+#include "battleship_log.h"
+#include "battleship_windows.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/* One nickname's row: a count per node, plus the cached sum */
+struct counter_row {
+    std::vector<std::pair<uint32_t, uint64_t> > columns;
+    uint64_t total;
+};
+
+/* Change log entry: this (nickname, node) cell moved at sequence seq */
+struct counter_change {
+    uint64_t seq;
+    std::string nickname;
+    uint32_t node;
+};
+
+struct peer_link {
+    int fd;
+    int outbound;            // a configured peer that we dial ourselves
+    std::string host;
+    int port;
+    uint64_t sent_seq;       // changes up to here were shipped on this link
+    int authed;              // its hello checked out; only then does it get state
+    int hello_sent;          // dialer: answered the challenge
+    std::string challenge;   // the listener's nonce on this link
+    std::string nonce;       // the dialer's nonce on this link
+    long long opened_ms;
+    std::string inbuf;
+    long long next_dial_ms;
+};
+
+static std::mutex g_crdt_mutex;
+static std::unordered_map<std::string, counter_row> g_rows;
+static std::deque<counter_change> g_log;
+static uint64_t g_seq = 0;
+static uint32_t g_node_id = 0;
+static int g_own_dirty = 0;                 // own column changed since the last save
+static std::string g_bind = GOSSIP_BIND_DEFAULT;
+static std::string g_secret;
+static std::string g_state_path;
+static int g_state_set = 0;                 // crdt_set_state_file was called
+static std::mutex g_save_mutex;             // the gossip thread and crdt_stop() both save
+
+static std::vector<peer_link> g_links;
+static int g_gossip_sock = -1;
+static std::atomic<bool> g_running{false};
+
+static long long now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* --- counter map (callers hold g_crdt_mutex) --- */
+
+static uint64_t* cell(const std::string& nickname, uint32_t node, counter_row** row_out) {
+    counter_row& row = g_rows[nickname];
+    *row_out = &row;
+    for (auto& col : row.columns) {
+        if (col.first == node) return &col.second;
+    }
+    row.columns.push_back(std::make_pair(node, (uint64_t)0));
+    return &row.columns.back().second;
+}
+
+static void log_change(const std::string& nickname, uint32_t node) {
+    counter_change c;
+    c.seq = ++g_seq;
+    c.nickname = nickname;
+    c.node = node;
+    g_log.push_back(std::move(c));
+}
+
+/* Max-merge of one cell. Returns 1 if the local value grew. */
+static int merge_cell(const std::string& nickname, uint32_t node, uint64_t count) {
+    counter_row* row;
+    uint64_t* value = cell(nickname, node, &row);
+    if (count <= *value) return 0;
+    row->total += count - *value;
+    *value = count;
+    log_change(nickname, node);
+    return 1;
+}
+
+static void append_cell(std::string& out, const std::string& nickname, uint32_t node, uint64_t count) {
+    char line[96];
+    snprintf(line, sizeof(line), "C %u %llu ", node, (unsigned long long)count);
+    out += line;
+    out += nickname;
+    out += '\n';
+}
+
+/* --- public API --- */
+
+int crdt_enabled() {
+    return g_running.load();
+}
+
+void crdt_increment(const char* nickname) {
+    if (!nickname || !nickname[0]) return;
+    std::lock_guard<std::mutex> lk(g_crdt_mutex);
+    counter_row* row;
+    uint64_t* value = cell(nickname, g_node_id, &row);
+    (*value)++;
+    row->total++;
+    log_change(nickname, g_node_id);
+    g_own_dirty = 1;
+}
+
+uint32_t crdt_node_id() {
+    return g_node_id;
+}
+
+void crdt_set_bind(const char* address) {
+    g_bind = address ? address : GOSSIP_BIND_DEFAULT;
+}
+
+int crdt_load_secret(const char* path) {
+    FILE* f = fopen(path, "r");
+    if (!f) return -1;
+    char line[GOSSIP_SECRET_SIZE + 2];
+    int ok = fgets(line, sizeof(line), f) != NULL;
+    fclose(f);
+    if (!ok) return -1;
+    line[strcspn(line, "\r\n")] = '\0';
+    if (!line[0]) return -1;
+    g_secret = line;
+    return 0;
+}
+
+void crdt_set_state_file(const char* path) {
+    g_state_path = path ? path : "";
+    g_state_set = 1;
+}
+
+const char* crdt_default_state_file() {
+    static char path[256];
+#ifdef _WIN32
+    snprintf(path, sizeof(path), CRDT_STATE_DIR "/" CRDT_STATE_NAME);
+#else
+    snprintf(path, sizeof(path), CRDT_STATE_DIR "/" CRDT_STATE_NAME, (unsigned)geteuid());
+#endif
+    return path;
+}
+
+/* The default state file's directory is created owner-only and must stay
+   that way, so nobody else can plant or swap the file. Returns 0 when
+   g_state_path may be used. */
+static int prepare_default_state_dir() {
+#ifndef _WIN32
+    char dir[256];
+    snprintf(dir, sizeof(dir), CRDT_STATE_DIR, (unsigned)geteuid());
+    if (mkdir(dir, 0700) == -1 && errno != EEXIST) return -1;
+    struct stat st;
+    if (lstat(dir, &st) == -1 || !S_ISDIR(st.st_mode) || st.st_uid != geteuid() || (st.st_mode & 077)) {
+        fprintf(stderr, "Refusing gossip state directory '%s': not a private directory of this user\n", dir);
+        return -1;
+    }
+#endif
+    return 0;
+}
+
+/* --- state file: "N <node id>", then "<count> <nickname>" per own cell --- */
+
+/* Loads this node's column. Returns the file's node id, or 0 when there
+   is no file or it belongs to another node_id (then nothing is loaded). */
+static uint32_t load_state(uint32_t node_id) {
+    if (g_state_path.empty()) return 0;
+#ifdef _WIN32
+    FILE* f = fopen(g_state_path.c_str(), "r");
+#else
+    int fd = open(g_state_path.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd == -1) {
+        if (errno != ENOENT) {
+            fprintf(stderr, "Cannot open gossip state '%s': %s\n", g_state_path.c_str(), strerror(errno));
+        }
+        return 0;
+    }
+    /* Its column is merged in as this node's own wins, so it must be ours */
+    struct stat st;
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_uid != geteuid() || (st.st_mode & 022)) {
+        fprintf(stderr, "Refusing gossip state '%s': not a file of this user that only it can write\n",
+                g_state_path.c_str());
+        close(fd);
+        return 0;
+    }
+    FILE* f = fdopen(fd, "r");
+    if (!f) {
+        close(fd);
+        return 0;
+    }
+#endif
+    if (!f) return 0;
+    unsigned file_id = 0;
+    if (fscanf(f, "N %u\n", &file_id) != 1 || file_id == 0 || (node_id != 0 && node_id != file_id)) {
+        if (file_id != 0) {
+            fprintf(stderr, "Gossip state '%s' belongs to node %u, not %u; not loaded\n",
+                    g_state_path.c_str(), file_id, node_id);
+        }
+        fclose(f);
+        return 0;
+    }
+    char line[128];
+    std::lock_guard<std::mutex> lk(g_crdt_mutex);
+    while (fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        unsigned long long count = 0;
+        int consumed = 0;
+        if (sscanf(line, "%llu %n", &count, &consumed) < 1 || consumed <= 0 || !line[consumed]) continue;
+        merge_cell(line + consumed, file_id, count);
+    }
+    fclose(f);
+    return file_id;
+}
+
+static void save_state() {
+    if (g_state_path.empty()) return;
+    std::lock_guard<std::mutex> save_lk(g_save_mutex);
+    std::string out;
+    {
+        std::lock_guard<std::mutex> lk(g_crdt_mutex);
+        if (!g_own_dirty) return;
+        g_own_dirty = 0;
+        char line[32];
+        snprintf(line, sizeof(line), "N %u\n", g_node_id);
+        out += line;
+        for (const auto& kv : g_rows) {
+            for (const auto& col : kv.second.columns) {
+                if (col.first != g_node_id) continue;
+                snprintf(line, sizeof(line), "%llu ", (unsigned long long)col.second);
+                out += line;
+                out += kv.first;
+                out += '\n';
+            }
+        }
+    }
+
+    /* Written aside and renamed over, so a crash leaves the old file */
+    std::string tmp = g_state_path + ".tmp";
+#ifdef _WIN32
+    FILE* f = fopen(tmp.c_str(), "w");
+#else
+    /* Created fresh and private; a leftover or planted .tmp is not reused */
+    unlink(tmp.c_str());
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+    FILE* f = fd == -1 ? NULL : fdopen(fd, "w");
+    if (fd != -1 && !f) close(fd);
+#endif
+    int ok = f != NULL;
+    if (f) {
+        ok = fwrite(out.data(), 1, out.size(), f) == out.size();
+        ok = fclose(f) == 0 && ok;
+    }
+#ifdef _WIN32
+    if (ok) remove(g_state_path.c_str());
+#endif
+    if (!ok || rename(tmp.c_str(), g_state_path.c_str()) != 0) {
+        remove(tmp.c_str());
+        std::lock_guard<std::mutex> lk(g_crdt_mutex);
+        g_own_dirty = 1;
+    }
+}
+
+// A fresh node id: random, so two nodes started without --node-id differ
+static uint32_t random_node_id() {
+    uint32_t id = 0;
+#ifndef _WIN32
+    FILE* f = fopen("/dev/urandom", "rb");
+    if (f) {
+        if (fread(&id, sizeof(id), 1, f) != 1) id = 0;
+        fclose(f);
+    }
+#endif
+    while (id == 0) id = (uint32_t)time(NULL) ^ ((uint32_t)rand() << 8) ^ (uint32_t)rand();
+    return id;
+}
+
+int crdt_format(char* out, size_t out_size) {
+    if (!out || out_size == 0) return 0;
+    out[0] = '\0';
+
+    std::vector<std::pair<std::string, uint64_t> > totals;
+    {
+        std::lock_guard<std::mutex> lk(g_crdt_mutex);
+        totals.reserve(g_rows.size());
+        for (const auto& kv : g_rows) {
+            if (kv.second.total > 0) totals.push_back(std::make_pair(kv.first, kv.second.total));
+        }
+    }
+    std::sort(totals.begin(), totals.end(), [](const std::pair<std::string, uint64_t>& a,
+                                               const std::pair<std::string, uint64_t>& b) {
+        if (a.second != b.second) return a.second > b.second;
+        return a.first < b.first;
+    });
+
+    size_t used = 0;
+    int count = 0;
+    for (const auto& t : totals) {
+        char line[128];
+        int n = snprintf(line, sizeof(line), "%s %llu\n", t.first.c_str(), (unsigned long long)t.second);
+        if (n < 0 || used + (size_t)n + 1 >= out_size) break;
+        memcpy(out + used, line, (size_t)n + 1);
+        used += (size_t)n;
+        count++;
+    }
+    return count;
+}
+
+int crdt_add_peer(const char* host_port) {
+    if (!host_port || g_links.size() >= MAX_GOSSIP_PEERS) return -1;
+    const char* colon = strrchr(host_port, ':');
+    if (!colon || colon == host_port) return -1;
+
+    peer_link link;
+    link.fd = -1;
+    link.outbound = 1;
+    link.host.assign(host_port, colon - host_port);
+    link.port = atoi(colon + 1);
+    link.sent_seq = 0;
+    link.authed = 0;
+    link.hello_sent = 0;
+    link.opened_ms = 0;
+    link.next_dial_ms = 0;
+    if (link.port <= 0) return -1;
+    g_links.push_back(link);
+    return 0;
+}
+
+/* --- gossip thread --- */
+
+static int send_all(int fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        int n = send(fd, data.data() + sent, (int)(data.size() - sent), 0);
+        if (n <= 0) {
+            if (n == -1 && errno == EINTR) continue;
+            return -1;
+        }
+        sent += (size_t)n;
+    }
+    return 0;
+}
+
+static void close_link(peer_link& link) {
+    if (link.fd == -1) return;
+    sock_close(link.fd);
+    link.fd = -1;
+    link.authed = 0;
+    link.inbuf.clear();
+    link.next_dial_ms = now_ms() + GOSSIP_RECONNECT_MS;
+}
+
+/* --- link authentication: HMAC-SHA256 (FIPS 180-4, RFC 2104) --- */
+
+struct sha256_ctx {
+    uint32_t h[8];
+    uint64_t length;
+    unsigned char block[64];
+    size_t used;
+};
+
+static const uint32_t k_sha256[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static uint32_t rotr(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+static void sha256_block(sha256_ctx* ctx, const unsigned char* p) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = ((uint32_t)p[4 * i] << 24) | ((uint32_t)p[4 * i + 1] << 16) |
+               ((uint32_t)p[4 * i + 2] << 8) | (uint32_t)p[4 * i + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t a = ctx->h[0], b = ctx->h[1], c = ctx->h[2], d = ctx->h[3];
+    uint32_t e = ctx->h[4], f = ctx->h[5], g = ctx->h[6], h = ctx->h[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + k_sha256[i] + w[i];
+        uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+    ctx->h[0] += a; ctx->h[1] += b; ctx->h[2] += c; ctx->h[3] += d;
+    ctx->h[4] += e; ctx->h[5] += f; ctx->h[6] += g; ctx->h[7] += h;
+}
+
+static void sha256_init(sha256_ctx* ctx) {
+    static const uint32_t iv[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(ctx->h, iv, sizeof(iv));
+    ctx->length = 0;
+    ctx->used = 0;
+}
+
+static void sha256_update(sha256_ctx* ctx, const void* data, size_t len) {
+    const unsigned char* p = (const unsigned char*)data;
+    ctx->length += len;
+    while (len > 0) {
+        size_t n = std::min(len, sizeof(ctx->block) - ctx->used);
+        memcpy(ctx->block + ctx->used, p, n);
+        ctx->used += n;
+        p += n;
+        len -= n;
+        if (ctx->used == sizeof(ctx->block)) {
+            sha256_block(ctx, ctx->block);
+            ctx->used = 0;
+        }
+    }
+}
+
+static void sha256_final(sha256_ctx* ctx, unsigned char out[32]) {
+    uint64_t bits = ctx->length * 8;
+    unsigned char pad = 0x80;
+    sha256_update(ctx, &pad, 1);
+    pad = 0;
+    while (ctx->used != 56) sha256_update(ctx, &pad, 1);
+    unsigned char len_be[8];
+    for (int i = 0; i < 8; i++) len_be[i] = (unsigned char)(bits >> (56 - 8 * i));
+    sha256_update(ctx, len_be, sizeof(len_be));
+    for (int i = 0; i < 8; i++) {
+        out[4 * i] = (unsigned char)(ctx->h[i] >> 24);
+        out[4 * i + 1] = (unsigned char)(ctx->h[i] >> 16);
+        out[4 * i + 2] = (unsigned char)(ctx->h[i] >> 8);
+        out[4 * i + 3] = (unsigned char)ctx->h[i];
+    }
+}
+
+static void hmac_sha256(const std::string& key, const std::string& msg, unsigned char out[32]) {
+    unsigned char k[64];
+    memset(k, 0, sizeof(k));
+    if (key.size() > sizeof(k)) {
+        sha256_ctx kc;
+        sha256_init(&kc);
+        sha256_update(&kc, key.data(), key.size());
+        sha256_final(&kc, k);
+    } else {
+        memcpy(k, key.data(), key.size());
+    }
+    unsigned char ipad[64], opad[64];
+    for (int i = 0; i < 64; i++) {
+        ipad[i] = k[i] ^ 0x36;
+        opad[i] = k[i] ^ 0x5c;
+    }
+    unsigned char inner[32];
+    sha256_ctx ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, ipad, sizeof(ipad));
+    sha256_update(&ctx, msg.data(), msg.size());
+    sha256_final(&ctx, inner);
+    sha256_init(&ctx);
+    sha256_update(&ctx, opad, sizeof(opad));
+    sha256_update(&ctx, inner, sizeof(inner));
+    sha256_final(&ctx, out);
+}
+
+static std::string to_hex(const unsigned char* p, size_t n) {
+    static const char digits[] = "0123456789abcdef";
+    std::string out;
+    for (size_t i = 0; i < n; i++) {
+        out += digits[p[i] >> 4];
+        out += digits[p[i] & 15];
+    }
+    return out;
+}
+
+// A fresh nonce per link, so an answer seen once cannot be replayed
+static std::string random_nonce() {
+    unsigned char bytes[16];
+    size_t got = 0;
+#ifndef _WIN32
+    FILE* f = fopen("/dev/urandom", "rb");
+    if (f) {
+        got = fread(bytes, 1, sizeof(bytes), f);
+        fclose(f);
+    }
+#endif
+    for (; got < sizeof(bytes); got++) bytes[got] = (unsigned char)(rand() ^ (now_ms() >> (got % 8)));
+    return to_hex(bytes, sizeof(bytes));
+}
+
+/* The proof a side gives on a link: which side it speaks for, both
+   nonces and its node id, under the secret */
+static std::string link_mac(const char* role, const std::string& first, const std::string& second,
+                            uint32_t node) {
+    char id[16];
+    snprintf(id, sizeof(id), "%u", node);
+    std::string msg = std::string(role) + ' ' + first + ' ' + second + ' ' + id;
+    unsigned char mac[32];
+    hmac_sha256(g_secret, msg, mac);
+    return to_hex(mac, sizeof(mac));
+}
+
+// Compares every byte, so the time taken says nothing about the expected MAC
+static int mac_matches(const std::string& given, const std::string& expected) {
+    size_t n = std::max(given.size(), expected.size());
+    unsigned char diff = given.size() != expected.size();
+    for (size_t i = 0; i < n; i++) {
+        unsigned char a = i < given.size() ? (unsigned char)given[i] : 0;
+        unsigned char b = i < expected.size() ? (unsigned char)expected[i] : 0;
+        diff |= a ^ b;
+    }
+    return diff == 0;
+}
+
+static int valid_nonce(const std::string& nonce) {
+    if (nonce.size() != 32) return 0;
+    for (char ch : nonce) {
+        if (!((ch >= '0' && ch <= '9') || (ch >= 'a' && ch <= 'f'))) return 0;
+    }
+    return 1;
+}
+
+/* --- link traffic --- */
+
+static void append_hello(std::string& out, const std::string& proof) {
+    char hello[32];
+    snprintf(hello, sizeof(hello), "H %u", g_node_id);
+    out += hello;
+    if (!proof.empty()) {
+        out += ' ';
+        out += proof;
+    }
+    out += '\n';
+}
+
+/* A link gets everything once it is authenticated; later rounds only send
+   the log tail. Returns -1 when the send failed. */
+static int send_full_state(peer_link& link, std::string out) {
+    {
+        std::lock_guard<std::mutex> lk(g_crdt_mutex);
+        for (const auto& kv : g_rows) {
+            for (const auto& col : kv.second.columns) {
+                append_cell(out, kv.first, col.first, col.second);
+            }
+        }
+        link.sent_seq = g_seq;
+    }
+    link.authed = 1;
+    return send_all(link.fd, out);
+}
+
+/* First words on a new link. Without a secret the dialer opens with its
+   hello and state; with one the listener opens with a challenge. The
+   listener never sends state before the dialer's hello checks out. */
+static int open_link(peer_link& link) {
+    link.authed = 0;
+    link.hello_sent = 0;
+    link.challenge.clear();
+    link.nonce.clear();
+    link.opened_ms = now_ms();
+    if (link.outbound) {
+        if (!g_secret.empty()) return 0;
+        std::string out;
+        append_hello(out, "");
+        return send_full_state(link, out);
+    }
+    if (g_secret.empty()) return 0;
+    link.challenge = random_nonce();
+    return send_all(link.fd, "R " + link.challenge + "\n");
+}
+
+static void send_deltas(peer_link& link) {
+    std::string out;
+    {
+        std::lock_guard<std::mutex> lk(g_crdt_mutex);
+        if (link.sent_seq >= g_seq) return;
+        for (const auto& c : g_log) {
+            if (c.seq <= link.sent_seq) continue;
+            counter_row* row;
+            uint64_t value = *cell(c.nickname, c.node, &row);
+            append_cell(out, c.nickname, c.node, value);
+        }
+        link.sent_seq = g_seq;
+    }
+    if (send_all(link.fd, out) < 0) close_link(link);
+}
+
+/* Drops log entries every authenticated link has already seen */
+static void trim_log() {
+    uint64_t low = UINT64_MAX;
+    for (const auto& link : g_links) {
+        if (link.fd != -1 && link.authed && link.sent_seq < low) low = link.sent_seq;
+    }
+    std::lock_guard<std::mutex> lk(g_crdt_mutex);
+    if (low == UINT64_MAX) {
+        g_log.clear();   // nobody listening: new links start from full state
+        return;
+    }
+    while (!g_log.empty() && g_log.front().seq <= low) g_log.pop_front();
+}
+
+/* The dialer's answer to a challenge: "H <node> <nonce> <mac>" */
+static int answer_challenge(peer_link& link, const std::string& line) {
+    if (!link.outbound || g_secret.empty() || link.hello_sent) return -1;
+    link.challenge = line.substr(2);
+    if (!valid_nonce(link.challenge)) return -1;
+    link.nonce = random_nonce();
+    std::string out;
+    append_hello(out, link.nonce + ' ' + link_mac("dial", link.challenge, link.nonce, g_node_id));
+    link.hello_sent = 1;
+    return send_all(link.fd, out);
+}
+
+/* "R <challenge>" asks the dialer to prove the secret, "H <node> [proof]"
+   is a hello and "C <node> <count> <nickname>" a cell. Returns -1 when
+   the link must be dropped. */
+static int handle_line(peer_link& link, const std::string& line) {
+    if (line.size() >= 2 && line[0] == 'R') return answer_challenge(link, line);
+    if (line.size() >= 2 && line[0] == 'H') {
+        unsigned node = 0;
+        int consumed = 0;
+        if (sscanf(line.c_str(), "H %u%n", &node, &consumed) < 1) return -1;
+        if (node == g_node_id) {
+            log_write(LOG_LEVEL_WARN, "Gossip peer uses this node's id %u, dropping the link", node);
+            return -1;
+        }
+        if (link.authed) return 0;
+        std::string proof = (size_t)consumed < line.size() ? line.substr((size_t)consumed + 1) : "";
+
+        if (link.outbound) {
+            /* Only reached with a secret: the listener proves it too */
+            if (!link.hello_sent || !mac_matches(proof, link_mac("accept", link.nonce, link.challenge, node))) {
+                log_write(LOG_LEVEL_WARN, "Gossip peer %s:%d failed authentication, dropping the link",
+                          link.host.c_str(), link.port);
+                return -1;
+            }
+            return send_full_state(link, "");
+        }
+
+        std::string reply;
+        if (!g_secret.empty()) {
+            size_t space = proof.find(' ');
+            std::string nonce = proof.substr(0, space);
+            std::string mac = space == std::string::npos ? "" : proof.substr(space + 1);
+            if (!valid_nonce(nonce) || !mac_matches(mac, link_mac("dial", link.challenge, nonce, node))) {
+                log_write(LOG_LEVEL_WARN, "Gossip peer node %u failed authentication, dropping the link", node);
+                return -1;
+            }
+            append_hello(reply, link_mac("accept", nonce, link.challenge, g_node_id));
+        } else {
+            append_hello(reply, "");
+        }
+        return send_full_state(link, reply);
+    }
+    if (line.size() < 2 || line[0] != 'C') return 0;
+    if (!link.authed) return -1;
+
+    unsigned node = 0;
+    unsigned long long count = 0;
+    int consumed = 0;
+    if (sscanf(line.c_str(), "C %u %llu %n", &node, &count, &consumed) < 2 || consumed <= 0) return 0;
+    std::string nickname = line.substr((size_t)consumed);
+    if (nickname.empty()) return 0;
+
+    std::lock_guard<std::mutex> lk(g_crdt_mutex);
+    merge_cell(nickname, node, count);
+    return 0;
+}
+
+static void read_link(peer_link& link) {
+    char buf[4096];
+    int n = recv(link.fd, buf, sizeof(buf), 0);
+    if (n <= 0) {
+        if (n == -1 && errno == EINTR) return;
+        close_link(link);
+        return;
+    }
+    link.inbuf.append(buf, (size_t)n);
+    size_t start = 0;
+    size_t nl;
+    while ((nl = link.inbuf.find('\n', start)) != std::string::npos) {
+        if (handle_line(link, link.inbuf.substr(start, nl - start)) < 0) {
+            close_link(link);
+            return;
+        }
+        start = nl + 1;
+    }
+    link.inbuf.erase(0, start);
+    if (link.inbuf.size() > GOSSIP_MAX_LINE) close_link(link);
+}
+
+static int dial(const std::string& host, int port) {
+    struct addrinfo hints;
+    struct addrinfo* res = NULL;
+    char port_str[16];
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(port_str, sizeof(port_str), "%d", port);
+    if (getaddrinfo(host.c_str(), port_str, &hints, &res) != 0 || !res) return -1;
+
+    int fd = (int)socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (fd != -1 && connect(fd, res->ai_addr, (int)res->ai_addrlen) == -1) {
+        sock_close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+static void gossip_thread_func() {
+    long long next_round = now_ms() + GOSSIP_INTERVAL_MS;
+
+    while (g_running.load()) {
+        long long now = now_ms();
+
+        for (auto& link : g_links) {
+            if (link.fd == -1 && link.outbound && now >= link.next_dial_ms) {
+                link.fd = dial(link.host, link.port);
+                if (link.fd == -1) {
+                    link.next_dial_ms = now + GOSSIP_RECONNECT_MS;
+                } else if (open_link(link) < 0) {
+                    close_link(link);
+                }
+            }
+            if (link.fd != -1 && !link.authed && now - link.opened_ms > GOSSIP_AUTH_TIMEOUT_MS) {
+                log_write(LOG_LEVEL_WARN, "Gossip link did not authenticate in %d ms, dropping it",
+                          GOSSIP_AUTH_TIMEOUT_MS);
+                close_link(link);
+            }
+        }
+
+        std::vector<struct pollfd> pfds;
+        std::vector<size_t> owners;
+        if (g_gossip_sock != -1) {
+            struct pollfd p;
+            p.fd = g_gossip_sock;
+            p.events = POLLIN;
+            p.revents = 0;
+            pfds.push_back(p);
+            owners.push_back(SIZE_MAX);
+        }
+        for (size_t i = 0; i < g_links.size(); i++) {
+            if (g_links[i].fd == -1) continue;
+            struct pollfd p;
+            p.fd = g_links[i].fd;
+            p.events = POLLIN;
+            p.revents = 0;
+            pfds.push_back(p);
+            owners.push_back(i);
+        }
+
+        int timeout = (int)std::max(0LL, next_round - now);
+        int ready = pfds.empty() ? 0 : poll(pfds.data(), (unsigned long)pfds.size(), timeout);
+        if (pfds.empty()) std::this_thread::sleep_for(std::chrono::milliseconds(timeout));
+
+        for (size_t i = 0; ready > 0 && i < pfds.size(); i++) {
+            if (!(pfds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+            if (owners[i] == SIZE_MAX) {
+                int fd = (int)accept(g_gossip_sock, NULL, NULL);
+                if (fd == -1) continue;
+                size_t inbound = 0;
+                for (const auto& l : g_links) {
+                    if (!l.outbound && l.fd != -1) inbound++;
+                }
+                if (inbound >= MAX_GOSSIP_INBOUND) {
+                    log_write(LOG_LEVEL_WARN, "Gossip already has %d inbound links, refusing another",
+                              MAX_GOSSIP_INBOUND);
+                    sock_close(fd);
+                    continue;
+                }
+                peer_link link;
+                link.fd = fd;
+                link.outbound = 0;
+                link.port = 0;
+                link.sent_seq = 0;
+                link.next_dial_ms = 0;
+                g_links.push_back(link);
+                if (open_link(g_links.back()) < 0) close_link(g_links.back());
+            } else {
+                read_link(g_links[owners[i]]);
+            }
+        }
+
+        /* Inbound links that went away are not redialed; forget them */
+        g_links.erase(std::remove_if(g_links.begin(), g_links.end(), [](const peer_link& l) {
+            return l.fd == -1 && !l.outbound;
+        }), g_links.end());
+
+        if (now_ms() >= next_round) {
+            for (auto& link : g_links) {
+                if (link.fd != -1 && link.authed) send_deltas(link);
+            }
+            trim_log();
+            save_state();
+            next_round = now_ms() + GOSSIP_INTERVAL_MS;
+        }
+    }
+}
+
+int crdt_start(uint32_t node_id, int listen_port) {
+    if (g_running.load()) return 0;
+    if (!g_state_set) g_state_path = prepare_default_state_dir() == 0 ? crdt_default_state_file() : "";
+    uint32_t saved_id = load_state(node_id);
+    g_node_id = node_id ? node_id : (saved_id ? saved_id : random_node_id());
+    {
+        std::lock_guard<std::mutex> lk(g_crdt_mutex);
+        g_own_dirty = 1;    // the id goes to the state file even before a win
+    }
+
+    if (listen_port > 0) {
+        struct sockaddr_in addr;
+        g_gossip_sock = (int)socket(AF_INET, SOCK_STREAM, 0);
+        if (g_gossip_sock == -1) return -1;
+        int opt = 1;
+        setsockopt(g_gossip_sock, SOL_SOCKET, SO_REUSEADDR, (const char*)&opt, sizeof(opt));
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(listen_port);
+        struct addrinfo hints;
+        struct addrinfo* res = NULL;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_flags = AI_PASSIVE;
+        if (getaddrinfo(g_bind.c_str(), NULL, &hints, &res) != 0 || !res) {
+            fprintf(stderr, "Invalid gossip bind address '%s'\n", g_bind.c_str());
+            sock_close(g_gossip_sock);
+            g_gossip_sock = -1;
+            return -1;
+        }
+        addr.sin_addr = ((struct sockaddr_in*)res->ai_addr)->sin_addr;
+        freeaddrinfo(res);
+        if (bind(g_gossip_sock, (struct sockaddr*)&addr, sizeof(addr)) == -1 ||
+            listen(g_gossip_sock, MAX_GOSSIP_PEERS) == -1) {
+            fprintf(stderr, "Failed to listen for gossip on port %d\n", listen_port);
+            sock_close(g_gossip_sock);
+            g_gossip_sock = -1;
+            return -1;
+        }
+    }
+
+    g_running = true;
+    /* Detached: the server exits from several places and never joins */
+    std::thread(gossip_thread_func).detach();
+    return 0;
+}
+
+void crdt_stop() {
+    if (!g_running.load()) return;
+    g_running = false;
+    save_state();
+}
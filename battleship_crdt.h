@@ -0,0 +1,74 @@
+#ifndef BATTLESHIP_CRDT_H
+#define BATTLESHIP_CRDT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Multi-node leaderboard as a grow-only counter map (G-Counter CRDT).
+   Every node only ever increments its own column of a nickname's row and
+   merges other columns by max, so boards converge in any order without a
+   central store. A background thread exchanges deltas with peers over TCP:
+   a full state when a link comes up, then only the entries that changed
+   since the last exchange. Several nodes can run on one machine by giving
+   each its own --gossip-port and --gossip-state.
+
+   The listener binds to loopback unless told otherwise. An inbound link
+   is sent nothing until its hello has been checked. With a shared secret
+   the hellos are a challenge/response: the listener sends a random
+   challenge, the dialer answers with its own nonce and an HMAC-SHA256 of
+   both under the secret, and the listener proves itself the same way.
+   The secret never goes over the wire, but the counts that follow are
+   not encrypted. Links that fail, or claim this node's id, are dropped,
+   and so are links still unauthenticated after GOSSIP_AUTH_TIMEOUT_MS.
+
+   A node's own column exists nowhere else until peers have it, so it is
+   kept in the state file together with the node id, and a restarted
+   node (without --node-id) comes back as the same node with its wins.
+   By default the file lives in a directory only this user can enter, and
+   a file that is a symlink, belongs to another user or is writable by
+   others is not loaded. */
+
+#define GOSSIP_INTERVAL_MS 500
+#define GOSSIP_RECONNECT_MS 2000
+#define MAX_GOSSIP_PEERS 16
+#define MAX_GOSSIP_INBOUND 16
+#define GOSSIP_AUTH_TIMEOUT_MS 5000
+#define GOSSIP_MAX_LINE 1024
+#define GOSSIP_BIND_DEFAULT "127.0.0.1"
+#define GOSSIP_SECRET_SIZE 128
+
+#ifdef _WIN32
+#define CRDT_STATE_DIR "."
+#else
+#define CRDT_STATE_DIR "/tmp/battleship-%u"    // %u: the effective uid
+#endif
+#define CRDT_STATE_NAME "crdt.state"
+
+/* Starts the gossip thread. listen_port 0 disables inbound links.
+   node_id 0 takes the id from the state file, or a random one on first
+   start. */
+int crdt_start(uint32_t node_id, int listen_port);
+// Adds an outbound peer ("host:port"); call before crdt_start.
+int crdt_add_peer(const char* host_port);
+// Address the listener binds to; call before crdt_start. Default loopback.
+void crdt_set_bind(const char* address);
+/* Reads the shared secret from the first line of path; call before
+   crdt_start. Returns 0, or -1 if it cannot be read or is empty. */
+int crdt_load_secret(const char* path);
+// Where the node id and own column are kept; NULL keeps nothing.
+void crdt_set_state_file(const char* path);
+// The state file used when crdt_set_state_file was not called.
+const char* crdt_default_state_file();
+// Saves the state file and stops the gossip thread.
+void crdt_stop();
+int crdt_enabled();
+uint32_t crdt_node_id();
+
+// Counts a win for this node.
+void crdt_increment(const char* nickname);
+
+// Merged totals as "nickname score" lines, best first. Returns the number
+// of entries written.
+int crdt_format(char* out, size_t out_size);
+
+#endif // BATTLESHIP_CRDT_H
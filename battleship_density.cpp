@@ -0,0 +1,469 @@
+#include "battleship_density.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#define DENSITY_MAX_LEN 4
+#define DENSITY_FREE_TRIES 16
+#define DENSITY_BOUND_SLACK 1e5
+#define DENSITY_MAX_CANDIDATES 200      // more than the 180 two-deck placements
+#define DENSITY_CLOCK_NODES 1024        // exact search nodes between deadline checks
+#define DENSITY_CLOCK_SAMPLES 16        // sampled fleets between deadline checks
+
+/* 100-bit board over the playable area, bit (i-1)*10 + (j-1) */
+struct bitboard {
+    uint64_t w[2];
+};
+
+static inline int bb_empty(struct bitboard a) {
+    return (a.w[0] | a.w[1]) == 0;
+}
+
+static inline struct bitboard bb_or(struct bitboard a, struct bitboard b) {
+    struct bitboard r = {{a.w[0] | b.w[0], a.w[1] | b.w[1]}};
+    return r;
+}
+
+static inline struct bitboard bb_andnot(struct bitboard a, struct bitboard b) {
+    struct bitboard r = {{a.w[0] & ~b.w[0], a.w[1] & ~b.w[1]}};
+    return r;
+}
+
+static inline int bb_intersects(struct bitboard a, struct bitboard b) {
+    return ((a.w[0] & b.w[0]) | (a.w[1] & b.w[1])) != 0;
+}
+
+static inline void bb_set(struct bitboard* a, int bit) {
+    a->w[bit >> 6] |= 1ull << (bit & 63);
+}
+
+static inline int bb_test(struct bitboard a, int bit) {
+    return (int)((a.w[bit >> 6] >> (bit & 63)) & 1);
+}
+
+static inline int bb_lowest(struct bitboard a) {
+    if (a.w[0]) return __builtin_ctzll(a.w[0]);
+    return 64 + __builtin_ctzll(a.w[1]);
+}
+
+// counts[bit]++ for every set bit
+static inline void bb_accumulate(struct bitboard a, uint32_t* counts) {
+    for (int k = 0; k < 2; k++) {
+        uint64_t w = a.w[k];
+        while (w) {
+            counts[k * 64 + __builtin_ctzll(w)]++;
+            w &= w - 1;
+        }
+    }
+}
+
+// Uniform in [0, n) without a division
+static inline unsigned int rand_below(unsigned int* rng, unsigned int n) {
+    return (unsigned int)(((uint64_t)xorshift32(rng) * n) >> 32);
+}
+
+/* Placement tables, built once */
+
+struct placement {
+    struct bitboard cells;
+    struct bitboard zone;       // cells plus their 8 neighbours: no other ship may enter
+};
+
+struct placement_tables {
+    std::vector<struct placement> by_len[DENSITY_MAX_LEN + 1];
+    // Indices into by_len[len] of placements covering a cell
+    std::vector<int> covering[DENSITY_MAX_LEN + 1][FIELD_PAYLOAD_SIZE];
+};
+
+static struct placement make_placement(int row, int col, int len, int vertical) {
+    struct placement p;
+    memset(&p, 0, sizeof(p));
+    for (int k = 0; k < len; k++) {
+        int r = row + (vertical ? k : 0);
+        int c = col + (vertical ? 0 : k);
+        bb_set(&p.cells, r * PLAYABLE_SIZE + c);
+        for (int dr = -1; dr <= 1; dr++) {
+            for (int dc = -1; dc <= 1; dc++) {
+                int nr = r + dr, nc = c + dc;
+                if (nr < 0 || nr >= PLAYABLE_SIZE || nc < 0 || nc >= PLAYABLE_SIZE) continue;
+                bb_set(&p.zone, nr * PLAYABLE_SIZE + nc);
+            }
+        }
+    }
+    return p;
+}
+
+static const struct placement_tables* tables() {
+    static const struct placement_tables* t = [] {
+        struct placement_tables* nt = new struct placement_tables;
+        for (int len = 1; len <= DENSITY_MAX_LEN; len++) {
+            for (int vertical = 0; vertical <= (len > 1 ? 1 : 0); vertical++) {
+                for (int row = 0; row + (vertical ? len : 1) <= PLAYABLE_SIZE; row++) {
+                    for (int col = 0; col + (vertical ? 1 : len) <= PLAYABLE_SIZE; col++) {
+                        struct placement p = make_placement(row, col, len, vertical);
+                        int index = (int)nt->by_len[len].size();
+                        nt->by_len[len].push_back(p);
+                        for (int bit = 0; bit < FIELD_PAYLOAD_SIZE; bit++) {
+                            if (bb_test(p.cells, bit)) nt->covering[len][bit].push_back(index);
+                        }
+                    }
+                }
+            }
+        }
+        return nt;
+    }();
+    return t;
+}
+
+/* What the fog tells us */
+
+struct density_problem {
+    struct bitboard blocked;    // misses, halos and sunk decks
+    struct bitboard live_hits;  // hits on ships still afloat
+    int remaining[DENSITY_MAX_LEN + 1];
+};
+
+static int known(Field fog, int i, int j) {
+    if (i < 1 || i > PLAYABLE_SIZE || j < 1 || j > PLAYABLE_SIZE) return 1;
+    return fog[i][j] != 0;
+}
+
+/* Splits hits into sunk ships and live ones. A straight run of hits whose
+   cells beyond both ends are known (or off the board) cannot grow, so all
+   of its decks are hit: it is sunk. Returns -1 for an impossible fog. */
+static int analyze_fog(Field fog, struct density_problem* pr) {
+    static const int fleet[DENSITY_MAX_LEN + 1] = {0, 4, 3, 2, 1};
+    memset(pr, 0, sizeof(*pr));
+    memcpy(pr->remaining, fleet, sizeof(fleet));
+
+    int seen[FIELD_SIZE][FIELD_SIZE];
+    memset(seen, 0, sizeof(seen));
+    for (int i = 1; i <= PLAYABLE_SIZE; i++) {
+        for (int j = 1; j <= PLAYABLE_SIZE; j++) {
+            int bit = (i - 1) * PLAYABLE_SIZE + (j - 1);
+            if (fog[i][j] != 0 && fog[i][j] != 3) bb_set(&pr->blocked, bit);
+        }
+    }
+
+    for (int i = 1; i <= PLAYABLE_SIZE; i++) {
+        for (int j = 1; j <= PLAYABLE_SIZE; j++) {
+            if (fog[i][j] != 3 || seen[i][j]) continue;
+            /* Runs extend right or down from their first cell */
+            int horizontal = j < PLAYABLE_SIZE && fog[i][j + 1] == 3;
+            int vertical = i < PLAYABLE_SIZE && fog[i + 1][j] == 3;
+            if (horizontal && vertical) return -1;
+            int di = vertical ? 1 : 0, dj = horizontal ? 1 : 0;
+            int len = 0;
+            while (i + di * len <= PLAYABLE_SIZE && j + dj * len <= PLAYABLE_SIZE &&
+                   fog[i + di * len][j + dj * len] == 3) {
+                seen[i + di * len][j + dj * len] = 1;
+                len++;
+                if (!horizontal && !vertical) break;
+            }
+            if (len > DENSITY_MAX_LEN) return -1;
+
+            int closed;
+            if (horizontal || vertical) {
+                closed = known(fog, i - di, j - dj) && known(fog, i + di * len, j + dj * len);
+            } else {
+                closed = known(fog, i - 1, j) && known(fog, i + 1, j) &&
+                         known(fog, i, j - 1) && known(fog, i, j + 1);
+            }
+            if (closed) {
+                /* Nothing may touch a sunk ship, halo marked or not */
+                struct placement sunk = make_placement(i - 1, j - 1, len, vertical);
+                pr->blocked = bb_or(pr->blocked, sunk.zone);
+            } else {
+                for (int k = 0; k < len; k++) bb_set(&pr->live_hits, (i + di * k - 1) * PLAYABLE_SIZE + (j + dj * k - 1));
+            }
+            if (closed && --pr->remaining[len] < 0) return -1;
+        }
+    }
+    return 0;
+}
+
+static long long steady_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int past_deadline(long long deadline_us) {
+    return deadline_us > 0 && steady_us() >= deadline_us;
+}
+
+/* Fleets cannot outnumber the ways to place each afloat ship on its own.
+   Ships keeping apart prunes that bound by about five orders of magnitude
+   in practice; beyond that the exact search cannot finish in budget. */
+static double fleet_upper_bound(const struct placement_tables* t, const struct density_problem* pr) {
+    double bound = 1;
+    for (int len = 1; len <= DENSITY_MAX_LEN; len++) {
+        int free_spots = 0;
+        for (const struct placement& p : t->by_len[len]) {
+            if (!bb_intersects(p.cells, pr->blocked)) free_spots++;
+        }
+        for (int n = 0; n < pr->remaining[len]; n++) bound *= (double)(free_spots - n) / (n + 1);
+    }
+    return bound;
+}
+
+/* Exact enumeration: every hit is claimed by the first ship placed over
+   the lowest uncovered hit, and ships placed after that go in increasing
+   table order per length, so each fleet is visited exactly once. */
+
+struct exact_search {
+    const struct placement_tables* t;
+    long nodes;
+    long node_limit;
+    long long deadline_us;
+    int aborted;
+    int timed_out;
+    double fleets;
+    uint32_t counts[FIELD_PAYLOAD_SIZE];
+    struct bitboard placed[10];
+    int depth;
+};
+
+/* Counts a node; 0 once the node limit or the deadline stops the search */
+static int exact_step(struct exact_search* s) {
+    if (++s->nodes > s->node_limit ||
+        (s->nodes % DENSITY_CLOCK_NODES == 0 && past_deadline(s->deadline_us))) {
+        s->timed_out = s->nodes <= s->node_limit;
+        s->aborted = 1;
+        return 0;
+    }
+    return 1;
+}
+
+static void exact_place_free(struct exact_search* s, struct bitboard blocked,
+                             int* remaining, int len, int first) {
+    while (len > 0 && remaining[len] == 0) {
+        len--;
+        first = 0;
+    }
+    if (len == 0) {
+        s->fleets += 1;
+        for (int k = 0; k < s->depth; k++) bb_accumulate(s->placed[k], s->counts);
+        return;
+    }
+    const std::vector<struct placement>& list = s->t->by_len[len];
+    for (int idx = first; idx < (int)list.size() && !s->aborted; idx++) {
+        if (bb_intersects(list[idx].cells, blocked)) continue;
+        if (!exact_step(s)) return;
+        remaining[len]--;
+        s->placed[s->depth++] = list[idx].cells;
+        exact_place_free(s, bb_or(blocked, list[idx].zone), remaining, len, idx + 1);
+        s->depth--;
+        remaining[len]++;
+    }
+}
+
+static void exact_cover_hits(struct exact_search* s, struct bitboard blocked,
+                             struct bitboard uncovered, int* remaining) {
+    if (bb_empty(uncovered)) {
+        exact_place_free(s, blocked, remaining, DENSITY_MAX_LEN, 0);
+        return;
+    }
+    int hit = bb_lowest(uncovered);
+    for (int len = 1; len <= DENSITY_MAX_LEN && !s->aborted; len++) {
+        if (remaining[len] == 0) continue;
+        const std::vector<struct placement>& list = s->t->by_len[len];
+        for (int idx : s->t->covering[len][hit]) {
+            const struct placement* p = &list[idx];
+            if (bb_intersects(p->cells, blocked)) continue;
+            // Its neighbourhood may not swallow a hit it doesn't cover
+            if (bb_intersects(bb_andnot(p->zone, p->cells), uncovered)) continue;
+            if (!exact_step(s)) return;
+            remaining[len]--;
+            s->placed[s->depth++] = p->cells;
+            exact_cover_hits(s, bb_or(blocked, p->zone), bb_andnot(uncovered, p->cells), remaining);
+            s->depth--;
+            remaining[len]++;
+            if (s->aborted) return;
+        }
+    }
+}
+
+/* Sampling: cover the hits first, then drop the other ships at random
+   free spots. Each step is uniform over the legal choices; the result is
+   a sequential estimate rather than an exactly uniform draw. */
+
+struct sampler {
+    const struct placement_tables* t;
+    const struct density_problem* pr;
+    unsigned int rng;
+    long long deadline_us;
+    std::atomic<int>* timed_out;        // shared by the sampling threads
+    double fleets;
+    uint32_t counts[FIELD_PAYLOAD_SIZE];
+};
+
+static int sample_fleet(struct sampler* s) {
+    struct bitboard blocked = s->pr->blocked;
+    struct bitboard uncovered = s->pr->live_hits;
+    struct bitboard fleet = {{0, 0}};
+    int remaining[DENSITY_MAX_LEN + 1];
+    memcpy(remaining, s->pr->remaining, sizeof(remaining));
+
+    const struct placement* cand[DENSITY_MAX_CANDIDATES];
+    int cand_len[DENSITY_MAX_CANDIDATES];
+    while (!bb_empty(uncovered)) {
+        int hit = bb_lowest(uncovered);
+        int count = 0;
+        for (int len = 1; len <= DENSITY_MAX_LEN; len++) {
+            if (remaining[len] == 0) continue;
+            for (int idx : s->t->covering[len][hit]) {
+                const struct placement* p = &s->t->by_len[len][idx];
+                if (bb_intersects(p->cells, blocked)) continue;
+                if (bb_intersects(bb_andnot(p->zone, p->cells), uncovered)) continue;
+                cand[count] = p;
+                cand_len[count++] = len;
+            }
+        }
+        if (count == 0) return 0;
+        int pick = (int)rand_below(&s->rng, (unsigned)count);
+        const struct placement* choice = cand[pick];
+        remaining[cand_len[pick]]--;
+        blocked = bb_or(blocked, choice->zone);
+        uncovered = bb_andnot(uncovered, choice->cells);
+        fleet = bb_or(fleet, choice->cells);
+    }
+
+    for (int len = DENSITY_MAX_LEN; len >= 1; len--) {
+        const std::vector<struct placement>& list = s->t->by_len[len];
+        for (int n = 0; n < remaining[len]; n++) {
+            const struct placement* choice = NULL;
+            /* Open boards: a few random probes find a spot quickly */
+            for (int tries = 0; tries < DENSITY_FREE_TRIES && !choice; tries++) {
+                const struct placement* p = &list[rand_below(&s->rng, (unsigned)list.size())];
+                if (!bb_intersects(p->cells, blocked)) choice = p;
+            }
+            if (!choice) {
+                int count = 0;
+                for (const struct placement& p : list) {
+                    if (!bb_intersects(p.cells, blocked)) cand[count++] = &p;
+                }
+                if (count == 0) return 0;
+                choice = cand[rand_below(&s->rng, (unsigned)count)];
+            }
+            blocked = bb_or(blocked, choice->zone);
+            fleet = bb_or(fleet, choice->cells);
+        }
+    }
+    bb_accumulate(fleet, s->counts);
+    s->fleets += 1;
+    return 1;
+}
+
+static void run_sampler(struct sampler* s, int samples) {
+    for (int n = 0; n < samples; n++) {
+        if (n % DENSITY_CLOCK_SAMPLES == DENSITY_CLOCK_SAMPLES - 1 &&
+            (*s->timed_out || past_deadline(s->deadline_us))) {
+            *s->timed_out = 1;
+            return;
+        }
+        sample_fleet(s);
+    }
+}
+
+void density_default_options(struct density_options* opt) {
+    opt->exact_node_limit = 5000;
+    opt->samples = 1000;
+    opt->threads = 1;
+    opt->seed = 2463534242u;
+    opt->deadline_us = 0;
+}
+
+int density_compute(Field fog, const struct density_options* opt, struct density_result* out) {
+    struct density_problem pr;
+    memset(out, 0, sizeof(*out));
+    if (analyze_fog(fog, &pr) != 0) return -1;
+    memcpy(out->remaining, pr.remaining, sizeof(out->remaining));
+
+    const struct placement_tables* t = tables();
+    const uint32_t* counts = NULL;
+    double fleets = 0;
+
+    struct exact_search* ex = new struct exact_search;
+    memset(ex, 0, sizeof(*ex));
+    ex->t = t;
+    ex->node_limit = opt->exact_node_limit;
+    ex->deadline_us = opt->deadline_us;
+    if (opt->exact_node_limit > 0 && fleet_upper_bound(t, &pr) > opt->exact_node_limit * DENSITY_BOUND_SLACK) {
+        ex->aborted = 1;
+    } else if (opt->exact_node_limit > 0) {
+        int remaining[DENSITY_MAX_LEN + 1];
+        memcpy(remaining, pr.remaining, sizeof(remaining));
+        exact_cover_hits(ex, pr.blocked, pr.live_hits, remaining);
+    }
+
+    std::vector<struct sampler> samplers;
+    std::atomic<int> sampling_timed_out{0};
+    if (ex->timed_out) {
+        /* Out of time: sampling now would only run further past it */
+        out->timed_out = 1;
+    } else if (opt->exact_node_limit > 0 && !ex->aborted) {
+        out->exact = 1;
+        counts = ex->counts;
+        fleets = ex->fleets;
+    } else {
+        int threads = opt->threads > 1 ? opt->threads : 1;
+        samplers.resize(threads);
+        for (int k = 0; k < threads; k++) {
+            memset(samplers[k].counts, 0, sizeof(samplers[k].counts));
+            samplers[k].t = t;
+            samplers[k].pr = &pr;
+            samplers[k].fleets = 0;
+            samplers[k].deadline_us = opt->deadline_us;
+            samplers[k].timed_out = &sampling_timed_out;
+            samplers[k].rng = (opt->seed ^ (0x9e3779b9u * (unsigned)(k + 1))) | 1;
+        }
+        std::vector<std::thread> workers;
+        for (int k = 1; k < threads; k++) {
+            int share = opt->samples / threads;
+            workers.emplace_back(run_sampler, &samplers[k], share);
+        }
+        run_sampler(&samplers[0], opt->samples - (opt->samples / threads) * (threads - 1));
+        for (std::thread& w : workers) w.join();
+        for (int k = 1; k < threads; k++) {
+            for (int c = 0; c < FIELD_PAYLOAD_SIZE; c++) samplers[0].counts[c] += samplers[k].counts[c];
+            samplers[0].fleets += samplers[k].fleets;
+        }
+        counts = samplers[0].counts;
+        fleets = samplers[0].fleets;
+        out->timed_out = sampling_timed_out;
+    }
+
+    out->fleets = fleets;
+    int rc = fleets > 0 ? 0 : -1;
+    if (rc == 0) {
+        float scale = (float)(1.0 / fleets);
+        for (int c = 0; c < FIELD_PAYLOAD_SIZE; c++) out->prob[c] = counts[c] * scale;
+    }
+    delete ex;
+    return rc;
+}
+
+int density_best_cell(Field fog, const struct density_result* r, unsigned int* rng, int* x, int* y) {
+    float best = -1;
+    int seen = 0;
+    for (int i = 1; i <= PLAYABLE_SIZE; i++) {
+        for (int j = 1; j <= PLAYABLE_SIZE; j++) {
+            if (fog[i][j] != 0) continue;
+            float p = r->prob[(i - 1) * PLAYABLE_SIZE + (j - 1)];
+            if (p > best + 1e-6f) {
+                best = p;
+                seen = 0;
+            }
+            if (p >= best - 1e-6f && xorshift32(rng) % (unsigned)++seen == 0) {
+                *x = i;
+                *y = j;
+            }
+        }
+    }
+    return best >= 0;
+}
@@ -0,0 +1,44 @@
+#ifndef BATTLESHIP_DENSITY_H
+#define BATTLESHIP_DENSITY_H
+
+#include "battleship.h"
+
+/* Probability-density targeting. Given the shooter's fog of the enemy
+   field (build_fog_field: 0 unknown, 2 miss or halo, 3 hit), works out
+   which ships are already sunk, which hits still belong to afloat ships,
+   and how likely every cell is to hold a deck over all fleets consistent
+   with what has been seen.
+
+   The count is exact (every consistent fleet enumerated) while the search
+   stays under exact_node_limit nodes; otherwise it samples that many
+   random consistent fleets, optionally on several threads. Boards are
+   kept as 100-bit bitboards, so each placement test is two word ANDs.
+   Past the deadline sampling keeps the fleets drawn so far, while an
+   unfinished exact count is dropped. */
+
+struct density_options {
+    long exact_node_limit;  // search nodes before switching to sampling, 0: always sample
+    int samples;            // fleets drawn when sampling
+    int threads;            // sampling threads (1: the calling thread only)
+    unsigned int seed;
+    long long deadline_us;  // steady_clock time to give up at, 0: none
+};
+
+struct density_result {
+    float prob[FIELD_PAYLOAD_SIZE];     // row-major over the playable area
+    int exact;
+    int timed_out;                      // cut short by the deadline
+    double fleets;                      // consistent fleets counted or sampled
+    int remaining[5];                   // afloat ships by length (index 1..4)
+};
+
+void density_default_options(struct density_options* opt);
+
+/* Returns 0, or -1 when no fleet fits the fog (or sampling found none) */
+int density_compute(Field fog, const struct density_options* opt, struct density_result* out);
+
+/* The most likely unknown cell, ties broken with rng; 1-based indices.
+   Returns 0 when no unknown cell is left. */
+int density_best_cell(Field fog, const struct density_result* r, unsigned int* rng, int* x, int* y);
+
+#endif // BATTLESHIP_DENSITY_H
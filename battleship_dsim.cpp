@@ -0,0 +1,555 @@
+/* Deterministic simulation: the real server core (battleship_server.cpp
+   built with BATTLESHIP_SERVER_NO_MAIN) and a crowd of bots in one
+   process, joined by a simulated network and driven by a virtual clock.
+   Every random choice (placement, tokens, latency, think time, churn) is
+   derived from --seed and time only advances from event to event, so a
+   seed always replays the same event sequence, as fast as the CPU allows.
+   The run ends with a digest of that sequence; --trace writes it out. */
+
+#include "battleship.h"
+#include "battleship_server.h"
+#include "battleship_windows.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <queue>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define NULL_DEVICE "NUL"
+#else
+#define NULL_DEVICE "/dev/null"
+#endif
+
+#define SIM_TICK_US 250000          // server_tick() cadence, like the poll timeout
+#define SIM_FD_BASE 1000            // virtual connection numbers start here
+#define SIM_RETRY_US 100000
+
+enum {
+    EV_CONNECT = 0,     // SYN reaches the server
+    EV_TO_SERVER,       // bot -> server packet arrives
+    EV_DROP,            // bot's FIN reaches the server
+    EV_TO_BOT,          // server -> bot packet arrives
+    EV_CLOSED,          // server's FIN reaches the bot
+    EV_TIMER,           // bot think time or reconnect delay is over
+    EV_TICK             // server timers
+};
+
+static const char* const k_event_names[] = {
+    "CONNECT", "TO_SERVER", "DROP", "TO_BOT", "CLOSED", "TIMER", "TICK"
+};
+
+struct sim_event {
+    long long at_us;
+    unsigned long long seq;     // FIFO among events due at the same time
+    int kind;
+    int bot;
+    int fd;
+    int arg;                    // packet index, or timer generation
+};
+
+struct event_later {
+    bool operator()(const struct sim_event& a, const struct sim_event& b) const {
+        if (a.at_us != b.at_us) return a.at_us > b.at_us;
+        return a.seq > b.seq;
+    }
+};
+
+// One simulated TCP connection; each direction is FIFO
+struct sim_conn {
+    int bot;
+    int server_open;
+    int bot_open;
+    long long last_up_us;
+    long long last_down_us;
+};
+
+enum {
+    TIMER_NONE = 0,
+    TIMER_SHOOT,
+    TIMER_CONNECT
+};
+
+struct sim_bot {
+    int id;
+    int fd;                     // current connection, -1 when offline
+    unsigned int rng;
+    unsigned char order[FIELD_PAYLOAD_SIZE];
+    int next_shot;
+    char token[RESUME_TOKEN_SIZE];
+    int resuming;
+    long long shot_sent_us;
+    int timer;
+    int timer_gen;
+};
+
+struct dsim_config {
+    int bots;
+    double duration_sec;
+    double ramp_sec;
+    int think_ms;
+    int latency_us;
+    int jitter_us;
+    double churn;
+    int resume_grace_sec;
+    unsigned long long seed;
+    const char* trace_path;
+    int verbose;
+    int json;
+};
+
+struct command_cost {
+    long long count;
+    long long total_ns;
+};
+
+static struct dsim_config g_cfg;
+static long long g_now_us = 0;
+static unsigned long long g_seq = 0;
+static unsigned int g_net_rng;
+static std::priority_queue<struct sim_event, std::vector<struct sim_event>, event_later> g_events;
+static std::vector<packet_t> g_packets;
+static std::vector<int> g_free_packets;
+static std::vector<struct sim_conn> g_conns;
+static std::vector<struct sim_bot> g_bots;
+static FILE* g_trace = NULL;
+static uint64_t g_digest = 1469598103934665603ull;
+
+static long long g_games = 0;
+static long long g_events_run = 0;
+static long long g_drops = 0;
+static std::vector<long long> g_turn_rtt_us;
+static std::vector<long long> g_handle_ns;
+static std::map<std::string, struct command_cost> g_cost_by_command;
+
+static uint64_t splitmix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+static void digest_bytes(const void* data, size_t len) {
+    const unsigned char* p = (const unsigned char*)data;
+    for (size_t i = 0; i < len; i++) {
+        g_digest ^= p[i];
+        g_digest *= 1099511628211ull;
+    }
+}
+
+static long long sim_clock_ms() {
+    return g_now_us / 1000;
+}
+
+static void schedule(long long at_us, int kind, int bot, int fd, int arg) {
+    struct sim_event ev;
+    ev.at_us = at_us;
+    ev.seq = g_seq++;
+    ev.kind = kind;
+    ev.bot = bot;
+    ev.fd = fd;
+    ev.arg = arg;
+    g_events.push(ev);
+}
+
+static int store_packet(const packet_t* p) {
+    int idx;
+    if (!g_free_packets.empty()) {
+        idx = g_free_packets.back();
+        g_free_packets.pop_back();
+        g_packets[idx] = *p;
+    } else {
+        idx = (int)g_packets.size();
+        g_packets.push_back(*p);
+    }
+    return idx;
+}
+
+static struct sim_conn* find_conn(int fd) {
+    int idx = fd - SIM_FD_BASE;
+    if (idx < 0 || idx >= (int)g_conns.size()) return NULL;
+    return &g_conns[idx];
+}
+
+static long long one_way_delay() {
+    long long jitter = g_cfg.jitter_us > 0 ? xorshift32(&g_net_rng) % (unsigned)(g_cfg.jitter_us + 1) : 0;
+    return g_cfg.latency_us + jitter;
+}
+
+static long long next_up(struct sim_conn* c) {
+    c->last_up_us = std::max(g_now_us + one_way_delay(), c->last_up_us);
+    return c->last_up_us;
+}
+
+static long long next_down(struct sim_conn* c) {
+    c->last_down_us = std::max(g_now_us + one_way_delay(), c->last_down_us);
+    return c->last_down_us;
+}
+
+/* Server side of the simulated network */
+
+static int net_server_send(int fd, const packet_t* p) {
+    struct sim_conn* c = find_conn(fd);
+    if (!c || !c->server_open) return -1;
+    schedule(next_down(c), EV_TO_BOT, c->bot, fd, store_packet(p));
+    return PACKET_SIZE;
+}
+
+static void net_server_close(int fd) {
+    struct sim_conn* c = find_conn(fd);
+    if (!c || !c->server_open) return;
+    c->server_open = 0;
+    schedule(next_down(c), EV_CLOSED, c->bot, fd, 0);
+}
+
+/* Bots */
+
+static void bot_send(struct sim_bot* b, const char* command, const char* arg1, const char* arg2) {
+    struct sim_conn* c = find_conn(b->fd);
+    if (!c || !c->bot_open) return;
+    packet_t p;
+    memset(&p, 0, sizeof(p));
+    if (command) strncpy(p.command, command, PACKET_COMMAND_SIZE - 1);
+    if (arg1) strncpy(p.arg1, arg1, PACKET_ARG_SIZE_1 - 1);
+    if (arg2) strncpy(p.arg2, arg2, PACKET_ARG_SIZE_2 - 1);
+    schedule(next_up(c), EV_TO_SERVER, b->id, b->fd, store_packet(&p));
+}
+
+static void bot_set_timer(struct sim_bot* b, int timer, long long at_us) {
+    b->timer = timer;
+    b->timer_gen++;
+    schedule(at_us, EV_TIMER, b->id, -1, b->timer_gen);
+}
+
+static void bot_offline(struct sim_bot* b, long long retry_at_us, int resume) {
+    b->fd = -1;
+    b->resuming = resume && b->token[0];
+    if (!b->resuming) b->token[0] = '\0';
+    b->shot_sent_us = 0;
+    bot_set_timer(b, TIMER_CONNECT, retry_at_us);
+}
+
+static void bot_connect(struct sim_bot* b) {
+    struct sim_conn c;
+    c.bot = b->id;
+    c.server_open = 0;
+    c.bot_open = 1;
+    c.last_up_us = 0;
+    c.last_down_us = 0;
+    g_conns.push_back(c);
+    b->fd = SIM_FD_BASE + (int)g_conns.size() - 1;
+    b->timer = TIMER_NONE;
+
+    schedule(next_up(&g_conns.back()), EV_CONNECT, b->id, b->fd, 0);
+    if (b->resuming) {
+        bot_send(b, "RESUME", b->token, NULL);
+        return;
+    }
+    char nick[32];
+    snprintf(nick, sizeof(nick), "bot%d", b->id);
+    for (int i = 0; i < FIELD_PAYLOAD_SIZE; i++) b->order[i] = (unsigned char)i;
+    for (int i = FIELD_PAYLOAD_SIZE - 1; i > 0; i--) {
+        std::swap(b->order[i], b->order[xorshift32(&b->rng) % (unsigned)(i + 1)]);
+    }
+    b->next_shot = 0;
+    bot_send(b, "SET_NICK", nick, NULL);
+    bot_send(b, "JOIN_SESSION", "auto", NULL);
+}
+
+// Client-side drop: the FIN reaches the server one latency later
+static void bot_drop(struct sim_bot* b) {
+    struct sim_conn* c = find_conn(b->fd);
+    if (c) {
+        c->bot_open = 0;
+        schedule(next_up(c), EV_DROP, b->id, b->fd, 0);
+    }
+    g_drops++;
+    bot_offline(b, g_now_us + SIM_RETRY_US, 1);
+}
+
+static void bot_schedule_shot(struct sim_bot* b) {
+    long long think = g_cfg.think_ms > 0 ? xorshift32(&b->rng) % (unsigned)(2 * g_cfg.think_ms * 1000 + 1) : 0;
+    bot_set_timer(b, TIMER_SHOOT, g_now_us + think);
+}
+
+static void bot_shoot(struct sim_bot* b) {
+    if (b->next_shot >= FIELD_PAYLOAD_SIZE) return;
+    if (g_cfg.churn > 0 && b->token[0] &&
+        (xorshift32(&b->rng) % 1000000) < (unsigned)(g_cfg.churn * 1000000)) {
+        bot_drop(b);
+        return;
+    }
+    static const char rows[] = "ABCDEFGHIK";
+    int cell = b->order[b->next_shot++];
+    char coord[8];
+    snprintf(coord, sizeof(coord), "%c%d", rows[cell / PLAYABLE_SIZE], cell % PLAYABLE_SIZE + 1);
+    bot_send(b, "SHOT", coord, NULL);
+    b->shot_sent_us = g_now_us;
+}
+
+static void bot_handle(struct sim_bot* b, const packet_t* p) {
+    const char* cmd = p->command;
+    if (strcmp(cmd, "PLACEMENT_START") == 0) {
+        bot_send(b, "PLACEMENT_CHOICE", "auto", NULL);
+    } else if (strcmp(cmd, "RESUME_TOKEN") == 0) {
+        strncpy(b->token, p->arg1, sizeof(b->token) - 1);
+        b->token[sizeof(b->token) - 1] = '\0';
+    } else if (strcmp(cmd, "YOUR_TURN") == 0) {
+        bot_schedule_shot(b);
+    } else if (strcmp(cmd, "SHOT_RESULT") == 0) {
+        if (b->shot_sent_us) {
+            g_turn_rtt_us.push_back(g_now_us - b->shot_sent_us);
+            b->shot_sent_us = 0;
+        }
+    } else if (strcmp(cmd, "STATE_SYNC") == 0) {
+        int session_id, player, turn;
+        char state;
+        b->resuming = 0;
+        if (sscanf(p->arg2, "%d;%d;%d;%c", &session_id, &player, &turn, &state) == 4) {
+            if (state == 'G' && turn == player) bot_schedule_shot(b);
+            else if (state == 'P') bot_send(b, "PLACEMENT_CHOICE", "auto", NULL);
+        }
+    } else if (strcmp(cmd, "GAME_OVER") == 0 || strcmp(cmd, "OPPONENT_DISCONNECTED") == 0 ||
+               strcmp(cmd, "ERROR") == 0) {
+        if (strcmp(cmd, "GAME_OVER") == 0 && strcmp(p->arg1, "WIN") == 0) g_games++;
+        struct sim_conn* c = find_conn(b->fd);
+        if (c) {
+            c->bot_open = 0;
+            schedule(next_up(c), EV_DROP, b->id, b->fd, 0);
+        }
+        long long delay = strcmp(cmd, "ERROR") == 0 ? SIM_RETRY_US : 0;
+        bot_offline(b, g_now_us + delay, 0);
+    }
+}
+
+/* Event loop */
+
+static void trace_event(const struct sim_event* ev, const packet_t* p) {
+    digest_bytes(&ev->at_us, sizeof(ev->at_us));
+    digest_bytes(&ev->kind, sizeof(ev->kind));
+    digest_bytes(&ev->bot, sizeof(ev->bot));
+    digest_bytes(&ev->fd, sizeof(ev->fd));
+    if (p) {
+        digest_bytes(p->command, strnlen(p->command, PACKET_COMMAND_SIZE));
+        digest_bytes(p->arg1, strnlen(p->arg1, PACKET_ARG_SIZE_1));
+        digest_bytes(p->arg2, strnlen(p->arg2, PACKET_ARG_SIZE_2));
+    }
+    if (g_trace) {
+        fprintf(g_trace, "%lld %s bot=%d fd=%d", ev->at_us, k_event_names[ev->kind], ev->bot, ev->fd);
+        if (p) {
+            fprintf(g_trace, " %s [%.*s] [%.*s]", p->command,
+                    (int)strcspn(p->arg1, "\n"), p->arg1, (int)strcspn(p->arg2, "\n"), p->arg2);
+        }
+        fputc('\n', g_trace);
+    }
+}
+
+static void run_event(const struct sim_event* ev) {
+    struct sim_conn* c = find_conn(ev->fd);
+    struct sim_bot* b = (ev->bot >= 0) ? &g_bots[ev->bot] : NULL;
+    if (ev->kind == EV_TIMER && ev->arg != b->timer_gen) return;   // superseded
+
+    /* Copy out: handlers send packets, which may grow g_packets */
+    packet_t pkt;
+    const packet_t* p = NULL;
+    if (ev->kind == EV_TO_SERVER || ev->kind == EV_TO_BOT) {
+        pkt = g_packets[ev->arg];
+        g_free_packets.push_back(ev->arg);
+        p = &pkt;
+    }
+    trace_event(ev, p);
+    g_events_run++;
+
+    switch (ev->kind) {
+    case EV_CONNECT:
+        c->server_open = 1;
+        if (server_attach(ev->fd) == -1) net_server_close(ev->fd);
+        break;
+    case EV_TO_SERVER:
+        if (c->server_open) {
+            auto start = std::chrono::steady_clock::now();
+            server_receive(ev->fd, p);
+            long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+            g_handle_ns.push_back(ns);
+            struct command_cost& cost = g_cost_by_command[p->command];
+            cost.count++;
+            cost.total_ns += ns;
+        }
+        break;
+    case EV_DROP:
+        if (c->server_open) server_detach(ev->fd);
+        c->server_open = 0;
+        break;
+    case EV_TO_BOT:
+        if (b->fd == ev->fd && c->bot_open) bot_handle(b, p);
+        break;
+    case EV_CLOSED:
+        if (b->fd == ev->fd && c->bot_open) {
+            c->bot_open = 0;
+            bot_offline(b, g_now_us + SIM_RETRY_US, 1);
+        }
+        break;
+    case EV_TIMER:
+        if (b->timer == TIMER_CONNECT) bot_connect(b);
+        else if (b->timer == TIMER_SHOOT) {
+            b->timer = TIMER_NONE;
+            bot_shoot(b);
+        }
+        break;
+    case EV_TICK:
+        server_tick();
+        schedule(g_now_us + SIM_TICK_US, EV_TICK, -1, -1, 0);
+        break;
+    }
+}
+
+static long long pct(std::vector<long long>& v, double q) {
+    if (v.empty()) return 0;
+    size_t idx = (size_t)(q * (double)(v.size() - 1) + 0.5);
+    return v[std::min(idx, v.size() - 1)];
+}
+
+static void print_usage(const char* prog) {
+    printf("Usage: %s [--seed N] [--bots N] [--duration SEC] [--ramp SEC] [--think MS]\n"
+           "          [--latency US] [--jitter US] [--churn PROB] [--resume-grace SEC]\n"
+           "          [--trace PATH] [--verbose] [--json]\n", prog);
+}
+
+int main(int argc, char* argv[]) {
+    g_cfg.bots = MAX_CLIENTS < 16 ? MAX_CLIENTS : 16;
+    g_cfg.duration_sec = 60;
+    g_cfg.ramp_sec = 1;
+    g_cfg.think_ms = 50;
+    g_cfg.latency_us = 500;
+    g_cfg.jitter_us = 200;
+    g_cfg.churn = 0;
+    g_cfg.resume_grace_sec = 60;
+    g_cfg.seed = 1;
+    g_cfg.trace_path = NULL;
+    g_cfg.verbose = 0;
+    g_cfg.json = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char* a = argv[i];
+        const char* v = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (strcmp(a, "--seed") == 0 && v) { g_cfg.seed = strtoull(v, NULL, 10); i++; }
+        else if (strcmp(a, "--bots") == 0 && v) { g_cfg.bots = atoi(v); i++; }
+        else if (strcmp(a, "--duration") == 0 && v) { g_cfg.duration_sec = atof(v); i++; }
+        else if (strcmp(a, "--ramp") == 0 && v) { g_cfg.ramp_sec = atof(v); i++; }
+        else if (strcmp(a, "--think") == 0 && v) { g_cfg.think_ms = atoi(v); i++; }
+        else if (strcmp(a, "--latency") == 0 && v) { g_cfg.latency_us = atoi(v); i++; }
+        else if (strcmp(a, "--jitter") == 0 && v) { g_cfg.jitter_us = atoi(v); i++; }
+        else if (strcmp(a, "--churn") == 0 && v) { g_cfg.churn = atof(v); i++; }
+        else if (strcmp(a, "--resume-grace") == 0 && v) { g_cfg.resume_grace_sec = atoi(v); i++; }
+        else if (strcmp(a, "--trace") == 0 && v) { g_cfg.trace_path = v; i++; }
+        else if (strcmp(a, "--verbose") == 0) { g_cfg.verbose = 1; }
+        else if (strcmp(a, "--json") == 0) { g_cfg.json = 1; }
+        else { print_usage(argv[0]); return strcmp(a, "--help") == 0 ? 0 : 1; }
+    }
+    if (g_cfg.bots <= 0 || g_cfg.bots > MAX_CLIENTS) {
+        fprintf(stderr, "--bots must be 1..%d (raise BATTLESHIP_MAX_CLIENTS for more)\n", MAX_CLIENTS);
+        return 1;
+    }
+    if (g_cfg.trace_path) {
+        g_trace = fopen(g_cfg.trace_path, "w");
+        if (!g_trace) {
+            fprintf(stderr, "Cannot open trace '%s'\n", g_cfg.trace_path);
+            return 1;
+        }
+    }
+
+    /* Independent streams for the server, the network and each bot */
+    uint64_t root = splitmix64(g_cfg.seed);
+    g_net_rng = (unsigned int)splitmix64(root ^ 1) | 1u;
+
+    struct server_transport transport = {net_server_send, net_server_close};
+    server_set_transport(&transport);
+    server_set_clock(sim_clock_ms);
+    server_set_seed((unsigned int)splitmix64(root ^ 2));
+    server_set_resume_grace(g_cfg.resume_grace_sec);
+    server_set_record_wins(0);
+    server_reset();
+
+    g_bots.resize(g_cfg.bots);
+    for (int i = 0; i < g_cfg.bots; i++) {
+        struct sim_bot* b = &g_bots[i];
+        memset(b, 0, sizeof(*b));
+        b->id = i;
+        b->fd = -1;
+        b->rng = (unsigned int)splitmix64(root ^ (0x100000000ull + (uint64_t)i)) | 1u;
+        bot_set_timer(b, TIMER_CONNECT, (long long)(g_cfg.ramp_sec * 1e6 * i / g_cfg.bots));
+    }
+    schedule(SIM_TICK_US, EV_TICK, -1, -1, 0);
+
+    // The server logs every connection; keep that out of the report
+    int saved_stdout = -1;
+    if (!g_cfg.verbose) {
+        fflush(stdout);
+        int devnull = open(NULL_DEVICE, O_WRONLY);
+        if (devnull >= 0) {
+            saved_stdout = dup(fileno(stdout));
+            dup2(devnull, fileno(stdout));
+            close(devnull);
+        }
+    }
+
+    long long end_us = (long long)(g_cfg.duration_sec * 1e6);
+    auto wall_start = std::chrono::steady_clock::now();
+    while (!g_events.empty() && g_events.top().at_us <= end_us) {
+        struct sim_event ev = g_events.top();
+        g_events.pop();
+        g_now_us = ev.at_us;
+        run_event(&ev);
+    }
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+
+    if (saved_stdout >= 0) {
+        fflush(stdout);
+        dup2(saved_stdout, fileno(stdout));
+        close(saved_stdout);
+    }
+    if (g_trace) fclose(g_trace);
+
+    std::sort(g_turn_rtt_us.begin(), g_turn_rtt_us.end());
+    std::sort(g_handle_ns.begin(), g_handle_ns.end());
+    double virtual_sec = end_us / 1e6;
+
+    if (g_cfg.json) {
+        printf("{\"seed\": %llu, \"bots\": %d, \"virtual_s\": %.3f, \"wall_s\": %.3f, "
+               "\"events\": %lld, \"games\": %lld, \"drops\": %lld, \"turns\": %zu, "
+               "\"turn_rtt_p50_us\": %lld, \"turn_rtt_p99_us\": %lld, "
+               "\"handle_p50_ns\": %lld, \"handle_p99_ns\": %lld, \"handle_p999_ns\": %lld, "
+               "\"digest\": \"%016llx\"}\n",
+               g_cfg.seed, g_cfg.bots, virtual_sec, wall, g_events_run, g_games, g_drops,
+               g_turn_rtt_us.size(), pct(g_turn_rtt_us, 0.5), pct(g_turn_rtt_us, 0.99),
+               pct(g_handle_ns, 0.5), pct(g_handle_ns, 0.99), pct(g_handle_ns, 0.999),
+               (unsigned long long)g_digest);
+        return 0;
+    }
+
+    printf("=== DETERMINISTIC SIMULATION (seed %llu) ===\n", g_cfg.seed);
+    printf("bots=%d virtual=%.1fs wall=%.2fs (%.0fx) events=%lld\n",
+           g_cfg.bots, virtual_sec, wall, wall > 0 ? virtual_sec / wall : 0.0, g_events_run);
+    printf("games=%lld (%.2f/s virtual) drops=%lld turns=%zu\n",
+           g_games, g_games / virtual_sec, g_drops, g_turn_rtt_us.size());
+    printf("virtual turn rtt: p50=%lldus p99=%lldus p999=%lldus\n",
+           pct(g_turn_rtt_us, 0.5), pct(g_turn_rtt_us, 0.99), pct(g_turn_rtt_us, 0.999));
+    printf("event digest: %016llx\n", (unsigned long long)g_digest);
+    printf("\nserver handling cost (wall clock, not part of the digest):\n");
+    printf("  all packets: p50=%lldns p99=%lldns p999=%lldns\n",
+           pct(g_handle_ns, 0.5), pct(g_handle_ns, 0.99), pct(g_handle_ns, 0.999));
+    for (const auto& kv : g_cost_by_command) {
+        printf("  %-18s count=%-9lld mean=%lldns\n", kv.first.c_str(), kv.second.count,
+               kv.second.count ? kv.second.total_ns / kv.second.count : 0);
+    }
+    return 0;
+}
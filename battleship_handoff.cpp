@@ -0,0 +1,423 @@
+#include "battleship_handoff.h"
+#include "battleship_snapshot.h"
+#include "battleship_windows.h"
+#include "battleship_log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#define HANDOFF_MAGIC 0x42534846u /* "BSHF" */
+#define HANDOFF_VERSION 1
+#define HANDOFF_FDS_PER_MSG 200   /* stays below the kernel's SCM_MAX_FD */
+
+struct handoff_hello {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t max_clients;
+    uint32_t max_sessions;
+    uint32_t client_record_size;
+};
+
+struct handoff_header {
+    uint32_t magic;
+    uint32_t n_clients;
+    uint32_t n_sessions;
+    uint32_t n_fds;          // listener first, then one per connected client
+};
+
+struct handoff_client {
+    int32_t slot;
+    int32_t fd_index;        // index into the passed fds, -1 for a held seat
+    int32_t session_id;
+    int32_t player_number;
+    int64_t detached_at;
+    struct snapshot_player player;
+};
+
+struct handoff_session {
+    int32_t id;
+    int32_t player1_slot;
+    int32_t player2_slot;
+    int32_t game_started;
+    int32_t game_finished;
+    int32_t current_turn;
+};
+
+#ifdef _WIN32
+
+int handoff_listen(const char* path) { (void)path; return -1; }
+void handoff_close(int control_fd, const char* path) { (void)control_fd; (void)path; }
+int handoff_poll_fd(int control_fd) { return control_fd; }
+int handoff_ready(int control_fd) { (void)control_fd; return 0; }
+int handoff_serve(int listen_fd, struct client_info* all_clients, struct game_session* all_sessions) {
+    (void)listen_fd; (void)all_clients; (void)all_sessions;
+    return -1;
+}
+int handoff_takeover(const char* path,
+                     struct client_info* all_clients, struct game_session* all_sessions) {
+    (void)path; (void)all_clients; (void)all_sessions;
+    fprintf(stderr, "Hot upgrade is not supported on Windows\n");
+    return -1;
+}
+int handoff_listen_fds() { return -1; }
+
+#else
+
+static int write_all(int fd, const void* data, size_t len) {
+    const char* p = (const char*)data;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int read_all(int fd, void* data, size_t len) {
+    char* p = (char*)data;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int send_fds(int sock, const int* fds, int count) {
+    while (count > 0) {
+        int chunk = count > HANDOFF_FDS_PER_MSG ? HANDOFF_FDS_PER_MSG : count;
+        uint32_t n = (uint32_t)chunk;
+        struct iovec iov = { &n, sizeof(n) };
+        char ctrl[CMSG_SPACE(sizeof(int) * HANDOFF_FDS_PER_MSG)];
+        memset(ctrl, 0, sizeof(ctrl));
+
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = ctrl;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * chunk);
+
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * chunk);
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * chunk);
+
+        ssize_t r;
+        do {
+            r = sendmsg(sock, &msg, 0);
+        } while (r < 0 && errno == EINTR);
+        if (r != (ssize_t)sizeof(n)) return -1;
+
+        fds += chunk;
+        count -= chunk;
+    }
+    return 0;
+}
+
+static int recv_fds(int sock, int* fds, int count) {
+    while (count > 0) {
+        uint32_t n = 0;
+        struct iovec iov = { &n, sizeof(n) };
+        char ctrl[CMSG_SPACE(sizeof(int) * HANDOFF_FDS_PER_MSG)];
+
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = ctrl;
+        msg.msg_controllen = sizeof(ctrl);
+
+        ssize_t r;
+        do {
+            r = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+        } while (r < 0 && errno == EINTR);
+        if (r != (ssize_t)sizeof(n) || (msg.msg_flags & MSG_CTRUNC)) return -1;
+
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) return -1;
+        int got = (int)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+        if (got != (int)n || got > count) return -1;
+        memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * got);
+
+        fds += got;
+        count -= got;
+    }
+    return 0;
+}
+
+static void set_timeouts(int sock) {
+    struct timeval tv;
+    tv.tv_sec = HANDOFF_TIMEOUT_SEC;
+    tv.tv_usec = 0;
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+static int fill_unix_addr(struct sockaddr_un* addr, const char* path) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) return -1;
+    strncpy(addr->sun_path, path, sizeof(addr->sun_path) - 1);
+    return 0;
+}
+
+/* The takeover request being waited for: accepted, its hello not in yet */
+static int g_pending = -1;
+static time_t g_pending_since = 0;
+
+static void drop_pending() {
+    if (g_pending != -1) close(g_pending);
+    g_pending = -1;
+}
+
+int handoff_listen(const char* path) {
+    struct sockaddr_un addr;
+    if (fill_unix_addr(&addr, path) < 0) return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+
+    unlink(path);
+    /* Whoever connects gets every socket and resume token: owner only,
+       already at bind() since a daemon runs with umask 0 */
+    mode_t old_mask = umask(077);
+    int bound = bind(fd, (struct sockaddr*)&addr, sizeof(addr));
+    umask(old_mask);
+    if (bound < 0 || listen(fd, 1) < 0) {
+        fprintf(stderr, "Failed to bind upgrade socket '%s': %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void handoff_close(int control_fd, const char* path) {
+    drop_pending();
+    if (control_fd < 0) return;
+    close(control_fd);
+    if (path) unlink(path);
+}
+
+static int slot_of(struct client_info* all_clients, struct client_info* c) {
+    return c ? (int)(c - all_clients) : -1;
+}
+
+// 1 if the other end of a Unix socket runs as our effective user
+static int peer_is_us(int sock) {
+#ifdef SO_PEERCRED
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0) return 0;
+    return cred.uid == geteuid();
+#else
+    uid_t uid;
+    gid_t gid;
+    if (getpeereid(sock, &uid, &gid) != 0) return 0;
+    return uid == geteuid();
+#endif
+}
+
+int handoff_poll_fd(int control_fd) {
+    if (g_pending != -1 && time(NULL) - g_pending_since > HANDOFF_TIMEOUT_SEC) {
+        log_write(LOG_LEVEL_WARN, "Takeover request sent no hello within %d seconds, dropped", HANDOFF_TIMEOUT_SEC);
+        drop_pending();
+    }
+    return g_pending != -1 ? g_pending : control_fd;
+}
+
+int handoff_ready(int control_fd) {
+    if (g_pending == -1) {
+        int sock = accept(control_fd, NULL, NULL);
+        if (sock < 0) return 0;
+        if (!peer_is_us(sock)) {
+            log_write(LOG_LEVEL_WARN, "Rejected takeover request from another user");
+            close(sock);
+            return 0;
+        }
+        fcntl(sock, F_SETFD, FD_CLOEXEC);
+        g_pending = sock;
+        g_pending_since = time(NULL);
+    }
+    /* Only a complete hello is worth stopping the loop for */
+    struct handoff_hello hello;
+    ssize_t n = recv(g_pending, &hello, sizeof(hello), MSG_PEEK | MSG_DONTWAIT);
+    if (n == (ssize_t)sizeof(hello)) return 1;
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) drop_pending();
+    return 0;
+}
+
+int handoff_serve(int listen_fd, struct client_info* all_clients, struct game_session* all_sessions) {
+    int sock = g_pending;
+    if (sock < 0) return -1;
+    g_pending = -1;
+    set_timeouts(sock);
+
+    struct handoff_hello hello;
+    if (read_all(sock, &hello, sizeof(hello)) < 0 ||
+        hello.magic != HANDOFF_MAGIC || hello.version != HANDOFF_VERSION ||
+        hello.max_clients != MAX_CLIENTS || hello.max_sessions != MAX_SESSIONS ||
+        hello.client_record_size != sizeof(struct handoff_client)) {
+        log_write(LOG_LEVEL_WARN, "Rejected takeover request: incompatible binary");
+        close(sock);
+        return -1;
+    }
+
+    static int fds[MAX_CLIENTS + 1];
+    static struct handoff_client recs[MAX_CLIENTS];
+    static struct handoff_session sess[MAX_SESSIONS];
+    int n_fds = 0;
+    int n_clients = 0;
+
+    fds[n_fds++] = listen_fd;
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        struct client_info* c = &all_clients[i];
+        if (c->fd == -1 && c->session_id == -1) continue;
+        struct handoff_client* r = &recs[n_clients++];
+        memset(r, 0, sizeof(*r));
+        r->slot = i;
+        r->fd_index = -1;
+        if (c->fd != -1) {
+            r->fd_index = n_fds;
+            fds[n_fds++] = c->fd;
+        }
+        r->session_id = c->session_id;
+        r->player_number = c->player_number;
+        r->detached_at = (int64_t)c->detached_at;
+        snapshot_encode_player(c, &r->player);
+    }
+    for (int i = 0; i < MAX_SESSIONS; i++) {
+        memset(&sess[i], 0, sizeof(sess[i]));
+        sess[i].id = all_sessions[i].id;
+        sess[i].player1_slot = slot_of(all_clients, all_sessions[i].player1);
+        sess[i].player2_slot = slot_of(all_clients, all_sessions[i].player2);
+        sess[i].game_started = all_sessions[i].game_started;
+        sess[i].game_finished = all_sessions[i].game_finished;
+        sess[i].current_turn = all_sessions[i].current_turn;
+    }
+
+    struct handoff_header header;
+    header.magic = HANDOFF_MAGIC;
+    header.n_clients = (uint32_t)n_clients;
+    header.n_sessions = MAX_SESSIONS;
+    header.n_fds = (uint32_t)n_fds;
+
+    char ack[4];
+    if (write_all(sock, &header, sizeof(header)) < 0 ||
+        send_fds(sock, fds, n_fds) < 0 ||
+        write_all(sock, recs, sizeof(recs[0]) * n_clients) < 0 ||
+        write_all(sock, sess, sizeof(sess)) < 0 ||
+        read_all(sock, ack, sizeof(ack)) < 0 || memcmp(ack, "DONE", 4) != 0) {
+        log_write(LOG_LEVEL_WARN, "Takeover aborted, continuing to serve");
+        close(sock);
+        return -1;
+    }
+
+    close(sock);
+    return 0;
+}
+
+int handoff_takeover(const char* path,
+                     struct client_info* all_clients, struct game_session* all_sessions) {
+    struct sockaddr_un addr;
+    if (fill_unix_addr(&addr, path) < 0) return -1;
+
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0) return -1;
+    set_timeouts(sock);
+    if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "Failed to reach running server at '%s': %s\n", path, strerror(errno));
+        close(sock);
+        return -1;
+    }
+    // Only take sockets and tables from a server of our own user
+    if (!peer_is_us(sock)) {
+        fprintf(stderr, "Refusing takeover: '%s' belongs to another user\n", path);
+        close(sock);
+        return -1;
+    }
+
+    struct handoff_hello hello;
+    hello.magic = HANDOFF_MAGIC;
+    hello.version = HANDOFF_VERSION;
+    hello.max_clients = MAX_CLIENTS;
+    hello.max_sessions = MAX_SESSIONS;
+    hello.client_record_size = sizeof(struct handoff_client);
+
+    static int fds[MAX_CLIENTS + 1];
+    static struct handoff_client recs[MAX_CLIENTS];
+    static struct handoff_session sess[MAX_SESSIONS];
+    struct handoff_header header;
+
+    if (write_all(sock, &hello, sizeof(hello)) < 0 ||
+        read_all(sock, &header, sizeof(header)) < 0 ||
+        header.magic != HANDOFF_MAGIC || header.n_clients > MAX_CLIENTS ||
+        header.n_sessions != MAX_SESSIONS || header.n_fds < 1 || header.n_fds > MAX_CLIENTS + 1 ||
+        recv_fds(sock, fds, (int)header.n_fds) < 0 ||
+        read_all(sock, recs, sizeof(recs[0]) * header.n_clients) < 0 ||
+        read_all(sock, sess, sizeof(sess)) < 0) {
+        fprintf(stderr, "Takeover failed: incomplete state from running server\n");
+        close(sock);
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < header.n_clients; i++) {
+        const struct handoff_client* r = &recs[i];
+        if (r->slot < 0 || r->slot >= MAX_CLIENTS) continue;
+        struct client_info* c = &all_clients[r->slot];
+        snapshot_decode_player(&r->player, c);
+        c->fd = (r->fd_index > 0 && r->fd_index < (int)header.n_fds) ? fds[r->fd_index] : -1;
+        c->session_id = r->session_id;
+        c->player_number = r->player_number;
+        c->detached_at = (time_t)r->detached_at;
+    }
+    for (int i = 0; i < MAX_SESSIONS; i++) {
+        all_sessions[i].id = sess[i].id;
+        all_sessions[i].player1 = (sess[i].player1_slot >= 0 && sess[i].player1_slot < MAX_CLIENTS)
+                                ? &all_clients[sess[i].player1_slot] : NULL;
+        all_sessions[i].player2 = (sess[i].player2_slot >= 0 && sess[i].player2_slot < MAX_CLIENTS)
+                                ? &all_clients[sess[i].player2_slot] : NULL;
+        all_sessions[i].game_started = sess[i].game_started;
+        all_sessions[i].game_finished = sess[i].game_finished;
+        all_sessions[i].current_turn = sess[i].current_turn;
+    }
+
+    write_all(sock, "DONE", 4);
+    close(sock);
+    return fds[0];
+}
+
+int handoff_listen_fds() {
+    const char* pid = getenv("LISTEN_PID");
+    const char* count = getenv("LISTEN_FDS");
+    if (!pid || !count) return -1;
+    if (atoi(pid) != (int)getpid() || atoi(count) < 1) return -1;
+
+    unsetenv("LISTEN_PID");
+    unsetenv("LISTEN_FDS");
+    unsetenv("LISTEN_FDNAMES");
+    return 3; /* SD_LISTEN_FDS_START */
+}
+
+#endif /* _WIN32 */
@@ -0,0 +1,48 @@
+#ifndef BATTLESHIP_HANDOFF_H
+#define BATTLESHIP_HANDOFF_H
+
+#include "battleship.h"
+
+/* Zero-downtime hot upgrade.
+   A running server listens on a Unix control socket. A new binary started
+   with --takeover connects to it and receives the listening socket and every
+   live client socket (SCM_RIGHTS) together with the client and session
+   tables. The old process exits without closing any connection, so clients
+   never notice the switch. The control socket is private to the server's
+   user (mode 0700, and the peer's uid is checked on both sides), and the
+   old process waits for the new one's hello in its poll loop rather than
+   blocking on it. POSIX only; the calls fail on Windows. */
+
+#ifdef _WIN32
+#define UPGRADE_SOCKET_PATH "battleship_server.upgrade.sock"
+#else
+#define UPGRADE_SOCKET_PATH "/tmp/battleship_server.upgrade.sock"
+#endif
+
+#define HANDOFF_TIMEOUT_SEC 5
+
+// Binds the control socket the next binary connects to. Returns its fd or -1.
+int handoff_listen(const char* path);
+void handoff_close(int control_fd, const char* path);
+
+/* Old process. Poll handoff_poll_fd() for POLLIN: the control socket, or
+   a takeover request that has connected but not said hello yet (dropped
+   after HANDOFF_TIMEOUT_SEC). When it is readable, handoff_ready() accepts
+   the request and returns 1 once its hello is in; then handoff_serve()
+   ships the listener, client sockets and tables. That returns 0 once the
+   new process has acknowledged; the caller must then exit without
+   touching the sockets. */
+int handoff_poll_fd(int control_fd);
+int handoff_ready(int control_fd);
+int handoff_serve(int listen_fd, struct client_info* all_clients, struct game_session* all_sessions);
+
+// New process: connects to a running server and installs its state.
+// Returns the inherited listening socket, or -1 on failure.
+int handoff_takeover(const char* path,
+                     struct client_info* all_clients, struct game_session* all_sessions);
+
+// Socket activation: returns the first fd passed in LISTEN_FDS for this
+// process, or -1 when none were passed.
+int handoff_listen_fds();
+
+#endif // BATTLESHIP_HANDOFF_H
@@ -0,0 +1,336 @@
+#include "battleship_leaderboard.h"
+#include "battleship.h"
+#include "battleship_log.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <atomic>
+#include <algorithm>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+#define LEADERBOARD_VERSION 3
+#define NICK_SIZE 64
+#define CLAIM_SPIN_LIMIT 100000
+#define CLAIM_WAIT_ROUNDS 2         // CLAIM_SPIN_LIMIT spins each, then give up
+
+/* A slot's state word: the state in the low bits and, while claimed,
+   the claiming pid above them. One CAS claims the slot and names its
+   owner, so there is no moment where a claim has no owner. */
+enum {
+    SLOT_EMPTY = 0,
+    SLOT_CLAIMED,   // name being written by the pid in the state word
+    SLOT_READY,     // name published, score may be updated
+    SLOT_DEAD       // torn write retired by recovery; probes skip it
+};
+#define SLOT_STATE_BITS 2           // Linux pids fit in the 22 bits above
+#define SLOT_STATE(word) ((word) & ((1u << SLOT_STATE_BITS) - 1))
+#define SLOT_OWNER(word) ((word) >> SLOT_STATE_BITS)
+
+enum {
+    REGION_UNINIT = 0,
+    REGION_INITIALIZING,
+    REGION_READY
+};
+
+struct leaderboard_slot {
+    std::atomic<uint32_t> state;
+    uint32_t name_check;
+    uint64_t hash;
+    char nickname[NICK_SIZE];
+    std::atomic<uint64_t> score;
+};
+
+struct leaderboard_region {
+    char magic[8];
+    uint32_t version;
+    uint32_t capacity;
+    std::atomic<uint32_t> init_state;
+    std::atomic<uint32_t> used;
+    struct leaderboard_slot slots[LEADERBOARD_CAPACITY];
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "shared counters must be lock-free");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared counters must be lock-free");
+
+static struct leaderboard_region* g_board = NULL;
+
+static uint64_t name_hash(const char* s) {
+    uint64_t h = 1469598103934665603ull;
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+static uint32_t name_check(const char* s, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+int leaderboard_shared() {
+    return g_board != NULL;
+}
+
+#ifdef _WIN32
+
+int leaderboard_open(const char* path) { (void)path; return -1; }
+void leaderboard_close() {}
+int leaderboard_recover() { return 0; }
+
+#else
+
+static int owner_alive(uint32_t pid) {
+    if (pid == 0) return 0;
+    return kill((pid_t)pid, 0) == 0 || errno != ESRCH;
+}
+
+/* A claimed slot whose owner is gone: keep it if the name made it to
+   memory intact, otherwise retire it so probes walk past it. */
+static int repair_slot(struct leaderboard_slot* slot) {
+    uint32_t claim = slot->state.load(std::memory_order_acquire);
+    if (SLOT_STATE(claim) != SLOT_CLAIMED || owner_alive(SLOT_OWNER(claim))) return 0;
+
+    uint32_t next = SLOT_DEAD;
+    size_t len = strnlen(slot->nickname, NICK_SIZE);
+    if (len > 0 && len < NICK_SIZE &&
+        slot->name_check == name_check(slot->nickname, len) &&
+        slot->hash == name_hash(slot->nickname)) {
+        next = SLOT_READY;
+    }
+    // Only this claim: the slot may have been published meanwhile
+    uint32_t expected = claim;
+    return slot->state.compare_exchange_strong(expected, next, std::memory_order_acq_rel) ? 1 : 0;
+}
+
+int leaderboard_recover() {
+    if (!g_board) return 0;
+    int repaired = 0;
+    for (int i = 0; i < LEADERBOARD_CAPACITY; i++) {
+        struct leaderboard_slot* slot = &g_board->slots[i];
+        if (SLOT_STATE(slot->state.load(std::memory_order_acquire)) == SLOT_CLAIMED) {
+            repaired += repair_slot(slot);
+        }
+    }
+    return repaired;
+}
+
+static void import_legacy_file() {
+    FILE* f = fopen(LEADERBOARD_FILE, "r");
+    if (!f) return;
+    char name[NICK_SIZE];
+    unsigned long long score;
+    while (fscanf(f, "%63s %llu", name, &score) == 2) {
+        leaderboard_add(name, score);
+    }
+    fclose(f);
+}
+
+int leaderboard_open(const char* path) {
+    if (g_board) return 0;
+
+    /* Explicit: a daemon runs with umask 0, and only servers of this user
+       may write the board */
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Failed to open shared leaderboard '%s': %s\n", path, strerror(errno));
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 ||
+        (st.st_size < (off_t)sizeof(struct leaderboard_region) &&
+         ftruncate(fd, sizeof(struct leaderboard_region)) != 0)) {
+        fprintf(stderr, "Failed to size shared leaderboard '%s': %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    void* map = mmap(NULL, sizeof(struct leaderboard_region), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "Failed to map shared leaderboard '%s': %s\n", path, strerror(errno));
+        return -1;
+    }
+    struct leaderboard_region* board = (struct leaderboard_region*)map;
+
+    /* The file starts zero-filled, which already is an empty table; the
+       first process only has to stamp the header. */
+    int created = 0;
+    uint32_t expected = REGION_UNINIT;
+    if (board->init_state.compare_exchange_strong(expected, REGION_INITIALIZING)) {
+        memcpy(board->magic, "BSLBRD\0\0", 8);
+        board->version = LEADERBOARD_VERSION;
+        board->capacity = LEADERBOARD_CAPACITY;
+        board->init_state.store(REGION_READY, std::memory_order_release);
+        created = 1;
+    } else {
+        for (int spin = 0; board->init_state.load(std::memory_order_acquire) != REGION_READY; spin++) {
+            if (spin > CLAIM_SPIN_LIMIT) break;
+            sched_yield();
+        }
+    }
+    if (board->init_state.load(std::memory_order_acquire) != REGION_READY ||
+        memcmp(board->magic, "BSLBRD\0\0", 8) != 0 ||
+        board->version != LEADERBOARD_VERSION || board->capacity != LEADERBOARD_CAPACITY) {
+        fprintf(stderr, "Shared leaderboard '%s' has an incompatible layout\n", path);
+        munmap(map, sizeof(struct leaderboard_region));
+        return -1;
+    }
+
+    g_board = board;
+    int repaired = leaderboard_recover();
+    if (repaired > 0) {
+        log_write(LOG_LEVEL_WARN, "Leaderboard recovery repaired %d torn slot(s)", repaired);
+    }
+    if (created) import_legacy_file();
+    return 0;
+}
+
+void leaderboard_close() {
+    if (!g_board) return;
+    munmap(g_board, sizeof(struct leaderboard_region));
+    g_board = NULL;
+}
+
+#endif /* _WIN32 */
+
+static uint32_t claim_word() {
+#ifdef _WIN32
+    return SLOT_CLAIMED;
+#else
+    return SLOT_CLAIMED | ((uint32_t)getpid() << SLOT_STATE_BITS);
+#endif
+}
+
+/* Finds (or claims) the slot for a nickname. Returns NULL when the table
+   is full, or when a slot on the way stays claimed by a process that
+   looks alive but does not finish (stopped, or a reused pid). */
+static struct leaderboard_slot* find_slot(const char* nickname) {
+    uint64_t h = name_hash(nickname);
+    size_t len = strnlen(nickname, NICK_SIZE - 1);
+
+    for (uint32_t probe = 0; probe < LEADERBOARD_CAPACITY; probe++) {
+        struct leaderboard_slot* slot = &g_board->slots[(h + probe) % LEADERBOARD_CAPACITY];
+        uint32_t state = slot->state.load(std::memory_order_acquire);
+
+        if (state == SLOT_EMPTY) {
+            uint32_t expected = SLOT_EMPTY;
+            if (slot->state.compare_exchange_strong(expected, claim_word(), std::memory_order_acq_rel)) {
+                slot->hash = h;
+                memset(slot->nickname, 0, NICK_SIZE);
+                memcpy(slot->nickname, nickname, len);
+                slot->name_check = name_check(slot->nickname, len);
+                slot->state.store(SLOT_READY, std::memory_order_release);
+                g_board->used.fetch_add(1, std::memory_order_relaxed);
+                return slot;
+            }
+            state = expected;
+        }
+
+        /* Another process is publishing this slot; wait for the name, but
+           only so long: skipping the slot could add the name twice */
+        int rounds = 0;
+        for (int spin = 0; SLOT_STATE(state) == SLOT_CLAIMED; spin++) {
+            if (spin > CLAIM_SPIN_LIMIT) {
+                if (++rounds > CLAIM_WAIT_ROUNDS) return NULL;
+#ifndef _WIN32
+                repair_slot(slot);
+#endif
+                spin = 0;
+            }
+#ifndef _WIN32
+            sched_yield();
+#endif
+            state = slot->state.load(std::memory_order_acquire);
+        }
+
+        if (state == SLOT_READY && slot->hash == h &&
+            strncmp(slot->nickname, nickname, NICK_SIZE) == 0) {
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+long long leaderboard_add(const char* nickname, uint64_t wins) {
+    if (!nickname || !nickname[0]) return -1;
+    if (!g_board) {
+        for (uint64_t i = 0; i < wins; i++) update_leaderboard(nickname);
+        return -1;
+    }
+    struct leaderboard_slot* slot = find_slot(nickname);
+    if (!slot) {
+        log_write(LOG_LEVEL_WARN, "Shared leaderboard is full or busy, dropping win for %s", nickname);
+        return -1;
+    }
+    return (long long)(slot->score.fetch_add(wins, std::memory_order_relaxed) + wins);
+}
+
+long long leaderboard_add_win(const char* nickname) {
+    return leaderboard_add(nickname, 1);
+}
+
+int leaderboard_format(char* out, size_t out_size) {
+    if (!out || out_size == 0) return 0;
+    out[0] = '\0';
+
+    if (!g_board) {
+        /* Legacy text file, in file order */
+        FILE* f = fopen(LEADERBOARD_FILE, "r");
+        if (!f) return 0;
+        char line[200];
+        int count = 0;
+        while (fgets(line, sizeof(line), f)) {
+            if (strlen(out) + strlen(line) + 1 >= out_size) break;
+            strcat(out, line);
+            count++;
+        }
+        fclose(f);
+        return count;
+    }
+
+    struct row {
+        char nickname[NICK_SIZE];
+        uint64_t score;
+    };
+    std::vector<row> rows;
+    rows.reserve(g_board->used.load(std::memory_order_relaxed));
+    for (int i = 0; i < LEADERBOARD_CAPACITY; i++) {
+        struct leaderboard_slot* slot = &g_board->slots[i];
+        if (slot->state.load(std::memory_order_acquire) != SLOT_READY) continue;
+        row r;
+        memcpy(r.nickname, slot->nickname, NICK_SIZE);
+        r.nickname[NICK_SIZE - 1] = '\0';
+        r.score = slot->score.load(std::memory_order_relaxed);
+        if (r.score > 0) rows.push_back(r);
+    }
+    std::sort(rows.begin(), rows.end(), [](const row& a, const row& b) {
+        if (a.score != b.score) return a.score > b.score;
+        return strcmp(a.nickname, b.nickname) < 0;
+    });
+
+    size_t used = 0;
+    int count = 0;
+    for (const row& r : rows) {
+        char line[NICK_SIZE + 32];
+        int n = snprintf(line, sizeof(line), "%s %llu\n", r.nickname, (unsigned long long)r.score);
+        if (n < 0 || used + (size_t)n + 1 >= out_size) break;
+        memcpy(out + used, line, (size_t)n + 1);
+        used += (size_t)n;
+        count++;
+    }
+    return count;
+}
@@ -0,0 +1,35 @@
+#ifndef BATTLESHIP_LEADERBOARD_H
+#define BATTLESHIP_LEADERBOARD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Host-wide leaderboard shared by every server process.
+   The board is a memory-mapped open-addressing table keyed by nickname.
+   Slots are claimed with a CAS and published once the name is written;
+   scores are atomic counters, so concurrent servers never lock or rewrite
+   anything. When the region cannot be mapped (or on Windows) the calls
+   fall back to LEADERBOARD_FILE. */
+
+#define LEADERBOARD_SHM_PATH "/dev/shm/battleship_leaderboard"
+#define LEADERBOARD_CAPACITY 4096
+
+// Maps the shared region, creating it if needed, and repairs slots left
+// half-written by a crashed process. Returns 0 on success.
+int leaderboard_open(const char* path);
+void leaderboard_close();
+int leaderboard_shared();
+
+// Adds wins to a nickname. Returns the new score, or -1 on failure.
+long long leaderboard_add(const char* nickname, uint64_t wins);
+long long leaderboard_add_win(const char* nickname);
+
+// Writes "nickname score" lines, best first, into out. Returns the number
+// of entries written.
+int leaderboard_format(char* out, size_t out_size);
+
+// Scans for slots whose claiming process died mid-write. Returns the
+// number of slots repaired or retired.
+int leaderboard_recover();
+
+#endif // BATTLESHIP_LEADERBOARD_H
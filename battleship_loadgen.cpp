@@ -0,0 +1,373 @@
+/* Headless load generator: many protocol-speaking bots on one poll loop.
+   Every bot sends SET_NICK, JOIN_SESSION auto and PLACEMENT_CHOICE auto,
+   then fires a SHOT whenever it gets YOUR_TURN. Reports games/s, msgs/s
+   and SHOT -> SHOT_RESULT round-trip percentiles. Connections run on
+   libbattleship_client (battleship_client_lib.h). */
+
+#include "battleship.h"
+#include "battleship_client_lib.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+enum {
+    BOT_IDLE = 0,       // waiting for start_at_us before (re)connecting
+    BOT_CONNECTING,
+    BOT_ACTIVE
+};
+
+struct bot {
+    int id;
+    struct client_conn* conn;
+    int state;
+    int player;
+    int games;
+    unsigned char order[FIELD_PAYLOAD_SIZE];
+    int next_shot;
+    long long start_at_us;
+    long long shoot_at_us;      // pending think time, 0 when none
+    long long shot_sent_us;     // outstanding SHOT, 0 when none
+    char token[RESUME_TOKEN_SIZE];
+    int resuming;
+};
+
+struct loadgen_config {
+    const char* host;
+    int port;
+    int bots;
+    double duration_sec;
+    double ramp_sec;
+    int think_ms;
+    double churn;
+    unsigned int seed;
+    int json;
+};
+
+struct loadgen_stats {
+    long long games;
+    long long msgs_in;
+    long long msgs_out;
+    long long connects;
+    long long drops;
+    long long errors;
+    std::vector<unsigned int> turn_rtt_us;
+};
+
+static struct loadgen_config g_cfg;
+static struct loadgen_stats g_stats;
+static struct sockaddr_in g_server_addr;
+static struct client_loop* g_loop;
+static unsigned int g_rng;
+
+static long long now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static unsigned int next_rand() {
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 17;
+    g_rng ^= g_rng << 5;
+    return g_rng;
+}
+
+static void bot_send(struct bot* b, const char* command, const char* arg1, const char* arg2) {
+    client_send(b->conn, command, arg1, arg2);
+    g_stats.msgs_out++;
+}
+
+static void shuffle_shots(struct bot* b) {
+    for (int i = 0; i < FIELD_PAYLOAD_SIZE; i++) b->order[i] = (unsigned char)i;
+    for (int i = FIELD_PAYLOAD_SIZE - 1; i > 0; i--) {
+        int j = (int)(next_rand() % (unsigned)(i + 1));
+        std::swap(b->order[i], b->order[j]);
+    }
+    b->next_shot = 0;
+}
+
+static void bot_close(struct bot* b, long long restart_at_us) {
+    if (b->conn) client_close(b->conn);
+    b->conn = NULL;
+    b->state = BOT_IDLE;
+    b->shoot_at_us = 0;
+    b->shot_sent_us = 0;
+    b->start_at_us = restart_at_us;
+}
+
+/* Finished or abandoned game: start over on a fresh connection */
+static void bot_restart(struct bot* b, long long now) {
+    b->token[0] = '\0';
+    b->resuming = 0;
+    bot_close(b, now);
+}
+
+static void bot_handle(struct bot* b, const packet_t* p, long long now);
+
+static void on_bot_connect(struct client_conn* c, void* user) {
+    (void)c;
+    ((struct bot*)user)->state = BOT_ACTIVE;
+}
+
+static void on_bot_packet(struct client_conn* c, const packet_t* p, void* user) {
+    (void)c;
+    bot_handle((struct bot*)user, p, now_us());
+}
+
+/* Server dropped us or the connect failed: resume if we hold a seat, else
+   start over */
+static void on_bot_close(struct client_conn* c, int error, void* user) {
+    (void)c;
+    struct bot* b = (struct bot*)user;
+    b->conn = NULL;
+    b->resuming = b->token[0] != '\0';
+    bot_close(b, now_us() + 100000);
+    if (error) g_stats.errors++;
+}
+
+static const struct client_callbacks k_bot_callbacks = {on_bot_connect, on_bot_packet, on_bot_close};
+
+static void bot_connect(struct bot* b, long long now) {
+    b->conn = client_connect(g_loop, &g_server_addr, &k_bot_callbacks, b);
+    if (!b->conn) {
+        g_stats.errors++;
+        b->start_at_us = now + 100000;
+        return;
+    }
+    b->state = BOT_CONNECTING;
+    g_stats.connects++;
+
+    if (b->resuming && b->token[0]) {
+        bot_send(b, "RESUME", b->token, NULL);
+    } else {
+        char nick[32];
+        snprintf(nick, sizeof(nick), "bot%d", b->id);
+        b->player = 0;
+        shuffle_shots(b);
+        bot_send(b, "SET_NICK", nick, NULL);
+        bot_send(b, "JOIN_SESSION", "auto", NULL);
+    }
+}
+
+static void bot_fire(struct bot* b, long long now) {
+    b->shoot_at_us = 0;
+    if (b->next_shot >= FIELD_PAYLOAD_SIZE) return;
+
+    /* Connection churn: drop before shooting and come back with RESUME */
+    if (g_cfg.churn > 0 && b->token[0] && (next_rand() % 1000000) < g_cfg.churn * 1000000) {
+        g_stats.drops++;
+        b->resuming = 1;
+        bot_close(b, now);
+        return;
+    }
+
+    static const char rows[] = "ABCDEFGHIK";
+    int cell = b->order[b->next_shot++];
+    char coord[8];
+    snprintf(coord, sizeof(coord), "%c%d", rows[cell / PLAYABLE_SIZE], cell % PLAYABLE_SIZE + 1);
+    bot_send(b, "SHOT", coord, NULL);
+    b->shot_sent_us = now;
+}
+
+static void bot_schedule_shot(struct bot* b, long long now) {
+    b->shoot_at_us = now + (long long)g_cfg.think_ms * 1000;
+    if (g_cfg.think_ms == 0) bot_fire(b, now);
+}
+
+static void bot_handle(struct bot* b, const packet_t* p, long long now) {
+    g_stats.msgs_in++;
+    const char* cmd = p->command;
+
+    if (strcmp(cmd, "PLACEMENT_START") == 0) {
+        bot_send(b, "PLACEMENT_CHOICE", "auto", NULL);
+    } else if (strcmp(cmd, "PLAYER_ASSIGNED") == 0) {
+        b->player = atoi(p->arg1);
+    } else if (strcmp(cmd, "RESUME_TOKEN") == 0) {
+        strncpy(b->token, p->arg1, sizeof(b->token) - 1);
+        b->token[sizeof(b->token) - 1] = '\0';
+    } else if (strcmp(cmd, "YOUR_TURN") == 0) {
+        bot_schedule_shot(b, now);
+    } else if (strcmp(cmd, "SHOT_RESULT") == 0) {
+        if (b->shot_sent_us) {
+            g_stats.turn_rtt_us.push_back((unsigned int)(now - b->shot_sent_us));
+            b->shot_sent_us = 0;
+        }
+    } else if (strcmp(cmd, "STATE_SYNC") == 0) {
+        int session_id, player, turn;
+        char state;
+        b->resuming = 0;
+        if (sscanf(p->arg2, "%d;%d;%d;%c", &session_id, &player, &turn, &state) == 4) {
+            b->player = player;
+            if (state == 'G' && turn == player) bot_schedule_shot(b, now);
+            else if (state == 'P') bot_send(b, "PLACEMENT_CHOICE", "auto", NULL);
+        }
+    } else if (strcmp(cmd, "GAME_OVER") == 0) {
+        if (strcmp(p->arg1, "WIN") == 0) g_stats.games++;
+        b->games++;
+        bot_restart(b, now);
+    } else if (strcmp(cmd, "OPPONENT_DISCONNECTED") == 0) {
+        bot_restart(b, now);
+    } else if (strcmp(cmd, "ERROR") == 0) {
+        /* Full server or rejected resume: back off and start over */
+        g_stats.errors++;
+        bot_restart(b, now + 100000);
+    }
+}
+
+static unsigned int percentile(std::vector<unsigned int>& sorted, double q) {
+    if (sorted.empty()) return 0;
+    size_t idx = (size_t)(q * (double)(sorted.size() - 1) + 0.5);
+    return sorted[std::min(idx, sorted.size() - 1)];
+}
+
+static void print_usage(const char* prog) {
+    printf("Usage: %s [-h HOST] [-p PORT] [--bots N] [--duration SEC] [--ramp SEC]\n"
+           "          [--think MS] [--churn PROB] [--seed N] [--json]\n", prog);
+}
+
+int main(int argc, char* argv[]) {
+    g_cfg.host = "127.0.0.1";
+    g_cfg.port = 0;
+    g_cfg.bots = 100;
+    g_cfg.duration_sec = 10;
+    g_cfg.ramp_sec = 1;
+    g_cfg.think_ms = 0;
+    g_cfg.churn = 0;
+    g_cfg.seed = 12345;
+    g_cfg.json = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char* a = argv[i];
+        const char* v = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (strcmp(a, "-h") == 0 && v) { g_cfg.host = v; i++; }
+        else if ((strcmp(a, "-p") == 0 || strcmp(a, "--port") == 0) && v) { g_cfg.port = atoi(v); i++; }
+        else if (strcmp(a, "--bots") == 0 && v) { g_cfg.bots = atoi(v); i++; }
+        else if (strcmp(a, "--duration") == 0 && v) { g_cfg.duration_sec = atof(v); i++; }
+        else if (strcmp(a, "--ramp") == 0 && v) { g_cfg.ramp_sec = atof(v); i++; }
+        else if (strcmp(a, "--think") == 0 && v) { g_cfg.think_ms = atoi(v); i++; }
+        else if (strcmp(a, "--churn") == 0 && v) { g_cfg.churn = atof(v); i++; }
+        else if (strcmp(a, "--seed") == 0 && v) { g_cfg.seed = (unsigned int)strtoul(v, NULL, 10); i++; }
+        else if (strcmp(a, "--json") == 0) { g_cfg.json = 1; }
+        else { print_usage(argv[0]); return strcmp(a, "--help") == 0 ? 0 : 1; }
+    }
+    if (g_cfg.port <= 0 || g_cfg.bots <= 0) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    g_rng = g_cfg.seed ? g_cfg.seed : 1;
+
+#ifdef _WIN32
+    if (!init_winsock()) {
+        fprintf(stderr, "Failed to initialize Winsock\n");
+        return 1;
+    }
+#else
+    signal(SIGPIPE, SIG_IGN);
+    /* Thousands of sockets need more than the usual 1024 descriptors */
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+#endif
+
+    if (client_resolve(g_cfg.host, g_cfg.port, &g_server_addr) != 0) {
+        fprintf(stderr, "Unknown host: %s\n", g_cfg.host);
+        return 1;
+    }
+    g_loop = client_loop_create();
+
+    long long start = now_us();
+    long long end = start + (long long)(g_cfg.duration_sec * 1e6);
+    std::vector<struct bot> bots(g_cfg.bots);
+    for (int i = 0; i < g_cfg.bots; i++) {
+        struct bot* b = &bots[i];
+        b->id = i;
+        b->conn = NULL;
+        b->state = BOT_IDLE;
+        b->games = 0;
+        b->token[0] = '\0';
+        b->resuming = 0;
+        b->shoot_at_us = 0;
+        b->shot_sent_us = 0;
+        /* Linear ramp-up */
+        b->start_at_us = start + (long long)(g_cfg.ramp_sec * 1e6 * i / g_cfg.bots);
+    }
+
+    long long next_report = start + 1000000;
+    long long last_games = 0, last_in = 0, last_out = 0;
+
+    while (1) {
+        long long now = now_us();
+        if (now >= end) break;
+
+        long long wake = std::min(end, next_report);
+        for (int i = 0; i < g_cfg.bots; i++) {
+            struct bot* b = &bots[i];
+            if (b->state == BOT_IDLE) {
+                if (now >= b->start_at_us) bot_connect(b, now);
+                else wake = std::min(wake, b->start_at_us);
+            }
+            if (b->shoot_at_us) {
+                if (now >= b->shoot_at_us) bot_fire(b, now);
+                else wake = std::min(wake, b->shoot_at_us);
+            }
+        }
+
+        int timeout = (int)std::max(0LL, (wake - now + 999) / 1000);
+        int live = client_loop_run(g_loop, timeout);
+        now = now_us();
+
+        if (now >= next_report && !g_cfg.json) {
+            printf("t=%4.1fs conns=%d games/s=%lld msgs_in/s=%lld msgs_out/s=%lld\n",
+                   (now - start) / 1e6, live, g_stats.games - last_games,
+                   g_stats.msgs_in - last_in, g_stats.msgs_out - last_out);
+            fflush(stdout);
+            last_games = g_stats.games;
+            last_in = g_stats.msgs_in;
+            last_out = g_stats.msgs_out;
+            next_report += 1000000;
+        } else if (now >= next_report) {
+            next_report += 1000000;
+        }
+    }
+
+    double elapsed = (now_us() - start) / 1e6;
+    std::vector<unsigned int>& rtt = g_stats.turn_rtt_us;
+    std::sort(rtt.begin(), rtt.end());
+    unsigned int p50 = percentile(rtt, 0.50);
+    unsigned int p99 = percentile(rtt, 0.99);
+    unsigned int p999 = percentile(rtt, 0.999);
+
+    if (g_cfg.json) {
+        printf("{\"bots\": %d, \"duration_s\": %.3f, \"games\": %lld, \"games_per_s\": %.2f, "
+               "\"msgs_per_s\": %.1f, \"turns\": %zu, \"turn_rtt_p50_us\": %u, "
+               "\"turn_rtt_p99_us\": %u, \"turn_rtt_p999_us\": %u, \"connects\": %lld, "
+               "\"drops\": %lld, \"errors\": %lld}\n",
+               g_cfg.bots, elapsed, g_stats.games, g_stats.games / elapsed,
+               (g_stats.msgs_in + g_stats.msgs_out) / elapsed, rtt.size(), p50, p99, p999,
+               g_stats.connects, g_stats.drops, g_stats.errors);
+    } else {
+        printf("\n=== LOADGEN SUMMARY ===\n");
+        printf("bots=%d duration=%.1fs connects=%lld drops=%lld errors=%lld\n",
+               g_cfg.bots, elapsed, g_stats.connects, g_stats.drops, g_stats.errors);
+        printf("games=%lld (%.2f/s) msgs=%lld (%.0f/s)\n", g_stats.games, g_stats.games / elapsed,
+               g_stats.msgs_in + g_stats.msgs_out, (g_stats.msgs_in + g_stats.msgs_out) / elapsed);
+        printf("turn rtt: samples=%zu p50=%uus p99=%uus p999=%uus\n", rtt.size(), p50, p99, p999);
+    }
+
+    client_loop_destroy(g_loop);
+#ifdef _WIN32
+    cleanup_winsock();
+#endif
+    return 0;
+}
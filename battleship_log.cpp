@@ -0,0 +1,350 @@
+#include "battleship_log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#ifndef _WIN32
+#include <syslog.h>
+#endif
+
+#define LOG_LINE_SIZE 1024
+
+struct log_slot {
+    /* pos: free for the producer claiming pos; pos + 1: record complete;
+       the writer then frees it for the next lap (pos + LOG_QUEUE_RECORDS) */
+    std::atomic<uint64_t> seq;
+    struct log_record rec;
+};
+
+/* Multi-producer, single-consumer: producers claim positions with a CAS
+   on g_tail, the writer thread alone advances g_head */
+static struct log_slot g_queue[LOG_QUEUE_RECORDS];
+static std::atomic<uint64_t> g_tail{0};
+static uint64_t g_head = 0;
+
+static std::atomic<bool> g_started{false};
+static std::atomic<bool> g_stopping{false};
+static std::atomic<bool> g_writer_done{false};
+static std::atomic<int> g_min_level{LOG_LEVEL_INFO};
+static std::atomic<uint64_t> g_dropped{0};
+
+static int g_sinks = LOG_SINK_STDOUT;
+static FILE* g_file = NULL;
+
+// Used while no writer runs: formatted and printed by log_commit() itself
+static thread_local struct log_record t_scratch;
+
+static const char* const k_level_names[LOG_LEVELS] = {"DEBUG", "INFO", "WARN", "ERROR"};
+
+static uint64_t wall_ns() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+void log_set_level(int min_level) {
+    if (min_level < LOG_LEVEL_DEBUG) min_level = LOG_LEVEL_DEBUG;
+    if (min_level > LOG_LEVEL_ERROR) min_level = LOG_LEVEL_ERROR;
+    g_min_level.store(min_level, std::memory_order_relaxed);
+}
+
+int log_level_parse(const char* name) {
+    if (!name) return -1;
+    for (int i = 0; i < LOG_LEVELS; i++) {
+        const char* a = name;
+        const char* b = k_level_names[i];
+        while (*a && *b && (*a | 0x20) == (*b | 0x20)) {
+            a++;
+            b++;
+        }
+        if (!*a && !*b) return i;
+    }
+    if (strcmp(name, "warning") == 0) return LOG_LEVEL_WARN;
+    return -1;
+}
+
+const char* log_level_name(int level) {
+    return (level >= 0 && level < LOG_LEVELS) ? k_level_names[level] : "?";
+}
+
+uint64_t log_dropped() {
+    return g_dropped.load(std::memory_order_relaxed);
+}
+
+struct log_record* log_begin(int level, const char* fmt) {
+    if (level < g_min_level.load(std::memory_order_relaxed)) return NULL;
+
+    struct log_record* r;
+    if (!g_started.load(std::memory_order_acquire)) {
+        r = &t_scratch;
+        r->seq = 0;
+    } else {
+        uint64_t pos = g_tail.load(std::memory_order_relaxed);
+        struct log_slot* s;
+        while (1) {
+            s = &g_queue[pos & (LOG_QUEUE_RECORDS - 1)];
+            uint64_t seq = s->seq.load(std::memory_order_acquire);
+            if (seq < pos) {
+                // the writer is a whole lap behind
+                g_dropped.fetch_add(1, std::memory_order_relaxed);
+                return NULL;
+            }
+            if (seq > pos) {
+                pos = g_tail.load(std::memory_order_relaxed);
+                continue;
+            }
+            if (g_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        }
+        r = &s->rec;
+        r->seq = pos;
+    }
+    r->ts_ns = wall_ns();
+    r->fmt = fmt;
+    r->level = (uint8_t)level;
+    r->nargs = 0;
+    r->str_used = 0;
+    return r;
+}
+
+void log_put_str(struct log_record* r, const char* s) {
+    if (r->nargs >= LOG_MAX_ARGS) return;
+    if (!s) s = "(null)";
+    unsigned int off = r->str_used;
+    size_t room = LOG_STRING_BYTES - off;
+    size_t n = strlen(s);
+    if (room == 0) {
+        // out of space: point at the terminator of the previous string
+        off = LOG_STRING_BYTES - 1;
+        n = 0;
+    } else {
+        if (n >= room) n = room - 1;
+        memcpy(r->str + off, s, n);
+        r->str[off + n] = '\0';
+        r->str_used = (uint8_t)(off + n + 1);
+    }
+    r->kind[r->nargs] = LOG_ARG_STR;
+    r->arg[r->nargs++].str_off = off;
+}
+
+/* Renders fmt with the stored arguments. Integers were widened to 64
+   bits, so each conversion is re-issued with an "ll" length. */
+static int format_message(const struct log_record* r, char* out, int size) {
+    int len = 0;
+    int next = 0;
+    const char* p = r->fmt;
+    while (*p && len < size - 1) {
+        if (*p != '%') {
+            out[len++] = *p++;
+            continue;
+        }
+        if (p[1] == '%') {
+            out[len++] = '%';
+            p += 2;
+            continue;
+        }
+
+        char spec[32];
+        int sl = 0;
+        spec[sl++] = *p++;
+        while (*p && strchr("-+ #0123456789.", *p) && sl < (int)sizeof(spec) - 4) spec[sl++] = *p++;
+        while (*p && strchr("hlLqjzt", *p)) p++;
+        char conv = *p;
+        if (!conv) break;
+        p++;
+
+        int room = size - len;
+        int n = 0;
+        const char* bad = NULL;
+        if (next >= r->nargs) {
+            bad = "(missing)";
+        } else {
+            int kind = r->kind[next];
+            if (conv == 's') {
+                if (kind != LOG_ARG_STR) bad = "(bad arg)";
+                else {
+                    spec[sl++] = 's';
+                    spec[sl] = '\0';
+                    n = snprintf(out + len, (size_t)room, spec, r->str + r->arg[next].str_off);
+                }
+            } else if (strchr("eEfFgGaA", conv)) {
+                double v = kind == LOG_ARG_DOUBLE ? r->arg[next].d :
+                           kind == LOG_ARG_INT ? (double)r->arg[next].i : (double)r->arg[next].u;
+                if (kind == LOG_ARG_STR) bad = "(bad arg)";
+                else {
+                    spec[sl++] = conv;
+                    spec[sl] = '\0';
+                    n = snprintf(out + len, (size_t)room, spec, v);
+                }
+            } else if (kind == LOG_ARG_STR || kind == LOG_ARG_DOUBLE) {
+                bad = "(bad arg)";
+            } else if (conv == 'c') {
+                spec[sl++] = 'c';
+                spec[sl] = '\0';
+                n = snprintf(out + len, (size_t)room, spec, (int)r->arg[next].i);
+            } else if (conv == 'p') {
+                spec[sl++] = 'p';
+                spec[sl] = '\0';
+                n = snprintf(out + len, (size_t)room, spec, (void*)(uintptr_t)r->arg[next].u);
+            } else if (conv == 'd' || conv == 'i') {
+                spec[sl++] = 'l';
+                spec[sl++] = 'l';
+                spec[sl++] = 'd';
+                spec[sl] = '\0';
+                n = snprintf(out + len, (size_t)room, spec, r->arg[next].i);
+            } else if (strchr("uoxX", conv)) {
+                spec[sl++] = 'l';
+                spec[sl++] = 'l';
+                spec[sl++] = conv;
+                spec[sl] = '\0';
+                n = snprintf(out + len, (size_t)room, spec, r->arg[next].u);
+            } else {
+                bad = "(bad format)";
+            }
+        }
+        next++;
+        if (bad) n = snprintf(out + len, (size_t)room, "%s", bad);
+        if (n < 0) n = 0;
+        len += n < room ? n : room - 1;
+    }
+    out[len] = '\0';
+    return len;
+}
+
+// "2026-10-19 14:03:07.123456 INFO  message"
+static int format_line(const struct log_record* r, char* out, int size) {
+    time_t secs = (time_t)(r->ts_ns / 1000000000ULL);
+    struct tm tm;
+#ifdef _WIN32
+    localtime_s(&tm, &secs);
+#else
+    localtime_r(&secs, &tm);
+#endif
+    int len = (int)strftime(out, (size_t)size, "%Y-%m-%d %H:%M:%S", &tm);
+    len += snprintf(out + len, (size_t)(size - len), ".%06u %-5s ",
+                    (unsigned)(r->ts_ns % 1000000000ULL / 1000), log_level_name(r->level));
+    len += format_message(r, out + len, size - len - 1);
+    out[len++] = '\n';
+    out[len] = '\0';
+    return len;
+}
+
+static void emit(const struct log_record* r) {
+    char line[LOG_LINE_SIZE];
+    int len = format_line(r, line, sizeof(line));
+
+    if (g_sinks & LOG_SINK_STDOUT) fwrite(line, 1, (size_t)len, stdout);
+    if ((g_sinks & LOG_SINK_FILE) && g_file) fwrite(line, 1, (size_t)len, g_file);
+#ifndef _WIN32
+    if (g_sinks & LOG_SINK_SYSLOG) {
+        static const int prio[LOG_LEVELS] = {LOG_DEBUG, LOG_INFO, LOG_WARNING, LOG_ERR};
+        // syslog stamps its own time: skip ours, and the newline
+        const char* msg = strchr(line, ' ');
+        msg = msg ? strchr(msg + 1, ' ') : NULL;
+        msg = msg ? msg + 1 : line;
+        line[len - 1] = '\0';
+        syslog(prio[r->level < LOG_LEVELS ? (int)r->level : (int)LOG_LEVEL_ERROR], "%s", msg);
+    }
+#endif
+}
+
+static void flush_sinks() {
+    if (g_sinks & LOG_SINK_STDOUT) fflush(stdout);
+    if (g_file) fflush(g_file);
+}
+
+void log_commit(struct log_record* r) {
+    if (r == &t_scratch) {
+        emit(r);
+        flush_sinks();
+        return;
+    }
+    struct log_slot* s = &g_queue[r->seq & (LOG_QUEUE_RECORDS - 1)];
+    s->seq.store(r->seq + 1, std::memory_order_release);
+}
+
+// Writes out everything published so far; stops at the first unfinished slot
+static int drain() {
+    int n = 0;
+    while (1) {
+        struct log_slot* s = &g_queue[g_head & (LOG_QUEUE_RECORDS - 1)];
+        if (s->seq.load(std::memory_order_acquire) != g_head + 1) break;
+        emit(&s->rec);
+        s->seq.store(g_head + LOG_QUEUE_RECORDS, std::memory_order_release);
+        g_head++;
+        n++;
+    }
+    return n;
+}
+
+static void writer_thread() {
+    uint64_t reported_drops = 0;
+    while (1) {
+        bool stopping = g_stopping.load();
+        int n = drain();
+
+        uint64_t drops = g_dropped.load(std::memory_order_relaxed);
+        if (drops != reported_drops) {
+            struct log_record r;
+            memset(&r, 0, sizeof(r));
+            r.ts_ns = wall_ns();
+            r.level = LOG_LEVEL_WARN;
+            r.fmt = "Log queue full, dropped %llu message(s)";
+            log_put_uint(&r, drops - reported_drops);
+            emit(&r);
+            reported_drops = drops;
+            n++;
+        }
+
+        if (n > 0) flush_sinks();
+        if (stopping) break;
+        if (n == 0) std::this_thread::sleep_for(std::chrono::milliseconds(LOG_FLUSH_MS));
+    }
+    g_writer_done = true;
+}
+
+int log_start(int sinks, const char* file_path, int min_level) {
+    int rc = 0;
+    if (g_started) return 0;
+    log_set_level(min_level);
+
+    g_sinks = sinks;
+    if ((sinks & LOG_SINK_FILE) && file_path) {
+        g_file = fopen(file_path, "a");
+        if (!g_file) {
+            fprintf(stderr, "Failed to open log file '%s'\n", file_path);
+            rc = -1;
+        }
+    }
+
+    static int initialized = 0;
+    if (!initialized) {
+        for (uint64_t i = 0; i < LOG_QUEUE_RECORDS; i++) g_queue[i].seq.store(i, std::memory_order_relaxed);
+        initialized = 1;
+    }
+    g_stopping = false;
+    g_writer_done = false;
+    g_started.store(true, std::memory_order_release);
+    /* Detached: log_stop() gives the drain a bounded wait, so a sink that
+       blocks cannot hold up the exit */
+    std::thread(writer_thread).detach();
+    return rc;
+}
+
+void log_stop() {
+    if (!g_started) return;
+    g_started.store(false, std::memory_order_release);
+    g_stopping = true;
+    for (int i = 0; i < 1000 && !g_writer_done; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    if (g_file) {
+        fclose(g_file);
+        g_file = NULL;
+    }
+    g_sinks = LOG_SINK_STDOUT;
+}
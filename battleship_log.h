@@ -0,0 +1,122 @@
+#ifndef BATTLESHIP_LOG_H
+#define BATTLESHIP_LOG_H
+
+#include <stdint.h>
+
+/* Asynchronous logger. log_write() does no formatting and no I/O: it
+   claims a slot in a bounded lock-free queue, stores the format pointer,
+   a timestamp and the raw arguments (strings are copied), and returns.
+   A writer thread formats the records and hands them to the sinks:
+   stdout, an append-only file and/or syslog. When the queue is full the
+   record is dropped and counted rather than blocking the caller.
+
+   The format must be a string literal (it is printed later) and uses
+   printf conversions; integer length modifiers are optional since every
+   integer is stored as 64 bits.
+
+     log_write(LOG_LEVEL_INFO, "Client %d disconnected.", fd);
+
+   Before log_start() (and in the embedding harnesses that never call it)
+   records are formatted on the spot and printed to stdout. */
+
+#define LOG_QUEUE_RECORDS 4096          // power of two
+#define LOG_MAX_ARGS 8
+#define LOG_STRING_BYTES 128            // copied string bytes per record, all arguments together
+#define LOG_FLUSH_MS 5                  // writer thread sleep when the queue is empty
+
+enum log_level {
+    LOG_LEVEL_DEBUG = 0,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_WARN,
+    LOG_LEVEL_ERROR,
+    LOG_LEVELS
+};
+
+enum log_sink {
+    LOG_SINK_STDOUT = 1,
+    LOG_SINK_FILE = 2,
+    LOG_SINK_SYSLOG = 4         // POSIX only; openlog() is the caller's
+};
+
+enum log_arg_kind {
+    LOG_ARG_INT = 0,
+    LOG_ARG_UINT,
+    LOG_ARG_DOUBLE,
+    LOG_ARG_STR
+};
+
+struct log_record {
+    uint64_t seq;               // queue position, used by log_commit()
+    uint64_t ts_ns;             // wall clock
+    const char* fmt;
+    uint8_t level;
+    uint8_t nargs;
+    uint8_t str_used;
+    uint8_t kind[LOG_MAX_ARGS];
+    union {
+        long long i;
+        unsigned long long u;
+        double d;
+        unsigned int str_off;   // into str[]
+    } arg[LOG_MAX_ARGS];
+    char str[LOG_STRING_BYTES];
+};
+
+/* Starts the writer thread. file_path is opened for appending when
+   sinks includes LOG_SINK_FILE. Returns 0, or -1 if the file cannot be
+   opened (the other sinks still work). */
+int log_start(int sinks, const char* file_path, int min_level);
+
+/* Drains the queue, stops the writer and falls back to synchronous
+   stdout. Not for signal handlers. */
+void log_stop();
+
+void log_set_level(int min_level);
+int log_level_parse(const char* name);     // -1 if unknown
+const char* log_level_name(int level);
+
+// Records dropped because the queue was full
+uint64_t log_dropped();
+
+/* The pieces log_write() is made of. log_begin() returns NULL when the
+   level is filtered out or the queue is full. */
+struct log_record* log_begin(int level, const char* fmt);
+void log_commit(struct log_record* r);
+void log_put_str(struct log_record* r, const char* s);
+
+static inline void log_put_int(struct log_record* r, long long v) {
+    if (r->nargs >= LOG_MAX_ARGS) return;
+    r->kind[r->nargs] = LOG_ARG_INT;
+    r->arg[r->nargs++].i = v;
+}
+
+static inline void log_put_uint(struct log_record* r, unsigned long long v) {
+    if (r->nargs >= LOG_MAX_ARGS) return;
+    r->kind[r->nargs] = LOG_ARG_UINT;
+    r->arg[r->nargs++].u = v;
+}
+
+static inline void log_put(struct log_record* r, int v) { log_put_int(r, v); }
+static inline void log_put(struct log_record* r, long v) { log_put_int(r, v); }
+static inline void log_put(struct log_record* r, long long v) { log_put_int(r, v); }
+static inline void log_put(struct log_record* r, unsigned int v) { log_put_uint(r, v); }
+static inline void log_put(struct log_record* r, unsigned long v) { log_put_uint(r, v); }
+static inline void log_put(struct log_record* r, unsigned long long v) { log_put_uint(r, v); }
+static inline void log_put(struct log_record* r, char v) { log_put_int(r, v); }
+static inline void log_put(struct log_record* r, const char* s) { log_put_str(r, s); }
+
+static inline void log_put(struct log_record* r, double v) {
+    if (r->nargs >= LOG_MAX_ARGS) return;
+    r->kind[r->nargs] = LOG_ARG_DOUBLE;
+    r->arg[r->nargs++].d = v;
+}
+
+template <typename... Args>
+static inline void log_write(int level, const char* fmt, Args... args) {
+    struct log_record* r = log_begin(level, fmt);
+    if (!r) return;
+    (log_put(r, args), ...);
+    log_commit(r);
+}
+
+#endif // BATTLESHIP_LOG_H
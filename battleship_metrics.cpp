@@ -0,0 +1,546 @@
+#include "battleship_metrics.h"
+#include "battleship_watchdog.h"
+#include "battleship_alloc.h"
+#include "battleship_windows.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+/* Every command the protocol knows, both directions. Index 0 collects
+   anything else so a misbehaving client cannot grow the label set. */
+static const char* const k_commands[] = {
+    "other",
+    // client -> server
+    "SET_NICK", "RESUME", "JOIN_SESSION", "FIELD_UPLOAD", "PLACEMENT_CHOICE",
+    "SHIP_PLACED", "SHOT", "REQUEST_FIELD", "QUIT", "DISCONNECT", "PONG",
+    // server -> client
+    "BYE", "ENEMY_FOG_UPDATE", "ERROR", "FIELD_UPDATE", "GAME_OVER", "GAME_START",
+    "LEADERBOARD", "MANUAL_PLACEMENT", "NOT_YOUR_TURN", "OPPONENT_AWAY",
+    "OPPONENT_DISCONNECTED", "OPPONENT_RECONNECTED", "OPPONENT_SHOT", "OPPONENT_TURN",
+    "PING", "PLACEMENT_DONE", "PLACEMENT_START", "PLAYER_ASSIGNED", "RAW", "RESUME_TOKEN",
+    "SESSION_CREATED", "SESSION_LIST", "SHOT_RESULT", "STATE_SYNC", "WAIT", "WELCOME",
+    "YOUR_TURN"
+};
+#define METRICS_COMMANDS ((int)(sizeof(k_commands) / sizeof(k_commands[0])))
+#define METRICS_COMMAND_HASH 128        // power of two, well above METRICS_COMMANDS
+
+/* Log-linear buckets: values below 16 exactly, then 16 sub-buckets per
+   power of two up to 2^40 ns (about 18 minutes) */
+#define HIST_SUB_BITS 4
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_MAX_EXP 40
+#define HIST_BUCKETS (HIST_SUB + (HIST_MAX_EXP - HIST_SUB_BITS + 1) * HIST_SUB)
+
+#define RATE_WINDOW 10                  // seconds behind the *_per_second gauges
+
+struct histogram {
+    std::atomic<uint64_t> buckets[HIST_BUCKETS];
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum_ns;
+};
+
+struct command_stats {
+    std::atomic<uint64_t> packets_in;
+    std::atomic<uint64_t> packets_out;
+    std::atomic<uint64_t> allocs;       // heap allocations inside the handler
+    struct histogram handler;
+};
+
+static struct command_stats g_commands[METRICS_COMMANDS];
+static struct histogram g_loop;
+static struct histogram g_rtt;          // heartbeat round trips
+static struct histogram g_jitter;       // smoothed RTT variation at each sample
+static std::atomic<uint64_t> g_heartbeat_dropped{0};
+static std::atomic<uint64_t> g_bytes_in{0};
+static std::atomic<uint64_t> g_bytes_out{0};
+static std::atomic<uint64_t> g_accepted{0};
+static std::atomic<uint64_t> g_rejected{0};
+static std::atomic<uint64_t> g_games_finished{0};
+
+static std::atomic<int> g_connections{0};
+static std::atomic<int> g_held_seats{0};
+static std::atomic<int> g_sessions[METRICS_SESSION_STATES];
+static std::atomic<long long> g_queued_bytes{0};
+
+static signed char g_command_hash[METRICS_COMMAND_HASH];   // filled once, read-only after
+static std::atomic<bool> g_running{false};
+static int g_tcp_sock = -1;
+static int g_unix_sock = -1;
+
+/* --- recording (poll loop) --- */
+
+static uint32_t command_hash(const char* s) {
+    uint32_t h = 2166136261u;
+    for (; *s; s++) h = (h ^ (unsigned char)*s) * 16777619u;
+    return h;
+}
+
+static void build_command_hash() {
+    memset(g_command_hash, -1, sizeof(g_command_hash));
+    for (int i = 1; i < METRICS_COMMANDS; i++) {
+        uint32_t h = command_hash(k_commands[i]);
+        while (g_command_hash[h & (METRICS_COMMAND_HASH - 1)] != -1) h++;
+        g_command_hash[h & (METRICS_COMMAND_HASH - 1)] = (signed char)i;
+    }
+}
+
+int metrics_command_id(const char* command) {
+    static const bool built = (build_command_hash(), true);
+    (void)built;
+    uint32_t h = command_hash(command);
+    for (;; h++) {
+        int id = g_command_hash[h & (METRICS_COMMAND_HASH - 1)];
+        if (id == -1) return 0;
+        if (strcmp(k_commands[id], command) == 0) return id;
+    }
+}
+
+static const char* const k_session_states[METRICS_SESSION_STATES] = {
+    "empty", "waiting", "placing", "playing", "finished"
+};
+
+const char* metrics_session_state_name(int state) {
+    return (state >= 0 && state < METRICS_SESSION_STATES) ? k_session_states[state] : k_session_states[0];
+}
+
+const char* metrics_command_name(int command_id) {
+    if (command_id < 0 || command_id >= METRICS_COMMANDS) return k_commands[0];
+    return k_commands[command_id];
+}
+
+static int hist_index(uint64_t v) {
+    if (v < HIST_SUB) return (int)v;
+    int e = 63 - __builtin_clzll(v);
+    if (e > HIST_MAX_EXP) return HIST_BUCKETS - 1;
+    int sub = (int)((v >> (e - HIST_SUB_BITS)) & (HIST_SUB - 1));
+    return HIST_SUB + (e - HIST_SUB_BITS) * HIST_SUB + sub;
+}
+
+// Middle of a bucket's value range
+static double hist_value(int idx) {
+    if (idx < HIST_SUB) return (double)idx;
+    int e = (idx - HIST_SUB) / HIST_SUB + HIST_SUB_BITS;
+    int sub = (idx - HIST_SUB) % HIST_SUB;
+    double low = (double)((uint64_t)(HIST_SUB + sub) << (e - HIST_SUB_BITS));
+    double width = (double)(1ull << (e - HIST_SUB_BITS));
+    return low + width / 2;
+}
+
+static void hist_record(struct histogram* h, uint64_t ns) {
+    h->buckets[hist_index(ns)].fetch_add(1, std::memory_order_relaxed);
+    h->count.fetch_add(1, std::memory_order_relaxed);
+    h->sum_ns.fetch_add(ns, std::memory_order_relaxed);
+}
+
+uint64_t metrics_now_ns() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void metrics_packet_in(int command_id, size_t bytes) {
+    g_commands[command_id].packets_in.fetch_add(1, std::memory_order_relaxed);
+    g_bytes_in.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void metrics_packet_out(int command_id, size_t bytes) {
+    g_commands[command_id].packets_out.fetch_add(1, std::memory_order_relaxed);
+    g_bytes_out.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void metrics_handler_ns(int command_id, uint64_t ns) {
+    hist_record(&g_commands[command_id].handler, ns);
+}
+
+void metrics_handler_allocs(int command_id, uint64_t allocs) {
+    if (allocs) g_commands[command_id].allocs.fetch_add(allocs, std::memory_order_relaxed);
+}
+
+void metrics_loop_ns(uint64_t ns) {
+    hist_record(&g_loop, ns);
+}
+
+void metrics_heartbeat_rtt(uint64_t rtt_ns, uint64_t jitter_ns) {
+    hist_record(&g_rtt, rtt_ns);
+    hist_record(&g_jitter, jitter_ns);
+}
+
+void metrics_heartbeat_dropped() {
+    g_heartbeat_dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+void metrics_connection(int accepted) {
+    (accepted ? g_accepted : g_rejected).fetch_add(1, std::memory_order_relaxed);
+}
+
+void metrics_game_finished() {
+    g_games_finished.fetch_add(1, std::memory_order_relaxed);
+}
+
+void metrics_set_gauges(const struct metrics_gauges* g) {
+    g_connections.store(g->connections, std::memory_order_relaxed);
+    g_held_seats.store(g->held_seats, std::memory_order_relaxed);
+    for (int i = 0; i < METRICS_SESSION_STATES; i++) {
+        g_sessions[i].store(g->sessions[i], std::memory_order_relaxed);
+    }
+    g_queued_bytes.store(g->queued_bytes, std::memory_order_relaxed);
+}
+
+/* --- exposition (scrape thread) --- */
+
+// A counter sampled once per second, newest last
+struct rate_window {
+    uint64_t samples[RATE_WINDOW + 1];
+    int sampled;
+};
+
+static struct rate_window g_games_rate;
+static struct rate_window g_allocs_rate;
+
+static void rate_sample(struct rate_window* w, uint64_t value) {
+    memmove(w->samples, w->samples + 1, sizeof(w->samples) - sizeof(w->samples[0]));
+    w->samples[RATE_WINDOW] = value;
+    if (w->sampled < RATE_WINDOW + 1) w->sampled++;
+}
+
+static double rate_per_second(const struct rate_window* w) {
+    if (w->sampled < 2) return 0.0;
+    int span = w->sampled - 1;
+    return (double)(w->samples[RATE_WINDOW] - w->samples[RATE_WINDOW - span]) / span;
+}
+
+static uint64_t total_allocs() {
+    uint64_t total = 0;
+    for (int t = 0; t < ALLOC_TAGS; t++) {
+        struct alloc_stats st;
+        alloc_read(t, &st);
+        total += st.allocs;
+    }
+    return total;
+}
+
+static void sample_rates() {
+    rate_sample(&g_games_rate, g_games_finished.load(std::memory_order_relaxed));
+    if (alloc_accounting_enabled()) rate_sample(&g_allocs_rate, total_allocs());
+}
+
+static void appendf(std::string* out, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+static void appendf(std::string* out, const char* fmt, ...) {
+    char buf[512];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (n > 0) out->append(buf, n < (int)sizeof(buf) ? (size_t)n : sizeof(buf) - 1);
+}
+
+/* Quantiles of one histogram, as summary lines. labels is either empty or
+   "key=\"value\"," */
+static void write_summary(std::string* out, const char* name, const char* labels, const struct histogram* h) {
+    static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t total = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        counts[i] = h->buckets[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++) {
+        double value = 0;
+        if (total > 0) {
+            uint64_t rank = (uint64_t)(quantiles[q] * (double)(total - 1)) + 1;
+            uint64_t seen = 0;
+            for (int i = 0; i < HIST_BUCKETS; i++) {
+                seen += counts[i];
+                if (seen >= rank) {
+                    value = hist_value(i);
+                    break;
+                }
+            }
+        }
+        appendf(out, "%s{%squantile=\"%g\"} %.9f\n", name, labels, quantiles[q], value / 1e9);
+    }
+    const char* bare = labels[0] ? "{" : "";
+    std::string l(labels);
+    if (!l.empty()) l[l.size() - 1] = '}';
+    appendf(out, "%s_sum%s%s %.9f\n", name, bare, l.c_str(),
+            (double)h->sum_ns.load(std::memory_order_relaxed) / 1e9);
+    appendf(out, "%s_count%s%s %llu\n", name, bare, l.c_str(),
+            (unsigned long long)h->count.load(std::memory_order_relaxed));
+}
+
+/* Only with BATTLESHIP_ALLOC_ACCOUNTING. The scrape thread's own
+   allocations land under "other". */
+static void write_alloc_metrics(std::string* out) {
+    struct alloc_stats st[ALLOC_TAGS];
+    for (int t = 0; t < ALLOC_TAGS; t++) alloc_read(t, &st[t]);
+
+    out->append("# HELP battleship_allocations_total Heap allocations, by subsystem.\n"
+                "# TYPE battleship_allocations_total counter\n");
+    for (int t = 0; t < ALLOC_TAGS; t++) {
+        appendf(out, "battleship_allocations_total{subsystem=\"%s\"} %llu\n", alloc_tag_name(t),
+                (unsigned long long)st[t].allocs);
+    }
+    out->append("# HELP battleship_allocated_bytes_total Heap bytes allocated, by subsystem.\n"
+                "# TYPE battleship_allocated_bytes_total counter\n");
+    for (int t = 0; t < ALLOC_TAGS; t++) {
+        appendf(out, "battleship_allocated_bytes_total{subsystem=\"%s\"} %llu\n", alloc_tag_name(t),
+                (unsigned long long)st[t].bytes);
+    }
+    out->append("# HELP battleship_live_bytes Heap bytes allocated and not yet freed, by subsystem.\n"
+                "# TYPE battleship_live_bytes gauge\n");
+    for (int t = 0; t < ALLOC_TAGS; t++) {
+        appendf(out, "battleship_live_bytes{subsystem=\"%s\"} %lld\n", alloc_tag_name(t),
+                (long long)st[t].live_bytes);
+    }
+    out->append("# HELP battleship_allocations_per_second Heap allocations per second over the last 10 seconds.\n"
+                "# TYPE battleship_allocations_per_second gauge\n");
+    appendf(out, "battleship_allocations_per_second %.3f\n", rate_per_second(&g_allocs_rate));
+
+    out->append("# HELP battleship_allocations_per_packet Heap allocations per handled packet, by command.\n"
+                "# TYPE battleship_allocations_per_packet gauge\n");
+    for (int i = 0; i < METRICS_COMMANDS; i++) {
+        uint64_t packets = g_commands[i].packets_in.load(std::memory_order_relaxed);
+        if (!packets) continue;
+        appendf(out, "battleship_allocations_per_packet{command=\"%s\"} %.4f\n", k_commands[i],
+                (double)g_commands[i].allocs.load(std::memory_order_relaxed) / (double)packets);
+    }
+}
+
+static void write_metrics(std::string* out) {
+    out->append("# HELP battleship_connections_accepted_total Client connections accepted.\n"
+                "# TYPE battleship_connections_accepted_total counter\n");
+    appendf(out, "battleship_connections_accepted_total %llu\n", (unsigned long long)g_accepted.load());
+    out->append("# HELP battleship_connections_rejected_total Client connections refused for lack of slots.\n"
+                "# TYPE battleship_connections_rejected_total counter\n");
+    appendf(out, "battleship_connections_rejected_total %llu\n", (unsigned long long)g_rejected.load());
+    out->append("# HELP battleship_connections Live client connections.\n"
+                "# TYPE battleship_connections gauge\n");
+    appendf(out, "battleship_connections %d\n", g_connections.load());
+    out->append("# HELP battleship_held_seats Seats of dropped players waiting for RESUME.\n"
+                "# TYPE battleship_held_seats gauge\n");
+    appendf(out, "battleship_held_seats %d\n", g_held_seats.load());
+
+    out->append("# HELP battleship_sessions Game sessions by state.\n"
+                "# TYPE battleship_sessions gauge\n");
+    for (int i = 0; i < METRICS_SESSION_STATES; i++) {
+        appendf(out, "battleship_sessions{state=\"%s\"} %d\n", k_session_states[i], g_sessions[i].load());
+    }
+
+    out->append("# HELP battleship_packets_received_total Packets received, by command.\n"
+                "# TYPE battleship_packets_received_total counter\n");
+    for (int i = 0; i < METRICS_COMMANDS; i++) {
+        uint64_t n = g_commands[i].packets_in.load(std::memory_order_relaxed);
+        if (n) appendf(out, "battleship_packets_received_total{command=\"%s\"} %llu\n", k_commands[i], (unsigned long long)n);
+    }
+    out->append("# HELP battleship_packets_sent_total Packets sent, by command.\n"
+                "# TYPE battleship_packets_sent_total counter\n");
+    for (int i = 0; i < METRICS_COMMANDS; i++) {
+        uint64_t n = g_commands[i].packets_out.load(std::memory_order_relaxed);
+        if (n) appendf(out, "battleship_packets_sent_total{command=\"%s\"} %llu\n", k_commands[i], (unsigned long long)n);
+    }
+    out->append("# HELP battleship_received_bytes_total Bytes of protocol packets received.\n"
+                "# TYPE battleship_received_bytes_total counter\n");
+    appendf(out, "battleship_received_bytes_total %llu\n", (unsigned long long)g_bytes_in.load());
+    out->append("# HELP battleship_sent_bytes_total Bytes of protocol packets sent.\n"
+                "# TYPE battleship_sent_bytes_total counter\n");
+    appendf(out, "battleship_sent_bytes_total %llu\n", (unsigned long long)g_bytes_out.load());
+    out->append("# HELP battleship_outbound_queued_bytes Bytes written but not yet sent by the kernel, all clients.\n"
+                "# TYPE battleship_outbound_queued_bytes gauge\n");
+    appendf(out, "battleship_outbound_queued_bytes %lld\n", g_queued_bytes.load());
+
+    out->append("# HELP battleship_handler_seconds Time to handle one packet, by command.\n"
+                "# TYPE battleship_handler_seconds summary\n");
+    for (int i = 0; i < METRICS_COMMANDS; i++) {
+        if (g_commands[i].handler.count.load(std::memory_order_relaxed) == 0) continue;
+        char labels[64];
+        snprintf(labels, sizeof(labels), "command=\"%s\",", k_commands[i]);
+        write_summary(out, "battleship_handler_seconds", labels, &g_commands[i].handler);
+    }
+    out->append("# HELP battleship_loop_iteration_seconds Work done per poll-loop wakeup.\n"
+                "# TYPE battleship_loop_iteration_seconds summary\n");
+    write_summary(out, "battleship_loop_iteration_seconds", "", &g_loop);
+    out->append("# HELP battleship_heartbeat_rtt_seconds Round trip of PING/PONG heartbeats.\n"
+                "# TYPE battleship_heartbeat_rtt_seconds summary\n");
+    write_summary(out, "battleship_heartbeat_rtt_seconds", "", &g_rtt);
+    out->append("# HELP battleship_heartbeat_jitter_seconds Smoothed RTT variation of a connection at each heartbeat.\n"
+                "# TYPE battleship_heartbeat_jitter_seconds summary\n");
+    write_summary(out, "battleship_heartbeat_jitter_seconds", "", &g_jitter);
+    out->append("# HELP battleship_heartbeat_dropped_total Connections dropped for missing heartbeats.\n"
+                "# TYPE battleship_heartbeat_dropped_total counter\n");
+    appendf(out, "battleship_heartbeat_dropped_total %llu\n", (unsigned long long)g_heartbeat_dropped.load());
+    out->append("# HELP battleship_loop_stalls_total Loop iterations caught past the stall threshold, by what they were stuck in.\n"
+                "# TYPE battleship_loop_stalls_total counter\n");
+    for (int i = 0; i < WATCHDOG_PHASES; i++) {
+        appendf(out, "battleship_loop_stalls_total{phase=\"%s\"} %llu\n", watchdog_phase_name(i),
+                (unsigned long long)watchdog_stalls(i));
+    }
+
+    out->append("# HELP battleship_games_finished_total Games played to the end.\n"
+                "# TYPE battleship_games_finished_total counter\n");
+    appendf(out, "battleship_games_finished_total %llu\n", (unsigned long long)g_games_finished.load());
+    out->append("# HELP battleship_games_finished_per_second Games finished per second over the last 10 seconds.\n"
+                "# TYPE battleship_games_finished_per_second gauge\n");
+    appendf(out, "battleship_games_finished_per_second %.3f\n", rate_per_second(&g_games_rate));
+
+    if (alloc_accounting_enabled()) write_alloc_metrics(out);
+}
+
+static void send_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        int n = send(fd, data, (int)len, 0);
+        if (n <= 0) {
+            if (n == -1 && errno == EINTR) continue;
+            return;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+}
+
+/* One scrape: read the request line, answer, close. Anything but a GET
+   of / or /metrics gets a 404. */
+static void serve_scrape(int fd) {
+#ifdef _WIN32
+    DWORD timeout_ms = 1000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout_ms, sizeof(timeout_ms));
+#else
+    struct timeval tv = {1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof(tv));
+#endif
+    char req[1024];
+    int got = 0;
+    while (got < (int)sizeof(req) - 1) {
+        int n = recv(fd, req + got, sizeof(req) - 1 - got, 0);
+        if (n <= 0) break;
+        got += n;
+        req[got] = '\0';
+        if (strstr(req, "\r\n\r\n") || strstr(req, "\n\n")) break;
+    }
+    req[got] = '\0';
+
+    if (strncmp(req, "GET / ", 6) != 0 && strncmp(req, "GET /metrics", 12) != 0) {
+        static const char not_found[] = "HTTP/1.0 404 Not Found\r\nContent-Type: text/plain\r\n\r\nTry /metrics\n";
+        send_all(fd, not_found, sizeof(not_found) - 1);
+        sock_close(fd);
+        return;
+    }
+
+    std::string body;
+    write_metrics(&body);
+    char header[160];
+    int n = snprintf(header, sizeof(header),
+                     "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                     "Content-Length: %lu\r\n\r\n", (unsigned long)body.size());
+    send_all(fd, header, (size_t)n);
+    send_all(fd, body.data(), body.size());
+    sock_close(fd);
+}
+
+static void metrics_thread_func() {
+    using namespace std::chrono;
+    steady_clock::time_point next_sample = steady_clock::now();
+
+    while (g_running) {
+        struct pollfd pfds[2];
+        int n = 0;
+        if (g_tcp_sock != -1) {
+            pfds[n].fd = g_tcp_sock;
+            pfds[n].events = POLLIN;
+            pfds[n].revents = 0;
+            n++;
+        }
+        if (g_unix_sock != -1) {
+            pfds[n].fd = g_unix_sock;
+            pfds[n].events = POLLIN;
+            pfds[n].revents = 0;
+            n++;
+        }
+        int ready = poll(pfds, n, 1000);
+
+        if (steady_clock::now() >= next_sample) {
+            sample_rates();
+            next_sample += seconds(1);
+        }
+        for (int i = 0; ready > 0 && i < n; i++) {
+            if (!(pfds[i].revents & POLLIN)) continue;
+            int fd = (int)accept(pfds[i].fd, NULL, NULL);
+            if (fd != -1) serve_scrape(fd);
+        }
+    }
+}
+
+static int listen_tcp(int port) {
+    int fd = (int)socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1) return -1;
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (const char*)&one, sizeof(one));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);  // admin only, never exposed
+    addr.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1 || listen(fd, 8) == -1) {
+        sock_close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int listen_unix(const char* path) {
+#ifdef _WIN32
+    (void)path;
+    return -1;
+#else
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path)) return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) return -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1 || listen(fd, 8) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+#endif
+}
+
+int metrics_start(int port, const char* unix_path) {
+    if (g_running) return 0;
+    if (port > 0) {
+        g_tcp_sock = listen_tcp(port);
+        if (g_tcp_sock == -1) fprintf(stderr, "Failed to listen for metrics on 127.0.0.1:%d\n", port);
+    }
+    if (unix_path) {
+        g_unix_sock = listen_unix(unix_path);
+        if (g_unix_sock == -1) fprintf(stderr, "Failed to listen for metrics on %s\n", unix_path);
+    }
+    if (g_tcp_sock == -1 && g_unix_sock == -1) return -1;
+
+    g_running = true;
+    /* Detached: the server exits from several places and never joins */
+    std::thread(metrics_thread_func).detach();
+    return 0;
+}
+
+void metrics_stop() {
+    g_running = false;
+}
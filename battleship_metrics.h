@@ -0,0 +1,60 @@
+#ifndef BATTLESHIP_METRICS_H
+#define BATTLESHIP_METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Server metrics in Prometheus text format. The poll loop only bumps
+   relaxed atomics (counters, gauges and log-linear histogram buckets);
+   a separate thread answers scrapes on a local admin port or Unix socket,
+   so a scrape never waits on the game and a stuck loop can still be
+   observed. Latency histograms keep 16 sub-buckets per power of two
+   (about 6% resolution) and are exported as summaries with quantiles.
+
+     curl http://127.0.0.1:9400/metrics
+     curl --unix-socket /tmp/battleship_metrics.sock http://x/metrics */
+
+enum metrics_session_state {
+    METRICS_SESSION_EMPTY = 0,
+    METRICS_SESSION_WAITING,        // one player seated
+    METRICS_SESSION_PLACING,        // both seated, not started
+    METRICS_SESSION_PLAYING,
+    METRICS_SESSION_FINISHED,
+    METRICS_SESSION_STATES
+};
+
+// Sampled by the poll loop, not counted
+struct metrics_gauges {
+    int connections;                // live client connections
+    int held_seats;                 // seats waiting for RESUME
+    int sessions[METRICS_SESSION_STATES];
+    long long queued_bytes;         // unsent bytes in the kernel send queues
+};
+
+/* Starts the scrape thread on 127.0.0.1:port and/or a Unix socket at
+   unix_path (either may be 0 / NULL). Returns 0, or -1 if nothing could
+   be bound. */
+int metrics_start(int port, const char* unix_path);
+void metrics_stop();
+
+// Monotonic nanoseconds for latency measurements
+uint64_t metrics_now_ns();
+
+/* Protocol command to a small id for the per-command series; unknown
+   commands share one "other" id. */
+int metrics_command_id(const char* command);
+const char* metrics_command_name(int command_id);
+const char* metrics_session_state_name(int state);
+
+void metrics_packet_in(int command_id, size_t bytes);
+void metrics_packet_out(int command_id, size_t bytes);
+void metrics_handler_ns(int command_id, uint64_t ns);
+void metrics_handler_allocs(int command_id, uint64_t allocs);   // needs BATTLESHIP_ALLOC_ACCOUNTING
+void metrics_loop_ns(uint64_t ns);
+void metrics_heartbeat_rtt(uint64_t rtt_ns, uint64_t jitter_ns);
+void metrics_heartbeat_dropped();
+void metrics_connection(int accepted);
+void metrics_game_finished();
+void metrics_set_gauges(const struct metrics_gauges* g);
+
+#endif // BATTLESHIP_METRICS_H
@@ -0,0 +1,379 @@
+/* Performance regression check used by the ctest perf suite.
+   Runs a benchmark command that prints JSON (battleship_bench --json,
+   battleship_loadgen --json), optionally with a battleship_server running
+   next to it, and compares the numbers against a committed baseline:
+
+     battleship_perfcheck --baseline perf/bench_baseline.json --lower min_ns
+                          -- ./battleship_bench --json --samples 5
+
+   --lower KEY[:SLACK] / --higher KEY select the metrics (matched on the
+   last component of the flattened key, e.g. benchmarks[simple_shot].median_ns).
+   A lower-is-better metric fails when it exceeds baseline * tolerance +
+   slack, a higher-is-better one when it drops below baseline / tolerance.
+   --retries N reruns a regressed scenario, keeping each metric's best.
+   --update writes the fresh output as the new baseline instead. */
+
+#include "battleship_windows.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/wait.h>
+#endif
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#endif
+
+struct metric_rule {
+    std::string key;
+    int lower_is_better;
+    double slack;
+};
+
+typedef std::map<std::string, double> metric_map;
+
+/* Minimal JSON reader: flattens numbers into "a.b[name].c" keys. Array
+   elements are labelled by their "name" member when they have one. */
+struct json_reader {
+    const char* s;
+    int ok;
+};
+
+static void skip_ws(struct json_reader* r) {
+    while (*r->s && isspace((unsigned char)*r->s)) r->s++;
+}
+
+static std::string parse_string(struct json_reader* r) {
+    std::string out;
+    if (*r->s != '"') {
+        r->ok = 0;
+        return out;
+    }
+    r->s++;
+    while (*r->s && *r->s != '"') {
+        if (*r->s == '\\' && r->s[1]) r->s++;
+        out += *r->s++;
+    }
+    if (*r->s != '"') r->ok = 0;
+    else r->s++;
+    return out;
+}
+
+static void parse_value(struct json_reader* r, const std::string& path,
+                        metric_map* nums, std::map<std::string, std::string>* strs) {
+    skip_ws(r);
+    if (*r->s == '{') {
+        r->s++;
+        skip_ws(r);
+        while (r->ok && *r->s != '}') {
+            skip_ws(r);
+            std::string key = parse_string(r);
+            skip_ws(r);
+            if (*r->s != ':') {
+                r->ok = 0;
+                return;
+            }
+            r->s++;
+            parse_value(r, path.empty() ? key : path + "." + key, nums, strs);
+            skip_ws(r);
+            if (*r->s == ',') r->s++;
+            else if (*r->s != '}') r->ok = 0;
+        }
+        if (r->ok) r->s++;
+    } else if (*r->s == '[') {
+        r->s++;
+        skip_ws(r);
+        for (int index = 0; r->ok && *r->s != ']'; index++) {
+            metric_map sub_nums;
+            std::map<std::string, std::string> sub_strs;
+            parse_value(r, "", &sub_nums, &sub_strs);
+            std::string label = sub_strs.count("name") ? sub_strs["name"] : std::to_string(index);
+            std::string prefix = path + "[" + label + "]";
+            for (const auto& kv : sub_nums) {
+                (*nums)[kv.first.empty() ? prefix : prefix + "." + kv.first] = kv.second;
+            }
+            skip_ws(r);
+            if (*r->s == ',') r->s++;
+            else if (*r->s != ']') r->ok = 0;
+            skip_ws(r);
+        }
+        if (r->ok) r->s++;
+    } else if (*r->s == '"') {
+        (*strs)[path] = parse_string(r);
+    } else if (strncmp(r->s, "true", 4) == 0 || strncmp(r->s, "null", 4) == 0) {
+        r->s += 4;
+    } else if (strncmp(r->s, "false", 5) == 0) {
+        r->s += 5;
+    } else {
+        char* end;
+        double v = strtod(r->s, &end);
+        if (end == r->s) {
+            r->ok = 0;
+            return;
+        }
+        (*nums)[path] = v;
+        r->s = end;
+    }
+}
+
+static int parse_metrics(const std::string& text, metric_map* out) {
+    struct json_reader r;
+    r.s = text.c_str();
+    r.ok = 1;
+    std::map<std::string, std::string> strs;
+    parse_value(&r, "", out, &strs);
+    return r.ok ? 0 : -1;
+}
+
+static int read_file(const char* path, std::string* out) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return -1;
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) out->append(buf, n);
+    fclose(f);
+    return 0;
+}
+
+static int run_command(const std::vector<std::string>& argv, std::string* out) {
+    std::string cmd;
+    for (const std::string& a : argv) {
+        if (!cmd.empty()) cmd += ' ';
+        cmd += '"' + a + '"';
+    }
+    FILE* p = popen(cmd.c_str(), "r");
+    if (!p) return -1;
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), p)) > 0) out->append(buf, n);
+    return pclose(p) == 0 ? 0 : -1;
+}
+
+static int wait_for_port(int port, int timeout_ms) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    for (int waited = 0; waited < timeout_ms; waited += 50) {
+        int fd = (int)socket(AF_INET, SOCK_STREAM, 0);
+        int rc = connect(fd, (struct sockaddr*)&addr, sizeof(addr));
+        sock_close(fd);
+        if (rc == 0) return 0;
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    return -1;
+}
+
+#ifndef _WIN32
+static pid_t start_server(const char* command) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        /* The server's own chatter would only clutter the test log */
+        if (!freopen("/dev/null", "w", stdout)) _exit(127);
+        std::string exec_cmd = std::string("exec ") + command;
+        execl("/bin/sh", "sh", "-c", exec_cmd.c_str(), (char*)NULL);
+        _exit(127);
+    }
+    return pid;
+}
+
+static void stop_server(pid_t pid) {
+    if (pid <= 0) return;
+    kill(pid, SIGINT);
+    waitpid(pid, NULL, 0);
+}
+#endif
+
+static int matches(const std::string& key, const std::string& name) {
+    size_t dot = key.rfind('.');
+    return key.compare(dot == std::string::npos ? 0 : dot + 1, std::string::npos, name) == 0;
+}
+
+static const struct metric_rule* find_rule(const std::vector<struct metric_rule>& rules, const std::string& key) {
+    for (const struct metric_rule& rule : rules) {
+        if (matches(key, rule.key)) return &rule;
+    }
+    return NULL;
+}
+
+/* Returns the number of regressed metrics, -1 when no rule matched */
+static int check_metrics(const metric_map& baseline, const metric_map& current,
+                         const std::vector<struct metric_rule>& rules, double tolerance, int print) {
+    int checked = 0, regressed = 0;
+    if (print) printf("%-44s %14s %14s %8s\n", "metric", "baseline", "current", "ratio");
+    for (const auto& kv : baseline) {
+        const struct metric_rule* rule = find_rule(rules, kv.first);
+        if (!rule) continue;
+        checked++;
+        auto it = current.find(kv.first);
+        if (it == current.end()) {
+            if (print) printf("%-44s %14.2f %14s %8s  MISSING\n", kv.first.c_str(), kv.second, "-", "-");
+            regressed++;
+            continue;
+        }
+        double base = kv.second, now = it->second;
+        int bad = rule->lower_is_better ? now > base * tolerance + rule->slack
+                                        : now < base / tolerance;
+        if (print) {
+            printf("%-44s %14.2f %14.2f %8.2f%s\n", kv.first.c_str(), base, now,
+                   base != 0 ? now / base : 0, bad ? "  REGRESSED" : "");
+        }
+        regressed += bad;
+    }
+    return checked ? regressed : -1;
+}
+
+/* Runs the command (with the server around it) and captures its stdout */
+static int run_scenario(const std::vector<std::string>& command, const char* server_cmd,
+                        int wait_port, std::string* output) {
+#ifndef _WIN32
+    pid_t server_pid = -1;
+    if (server_cmd) {
+        server_pid = start_server(server_cmd);
+        if (server_pid < 0 || (wait_port && wait_for_port(wait_port, 5000) != 0)) {
+            fprintf(stderr, "Server did not come up: %s\n", server_cmd);
+            stop_server(server_pid);
+            return -1;
+        }
+    }
+#else
+    (void)server_cmd;
+    (void)wait_port;
+#endif
+    int rc = run_command(command, output);
+#ifndef _WIN32
+    stop_server(server_pid);
+#endif
+    if (rc != 0) {
+        fprintf(stderr, "Command failed: %s\n%s", command[0].c_str(), output->c_str());
+        return -1;
+    }
+    return 0;
+}
+
+static void print_usage(const char* prog) {
+    printf("Usage: %s --baseline FILE [--tolerance X] [--retries N] [--lower KEY[:SLACK]]... [--higher KEY]...\n"
+           "          [--server \"COMMAND\" --wait-port PORT] [--update] -- COMMAND [ARGS]...\n", prog);
+}
+
+int main(int argc, char* argv[]) {
+    const char* baseline_path = NULL;
+    const char* server_cmd = NULL;
+    int wait_port = 0;
+    double tolerance = 2.0;
+    int update = 0;
+    int retries = 0;
+    std::vector<struct metric_rule> rules;
+    std::vector<std::string> command;
+
+    for (int i = 1; i < argc; i++) {
+        const char* a = argv[i];
+        const char* v = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (strcmp(a, "--") == 0) {
+            for (i++; i < argc; i++) command.push_back(argv[i]);
+        }
+        else if (strcmp(a, "--baseline") == 0 && v) { baseline_path = v; i++; }
+        else if (strcmp(a, "--tolerance") == 0 && v) { tolerance = atof(v); i++; }
+        else if (strcmp(a, "--server") == 0 && v) { server_cmd = v; i++; }
+        else if (strcmp(a, "--wait-port") == 0 && v) { wait_port = atoi(v); i++; }
+        else if (strcmp(a, "--retries") == 0 && v) { retries = atoi(v); i++; }
+        else if (strcmp(a, "--update") == 0) { update = 1; }
+        else if ((strcmp(a, "--lower") == 0 || strcmp(a, "--higher") == 0) && v) {
+            struct metric_rule rule;
+            rule.key = v;
+            rule.lower_is_better = strcmp(a, "--lower") == 0;
+            rule.slack = 0;
+            size_t colon = rule.key.find(':');
+            if (colon != std::string::npos) {
+                rule.slack = atof(rule.key.c_str() + colon + 1);
+                rule.key.resize(colon);
+            }
+            rules.push_back(rule);
+            i++;
+        }
+        else { print_usage(argv[0]); return strcmp(a, "--help") == 0 ? 0 : 1; }
+    }
+    if (!baseline_path || command.empty() || tolerance < 1.0 || (!update && rules.empty())) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+#ifdef _WIN32
+    if (server_cmd) {
+        fprintf(stderr, "--server is not supported on Windows\n");
+        return 1;
+    }
+    if (!init_winsock()) {
+        fprintf(stderr, "Failed to initialize Winsock\n");
+        return 1;
+    }
+#endif
+
+    std::string output;
+    if (update) {
+        if (run_scenario(command, server_cmd, wait_port, &output) != 0) return 1;
+        metric_map unused;
+        if (parse_metrics(output, &unused) != 0) {
+            fprintf(stderr, "Command output is not JSON:\n%s", output.c_str());
+            return 1;
+        }
+        FILE* f = fopen(baseline_path, "wb");
+        if (!f) {
+            fprintf(stderr, "Cannot write %s\n", baseline_path);
+            return 1;
+        }
+        fwrite(output.data(), 1, output.size(), f);
+        fclose(f);
+        printf("Baseline written to %s\n", baseline_path);
+        return 0;
+    }
+
+    std::string baseline_text;
+    metric_map baseline;
+    if (read_file(baseline_path, &baseline_text) != 0 || parse_metrics(baseline_text, &baseline) != 0) {
+        fprintf(stderr, "Cannot read baseline %s\n", baseline_path);
+        return 1;
+    }
+
+    /* A busy machine only ever makes numbers worse: on a regression run the
+       scenario again and keep each metric's best value */
+    metric_map best;
+    int regressed = 0;
+    for (int attempt = 0; attempt <= retries; attempt++) {
+        output.clear();
+        metric_map current;
+        if (run_scenario(command, server_cmd, wait_port, &output) != 0) return 1;
+        if (parse_metrics(output, &current) != 0) {
+            fprintf(stderr, "Command output is not JSON:\n%s", output.c_str());
+            return 1;
+        }
+        for (const auto& kv : current) {
+            const struct metric_rule* rule = find_rule(rules, kv.first);
+            auto it = best.find(kv.first);
+            if (!rule || it == best.end()) best[kv.first] = kv.second;
+            else if (rule->lower_is_better ? kv.second < it->second : kv.second > it->second) it->second = kv.second;
+        }
+        regressed = check_metrics(baseline, best, rules, tolerance, attempt == retries);
+        if (regressed <= 0) break;
+        if (attempt < retries) printf("%d metric(s) regressed, running again (%d/%d)\n", regressed, attempt + 1, retries);
+    }
+    if (regressed < 0) {
+        fprintf(stderr, "No baseline metric matched the --lower/--higher rules\n");
+        return 1;
+    }
+    if (regressed == 0) check_metrics(baseline, best, rules, tolerance, 1);
+    printf("%d metric(s) regressed beyond %.2fx of %s\n", regressed, tolerance, baseline_path);
+    return regressed ? 1 : 0;
+}
@@ -0,0 +1,497 @@
+/* Replays a traffic capture (battleship_server --record) against a fresh
+   server: over real sockets to a running battleship_server, or straight
+   into an embedded server core (battleship_server.cpp built with
+   BATTLESHIP_SERVER_NO_MAIN). --speed 1 keeps the recorded pacing, N
+   plays N times faster and "max" sends as fast as the target takes it.
+   In-process runs use the capture's timestamps as the server clock, so
+   held seats expire as they did in production even at full speed.
+
+   Ship placement follows the server's RNG, so the in-process server
+   starts from the seed in the capture header unless --seed says
+   otherwise. A socket target has to be started with that --seed, and
+   can still drift when its poll loop interleaves connections in another
+   order than production did. Resume tokens come from the seed only when
+   the recording server ran with --seed, otherwise RESUME frames cannot
+   line up. Connections the server refuses, frames it answers with an
+   error and frames for connections it already closed are warned about:
+   each means the replay has left the recorded path. */
+
+#include "battleship.h"
+#include "battleship_capture.h"
+#include "battleship_server.h"
+#include "battleship_windows.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifndef _WIN32
+#include <netinet/tcp.h>
+#endif
+
+#ifdef _WIN32
+#define NULL_DEVICE "NUL"
+#else
+#define NULL_DEVICE "/dev/null"
+#endif
+
+#define REPLAY_FD_BASE 1000
+#define REPLAY_TICK_US 250000
+#define REPLAY_MAX_WARNINGS 10
+
+struct replay_config {
+    const char* capture_path;
+    const char* host;
+    int port;               // 0: in-process
+    double speed;           // 0: as fast as possible
+    int drain_ms;
+    unsigned long seed;
+    int seed_set;
+    int verbose;
+    int json;
+};
+
+struct replay_stats {
+    long long records;
+    long long connects;
+    long long frames;
+    long long closes;
+    long long rejected;     // connections the server refused
+    long long refused;      // frames answered with ERROR
+    long long diverged;     // frames for a connection the server had closed
+    long long warnings;
+    long long dropped;      // connections the server closed
+    long long bytes_out;    // server -> clients
+    uint64_t span_us;
+    std::vector<long long> handle_ns;
+    std::vector<long long> late_us;
+    std::map<std::string, long long> count_by_command;
+    std::map<std::string, long long> ns_by_command;
+};
+
+static struct replay_config g_cfg;
+static struct replay_stats g_stats;
+static uint64_t g_capture_now_us = 0;
+static std::unordered_map<int, int> g_open;     // replay fd/socket by capture connection
+static std::unordered_map<int, std::string> g_partial;  // socket target: a packet cut by recv
+static const char* g_applying = NULL;          // command of the frame being fed in
+
+// Says where the replay left the recording; the first few only
+static void warn_divergence(int conn, const char* fmt, ...) {
+    if (++g_stats.warnings > REPLAY_MAX_WARNINGS) return;
+    fprintf(stderr, "replay: t=%.3fs conn %d: ", g_stats.span_us / 1e6, conn);
+    va_list ap;
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fputc('\n', stderr);
+}
+
+/* Looks at one server packet for a refused frame. Invalid shots are not
+   counted: clients repeat cells, and production answered those the same. */
+static void note_reply(int conn, const packet_t* p) {
+    if (strncmp(p->command, "ERROR", sizeof(p->command)) != 0) return;
+    g_stats.refused++;
+    if (g_applying) {
+        warn_divergence(conn, "server answered %s with ERROR %.*s", g_applying, (int)sizeof(p->arg1), p->arg1);
+    } else {
+        warn_divergence(conn, "server sent ERROR %.*s", (int)sizeof(p->arg1), p->arg1);
+    }
+}
+
+static long long pct(std::vector<long long>& v, double q) {
+    if (v.empty()) return 0;
+    size_t idx = (size_t)(q * (double)(v.size() - 1) + 0.5);
+    return v[std::min(idx, v.size() - 1)];
+}
+
+/* In-process target */
+
+static int inproc_send(int fd, const packet_t* p) {
+    note_reply(fd - REPLAY_FD_BASE, p);
+    g_stats.bytes_out += PACKET_SIZE;
+    return PACKET_SIZE;
+}
+
+static void inproc_close(int fd) {
+    g_open.erase(fd - REPLAY_FD_BASE);
+}
+
+static long long inproc_clock_ms() {
+    return (long long)(g_capture_now_us / 1000);
+}
+
+static void inproc_apply(const struct capture_record* rec, const packet_t* p) {
+    int conn = (int)rec->conn;
+    int fd = REPLAY_FD_BASE + conn;
+
+    if (rec->kind == CAPTURE_CONNECT) {
+        g_open[conn] = fd;
+        if (server_attach(fd) == -1) {
+            g_open.erase(conn);
+            g_stats.rejected++;
+            warn_divergence(conn, "server refused the connection");
+        }
+        return;
+    }
+    if (g_open.find(conn) == g_open.end()) {
+        if (rec->kind == CAPTURE_FRAME) {
+            g_stats.diverged++;
+            warn_divergence(conn, "%.*s for a connection the server already closed",
+                            (int)sizeof(p->command), p->command);
+        }
+        return;
+    }
+
+    if (rec->kind == CAPTURE_FRAME) {
+        auto start = std::chrono::steady_clock::now();
+        g_applying = p->command;
+        server_receive(fd, p);
+        g_applying = NULL;
+        long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        g_stats.handle_ns.push_back(ns);
+        g_stats.count_by_command[p->command]++;
+        g_stats.ns_by_command[p->command] += ns;
+    } else {
+        server_detach(fd);
+        g_open.erase(conn);
+    }
+}
+
+/* Socket target */
+
+static int set_nonblocking(int fd) {
+#ifdef _WIN32
+    u_long mode = 1;
+    return ioctlsocket((SOCKET)fd, FIONBIO, &mode);
+#else
+    int flags = fcntl(fd, F_GETFL, 0);
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+#endif
+}
+
+static int would_block() {
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
+
+// Reads and discards server output so the server never blocks on us
+static void drain_sockets(int timeout_ms) {
+    std::vector<struct pollfd> pfds;
+    std::vector<int> conns;
+    for (const auto& kv : g_open) {
+        struct pollfd p;
+        p.fd = kv.second;
+        p.events = POLLIN;
+        p.revents = 0;
+        pfds.push_back(p);
+        conns.push_back(kv.first);
+    }
+    if (pfds.empty()) {
+        if (timeout_ms > 0) std::this_thread::sleep_for(std::chrono::milliseconds(timeout_ms));
+        return;
+    }
+    if (poll(pfds.data(), (unsigned long)pfds.size(), timeout_ms) <= 0) return;
+
+    char buf[16 * PACKET_SIZE];
+    for (size_t i = 0; i < pfds.size(); i++) {
+        if (!(pfds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+        while (1) {
+            int n = recv(pfds[i].fd, buf, sizeof(buf), 0);
+            if (n > 0) {
+                g_stats.bytes_out += n;
+                std::string& pending = g_partial[conns[i]];
+                pending.append(buf, (size_t)n);
+                size_t used = 0;
+                for (; pending.size() - used >= PACKET_SIZE; used += PACKET_SIZE) {
+                    packet_t reply;
+                    memcpy(&reply, pending.data() + used, PACKET_SIZE);
+                    note_reply(conns[i], &reply);
+                }
+                pending.erase(0, used);
+                continue;
+            }
+            if (n == -1 && would_block()) break;
+            g_stats.dropped++;
+            sock_close(pfds[i].fd);
+            g_open.erase(conns[i]);
+            g_partial.erase(conns[i]);
+            break;
+        }
+    }
+}
+
+static void socket_send_all(int conn, int fd, const packet_t* p) {
+    const char* buf = (const char*)p;
+    int sent = 0;
+    while (sent < PACKET_SIZE) {
+        int n = send(fd, buf + sent, PACKET_SIZE - sent, 0);
+        if (n > 0) {
+            sent += n;
+            continue;
+        }
+        if (n == -1 && would_block()) {
+            drain_sockets(1);
+            if (g_open.find(conn) == g_open.end()) return;
+            continue;
+        }
+        sock_close(fd);
+        g_open.erase(conn);
+        return;
+    }
+}
+
+static void socket_apply(const struct capture_record* rec, const packet_t* p,
+                         const struct sockaddr_in* addr) {
+    int conn = (int)rec->conn;
+    if (rec->kind == CAPTURE_CONNECT) {
+        int fd = (int)socket(AF_INET, SOCK_STREAM, 0);
+        if (fd == -1 || connect(fd, (const struct sockaddr*)addr, sizeof(*addr)) == -1) {
+            if (fd != -1) sock_close(fd);
+            g_stats.rejected++;
+            warn_divergence(conn, "server refused the connection");
+            return;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const char*)&one, sizeof(one));
+        set_nonblocking(fd);
+        g_open[conn] = fd;
+        return;
+    }
+    auto it = g_open.find(conn);
+    if (it == g_open.end()) {
+        if (rec->kind == CAPTURE_FRAME) {
+            g_stats.diverged++;
+            warn_divergence(conn, "%.*s for a connection the server already closed",
+                            (int)sizeof(p->command), p->command);
+        }
+        return;
+    }
+    if (rec->kind == CAPTURE_FRAME) {
+        g_stats.count_by_command[p->command]++;
+        socket_send_all(conn, it->second, p);
+    } else {
+        sock_close(it->second);
+        g_open.erase(it);
+        g_partial.erase(conn);
+    }
+}
+
+static void print_usage(const char* prog) {
+    printf("Usage: %s CAPTURE [-h HOST -p PORT] [--speed 1|N|max] [--drain-ms MS]\n"
+           "          [--seed N] [--verbose] [--json]\n"
+           "Without -p the capture is fed to an in-process server core, seeded from\n"
+           "the capture unless --seed is given. A socket target should be a fresh\n"
+           "server started with --no-snapshot and the seed the replay prints.\n", prog);
+}
+
+int main(int argc, char* argv[]) {
+    g_cfg.capture_path = NULL;
+    g_cfg.host = "127.0.0.1";
+    g_cfg.port = 0;
+    g_cfg.speed = 0;
+    g_cfg.drain_ms = 500;
+    g_cfg.seed = 0;
+    g_cfg.seed_set = 0;
+    g_cfg.verbose = 0;
+    g_cfg.json = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char* a = argv[i];
+        const char* v = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (strcmp(a, "-h") == 0 && v) { g_cfg.host = v; i++; }
+        else if ((strcmp(a, "-p") == 0 || strcmp(a, "--port") == 0) && v) { g_cfg.port = atoi(v); i++; }
+        else if (strcmp(a, "--speed") == 0 && v) {
+            g_cfg.speed = strcmp(v, "max") == 0 ? 0 : atof(v);
+            i++;
+        }
+        else if (strcmp(a, "--drain-ms") == 0 && v) { g_cfg.drain_ms = atoi(v); i++; }
+        else if (strcmp(a, "--seed") == 0 && v) { g_cfg.seed = strtoul(v, NULL, 10); g_cfg.seed_set = 1; i++; }
+        else if (strcmp(a, "--verbose") == 0) { g_cfg.verbose = 1; }
+        else if (strcmp(a, "--json") == 0) { g_cfg.json = 1; }
+        else if (a[0] != '-' && !g_cfg.capture_path) { g_cfg.capture_path = a; }
+        else { print_usage(argv[0]); return strcmp(a, "--help") == 0 ? 0 : 1; }
+    }
+    if (!g_cfg.capture_path || g_cfg.speed < 0) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    struct capture_header header;
+    FILE* f = capture_reader_open(g_cfg.capture_path, &header);
+    if (!f) return 1;
+
+    int inproc = g_cfg.port == 0;
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+
+    if (inproc) {
+        struct server_transport transport = {inproc_send, inproc_close};
+        server_set_transport(&transport);
+        server_set_clock(inproc_clock_ms);
+        server_set_seed(g_cfg.seed_set ? (unsigned int)g_cfg.seed : header.seed);
+        server_set_record_wins(0);
+        server_reset();
+    } else {
+#ifdef _WIN32
+        if (!init_winsock()) {
+            fprintf(stderr, "Failed to initialize Winsock\n");
+            return 1;
+        }
+#else
+        signal(SIGPIPE, SIG_IGN);
+#endif
+        struct hostent* hp = gethostbyname(g_cfg.host);
+        if (!hp) {
+            fprintf(stderr, "Unknown host: %s\n", g_cfg.host);
+            return 1;
+        }
+        addr.sin_family = AF_INET;
+        memcpy(&addr.sin_addr, hp->h_addr_list[0], hp->h_length);
+        addr.sin_port = htons(g_cfg.port);
+    }
+
+    if (!inproc) {
+        fprintf(stderr, "replay: the capture was recorded with seed %u; start the target with --seed %u\n",
+                header.seed, header.seed);
+    } else if (g_cfg.seed_set && (unsigned int)g_cfg.seed != header.seed) {
+        fprintf(stderr, "replay: --seed %lu overrides the capture's seed %u; expect divergence\n",
+                g_cfg.seed, header.seed);
+    }
+    if (!header.seeded) {
+        fprintf(stderr, "replay: the capture was recorded without --seed, so RESUME frames will not match\n");
+    }
+
+    // The embedded server logs every connection; keep that out of the report
+    int saved_stdout = -1;
+    if (inproc && !g_cfg.verbose) {
+        fflush(stdout);
+        int devnull = open(NULL_DEVICE, O_WRONLY);
+        if (devnull >= 0) {
+            saved_stdout = dup(fileno(stdout));
+            dup2(devnull, fileno(stdout));
+            close(devnull);
+        }
+    }
+
+    auto wall_start = std::chrono::steady_clock::now();
+    uint64_t next_tick_us = REPLAY_TICK_US;
+    struct capture_record rec;
+    packet_t pkt;
+    int rc;
+    while ((rc = capture_read(f, &rec, &pkt)) == 1) {
+        g_stats.records++;
+        g_stats.span_us = rec.t_us;
+
+        if (g_cfg.speed > 0) {
+            auto due = wall_start + std::chrono::microseconds((long long)(rec.t_us / g_cfg.speed));
+            while (std::chrono::steady_clock::now() < due) {
+                long long left_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    due - std::chrono::steady_clock::now()).count();
+                if (inproc) std::this_thread::sleep_until(due);
+                else drain_sockets((int)std::min(50LL, std::max(0LL, left_ms)));
+            }
+            g_stats.late_us.push_back(std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - due).count());
+        }
+
+        if (rec.kind == CAPTURE_CONNECT) g_stats.connects++;
+        else if (rec.kind == CAPTURE_FRAME) g_stats.frames++;
+        else g_stats.closes++;
+
+        if (inproc) {
+            g_capture_now_us = rec.t_us;
+            while (next_tick_us <= rec.t_us) {
+                server_tick();
+                next_tick_us += REPLAY_TICK_US;
+            }
+            inproc_apply(&rec, &pkt);
+        } else {
+            socket_apply(&rec, &pkt, &addr);
+            drain_sockets(0);
+        }
+    }
+    fclose(f);
+
+    if (!inproc) {
+        auto drain_end = std::chrono::steady_clock::now() + std::chrono::milliseconds(g_cfg.drain_ms);
+        while (!g_open.empty() && std::chrono::steady_clock::now() < drain_end) drain_sockets(20);
+        for (const auto& kv : g_open) sock_close(kv.second);
+        g_open.clear();
+    }
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+
+    if (saved_stdout >= 0) {
+        fflush(stdout);
+        dup2(saved_stdout, fileno(stdout));
+        close(saved_stdout);
+    }
+    if (rc < 0) fprintf(stderr, "Capture is damaged after %lld records\n", g_stats.records);
+    if (g_stats.warnings > REPLAY_MAX_WARNINGS) {
+        fprintf(stderr, "replay: %lld more divergence warnings not shown\n", g_stats.warnings - REPLAY_MAX_WARNINGS);
+    }
+    if (g_stats.warnings > 0) {
+        fprintf(stderr, "replay: diverged from the recording (%lld refused connections, %lld refused frames, "
+                "%lld frames after a close)\n", g_stats.rejected, g_stats.refused, g_stats.diverged);
+    }
+
+    std::sort(g_stats.handle_ns.begin(), g_stats.handle_ns.end());
+    std::sort(g_stats.late_us.begin(), g_stats.late_us.end());
+    double span = g_stats.span_us / 1e6;
+
+    if (g_cfg.json) {
+        printf("{\"target\": \"%s\", \"speed\": %.2f, \"records\": %lld, \"connects\": %lld, "
+               "\"frames\": %lld, \"closes\": %lld, \"rejected\": %lld, \"refused\": %lld, \"diverged\": %lld, "
+               "\"dropped\": %lld, \"capture_s\": %.3f, "
+               "\"wall_s\": %.3f, \"frames_per_s\": %.1f, \"bytes_out\": %lld, "
+               "\"handle_p50_ns\": %lld, \"handle_p99_ns\": %lld, \"handle_p999_ns\": %lld, "
+               "\"late_p99_us\": %lld}\n",
+               inproc ? "inproc" : "socket", g_cfg.speed, g_stats.records, g_stats.connects,
+               g_stats.frames, g_stats.closes, g_stats.rejected, g_stats.refused, g_stats.diverged,
+               g_stats.dropped, span, wall,
+               wall > 0 ? g_stats.frames / wall : 0.0, g_stats.bytes_out,
+               pct(g_stats.handle_ns, 0.5), pct(g_stats.handle_ns, 0.99), pct(g_stats.handle_ns, 0.999),
+               pct(g_stats.late_us, 0.99));
+        return rc < 0 ? 1 : 0;
+    }
+
+    printf("=== REPLAY %s -> %s ===\n", g_cfg.capture_path, inproc ? "in-process server" : "socket");
+    printf("records=%lld connects=%lld frames=%lld closes=%lld rejected=%lld refused=%lld diverged=%lld "
+           "dropped=%lld\n", g_stats.records, g_stats.connects, g_stats.frames, g_stats.closes,
+           g_stats.rejected, g_stats.refused, g_stats.diverged, g_stats.dropped);
+    printf("capture span=%.2fs wall=%.2fs (%.1fx) frames/s=%.0f server bytes=%lld\n",
+           span, wall, wall > 0 ? span / wall : 0.0, wall > 0 ? g_stats.frames / wall : 0.0,
+           g_stats.bytes_out);
+    if (g_cfg.speed > 0) {
+        printf("schedule lateness: p50=%lldus p99=%lldus\n", pct(g_stats.late_us, 0.5), pct(g_stats.late_us, 0.99));
+    }
+    if (inproc) {
+        printf("server handling: p50=%lldns p99=%lldns p999=%lldns\n",
+               pct(g_stats.handle_ns, 0.5), pct(g_stats.handle_ns, 0.99), pct(g_stats.handle_ns, 0.999));
+    }
+    for (const auto& kv : g_stats.count_by_command) {
+        if (inproc) {
+            printf("  %-18s count=%-9lld mean=%lldns\n", kv.first.c_str(), kv.second,
+                   g_stats.ns_by_command[kv.first] / kv.second);
+        } else {
+            printf("  %-18s count=%lld\n", kv.first.c_str(), kv.second);
+        }
+    }
+    return rc < 0 ? 1 : 0;
+}
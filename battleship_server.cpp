@@ -1,5 +1,19 @@
 #include "battleship.h"
+#include "battleship_server.h"
 #include "battleship_windows.h"
+#include "battleship_snapshot.h"
+#include "battleship_handoff.h"
+#include "battleship_leaderboard.h"
+#include "battleship_crdt.h"
+#include "battleship_capture.h"
+#include "battleship_bot_pool.h"
+#include "battleship_metrics.h"
+#include "battleship_trace.h"
+#include "battleship_log.h"
+#include "battleship_watchdog.h"
+#include "battleship_alloc.h"
+#include "battleship_admin.h"
+#include "battleship_timer.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -12,18 +26,31 @@
 #else
 #include <syslog.h>
 #include <sys/stat.h>
+#include <sys/resource.h>
 #include <fcntl.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <poll.h>
 #include <signal.h>
 #include <unistd.h>
+#include <sys/ioctl.h>
 #endif
 
 #define BUFFER_SIZE 1024
 
+/* Fixed slots at the front of the poll set; clients follow */
+enum {
+    POLL_LISTENER = 0,
+    POLL_UPGRADE,
+    POLL_BOTS,
+    POLL_ADMIN,
+    POLL_SIGNAL,
+    POLL_FIRST_CLIENT
+};
+
 #ifdef _WIN32
 #define PID_FILE "battleship_server.pid"
 #else
@@ -32,7 +59,165 @@
 
 struct client_info clients[MAX_CLIENTS];
 struct game_session sessions[MAX_SESSIONS];
-static int g_server_sock = -1;
+#ifndef BATTLESHIP_SERVER_NO_MAIN
+static int g_upgrade_sock = -1;
+static const char* g_upgrade_path = NULL;
+#endif
+static int g_resume_grace_sec = 60;
+static int g_record_wins = 1;
+
+/* Hooks for embedding (battleship_server.h); NULL means sockets/clock */
+static struct server_transport g_transport = {NULL, NULL};
+static server_clock_fn g_clock = NULL;
+static unsigned int g_rng = 0;          // placement, and tokens when seeded
+static int g_seeded = 0;
+
+/* Server-hosted bots (JOIN_SESSION arg2 "bot" or "bot:LEVEL"). A bot sits
+   in an ordinary client slot with a virtual fd: packets sent to it are
+   read by bot_deliver() instead of a socket, and its replies go through
+   process_client_packet() from dispatch_bots(), never from inside another
+   client's handler. Moves are computed on the bot pool. */
+#define BOT_FD_BASE 0x40000000
+
+struct hosted_bot {
+    int active;
+    int level;
+    int want_place;
+    int want_move;
+    int want_leave;
+    unsigned int serial;        // move being computed, 0 if none
+    Field fog;                  // from ENEMY_FOG_UPDATE
+};
+
+static struct hosted_bot g_bots[MAX_CLIENTS];
+static unsigned int g_bot_serial = 0;
+static int g_bot_deadline_ms = BOT_MOVE_DEADLINE_MS;
+
+/* Application heartbeats. Every g_heartbeat_ms each connection gets PING
+   with the server's monotonic microseconds in arg1 and echoes them back
+   in PONG. RTT is smoothed per connection the way TCP does it (RFC 6298:
+   srtt += err / 8, rttvar += (|err| - rttvar) / 4). A connection that has
+   answered before and then misses HEARTBEAT_MISSES pings in a row is
+   dropped like a lost connection; clients that never answer (older
+   builds) are left to TCP keepalive. */
+#define HEARTBEAT_INTERVAL_MS 5000
+#define HEARTBEAT_MISSES 3
+#define HEARTBEAT_CHECK_MS 250
+
+struct heartbeat {
+    long long next_ping_ms;     // 0 until the first check sees the connection
+    long long ping_sent_us;     // outstanding PING, 0 once answered
+    int missed;
+    int answered;               // has ever sent PONG
+    long long srtt_us;
+    long long rttvar_us;
+    long long last_rtt_us;
+};
+
+static struct heartbeat g_heartbeats[MAX_CLIENTS];     // by client slot
+#ifndef BATTLESHIP_SERVER_NO_MAIN
+static int g_heartbeat_ms = HEARTBEAT_INTERVAL_MS;     // embedders ping nobody
+#endif
+
+/* Deadlines. Each seat and each session owns its timer nodes on one
+   timing wheel (battleship_timer.h); arming and cancelling are O(1) and
+   server_tick() only visits what came due. A timer that fires re-checks
+   the state it guards, so the places that make a deadline moot (a shot, a
+   placement, a RESUME) may leave it armed. 0 seconds disables a kind.
+     turn       the player on turn did not shoot: the server shoots for
+                them, and after TURN_FORFEIT_AFTER in a row (or at once
+                with the forfeit action) they lose the game
+     placement  the player did not place their ships: auto placement
+     seat       a held seat's resume grace ran out
+     idle       a connection outside a game sent nothing (PONG aside) */
+#define TURN_TIMEOUT_SEC 60
+#define TURN_FORFEIT_AFTER 3
+#define PLACEMENT_TIMEOUT_SEC 120
+#define IDLE_TIMEOUT_SEC 300
+
+enum { TIMER_TURN = 0, TIMER_PLACEMENT, TIMER_SEAT, TIMER_IDLE };
+enum { TURN_ACTION_SHOT = 0, TURN_ACTION_FORFEIT };
+
+struct seat_timers {
+    struct timer placement;
+    struct timer seat;
+    struct timer idle;
+};
+
+struct turn_clock {
+    struct timer timer;
+    int timeouts[2];            // in a row, by player number - 1
+};
+
+static struct timer_wheel g_wheel;
+static int g_wheel_ready = 0;                           // armed lazily, on the embedder's clock
+static struct seat_timers g_seat_timers[MAX_CLIENTS];  // by client slot
+static struct turn_clock g_turn_clocks[MAX_SESSIONS];
+static int g_turn_timeout_sec = TURN_TIMEOUT_SEC;
+static int g_turn_action = TURN_ACTION_SHOT;
+static int g_placement_timeout_sec = PLACEMENT_TIMEOUT_SEC;
+static int g_idle_timeout_sec = IDLE_TIMEOUT_SEC;
+/* Connections closed other than by their own packet (timers, a RESUME
+   taking over a seat): main() takes them out of the poll set */
+static int g_closed_elsewhere = 0;
+
+/* Shutdown. SIGINT/SIGTERM only count the signal and write to a
+   self-pipe; the loop takes it from there and drains: JOIN_SESSION is
+   refused (ERROR SERVER_DRAINING) while games past the lobby with a
+   player still connected go on until they are over or --drain-timeout
+   runs out, and a second signal stops waiting. Sends give up after
+   DRAIN_SEND_TIMEOUT_MS meanwhile, and a peer that does not keep up is
+   cut off, so no slow reader holds the loop past the deadline. Then
+   every connection is told without blocking, its write side is shut
+   down and peers get SHUTDOWN_LINGER_MS to read it and close before the
+   state is persisted and the server exits. Seats of unfinished games
+   stay in the snapshot: their players get SERVER_RESTARTING and resume
+   against the next server, everyone else GAME_OVER SERVER_SHUTDOWN. */
+#define DRAIN_TIMEOUT_SEC 30
+#define SHUTDOWN_LINGER_MS 1000
+#define DRAIN_SEND_TIMEOUT_MS 500
+
+static volatile sig_atomic_t g_signals = 0;
+static int g_signal_pipe[2] = {-1, -1};
+static int g_draining = 0;
+#ifndef BATTLESHIP_SERVER_NO_MAIN
+static int g_drain_timeout_sec = DRAIN_TIMEOUT_SEC;
+#endif
+
+/* What the admin console shows besides the game state itself. Handler
+   time is the wall-clock delta server_receive() already takes around
+   process_client_packet(); the loop is single-threaded, so it is the CPU
+   the packet cost the loop, without a second clock read per packet. */
+struct conn_stats {
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t packets_in;
+    uint64_t handler_ns;
+    time_t connected_at;
+};
+
+struct traffic {
+    uint64_t handler_ns;
+    uint64_t packets_in;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+};
+
+struct session_stats {
+    time_t created_at;
+    int moves;                  // shots that landed on the board
+    struct traffic total;
+    struct traffic sampled;     // total at the last hot-session sample
+};
+
+static struct conn_stats g_conn_stats[MAX_CLIENTS];    // by client slot
+static struct session_stats g_session_stats[MAX_SESSIONS];
+
+/* fd -> client slot. Entries are checked against clients[] on use and
+   refilled by a scan on a miss, so moving an fd between slots (RESUME,
+   takeover) needs no bookkeeping here. */
+#define FD_SLOT_CACHE (MAX_CLIENTS + 256)
+static int g_fd_slots[FD_SLOT_CACHE];
 
 /* Forward declarations */
 void send_session_list(struct client_info* client);
@@ -40,6 +225,11 @@ int auto_assign_to_session(struct client_info* client);
 int assign_to_session(struct client_info* client, int session_id);
 void broadcast_session_list();
 void disconnect_client(struct client_info* c);
+static void release_seat(struct client_info* c);
+static int host_bot(int session_id, int level);
+static void heartbeat_answered(struct client_info* c, const char* echo);
+
+#ifndef BATTLESHIP_SERVER_NO_MAIN
 
 /* PID file helpers */
 static int write_pid_file() {
@@ -61,6 +251,159 @@ static void remove_pid_file() {
     remove(PID_FILE);
 }
 
+#endif /* BATTLESHIP_SERVER_NO_MAIN */
+
+static long long monotonic_ms() {
+    if (g_clock) return g_clock();
+#ifdef _WIN32
+    return (long long)GetTickCount64();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
+}
+
+// Wall-clock seconds, or the embedder's clock
+static time_t server_time() {
+    if (g_clock) return (time_t)(g_clock() / 1000);
+    return time(NULL);
+}
+
+/* --- deadlines --- */
+
+static struct timer_wheel* wheel() {
+    if (!g_wheel_ready) {
+        timer_wheel_init(&g_wheel, monotonic_ms());
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            timer_init(&g_seat_timers[i].placement, TIMER_PLACEMENT, i);
+            timer_init(&g_seat_timers[i].seat, TIMER_SEAT, i);
+            timer_init(&g_seat_timers[i].idle, TIMER_IDLE, i);
+        }
+        for (int s = 0; s < MAX_SESSIONS; s++) {
+            timer_init(&g_turn_clocks[s].timer, TIMER_TURN, s);
+            g_turn_clocks[s].timeouts[0] = g_turn_clocks[s].timeouts[1] = 0;
+        }
+        g_wheel_ready = 1;
+    }
+    return &g_wheel;
+}
+
+// Arms t seconds from now; 0 or less cancels it
+static void arm_timer(struct timer* t, long long seconds) {
+    if (seconds <= 0) {
+        timer_cancel(wheel(), t);
+        return;
+    }
+    timer_arm(wheel(), t, monotonic_ms() + seconds * 1000);
+}
+
+static void cancel_seat_timers(struct client_info* c) {
+    struct seat_timers* st = &g_seat_timers[c - clients];
+    timer_cancel(wheel(), &st->placement);
+    timer_cancel(wheel(), &st->seat);
+    timer_cancel(wheel(), &st->idle);
+}
+
+/* Not in a game that has deadlines of its own: no session yet, waiting
+   for an opponent, or the game is over */
+static int outside_game(const struct client_info* c) {
+    if (c->session_id == -1) return 1;
+    const struct game_session* sess = &sessions[c->session_id];
+    return sess->game_finished || !sess->player1 || !sess->player2;
+}
+
+// Restarts the idle clock of a connection outside a game
+static void watch_idle(struct client_info* c) {
+    if (c->fd == -1 || g_bots[c - clients].active || !outside_game(c)) return;
+    arm_timer(&g_seat_timers[c - clients].idle, g_idle_timeout_sec);
+}
+
+/* Placement is in turns: player 1 first, then player 2 (STATE_SYNC's P) */
+static int placing_now(const struct client_info* c) {
+    if (c->session_id == -1 || c->ready) return 0;
+    const struct game_session* sess = &sessions[c->session_id];
+    const struct client_info* opponent = (c->player_number == 1) ? sess->player2 : sess->player1;
+    return !sess->game_started && !sess->game_finished && opponent && (c->player_number == 1 || opponent->ready);
+}
+
+static void watch_placement(struct client_info* c) {
+    arm_timer(&g_seat_timers[c - clients].placement, g_placement_timeout_sec);
+}
+
+// A held seat expires g_resume_grace_sec after it was detached
+static void watch_held_seat(struct client_info* c) {
+    long long left = g_resume_grace_sec - (long long)(server_time() - c->detached_at);
+    timer_arm(wheel(), &g_seat_timers[c - clients].seat, monotonic_ms() + (left > 0 ? left * 1000 : 0));
+}
+
+static void start_turn_clock(int session_id) {
+    arm_timer(&g_turn_clocks[session_id].timer, g_turn_timeout_sec);
+}
+
+/* Resume tokens: 128 random bits, hex encoded */
+static void generate_resume_token(char* out) {
+    unsigned char raw[(RESUME_TOKEN_SIZE - 1) / 2];
+    int have = 0;
+    if (g_seeded) {
+        for (size_t i = 0; i < sizeof(raw); i++) raw[i] = (unsigned char)(xorshift32(&g_rng) >> 24);
+        have = 1;
+    }
+#ifndef _WIN32
+    static FILE* urandom = NULL;
+    if (!have && !urandom) urandom = fopen("/dev/urandom", "rb");
+    if (!have && urandom) have = fread(raw, 1, sizeof(raw), urandom) == sizeof(raw);
+#endif
+    if (!have) {
+        for (size_t i = 0; i < sizeof(raw); i++) raw[i] = (unsigned char)(rand() & 0xff);
+    }
+    static const char hex[] = "0123456789abcdef";
+    for (size_t i = 0; i < sizeof(raw); i++) {
+        out[2 * i] = hex[raw[i] >> 4];
+        out[2 * i + 1] = hex[raw[i] & 0x0f];
+    }
+    out[2 * sizeof(raw)] = '\0';
+}
+
+/* A slot is free only when it has no connection and holds no seat */
+static int find_free_client_slot() {
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (clients[i].fd == -1 && clients[i].session_id == -1) return i;
+    }
+    return -1;
+}
+
+static void reset_client_slot(struct client_info* c) {
+    c->fd = -1;
+    c->session_id = -1;
+    c->player_number = 0;
+    c->ready = 0;
+    c->nickname[0] = '\0';
+    c->resume_token[0] = '\0';
+    c->detached_at = 0;
+    create_game_field(c->field);
+    initialize_ships(&c->ship_data);
+    memset(&g_heartbeats[c - clients], 0, sizeof(g_heartbeats[0]));
+    memset(&g_conn_stats[c - clients], 0, sizeof(g_conn_stats[0]));
+    cancel_seat_timers(c);
+}
+
+/* The seat a resume token belongs to. Usually held (fd -1), but the old
+   connection may still be registered when it went half-open and the
+   player noticed before the server did. */
+static struct client_info* find_held_seat(const char* token) {
+    if (!token || !token[0]) return NULL;
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (clients[i].session_id != -1 && !g_bots[i].active &&
+            strcmp(clients[i].resume_token, token) == 0) {
+            return &clients[i];
+        }
+    }
+    return NULL;
+}
+
+#ifndef BATTLESHIP_SERVER_NO_MAIN
+
 /* Daemonize (POSIX only) */
 static int daemonize() {
 #ifdef _WIN32
@@ -86,8 +429,78 @@ static int daemonize() {
 #endif
 }
 
+#endif /* BATTLESHIP_SERVER_NO_MAIN */
+
+static int is_bot_fd(int fd) {
+    return fd >= BOT_FD_BASE && fd < BOT_FD_BASE + MAX_CLIENTS;
+}
+
+/* A hosted bot "receives" a packet: only note what it has to do next */
+static int bot_deliver(struct hosted_bot* b, const packet_t* p) {
+    if (strcmp(p->command, "ENEMY_FOG_UPDATE") == 0) {
+        decode_field(p->arg1, b->fog);
+    } else if (strcmp(p->command, "YOUR_TURN") == 0) {
+        b->want_move = 1;
+    } else if (strcmp(p->command, "PLACEMENT_START") == 0) {
+        b->want_place = 1;
+    } else if (strcmp(p->command, "GAME_OVER") == 0 || strcmp(p->command, "OPPONENT_DISCONNECTED") == 0) {
+        b->want_leave = 1;
+    }
+    return PACKET_SIZE;
+}
+
+static int client_slot_of_fd(int fd) {
+    if (fd < 0) return -1;
+    if (fd < FD_SLOT_CACHE) {
+        int slot = g_fd_slots[fd];
+        if (clients[slot].fd == fd) return slot;
+    }
+    for (int j = 0; j < MAX_CLIENTS; j++) {
+        if (clients[j].fd == fd) {
+            if (fd < FD_SLOT_CACHE) g_fd_slots[fd] = j;
+            return j;
+        }
+    }
+    return -1;
+}
+
+static void count_bytes_out(int fd, int sent) {
+    int slot = client_slot_of_fd(fd);
+    if (slot == -1 || sent <= 0) return;
+    g_conn_stats[slot].bytes_out += (uint64_t)sent;
+    int session_id = clients[slot].session_id;
+    if (session_id >= 0 && session_id < MAX_SESSIONS) g_session_stats[session_id].total.bytes_out += (uint64_t)sent;
+}
+
+/* Charges one handled packet to its connection and session. A packet that
+   left its session (QUIT, DISCONNECT) is charged to the one it left. */
+static void count_packet_in(struct client_info* c, int session_before, int bytes, uint64_t handler_ns) {
+    struct conn_stats* st = &g_conn_stats[c - clients];
+    st->bytes_in += (uint64_t)bytes;
+    st->packets_in++;
+    st->handler_ns += handler_ns;
+    int session_id = c->session_id != -1 ? c->session_id : session_before;
+    if (session_id < 0 || session_id >= MAX_SESSIONS) return;
+    struct traffic* t = &g_session_stats[session_id].total;
+    t->bytes_in += (uint64_t)bytes;
+    t->packets_in++;
+    t->handler_ns += handler_ns;
+}
+
 /* Packet helpers */
 static int send_packet_fd(int fd, const packet_t* p) {
+    if (is_bot_fd(fd)) return bot_deliver(&g_bots[fd - BOT_FD_BASE], p);
+    int command_id = metrics_command_id(p->command);
+    metrics_packet_out(command_id, PACKET_SIZE);
+    uint64_t outer = watchdog_enter(WATCHDOG_SEND, command_id, fd);
+    uint64_t started = trace_now_ns();
+    if (g_transport.send) {
+        int r = g_transport.send(fd, p);
+        trace_complete(TRACE_SEND, command_id, fd, started, trace_now_ns());
+        watchdog_leave(outer);
+        count_bytes_out(fd, r);
+        return r;
+    }
     const char* buf = (const char*)p;
     int to_send = PACKET_SIZE;
     int sent = 0;
@@ -95,27 +508,43 @@ static int send_packet_fd(int fd, const packet_t* p) {
         int n = send(fd, buf + sent, to_send - sent, 0);
         if (n <= 0) {
             if (n == -1 && errno == EINTR) continue;
-            return -1;
+#ifndef _WIN32
+            /* Only a drain sets a send timeout: the packet is cut, so the
+               connection is too, and the loop reaps it on the EOF */
+            if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) shutdown(fd, SHUT_RDWR);
+#endif
+            sent = -1;
+            break;
         }
         sent += n;
     }
+    /* A send that blocks on a full socket buffer shows up here */
+    trace_complete(TRACE_SEND, command_id, fd, started, trace_now_ns());
+    watchdog_leave(outer);
+    count_bytes_out(fd, sent);
     return sent;
 }
 
+#ifndef BATTLESHIP_SERVER_NO_MAIN
 static int recv_packet_fd(int fd, packet_t* p) {
     char* buf = (char*)p;
     int to_read = PACKET_SIZE;
     int got = 0;
+    /* Blocks until the whole packet is in, however slowly it trickles */
+    uint64_t outer = watchdog_enter(WATCHDOG_RECV, 0, fd);
     while (got < to_read) {
         int n = recv(fd, buf + got, to_read - got, 0);
         if (n <= 0) {
             if (n == -1 && errno == EINTR) continue;
-            return -1;
+            got = -1;
+            break;
         }
         got += n;
     }
+    watchdog_leave(outer);
     return got;
 }
+#endif /* BATTLESHIP_SERVER_NO_MAIN */
 
 static void send_packet_by_parts(int fd, const char* command, const char* arg1, const char* arg2) {
     packet_t p;
@@ -126,6 +555,17 @@ static void send_packet_by_parts(int fd, const char* command, const char* arg1,
     send_packet_fd(fd, &p);
 }
 
+static void close_client_fd(int fd) {
+    trace_instant(TRACE_DISCONNECT, fd);
+    if (is_bot_fd(fd)) {
+        g_bots[fd - BOT_FD_BASE].active = 0;
+        return;
+    }
+    capture_disconnect(fd);
+    if (g_transport.close) g_transport.close(fd);
+    else sock_close(fd);
+}
+
 void send_message(int fd, const char* message) {
     send_packet_by_parts(fd, "RAW", message, NULL);
 }
@@ -133,45 +573,26 @@ void send_message(int fd, const char* message) {
 /* Field sync helpers */
 void send_full_field_update(struct client_info* client) {
     if (!client || client->fd == -1) return;
-    char payload[PLAYABLE_SIZE * PLAYABLE_SIZE + 1];
-    int idx = 0;
-    for (int i = 1; i <= PLAYABLE_SIZE; i++) {
-        for (int j = 1; j <= PLAYABLE_SIZE; j++) {
-            payload[idx++] = '0' + (client->field[i][j] & 0x07);
-        }
-    }
-    payload[idx] = '\0';
+    char payload[FIELD_PAYLOAD_SIZE + 1];
+    encode_field(client->field, payload);
+    payload[FIELD_PAYLOAD_SIZE] = '\0';
     send_packet_by_parts(client->fd, "FIELD_UPDATE", payload, NULL);
 }
 
-void build_fog_field(char dest[12][12], char src[12][12]) {
-    for (int i = 1; i <= PLAYABLE_SIZE; i++) {
-        for (int j = 1; j <= PLAYABLE_SIZE; j++) {
-            char v = src[i][j];
-            if (v == 2 || v == 3) dest[i][j] = v;
-            else dest[i][j] = 0;
-        }
-    }
-}
-
 void send_fog_update(struct client_info* attacker, struct client_info* defender) {
     if (!attacker || attacker->fd == -1 || !defender) return;
     char fog[12][12];
     build_fog_field(fog, defender->field);
-    char payload[PLAYABLE_SIZE * PLAYABLE_SIZE + 1];
-    int idx = 0;
-    for (int i = 1; i <= PLAYABLE_SIZE; i++) {
-        for (int j = 1; j <= PLAYABLE_SIZE; j++) {
-            payload[idx++] = '0' + (fog[i][j] & 0x07);
-        }
-    }
-    payload[idx] = '\0';
+    char payload[FIELD_PAYLOAD_SIZE + 1];
+    encode_field(fog, payload);
+    payload[FIELD_PAYLOAD_SIZE] = '\0';
     send_packet_by_parts(attacker->fd, "ENEMY_FOG_UPDATE", payload, NULL);
 }
 
 /* Game/session helpers */
 void handle_ship_placement(struct client_info* client) {
     if (!client) return;
+    watch_placement(client);
     if (client->player_number == 1) {
         send_packet_by_parts(client->fd, "PLACEMENT_START", "1", NULL);
         for (int i = 0; i < MAX_CLIENTS; i++) {
@@ -197,7 +618,9 @@ void start_game_session(int session_id) {
 
     if (player1 && player2 && player1->ready && player2->ready) {
         sess->game_started = 1;
+        sess->game_finished = 0;
         sess->current_turn = 1;
+        snapshot_mark_dirty(session_id);
         
         send_packet_by_parts(player1->fd, "GAME_START", "1", NULL);
         send_packet_by_parts(player2->fd, "GAME_START", "2", NULL);
@@ -210,11 +633,13 @@ void start_game_session(int session_id) {
 
         send_packet_by_parts(player1->fd, "YOUR_TURN", NULL, NULL);
         send_packet_by_parts(player2->fd, "OPPONENT_TURN", NULL, NULL);
+        g_turn_clocks[session_id].timeouts[0] = g_turn_clocks[session_id].timeouts[1] = 0;
+        start_turn_clock(session_id);
 
-        printf("Game session %d started! Player1: %s, Player2: %s\n", 
+        log_write(LOG_LEVEL_INFO, "Game session %d started! Player1: %s, Player2: %s", 
                session_id, player1->nickname, player2->nickname);
     } else {
-        printf("Cannot start game session %d - players not ready\n", session_id);
+        log_write(LOG_LEVEL_WARN, "Cannot start game session %d - players not ready", session_id);
     }
 }
 
@@ -223,7 +648,7 @@ void try_start_session(int session_id) {
     if (session_id < 0 || session_id >= MAX_SESSIONS) return;
     struct game_session* sess = &sessions[session_id];
     if (!sess) return;
-    if (sess->game_started) return;
+    if (sess->game_started || sess->game_finished) return;
 
     struct client_info* p1 = sess->player1;
     struct client_info* p2 = sess->player2;
@@ -231,10 +656,87 @@ void try_start_session(int session_id) {
     if (p1->fd == -1 || p2->fd == -1) return;
     if (!p1->ready || !p2->ready) return;
 
-    printf("Both players ready for session %d, starting game (try_start_session)\n", session_id);
+    log_write(LOG_LEVEL_INFO, "Both players ready for session %d, starting game (try_start_session)", session_id);
     start_game_session(session_id);
 }
 
+/* One-packet resume. arg1 carries the player's own board followed by the
+   fog of the opponent's board, arg2 is "session;player;turn;state;opponent"
+   where state is L (lobby), P (place ships now), W (waiting for the
+   opponent to place) or G (game running). */
+static void send_state_sync(struct client_info* c) {
+    struct game_session* sess = &sessions[c->session_id];
+    struct client_info* opponent = (c->player_number == 1) ? sess->player2 : sess->player1;
+    char boards[2 * FIELD_PAYLOAD_SIZE + 1];
+    char info[PACKET_ARG_SIZE_2];
+    char state;
+
+    encode_field(c->field, boards);
+    if (opponent) {
+        Field fog;
+        build_fog_field(fog, opponent->field);
+        encode_field(fog, boards + FIELD_PAYLOAD_SIZE);
+    } else {
+        memset(boards + FIELD_PAYLOAD_SIZE, '0', FIELD_PAYLOAD_SIZE);
+    }
+    boards[2 * FIELD_PAYLOAD_SIZE] = '\0';
+
+    if (sess->game_started) state = 'G';
+    else if (!opponent) state = 'L';
+    else if (!c->ready && (c->player_number == 1 || opponent->ready)) state = 'P';
+    else state = 'W';
+
+    snprintf(info, sizeof(info), "%d;%d;%d;%c;%s", c->session_id, c->player_number,
+             sess->current_turn, state, opponent ? opponent->nickname : "");
+    send_packet_by_parts(c->fd, "STATE_SYNC", boards, info);
+}
+
+/* Brings a reconnected player back to where their seat left off */
+static void resume_seat(struct client_info* c) {
+    struct game_session* sess = &sessions[c->session_id];
+    struct client_info* opponent = (c->player_number == 1) ? sess->player2 : sess->player1;
+
+    log_write(LOG_LEVEL_INFO, "Client %s resumed session %d as player %d",
+           c->nickname, c->session_id, c->player_number);
+
+    send_state_sync(c);
+
+    if (opponent && opponent->fd != -1) {
+        send_packet_by_parts(opponent->fd, "OPPONENT_RECONNECTED", c->nickname, NULL);
+    }
+
+    if (!sess->game_started && c->ready) {
+        try_start_session(c->session_id);
+    } else if (placing_now(c)) {
+        // Back to placing: the deadline starts over
+        watch_placement(c);
+    }
+    watch_idle(c);
+}
+
+/* Ends a running game and tells both players. reason goes out in
+   GAME_OVER's arg2; NULL when the loser's fleet was sunk. */
+static void finish_game(int session_id, struct client_info* winner, struct client_info* loser, const char* reason) {
+    metrics_game_finished();
+    if (g_record_wins) {
+        uint64_t outer = watchdog_enter(WATCHDOG_LEADERBOARD, 0, winner->fd);
+        int outer_tag = alloc_tag_enter(ALLOC_LEADERBOARD);
+        leaderboard_add_win(winner->nickname);
+        alloc_tag_leave(outer_tag);
+        watchdog_leave(outer);
+        if (crdt_enabled()) crdt_increment(winner->nickname);
+    }
+
+    send_packet_by_parts(winner->fd, "GAME_OVER", "WIN", reason);
+    send_packet_by_parts(loser->fd, "GAME_OVER", "LOSE", reason);
+
+    sessions[session_id].game_started = 0;
+    sessions[session_id].game_finished = 1;
+    timer_cancel(wheel(), &g_turn_clocks[session_id].timer);
+    watch_idle(winner);
+    watch_idle(loser);
+}
+
 /* Process incoming packets from client */
 void process_client_packet(struct client_info* client, const packet_t* p) {
     if (!client || !p) return;
@@ -249,28 +751,95 @@ void process_client_packet(struct client_info* client, const packet_t* p) {
     strncpy(arg1, p->arg1, PACKET_ARG_SIZE_1 - 1);
     strncpy(arg2, p->arg2, PACKET_ARG_SIZE_2 - 1);
 
+    if (strcmp(command, "PONG") == 0) {
+        heartbeat_answered(client, arg1);
+        return;
+    }
+
     if (strcmp(command, "SET_NICK") == 0) {
         strncpy(client->nickname, arg1, sizeof(client->nickname) - 1);
         client->nickname[sizeof(client->nickname) - 1] = 0;
+        snapshot_mark_dirty(client->session_id);
         send_session_list(client);
         return;
     }
+
+    if (strcmp(command, "RESUME") == 0) {
+        struct client_info* seat = find_held_seat(arg1);
+        if (!seat || seat == client || client->session_id != -1) {
+            send_packet_by_parts(client->fd, "ERROR", "RESUME_REJECTED", NULL);
+            return;
+        }
+        if (seat->fd != -1) {
+            /* The token is the player: the connection they gave up on goes */
+            log_write(LOG_LEVEL_WARN, "Client %s resumed from a new connection, closing the old one (fd %d)",
+                      seat->nickname, seat->fd);
+            close_client_fd(seat->fd);
+            seat->fd = -1;
+            g_closed_elsewhere++;
+        }
+        /* Move the live connection into the held seat and free this slot */
+        seat->fd = client->fd;
+        seat->detached_at = 0;
+        timer_cancel(wheel(), &g_seat_timers[seat - clients].seat);
+        g_heartbeats[seat - clients] = g_heartbeats[client - clients];
+        g_conn_stats[seat - clients] = g_conn_stats[client - clients];
+        client->fd = -1;
+        reset_client_slot(client);
+        resume_seat(seat);
+        broadcast_session_list();
+        return;
+    }
     
     if (strcmp(command, "JOIN_SESSION") == 0) {
-        int session_id = atoi(arg1);
+        int session_id = strcmp(arg1, "auto") == 0 ? -1 : atoi(arg1);
+
+        if (g_draining) {
+            send_packet_by_parts(client->fd, "ERROR", "SERVER_DRAINING", NULL);
+            return;
+        }
         
         if ((session_id < 0 && session_id != -1) || session_id >= MAX_SESSIONS) {
             send_packet_by_parts(client->fd, "ERROR", "Invalid session number", NULL);
             send_session_list(client);
             return;
         }
+
+        /* arg2 "bot" or "bot:easy|medium|hard": a hosted bot takes player 2
+           of an empty session instead of a second connection */
+        int bot_level = -1;
+        if (strncmp(arg2, "bot", 3) == 0) {
+            bot_level = arg2[3] == ':' ? bot_level_parse(arg2 + 4) : (arg2[3] == '\0' ? BOT_MEDIUM : -1);
+            if (bot_level == -1) {
+                send_packet_by_parts(client->fd, "ERROR", "Unknown bot level", NULL);
+                return;
+            }
+            if (!bot_pool_running() || is_bot_fd(client->fd)) {
+                send_packet_by_parts(client->fd, "ERROR", "Bots are disabled on this server", NULL);
+                return;
+            }
+            if (find_free_client_slot() == -1) {
+                send_packet_by_parts(client->fd, "ERROR", "Session is full or unavailable", NULL);
+                send_session_list(client);
+                return;
+            }
+        }
         
         int result;
-        if (session_id == -1) {
+        int outer_tag = alloc_tag_enter(ALLOC_SESSION);
+        if (bot_level != -1) {
+            if (session_id == -1) {
+                for (int i = 0; i < MAX_SESSIONS && session_id == -1; i++) {
+                    if (sessions[i].id == -1) session_id = i;
+                }
+            }
+            result = (session_id != -1 && sessions[session_id].id == -1) ? assign_to_session(client, session_id) : -1;
+        } else if (session_id == -1) {
             result = auto_assign_to_session(client);
         } else {
             result = assign_to_session(client, session_id);
         }
+        alloc_tag_leave(outer_tag);
         
         if (result == -1) {
             send_packet_by_parts(client->fd, "ERROR", "Session is full or unavailable", NULL);
@@ -281,8 +850,9 @@ void process_client_packet(struct client_info* client, const packet_t* p) {
             send_packet_by_parts(client->fd, "SESSION_CREATED", tmp, NULL);
             snprintf(tmp, sizeof(tmp), "%d", client->player_number);
             send_packet_by_parts(client->fd, "PLAYER_ASSIGNED", tmp, NULL);
+            send_packet_by_parts(client->fd, "RESUME_TOKEN", client->resume_token, NULL);
             
-            printf("Client %s joined session %d as player %d\n", 
+            log_write(LOG_LEVEL_INFO, "Client %s joined session %d as player %d", 
                    client->nickname, result, client->player_number);
             
             if (client->player_number == 1) {
@@ -293,22 +863,18 @@ void process_client_packet(struct client_info* client, const packet_t* p) {
                     handle_ship_placement(sessions[result].player1);
                 }
             }
+            if (bot_level != -1 && host_bot(result, bot_level) == -1) {
+                send_packet_by_parts(client->fd, "ERROR", "Bot could not join", NULL);
+            }
             broadcast_session_list();
         }
         return;
     }
 
     if (strcmp(command, "FIELD_UPLOAD") == 0) {
-        int len = strlen(arg1);
-        if (len >= PLAYABLE_SIZE * PLAYABLE_SIZE) {
-            int idx = 0;
-            for (int i = 1; i <= PLAYABLE_SIZE; i++) {
-                for (int j = 1; j <= PLAYABLE_SIZE; j++) {
-                    char c = arg1[idx++];
-                    client->field[i][j] = (c >= '0' && c <= '3') ? (c - '0') : 0;
-                }
-            }
+        if (decode_field(arg1, client->field)) {
             client->ready = 1;
+            snapshot_mark_dirty(client->session_id);
             send_full_field_update(client);
             send_packet_by_parts(client->fd, "PLACEMENT_DONE", NULL, NULL);
 
@@ -318,7 +884,7 @@ void process_client_packet(struct client_info* client, const packet_t* p) {
                 struct client_info* other_player = (client->player_number == 1) ? sess->player2 : sess->player1;
                 
                 if (other_player && other_player->ready) {
-                    printf("Both players ready after manual placement, starting game...\n");
+                    log_write(LOG_LEVEL_INFO, "Both players ready after manual placement, starting game...");
                     start_game_session(session_id);
                 } else {
                     if (client->player_number == 1) {
@@ -342,14 +908,17 @@ void process_client_packet(struct client_info* client, const packet_t* p) {
         if (strcmp(arg1, "auto") == 0) {
             create_game_field(client->field);
             initialize_ships(&client->ship_data);
-            place_ships(client->field, &client->ship_data);
+            int outer_tag = alloc_tag_enter(ALLOC_SESSION);
+            place_ships_r(client->field, &client->ship_data, &g_rng);
+            alloc_tag_leave(outer_tag);
 
             send_full_field_update(client);
 
             client->ready = 1;
+            snapshot_mark_dirty(client->session_id);
             send_packet_by_parts(client->fd, "PLACEMENT_DONE", NULL, NULL);
             
-            printf("Player %d in session %d finished auto placement\n", 
+            log_write(LOG_LEVEL_INFO, "Player %d in session %d finished auto placement", 
                    client->player_number, client->session_id);
 
             int session_id = client->session_id;
@@ -358,11 +927,11 @@ void process_client_packet(struct client_info* client, const packet_t* p) {
                 struct client_info* other_player = (client->player_number == 1) ? sess->player2 : sess->player1;
                 
                 if (other_player && other_player->ready) {
-                    printf("Both players ready after auto placement, starting game...\n");
+                    log_write(LOG_LEVEL_INFO, "Both players ready after auto placement, starting game...");
                     start_game_session(session_id);
                 } else {
                     if (client->player_number == 1) {
-                        printf("Starting placement for player 2 after player 1 auto\n");
+                        log_write(LOG_LEVEL_INFO, "Starting placement for player 2 after player 1 auto");
                         for (int i = 0; i < MAX_CLIENTS; i++) {
                             if (clients[i].fd != -1 && clients[i].session_id == session_id && clients[i].player_number == 2) {
                                 handle_ship_placement(&clients[i]);
@@ -380,6 +949,7 @@ void process_client_packet(struct client_info* client, const packet_t* p) {
         }
     } else if (strcmp(command, "SHIP_PLACED") == 0) {
         client->ready = 1;
+        snapshot_mark_dirty(client->session_id);
 
         send_full_field_update(client);
         send_packet_by_parts(client->fd, "PLACEMENT_DONE", NULL, NULL);
@@ -390,7 +960,7 @@ void process_client_packet(struct client_info* client, const packet_t* p) {
             struct client_info* other_player = (client->player_number == 1) ? sess->player2 : sess->player1;
             
             if (other_player && other_player->ready) {
-                printf("Both players ready after manual placement, starting game...\n");
+                log_write(LOG_LEVEL_INFO, "Both players ready after manual placement, starting game...");
                 start_game_session(session_id);
             } else {
                 if (client->player_number == 1) {
@@ -422,7 +992,16 @@ void process_client_packet(struct client_info* client, const packet_t* p) {
             return;
         }
 
+        /* simple_shot() takes a std::string: the temporary is the game
+           logic's, so it is counted there */
+        int outer_tag = alloc_tag_enter(ALLOC_SESSION);
         int result = simple_shot(opponent->field, &opponent->ship_data, arg1);
+        alloc_tag_leave(outer_tag);
+        snapshot_mark_dirty(session_id);
+        if (result == 0 || result == 1) {
+            g_session_stats[session_id].moves++;
+            g_turn_clocks[session_id].timeouts[client->player_number - 1] = 0;
+        }
 
         if (result == 1) {
             send_packet_by_parts(client->fd, "SHOT_RESULT", arg1, "HIT");
@@ -443,14 +1022,11 @@ void process_client_packet(struct client_info* client, const packet_t* p) {
         send_full_field_update(opponent);
 
         if (all_ships_sunk(&opponent->ship_data)) {
-            update_leaderboard(client->nickname);
-
-            send_packet_by_parts(client->fd, "GAME_OVER", "WIN", NULL);
-            send_packet_by_parts(opponent->fd, "GAME_OVER", "LOSE", NULL);
-
-            sessions[session_id].game_started = 0;
+            finish_game(session_id, client, opponent, NULL);
             return;
         }
+        // An invalid shot does not buy time
+        if (result == 0 || result == 1) start_turn_clock(session_id);
 
         if (sess->current_turn == 1) {
             send_packet_by_parts(sess->player1->fd, "YOUR_TURN", NULL, NULL);
@@ -541,9 +1117,12 @@ int assign_to_session(struct client_info* client, int session_id) {
         sessions[session_id].player1 = client;
         sessions[session_id].player2 = NULL;
         sessions[session_id].game_started = 0;
+        sessions[session_id].game_finished = 0;
         sessions[session_id].current_turn = 1;
         client->session_id = session_id;
         client->player_number = 1;
+        memset(&g_session_stats[session_id], 0, sizeof(g_session_stats[0]));
+        g_session_stats[session_id].created_at = server_time();
     } else {
         if (sessions[session_id].player1 == NULL) {
             sessions[session_id].player1 = client;
@@ -557,7 +1136,10 @@ int assign_to_session(struct client_info* client, int session_id) {
             return -1;
         }
     }
-    
+
+    generate_resume_token(client->resume_token);
+    client->detached_at = 0;
+    snapshot_mark_dirty(session_id);
     return session_id;
 }
 
@@ -566,6 +1148,10 @@ int auto_assign_to_session(struct client_info* client) {
         if (sessions[i].id == -1) {
             return assign_to_session(client, i);
         }
+        /* Skip finished games and players who are away on a held seat:
+           nobody is coming back to play there. */
+        if (sessions[i].game_finished) continue;
+        if (sessions[i].player1 && sessions[i].player1->fd == -1) continue;
         if (sessions[i].player2 == NULL) {
             return assign_to_session(client, i);
         }
@@ -573,61 +1159,209 @@ int auto_assign_to_session(struct client_info* client) {
     return -1;
 }
 
+/* Drops a seat from its session: tells the opponent, clears the session
+   once it is empty and frees the client slot for reuse. */
+static void release_seat(struct client_info* c) {
+    int session_id = c->session_id;
+
+    if (session_id >= 0 && session_id < MAX_SESSIONS) {
+        struct game_session* sess = &sessions[session_id];
+        struct client_info* opponent = (c->player_number == 1) ? sess->player2 : sess->player1;
+
+        if (opponent && opponent->fd != -1) {
+            send_packet_by_parts(opponent->fd, "OPPONENT_DISCONNECTED", NULL, NULL);
+        }
+
+        if (sess->player1 == c)
+            sess->player1 = NULL;
+        if (sess->player2 == c)
+            sess->player2 = NULL;
+        /* Nobody to take turns with: the opponent is back to waiting */
+        timer_cancel(wheel(), &g_turn_clocks[session_id].timer);
+        if (opponent) watch_idle(opponent);
+
+        if (!sess->player1 && !sess->player2) {
+            sess->id = -1;
+            sess->game_started = 0;
+            sess->game_finished = 0;
+            log_write(LOG_LEVEL_INFO, "Session %d cleared.", session_id);
+        }
+        snapshot_mark_dirty(session_id);
+    }
+
+    c->session_id = -1;
+    c->player_number = 0;
+    c->ready = 0;
+    c->detached_at = 0;
+    c->resume_token[0] = '\0';
+    cancel_seat_timers(c);
+}
+
 void disconnect_client(struct client_info* c) {
     if (!c || c->fd == -1) return;
 
     int session_id = c->session_id;
-    struct client_info* opponent = NULL;
+
+    log_write(LOG_LEVEL_INFO, "Client %d disconnected.", c->fd);
+
+    close_client_fd(c->fd);
+    c->fd = -1;
+    timer_cancel(wheel(), &g_seat_timers[c - clients].idle);
 
     if (session_id != -1) {
-        opponent = (c->player_number == 1)
-                 ? sessions[session_id].player2
-                 : sessions[session_id].player1;
+        release_seat(c);
+        broadcast_session_list();
     }
+}
 
-    if (opponent && opponent->fd != -1) {
-        send_packet_by_parts(opponent->fd, "OPPONENT_DISCONNECTED", NULL, NULL);
+/* A dropped connection keeps its seat for the grace period so the player
+   can come back with RESUME; an explicit DISCONNECT still leaves at once. */
+static void connection_lost(struct client_info* c) {
+    if (!c || c->fd == -1) return;
+
+    int session_id = c->session_id;
+    if (session_id == -1 || g_resume_grace_sec <= 0 || sessions[session_id].game_finished) {
+        disconnect_client(c);
+        return;
     }
 
-    printf("Client %d disconnected.\n", c->fd);
+    log_write(LOG_LEVEL_WARN, "Client %d (%s) lost connection, holding seat in session %d for %d seconds",
+           c->fd, c->nickname, session_id, g_resume_grace_sec);
 
-    sock_close(c->fd);
+    close_client_fd(c->fd);
     c->fd = -1;
+    c->detached_at = server_time();
+    timer_cancel(wheel(), &g_seat_timers[c - clients].idle);
+    watch_held_seat(c);
 
-    if (session_id != -1) {
-        if (sessions[session_id].player1 == c)
-            sessions[session_id].player1 = NULL;
-        if (sessions[session_id].player2 == c)
-            sessions[session_id].player2 = NULL;
+    struct client_info* opponent = (c->player_number == 1)
+                                 ? sessions[session_id].player2
+                                 : sessions[session_id].player1;
+    if (opponent && opponent->fd != -1) {
+        char tmp[32];
+        snprintf(tmp, sizeof(tmp), "%d", g_resume_grace_sec);
+        send_packet_by_parts(opponent->fd, "OPPONENT_AWAY", tmp, NULL);
+    }
+    snapshot_mark_dirty(session_id);
+}
 
-        if (!sessions[session_id].player1 && !sessions[session_id].player2) {
-            sessions[session_id].id = -1;
-            sessions[session_id].game_started = 0;
-            printf("Session %d cleared.\n", session_id);
-        }
-        broadcast_session_list();
+static void heartbeat_answered(struct client_info* c, const char* echo) {
+    struct heartbeat* hb = &g_heartbeats[c - clients];
+    long long sent_us = atoll(echo);
+    /* Only the outstanding ping counts: late or made-up echoes are ignored */
+    if (!hb->ping_sent_us || sent_us != hb->ping_sent_us) return;
+
+    long long rtt = (long long)(metrics_now_ns() / 1000) - sent_us;
+    hb->ping_sent_us = 0;
+    hb->missed = 0;
+    hb->answered = 1;
+    hb->last_rtt_us = rtt;
+    if (hb->srtt_us == 0) {
+        hb->srtt_us = rtt;
+        hb->rttvar_us = rtt / 2;
+    } else {
+        long long err = rtt - hb->srtt_us;
+        hb->srtt_us += err / 8;
+        hb->rttvar_us += ((err < 0 ? -err : err) - hb->rttvar_us) / 4;
     }
+    metrics_heartbeat_rtt((uint64_t)rtt * 1000, (uint64_t)hb->rttvar_us * 1000);
 }
 
-void handle_server_sigint(int sig) {
-    (void)sig;
-    printf("=== SERVER SHUTDOWN INITIATED ===\n");
+#ifndef BATTLESHIP_SERVER_NO_MAIN
 
+/* Pings connections that are due and drops the ones that stopped
+   answering. Returns the number dropped; their fds are closed. */
+static int send_heartbeats(long long now_ms) {
+    int dropped = 0;
+    long long now_us = (long long)(metrics_now_ns() / 1000);
     for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (clients[i].fd != -1) {
-            send_packet_by_parts(clients[i].fd, "GAME_OVER", "SERVER_SHUTDOWN", NULL);
-            sock_close(clients[i].fd);
-            clients[i].fd = -1;
+        struct client_info* c = &clients[i];
+        if (c->fd == -1 || is_bot_fd(c->fd)) continue;
+        struct heartbeat* hb = &g_heartbeats[i];
+        if (hb->next_ping_ms == 0) {
+            hb->next_ping_ms = now_ms + g_heartbeat_ms;
+            continue;
         }
+        if (now_ms < hb->next_ping_ms) continue;
+
+        if (hb->ping_sent_us && ++hb->missed >= HEARTBEAT_MISSES && hb->answered) {
+            log_write(LOG_LEVEL_WARN, "Client %d (%s) missed %d heartbeats, dropping the connection",
+                      c->fd, c->nickname, hb->missed);
+            metrics_heartbeat_dropped();
+            connection_lost(c);
+            dropped++;
+            continue;
+        }
+
+        char stamp[24];
+        snprintf(stamp, sizeof(stamp), "%lld", now_us);
+        hb->ping_sent_us = now_us;
+        /* From the due time, so the HEARTBEAT_CHECK_MS granularity does
+           not stretch the interval */
+        hb->next_ping_ms += g_heartbeat_ms;
+        if (hb->next_ping_ms <= now_ms) hb->next_ping_ms = now_ms + g_heartbeat_ms;
+        send_packet_by_parts(c->fd, "PING", stamp, NULL);
     }
+    return dropped;
+}
 
-    if (g_server_sock != -1) {
-        sock_close(g_server_sock);
+static void restore_sessions_from_snapshot() {
+    time_t now = server_time();
+    int restored = 0;
+
+    for (int s = 0; s < MAX_SESSIONS; s++) {
+        const struct snapshot_record* rec = snapshot_load(s);
+        if (!rec || rec->session_id != s || rec->game_finished) continue;
+
+        struct client_info* seats[2] = {NULL, NULL};
+        for (int p = 0; p < 2; p++) {
+            if (!rec->players[p].present) continue;
+            int slot = find_free_client_slot();
+            if (slot == -1) break;
+            struct client_info* c = &clients[slot];
+            snapshot_decode_player(&rec->players[p], c);
+            c->fd = -1;
+            c->session_id = s;
+            c->player_number = p + 1;
+            c->detached_at = now;
+            watch_held_seat(c);
+            seats[p] = c;
+        }
+        if (!seats[0] && !seats[1]) continue;
+
+        sessions[s].id = s;
+        sessions[s].player1 = seats[0];
+        sessions[s].player2 = seats[1];
+        sessions[s].game_started = rec->game_started;
+        sessions[s].game_finished = 0;
+        sessions[s].current_turn = rec->current_turn;
+        memset(&g_session_stats[s], 0, sizeof(g_session_stats[0]));
+        g_session_stats[s].created_at = now;
+        restored++;
     }
 
-    remove_pid_file();
-    printf("Server terminated.\n");
-    exit(0);
+    if (restored > 0) {
+        log_write(LOG_LEVEL_INFO, "Restored %d session(s) from snapshot, seats held for %d seconds",
+               restored, g_resume_grace_sec);
+    }
+}
+
+#endif /* BATTLESHIP_SERVER_NO_MAIN */
+
+/* Async-signal-safe: the loop does the shutdown (see g_signals) */
+void handle_server_sigint(int sig) {
+    (void)sig;
+    g_signals = g_signals + 1;
+#ifndef _WIN32
+    if (g_signal_pipe[1] != -1) {
+        int saved_errno = errno;
+        char b = 1;
+        /* A full pipe already wakes the loop; nothing to retry */
+        ssize_t n = write(g_signal_pipe[1], &b, 1);
+        (void)n;
+        errno = saved_errno;
+    }
+#endif
 }
 
 void broadcast_session_list() {
@@ -639,137 +1373,343 @@ void broadcast_session_list() {
 }
 
 void send_leaderboard_to_client(int fd) {
-    FILE* f = fopen("leaderboard.txt", "r");
-    char line[200];
+    char payload[PACKET_ARG_SIZE_1];
 
-    if (!f) {
+    /* With gossip enabled the merged cluster board wins over the host one */
+    uint64_t outer = watchdog_enter(WATCHDOG_LEADERBOARD, metrics_command_id("LEADERBOARD"), fd);
+    int outer_tag = alloc_tag_enter(ALLOC_LEADERBOARD);
+    int entries = crdt_enabled() ? crdt_format(payload, sizeof(payload))
+                                 : leaderboard_format(payload, sizeof(payload));
+    alloc_tag_leave(outer_tag);
+    watchdog_leave(outer);
+    if (entries == 0) {
         send_packet_by_parts(fd, "LEADERBOARD", "EMPTY", NULL);
         return;
     }
+    send_packet_by_parts(fd, "LEADERBOARD", payload, NULL);
+}
 
-    char payload[PACKET_ARG_SIZE_1];
-    memset(payload, 0, sizeof(payload));
+/* --- hosted bots --- */
 
-    while (fgets(line, sizeof(line), f)) {
-        if (strlen(payload) + strlen(line) + 1 >= PACKET_ARG_SIZE_1)
-            break;
-        strcat(payload, line);
-    }
+/* Feeds c a packet as if it had sent it: the bots' moves, and what the
+   deadlines do for a player who ran out of time */
+static void act_for_client(struct client_info* c, const char* command, const char* arg1) {
+    packet_t p;
+    memset(&p, 0, sizeof(p));
+    strncpy(p.command, command, PACKET_COMMAND_SIZE - 1);
+    if (arg1) strncpy(p.arg1, arg1, PACKET_ARG_SIZE_1 - 1);
+    int command_id = metrics_command_id(command);
+    uint64_t outer = watchdog_enter(WATCHDOG_HANDLER, command_id, c->fd);
+    int outer_tag = alloc_tag_enter(ALLOC_PROTOCOL);
+    int session_before = c->session_id;
+    uint64_t started = trace_now_ns();
+    process_client_packet(c, &p);
+    uint64_t ended = trace_now_ns();
+    // No bytes: a bot's packets never touch the network
+    count_packet_in(c, session_before, 0, ended - started);
+    trace_complete(TRACE_HANDLER, command_id, c->fd, started, ended);
+    alloc_tag_leave(outer_tag);
+    watchdog_leave(outer);
+}
 
-    fclose(f);
-    send_packet_by_parts(fd, "LEADERBOARD", payload, NULL);
+/* Seats a bot as player 2 of session_id with the same SET_NICK and
+   JOIN_SESSION a remote client would send. Returns its slot or -1. */
+static int host_bot(int session_id, int level) {
+    int slot = find_free_client_slot();
+    if (slot == -1) return -1;
+
+    struct client_info* c = &clients[slot];
+    struct hosted_bot* b = &g_bots[slot];
+    reset_client_slot(c);
+    c->fd = BOT_FD_BASE + slot;
+    memset(b, 0, sizeof(*b));
+    b->active = 1;
+    b->level = level;
+    create_game_field(b->fog);
+
+    char tmp[64];
+    snprintf(tmp, sizeof(tmp), "Bot (%s)", bot_level_name(level));
+    act_for_client(c, "SET_NICK", tmp);
+    snprintf(tmp, sizeof(tmp), "%d", session_id);
+    act_for_client(c, "JOIN_SESSION", tmp);
+
+    if (c->session_id != session_id) {
+        disconnect_client(c);
+        return -1;
+    }
+    return slot;
 }
 
-/* Main server loop */
-int main(int argc, char* argv[]) {
-    int server_sock;
-    socklen_t length;
-    struct sockaddr_in server;
+/* Acts on what the bots were sent since the last call and plays the moves
+   the pool has finished. Runs on the poll loop between packets. */
+static void dispatch_bots() {
+    struct bot_result results[MAX_CLIENTS];
+    uint64_t outer = watchdog_enter(WATCHDOG_BOTS, 0, -1);
+    int n = bot_pool_running() ? bot_pool_collect(results, MAX_CLIENTS) : 0;
+
+    for (int k = 0; k < n; k++) {
+        const struct bot_result* r = &results[k];
+        struct hosted_bot* b = &g_bots[r->slot];
+        struct client_info* c = &clients[r->slot];
+        /* The seat may have left, or been reused, while the move was computed */
+        if (!b->active || b->serial != r->serial) continue;
+        b->serial = 0;
+        if (r->late) {
+            log_write(LOG_LEVEL_WARN, "Bot in session %d missed its %d ms deadline, played a fallback shot",
+                   c->session_id, g_bot_deadline_ms);
+        }
 
-#ifdef _WIN32
-    if (!init_winsock()) {
-        fprintf(stderr, "Failed to initialize Winsock\n");
-        return 1;
+        static const char rows[] = "ABCDEFGHIK";
+        char coord[8];
+        snprintf(coord, sizeof(coord), "%c%d", rows[r->x - 1], r->y);
+        act_for_client(c, "SHOT", coord);
     }
-#endif
 
-    struct pollfd fds[MAX_CLIENTS + 1];
-    int nfds = 1;
-    int i;
-    int daemon_mode = 0;
-    int port = 0;
-
-    for (i = 1; i < argc; i++) {
-        if (strcmp(argv[i], "-d") == 0 || strcmp(argv[i], "--daemon") == 0) {
-            daemon_mode = 1;
-        } else if (strcmp(argv[i], "-p") == 0 || strcmp(argv[i], "--port") == 0) {
-            if (i + 1 < argc) {
-                port = atoi(argv[++i]);
-            }
-        } else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
-            printf("Usage: %s [-d|--daemon] [-p|--port PORT]\n", argv[0]);
-#ifdef _WIN32
-            cleanup_winsock();
-#endif
-            return 0;
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        struct hosted_bot* b = &g_bots[i];
+        struct client_info* c = &clients[i];
+        if (!b->active) continue;
+
+        if (b->want_leave) {
+            b->want_leave = 0;
+            act_for_client(c, "DISCONNECT", NULL);
+            continue;
+        }
+        if (b->want_place) {
+            b->want_place = 0;
+            act_for_client(c, "PLACEMENT_CHOICE", "auto");
+        }
+        if (b->want_move && b->serial == 0) {
+            b->want_move = 0;
+            struct bot_job job;
+            job.slot = i;
+            if (++g_bot_serial == 0) g_bot_serial = 1;
+            job.serial = g_bot_serial;
+            job.level = b->level;
+            job.budget_ms = g_bot_deadline_ms;
+            job.seed = xorshift32(&g_rng);
+            memcpy(job.fog, b->fog, sizeof(job.fog));
+            if (bot_pool_submit(&job) == 0) b->serial = job.serial;
         }
     }
+    watchdog_leave(outer);
+}
 
-#ifdef _WIN32
-    if (daemon_mode) {
-        printf("Daemon mode not supported on Windows; running in foreground.\n");
+#ifndef BATTLESHIP_SERVER_NO_MAIN
+/* Bots are not sockets and cannot be passed to a new process: hand their
+   seats over as held seats (they expire there) and take them back if the
+   handover fails. */
+static void park_bots(int parked) {
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (!g_bots[i].active) continue;
+        clients[i].fd = parked ? -1 : BOT_FD_BASE + i;
+        clients[i].detached_at = parked ? server_time() : 0;
     }
-    daemon_mode = 0;
-    signal(SIGINT, handle_server_sigint);
-    signal(SIGTERM, handle_server_sigint);
-#else
-    openlog("battleship_server", LOG_PID | LOG_NDELAY, LOG_DAEMON);
+}
+#endif /* BATTLESHIP_SERVER_NO_MAIN */
 
-    if (daemon_mode) {
-        syslog(LOG_INFO, "Starting battleship server in daemon mode");
-        if (daemonize() < 0) {
-            syslog(LOG_ERR, "Failed to daemonize");
-            return 1;
-        }
-        signal(SIGINT, handle_server_sigint);
-        signal(SIGTERM, handle_server_sigint);
-        signal(SIGHUP, SIG_IGN);
-        signal(SIGTSTP, SIG_IGN);
-        signal(SIGQUIT, SIG_IGN);
-    } else {
-        signal(SIGINT, handle_server_sigint);
-        signal(SIGTSTP, handle_server_sigint);
+/* --- deadlines firing --- */
+
+static void turn_timed_out(int session_id) {
+    struct game_session* sess = &sessions[session_id];
+    if (!sess->game_started || sess->game_finished || !sess->player1 || !sess->player2) return;
+    struct client_info* player = sess->current_turn == 1 ? sess->player1 : sess->player2;
+    struct client_info* opponent = sess->current_turn == 1 ? sess->player2 : sess->player1;
+    struct turn_clock* clock = &g_turn_clocks[session_id];
+    int timeouts = ++clock->timeouts[player->player_number - 1];
+
+    if (g_turn_action == TURN_ACTION_FORFEIT || timeouts >= TURN_FORFEIT_AFTER) {
+        log_write(LOG_LEVEL_WARN, "%s ran out of time in session %d, forfeiting", player->nickname, session_id);
+        finish_game(session_id, opponent, player, "TIMEOUT");
+        broadcast_session_list();
+        return;
     }
-#endif
 
-#ifndef _WIN32
-    signal(SIGPIPE, SIG_IGN);
-#endif
+    /* Any cell not shot at yet, starting from a random one */
+    int cells = PLAYABLE_SIZE * PLAYABLE_SIZE;
+    int start = (int)(xorshift32(&g_rng) % (unsigned int)cells);
+    for (int k = 0; k < cells; k++) {
+        int cell = (start + k) % cells;
+        int x = cell / PLAYABLE_SIZE + 1, y = cell % PLAYABLE_SIZE + 1;
+        if (opponent->field[x][y] != 0 && opponent->field[x][y] != 1) continue;
+
+        static const char rows[] = "ABCDEFGHIK";
+        char coord[8];
+        snprintf(coord, sizeof(coord), "%c%d", rows[x - 1], y);
+        log_write(LOG_LEVEL_INFO, "%s ran out of time in session %d, shooting %s for them",
+                  player->nickname, session_id, coord);
+        act_for_client(player, "SHOT", coord);
+        // The shot went through SHOT like any other, which starts the count over
+        clock->timeouts[player->player_number - 1] = timeouts;
+        return;
+    }
+}
 
-    if (write_pid_file() < 0) {
-        fprintf(stderr, "Failed to write PID file\n");
-#ifdef _WIN32
-        cleanup_winsock();
-#endif
-        return 1;
+static void on_timer(struct timer* t) {
+    if (t->kind == TIMER_TURN) {
+        turn_timed_out(t->id);
+        return;
     }
 
-    for (i = 0; i < MAX_CLIENTS; i++) {
-        clients[i].fd = -1;
-        clients[i].session_id = -1;
-        clients[i].ready = 0;
-        create_game_field(clients[i].field);
-        initialize_ships(&clients[i].ship_data);
+    struct client_info* c = &clients[t->id];
+    switch (t->kind) {
+    case TIMER_PLACEMENT:
+        if (c->fd == -1 || !placing_now(c)) return;
+        log_write(LOG_LEVEL_INFO, "%s did not place ships in session %d in time, placing them", c->nickname, c->session_id);
+        act_for_client(c, "PLACEMENT_CHOICE", "auto");
+        break;
+    case TIMER_SEAT:
+        if (c->fd != -1 || c->session_id == -1) return;
+        log_write(LOG_LEVEL_WARN, "Seat of %s in session %d expired.", c->nickname, c->session_id);
+        release_seat(c);
+        broadcast_session_list();
+        break;
+    case TIMER_IDLE:
+        if (c->fd == -1 || !outside_game(c)) return;
+        log_write(LOG_LEVEL_INFO, "Client %d (%s) idle for %d seconds, closing", c->fd, c->nickname, g_idle_timeout_sec);
+        send_packet_by_parts(c->fd, "ERROR", "IDLE_TIMEOUT", NULL);
+        disconnect_client(c);
+        g_closed_elsewhere++;
+        break;
     }
+}
 
-    for (i = 0; i < MAX_SESSIONS; i++) {
+/* Embedding API (battleship_server.h) */
+
+void server_set_transport(const struct server_transport* transport) {
+    if (transport) {
+        g_transport = *transport;
+    } else {
+        g_transport.send = NULL;
+        g_transport.close = NULL;
+    }
+}
+
+void server_set_clock(server_clock_fn now_ms) {
+    g_clock = now_ms;
+    // Deadlines are kept on the clock they were armed with
+    g_wheel_ready = 0;
+}
+
+void server_set_seed(unsigned int seed) {
+    g_rng = seed ? seed : 1;
+    g_seeded = 1;
+}
+
+void server_set_resume_grace(int seconds) {
+    g_resume_grace_sec = seconds;
+}
+
+void server_set_record_wins(int enabled) {
+    g_record_wins = enabled;
+}
+
+void server_set_timeouts(int turn_sec, int placement_sec, int idle_sec) {
+    g_turn_timeout_sec = turn_sec;
+    g_placement_timeout_sec = placement_sec;
+    g_idle_timeout_sec = idle_sec;
+}
+
+void server_reset() {
+    g_wheel_ready = 0;
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        reset_client_slot(&clients[i]);
+        g_bots[i].active = 0;
+    }
+    for (int i = 0; i < MAX_SESSIONS; i++) {
         sessions[i].id = -1;
         sessions[i].player1 = NULL;
         sessions[i].player2 = NULL;
         sessions[i].game_started = 0;
+        sessions[i].game_finished = 0;
         sessions[i].current_turn = 1;
     }
+}
 
-    for (i = 0; i < MAX_CLIENTS + 1; i++) {
-        fds[i].fd = -1;
-        fds[i].events = POLLIN;
-        fds[i].revents = 0;
-    }
+static struct client_info* find_client_by_fd(int fd) {
+    int slot = client_slot_of_fd(fd);
+    return slot == -1 ? NULL : &clients[slot];
+}
+
+int server_attach(int fd) {
+    int client_slot = find_free_client_slot();
+    if (client_slot == -1) return -1;
+
+    reset_client_slot(&clients[client_slot]);
+    clients[client_slot].fd = fd;
+    g_conn_stats[client_slot].connected_at = server_time();
+    watch_idle(&clients[client_slot]);
+    capture_connect(fd);
+
+    log_write(LOG_LEVEL_INFO, "New client connected: fd=%d", fd);
+
+    send_packet_by_parts(fd, "WELCOME", "Welcome to Battleship! Choose a session:", NULL);
+    send_session_list(&clients[client_slot]);
+    send_leaderboard_to_client(fd);
+    return client_slot;
+}
+
+void server_receive(int fd, const packet_t* p) {
+    struct client_info* c = find_client_by_fd(fd);
+    if (!c) return;
+    capture_frame(fd, p);
 
-    g_server_sock = socket(AF_INET, SOCK_STREAM, 0);
-    server_sock = g_server_sock;
+    char command[PACKET_COMMAND_SIZE];
+    memcpy(command, p->command, sizeof(command));
+    command[PACKET_COMMAND_SIZE - 1] = '\0';
+    int command_id = metrics_command_id(command);
+    metrics_packet_in(command_id, PACKET_SIZE);
+
+    uint64_t outer = watchdog_enter(WATCHDOG_HANDLER, command_id, fd);
+    int outer_tag = alloc_tag_enter(ALLOC_PROTOCOL);
+    uint64_t allocs = alloc_thread_count();
+    int session_before = c->session_id;
+    uint64_t started = metrics_now_ns();
+    process_client_packet(c, p);
+    uint64_t ended = metrics_now_ns();
+    /* A RESUME moves the connection into the held seat and frees c: charge
+       the seat it landed in. A closed connection stays with c. */
+    struct client_info* now = find_client_by_fd(fd);
+    if (now) c = now;
+    count_packet_in(c, session_before, PACKET_SIZE, ended - started);
+    // A PONG is the client, not the player
+    if (strcmp(command, "PONG") != 0) watch_idle(c);
+    if (alloc_accounting_enabled()) metrics_handler_allocs(command_id, alloc_thread_count() - allocs);
+    alloc_tag_leave(outer_tag);
+    watchdog_leave(outer);
+    metrics_handler_ns(command_id, ended - started);
+    trace_complete(TRACE_HANDLER, command_id, fd, started, ended);
+}
+
+void server_detach(int fd) {
+    log_write(LOG_LEVEL_INFO, "Client %d disconnected", fd);
+    struct client_info* c = find_client_by_fd(fd);
+    if (c) connection_lost(c);
+}
+
+void server_tick() {
+    uint64_t outer = watchdog_enter(WATCHDOG_TIMERS, 0, -1);
+    timer_advance(wheel(), monotonic_ms(), on_timer);
+    watchdog_leave(outer);
+    dispatch_bots();
+}
+
+#ifndef BATTLESHIP_SERVER_NO_MAIN
+
+/* Creates, binds and starts the TCP listener. Returns its fd or -1. */
+static int create_listen_socket(int port) {
+    struct sockaddr_in server;
+    int server_sock = socket(AF_INET, SOCK_STREAM, 0);
 
     if (server_sock == -1) {
-        printf("Failed to create socket\n");
-#ifdef _WIN32
-        cleanup_winsock();
-#endif
-        exit(1);
+        log_write(LOG_LEVEL_ERROR, "Failed to create socket");
+        return -1;
     }
 
     int opt = 1;
     setsockopt(server_sock, SOL_SOCKET, SO_REUSEADDR, (const char*)&opt, sizeof(opt));
 
+    memset(&server, 0, sizeof(server));
     server.sin_family = AF_INET;
     server.sin_addr.s_addr = htonl(INADDR_ANY);
     if (port > 0) {
@@ -779,92 +1719,1000 @@ int main(int argc, char* argv[]) {
     }
 
     if (bind(server_sock, (struct sockaddr*) &server, sizeof server) == -1) {
-        printf("Failed to bind socket\n");
+        log_write(LOG_LEVEL_ERROR, "Failed to bind socket");
+        sock_close(server_sock);
+        return -1;
+    }
+
+    if (listen(server_sock, SOMAXCONN) == -1) {
+        log_write(LOG_LEVEL_ERROR, "Failed to listen on socket");
+        sock_close(server_sock);
+        return -1;
+    }
+
+    return server_sock;
+}
+
+static void drop_closed_elsewhere(struct pollfd* fds, int nfds) {
+    if (g_closed_elsewhere == 0) return;
+    for (int i = POLL_FIRST_CLIENT; i < nfds; i++) {
+        if (fds[i].fd != -1 && !find_client_by_fd(fds[i].fd)) fds[i].fd = -1;
+    }
+    g_closed_elsewhere = 0;
+}
+
+/* --- shutdown --- */
+
+static void open_signal_pipe() {
+#ifndef _WIN32
+    if (pipe(g_signal_pipe) == -1) {
+        g_signal_pipe[0] = g_signal_pipe[1] = -1;
+        return;
+    }
+    for (int i = 0; i < 2; i++) {
+        fcntl(g_signal_pipe[i], F_SETFL, fcntl(g_signal_pipe[i], F_GETFL, 0) | O_NONBLOCK);
+        fcntl(g_signal_pipe[i], F_SETFD, FD_CLOEXEC);
+    }
+#endif
+}
+
+static void clear_signal_pipe() {
+#ifndef _WIN32
+    char buf[64];
+    while (g_signal_pipe[0] != -1 && read(g_signal_pipe[0], buf, sizeof(buf)) > 0) {
+    }
+#endif
+}
+
+static int player_connected(const struct client_info* c) {
+    return c && c->fd != -1 && !is_bot_fd(c->fd);
+}
+
+/* Games a drain waits for: both seats taken, not over yet, and someone
+   still connected to play it out (a game of held seats only waits for a
+   RESUME that a draining server would not see through) */
+static int games_in_progress() {
+    int n = 0;
+    for (int s = 0; s < MAX_SESSIONS; s++) {
+        const struct game_session* sess = &sessions[s];
+        if (sess->id == -1 || !sess->player1 || !sess->player2 || sess->game_finished) continue;
+        if (player_connected(sess->player1) || player_connected(sess->player2)) n++;
+    }
+    return n;
+}
+
+// Bounds every send on fd to DRAIN_SEND_TIMEOUT_MS
+static void limit_send_wait(int fd) {
+#ifdef _WIN32
+    DWORD ms = DRAIN_SEND_TIMEOUT_MS;
+    setsockopt((SOCKET)fd, SOL_SOCKET, SO_SNDTIMEO, (const char*)&ms, sizeof(ms));
+#else
+    struct timeval tv = {DRAIN_SEND_TIMEOUT_MS / 1000, (DRAIN_SEND_TIMEOUT_MS % 1000) * 1000};
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+#endif
+}
+
+static void set_nonblocking(int fd) {
+#ifdef _WIN32
+    u_long mode = 1;
+    ioctlsocket((SOCKET)fd, FIONBIO, &mode);
+#else
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+#endif
+}
+
+/* Says goodbye to every connection in the poll set within
+   SHUTDOWN_LINGER_MS: GAME_OVER goes out non-blocking (a peer with a
+   full socket buffer goes without), the write side is shut down so what
+   was sent is flushed, and the fd is closed once the peer closes too or
+   the time is up. Closing with unread input would reset the connection
+   and could throw away the goodbye. */
+// The snapshot keeps this connection's seat, so RESUME works after a restart
+static int seat_survives_restart(int fd) {
+    struct client_info* c = find_client_by_fd(fd);
+    if (!c || !snapshot_enabled() || c->session_id < 0 || !c->resume_token[0]) return 0;
+    return !sessions[c->session_id].game_finished;
+}
+
+static void close_connections(struct pollfd* fds, int nfds) {
+    int open = 0;
+    for (int i = POLL_FIRST_CLIENT; i < nfds; i++) {
+        if (fds[i].fd == -1) continue;
+        set_nonblocking(fds[i].fd);
+        if (seat_survives_restart(fds[i].fd)) {
+            send_packet_by_parts(fds[i].fd, "SERVER_RESTARTING", NULL, NULL);
+        } else {
+            send_packet_by_parts(fds[i].fd, "GAME_OVER", "SERVER_SHUTDOWN", NULL);
+        }
+#ifdef _WIN32
+        shutdown(fds[i].fd, SD_SEND);
+#else
+        shutdown(fds[i].fd, SHUT_WR);
+#endif
+        fds[i].events = POLLIN;
+        open++;
+    }
+
+    long long deadline = monotonic_ms() + SHUTDOWN_LINGER_MS;
+    while (open > 0) {
+        long long left = deadline - monotonic_ms();
+        if (left <= 0) break;
+        int ready = poll(fds + POLL_FIRST_CLIENT, nfds - POLL_FIRST_CLIENT, (int)left);
+        if (ready < 0 && errno != EINTR) break;
+        for (int i = POLL_FIRST_CLIENT; ready > 0 && i < nfds; i++) {
+            if (fds[i].fd == -1 || !(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+            char buf[PACKET_SIZE];
+            if (recv(fds[i].fd, buf, sizeof(buf), 0) > 0) continue;
+            sock_close(fds[i].fd);
+            fds[i].fd = -1;
+            open--;
+        }
+    }
+
+    for (int i = POLL_FIRST_CLIENT; i < nfds; i++) {
+        if (fds[i].fd != -1) sock_close(fds[i].fd);
+        fds[i].fd = -1;
+    }
+    if (open > 0) log_write(LOG_LEVEL_WARN, "%d connection(s) still open after %d ms, closed", open, SHUTDOWN_LINGER_MS);
+}
+
+#define METRICS_SAMPLE_MS 100
+
+static int session_state(const struct game_session* sess) {
+    if (sess->id == -1) return METRICS_SESSION_EMPTY;
+    if (sess->game_finished) return METRICS_SESSION_FINISHED;
+    if (sess->game_started) return METRICS_SESSION_PLAYING;
+    if (sess->player1 && sess->player2) return METRICS_SESSION_PLACING;
+    return METRICS_SESSION_WAITING;
+}
+
+/* Gauges for the metrics endpoint; cheap enough for a few times a second */
+static void sample_metrics() {
+    struct metrics_gauges g;
+    memset(&g, 0, sizeof(g));
+
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        struct client_info* c = &clients[i];
+        if (c->fd == -1) {
+            if (c->session_id != -1) g.held_seats++;
+            continue;
+        }
+        if (is_bot_fd(c->fd)) continue;
+        g.connections++;
+#ifdef __linux__
+        int unsent = 0;
+        if (ioctl(c->fd, TIOCOUTQ, &unsent) == 0) g.queued_bytes += unsent;
+#endif
+    }
+
+    for (int i = 0; i < MAX_SESSIONS; i++) {
+        g.sessions[session_state(&sessions[i])]++;
+    }
+    metrics_set_gauges(&g);
+}
+
+/* The sessions that cost the loop most over the last HOT_WINDOW_MS, by
+   handler time, then packets. Rebuilt from the per-session totals once a
+   window: one pass over sessions[] a second, nothing per packet. */
+#define HOT_SESSIONS 16
+#define HOT_WINDOW_MS 1000
+
+struct hot_session {
+    int id;
+    struct traffic window;
+};
+
+static struct hot_session g_hot[HOT_SESSIONS];
+static int g_hot_count = 0;
+static long long g_hot_window_ms = 0;  // length of the window g_hot covers
+
+static int hotter(const struct traffic* a, const struct traffic* b) {
+    if (a->handler_ns != b->handler_ns) return a->handler_ns > b->handler_ns;
+    return a->packets_in > b->packets_in;
+}
+
+static void sample_hot_sessions(long long window_ms) {
+    g_hot_count = 0;
+    g_hot_window_ms = window_ms;
+    for (int i = 0; i < MAX_SESSIONS; i++) {
+        struct session_stats* st = &g_session_stats[i];
+        struct traffic w;
+        w.handler_ns = st->total.handler_ns - st->sampled.handler_ns;
+        w.packets_in = st->total.packets_in - st->sampled.packets_in;
+        w.bytes_in = st->total.bytes_in - st->sampled.bytes_in;
+        w.bytes_out = st->total.bytes_out - st->sampled.bytes_out;
+        st->sampled = st->total;
+        if (sessions[i].id == -1 || (w.packets_in == 0 && w.bytes_out == 0)) continue;
+
+        // Insertion into the short sorted list
+        int pos = g_hot_count < HOT_SESSIONS ? g_hot_count : HOT_SESSIONS;
+        while (pos > 0 && hotter(&w, &g_hot[pos - 1].window)) pos--;
+        if (pos >= HOT_SESSIONS) continue;
+        int last = g_hot_count < HOT_SESSIONS ? g_hot_count : HOT_SESSIONS - 1;
+        memmove(&g_hot[pos + 1], &g_hot[pos], (size_t)(last - pos) * sizeof(g_hot[0]));
+        g_hot[pos].id = i;
+        g_hot[pos].window = w;
+        if (g_hot_count < HOT_SESSIONS) g_hot_count++;
+    }
+}
+
+/* Admin console commands, answered from the loop (battleship_admin.h) */
+
+#define ADMIN_HELP \
+    "sessions [state=waiting|placing|playing|finished|empty] [player=NICK] [from=ID] [limit=N]\n" \
+    "connections [session=ID] [player=NICK] [from=SLOT] [limit=N]\n" \
+    "session ID\n" \
+    "top [limit=N]   hottest sessions over the last second\n"
+
+static int seat_matches(const struct client_info* c, const char* player) {
+    return c && strstr(c->nickname, player) != NULL;
+}
+
+static void describe_seat(const struct client_info* c, char* out, int size) {
+    if (!c) snprintf(out, (size_t)size, "-");
+    else if (c->fd == -1) snprintf(out, (size_t)size, "%s(away)", c->nickname);
+    else snprintf(out, (size_t)size, "%s", c->nickname[0] ? c->nickname : "?");
+}
+
+static void admin_sessions(const char* command, std::string* out) {
+    char state_name[16];
+    char player[64] = "";
+    int want_state = -1;
+    if (admin_arg_str(command, "state", state_name, sizeof(state_name))) {
+        for (int st = 0; st < METRICS_SESSION_STATES; st++) {
+            if (strcmp(state_name, metrics_session_state_name(st)) == 0) want_state = st;
+        }
+        if (want_state == -1) {
+            admin_appendf(out, "ERROR unknown state '%s'\n", state_name);
+            return;
+        }
+    }
+    admin_arg_str(command, "player", player, sizeof(player));
+    long long from = admin_arg_int(command, "from", 0);
+    int limit = admin_page_limit(command);
+    time_t now = server_time();
+
+    admin_appendf(out, "%-6s %-9s %-4s %-5s %-7s %-9s %-10s %-10s %s\n", "id", "state", "turn", "moves", "age_s",
+                  "cpu_ms", "bytes_in", "bytes_out", "players");
+    int id = from < 0 ? 0 : (from > MAX_SESSIONS ? MAX_SESSIONS : (int)from);
+    int shown = 0;
+    /* Bounded either way: a page of matches or ADMIN_SCAN_BUDGET looked at */
+    for (int scanned = 0; id < MAX_SESSIONS && shown < limit && scanned < ADMIN_SCAN_BUDGET; id++, scanned++) {
+        struct game_session* sess = &sessions[id];
+        int state = session_state(sess);
+        if (want_state == -1 ? state == METRICS_SESSION_EMPTY : state != want_state) continue;
+        if (player[0] && !seat_matches(sess->player1, player) && !seat_matches(sess->player2, player)) continue;
+
+        char p1[80], p2[80], turn[8];
+        describe_seat(sess->player1, p1, sizeof(p1));
+        describe_seat(sess->player2, p2, sizeof(p2));
+        snprintf(turn, sizeof(turn), "%d", sess->current_turn);
+        long long age = state == METRICS_SESSION_EMPTY ? 0 : (long long)(now - g_session_stats[id].created_at);
+        const struct traffic* t = &g_session_stats[id].total;
+        admin_appendf(out, "%-6d %-9s %-4s %-5d %-7lld %-9.3f %-10llu %-10llu %s vs %s\n", id,
+                      metrics_session_state_name(state), state == METRICS_SESSION_PLAYING ? turn : "-",
+                      g_session_stats[id].moves, age, t->handler_ns / 1e6, (unsigned long long)t->bytes_in,
+                      (unsigned long long)t->bytes_out, p1, p2);
+        shown++;
+    }
+    if (id < MAX_SESSIONS) admin_appendf(out, "next from=%d\n", id);
+}
+
+static void admin_connections(const char* command, std::string* out) {
+    char player[64] = "";
+    admin_arg_str(command, "player", player, sizeof(player));
+    long long want_session = admin_arg_int(command, "session", -1);
+    long long from = admin_arg_int(command, "from", 0);
+    int limit = admin_page_limit(command);
+    time_t now = server_time();
+
+    admin_appendf(out, "%-5s %-6s %-16s %-7s %-8s %-8s %-8s %-8s %-9s %-10s %-10s %s\n", "slot", "fd", "nick",
+                  "session", "rtt_ms", "rttvar", "queued", "packets", "cpu_ms", "bytes_in", "bytes_out", "age_s");
+    int slot = from < 0 ? 0 : (from > MAX_CLIENTS ? MAX_CLIENTS : (int)from);
+    int shown = 0;
+    for (int scanned = 0; slot < MAX_CLIENTS && shown < limit && scanned < ADMIN_SCAN_BUDGET; slot++, scanned++) {
+        struct client_info* c = &clients[slot];
+        if (c->fd == -1 && c->session_id == -1) continue;
+        if (want_session != -1 && c->session_id != want_session) continue;
+        if (player[0] && !seat_matches(c, player)) continue;
+
+        char fd[16], rtt[16] = "-", rttvar[16] = "-", queued[16] = "-";
+        if (c->fd == -1) snprintf(fd, sizeof(fd), "away");
+        else if (is_bot_fd(c->fd)) snprintf(fd, sizeof(fd), "bot");
+        else snprintf(fd, sizeof(fd), "%d", c->fd);
+        const struct heartbeat* hb = &g_heartbeats[slot];
+        if (hb->answered) {
+            snprintf(rtt, sizeof(rtt), "%.3f", hb->srtt_us / 1000.0);
+            snprintf(rttvar, sizeof(rttvar), "%.3f", hb->rttvar_us / 1000.0);
+        }
+#ifdef __linux__
+        int unsent = 0;
+        if (c->fd != -1 && !is_bot_fd(c->fd) && ioctl(c->fd, TIOCOUTQ, &unsent) == 0) {
+            snprintf(queued, sizeof(queued), "%d", unsent);
+        }
+#endif
+        const struct conn_stats* st = &g_conn_stats[slot];
+        long long age = st->connected_at ? (long long)(now - st->connected_at) : 0;
+        admin_appendf(out, "%-5d %-6s %-16s %-7d %-8s %-8s %-8s %-8llu %-9.3f %-10llu %-10llu %lld\n", slot, fd,
+                      c->nickname[0] ? c->nickname : "?", c->session_id, rtt, rttvar, queued,
+                      (unsigned long long)st->packets_in, st->handler_ns / 1e6,
+                      (unsigned long long)st->bytes_in, (unsigned long long)st->bytes_out, age);
+        shown++;
+    }
+    if (slot < MAX_CLIENTS) admin_appendf(out, "next from=%d\n", slot);
+}
+
+static void admin_top(const char* command, std::string* out) {
+    int limit = admin_page_limit(command);
+    double secs = g_hot_window_ms > 0 ? g_hot_window_ms / 1000.0 : 1.0;
+    admin_appendf(out, "%-4s %-6s %-8s %-9s %-10s %-10s %-9s %s\n", "rank", "id", "cpu_pct", "packets/s",
+                  "in_B/s", "out_B/s", "cpu_ms", "players");
+    for (int i = 0; i < g_hot_count && i < limit; i++) {
+        int id = g_hot[i].id;
+        const struct traffic* w = &g_hot[i].window;
+        char p1[80], p2[80];
+        describe_seat(sessions[id].player1, p1, sizeof(p1));
+        describe_seat(sessions[id].player2, p2, sizeof(p2));
+        admin_appendf(out, "%-4d %-6d %-8.3f %-9.1f %-10.0f %-10.0f %-9.3f %s vs %s\n", i + 1, id,
+                      w->handler_ns / (secs * 1e7), w->packets_in / secs, w->bytes_in / secs, w->bytes_out / secs,
+                      g_session_stats[id].total.handler_ns / 1e6, p1, p2);
+    }
+}
+
+// Both boards side by side: O ship, X hit, * miss
+static void admin_session(const char* command, std::string* out) {
+    int id = -1;
+    if (sscanf(command, "session %d", &id) != 1 || id < 0 || id >= MAX_SESSIONS) {
+        admin_appendf(out, "ERROR usage: session ID (0..%d)\n", MAX_SESSIONS - 1);
+        return;
+    }
+    struct game_session* sess = &sessions[id];
+    int state = session_state(sess);
+    if (state == METRICS_SESSION_EMPTY) {
+        admin_appendf(out, "session %d empty\n", id);
+        return;
+    }
+    admin_appendf(out, "session %d %s turn %d moves %d age %llds\n", id, metrics_session_state_name(state),
+                  sess->current_turn, g_session_stats[id].moves,
+                  (long long)(server_time() - g_session_stats[id].created_at));
+
+    struct client_info* seats[2] = {sess->player1, sess->player2};
+    char names[2][80];
+    for (int p = 0; p < 2; p++) {
+        describe_seat(seats[p], names[p], sizeof(names[p]));
+        if (seats[p]) {
+            admin_appendf(out, "player%d %s slot %d\n", p + 1, names[p], (int)(seats[p] - clients));
+        }
+    }
+
+    static const char letters[] = "-ABCDEFGHIK";
+    static const char cells[] = ".O*X";
+    admin_appendf(out, "   %-22s   %s\n", names[0], names[1]);
+    admin_appendf(out, "   1 2 3 4 5 6 7 8 9 10     1 2 3 4 5 6 7 8 9 10\n");
+    for (int i = 1; i <= PLAYABLE_SIZE; i++) {
+        char row[64];
+        int n = 0;
+        for (int p = 0; p < 2; p++) {
+            n += snprintf(row + n, sizeof(row) - n, p ? "  %c " : "%c ", letters[i]);
+            for (int j = 1; j <= PLAYABLE_SIZE; j++) {
+                int v = seats[p] ? (seats[p]->field[i][j] & 0x03) : 0;
+                n += snprintf(row + n, sizeof(row) - n, " %c", cells[v]);
+            }
+        }
+        admin_appendf(out, "%s\n", row);
+    }
+}
+
+static void admin_command(const char* command, std::string* out) {
+    uint64_t outer = watchdog_enter(WATCHDOG_ADMIN, 0, -1);
+    char word[32] = "";
+    sscanf(command, "%31s", word);
+    if (strcmp(word, "sessions") == 0) admin_sessions(command, out);
+    else if (strcmp(word, "connections") == 0) admin_connections(command, out);
+    else if (strcmp(word, "session") == 0) admin_session(command, out);
+    else if (strcmp(word, "top") == 0) admin_top(command, out);
+    else if (strcmp(word, "help") == 0) out->append(ADMIN_HELP);
+    else {
+        admin_appendf(out, "ERROR unknown command '%s'\n", word);
+        out->append(ADMIN_HELP);
+    }
+    watchdog_leave(outer);
+}
+
+/* Main server loop */
+int main(int argc, char* argv[]) {
+    int server_sock;
+    socklen_t length;
+    struct sockaddr_in server;
+
+#ifdef _WIN32
+    if (!init_winsock()) {
+        fprintf(stderr, "Failed to initialize Winsock\n");
+        return 1;
+    }
+#endif
+
+    struct pollfd fds[MAX_CLIENTS + POLL_FIRST_CLIENT];
+    int nfds = POLL_FIRST_CLIENT;
+    int i;
+    int daemon_mode = 0;
+    int port = 0;
+    int takeover = 0;
+    const char* snapshot_path = SNAPSHOT_FILE;
+    const char* leaderboard_path = LEADERBOARD_SHM_PATH;
+    int leaderboard_required = 0;
+    unsigned long node_id = 0;
+    int gossip_port = 0;
+    int gossip_peers = 0;
+    unsigned long seed = 0;
+    const char* record_path = NULL;
+    int seed_set = 0;
+    int bot_threads = BOT_DEFAULT_THREADS;
+    int metrics_port = 0;
+    const char* metrics_socket = NULL;
+    const char* admin_socket = NULL;
+    const char* trace_prefix = TRACE_DEFAULT_PREFIX;
+    const char* log_file = NULL;
+    int log_level = LOG_LEVEL_INFO;
+    int log_syslog = 0;
+    int stall_threshold_ms = WATCHDOG_DEFAULT_THRESHOLD_MS;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-d") == 0 || strcmp(argv[i], "--daemon") == 0) {
+            daemon_mode = 1;
+        } else if (strcmp(argv[i], "-p") == 0 || strcmp(argv[i], "--port") == 0) {
+            if (i + 1 < argc) {
+                port = atoi(argv[++i]);
+            }
+        } else if (strcmp(argv[i], "--snapshot") == 0) {
+            if (i + 1 < argc) {
+                snapshot_path = argv[++i];
+            }
+        } else if (strcmp(argv[i], "--no-snapshot") == 0) {
+            snapshot_path = NULL;
+        } else if (strcmp(argv[i], "--resume-grace") == 0) {
+            if (i + 1 < argc) {
+                g_resume_grace_sec = atoi(argv[++i]);
+            }
+        } else if (strcmp(argv[i], "--leaderboard") == 0) {
+            if (i + 1 < argc) {
+                leaderboard_path = argv[++i];
+            }
+        } else if (strcmp(argv[i], "--require-leaderboard") == 0) {
+            leaderboard_required = 1;
+        } else if (strcmp(argv[i], "--node-id") == 0) {
+            if (i + 1 < argc) {
+                node_id = strtoul(argv[++i], NULL, 10);
+            }
+        } else if (strcmp(argv[i], "--gossip-port") == 0) {
+            if (i + 1 < argc) {
+                gossip_port = atoi(argv[++i]);
+            }
+        } else if (strcmp(argv[i], "--gossip-bind") == 0) {
+            if (i + 1 < argc) {
+                crdt_set_bind(argv[++i]);
+            }
+        } else if (strcmp(argv[i], "--gossip-secret-file") == 0) {
+            if (i + 1 < argc) {
+                if (crdt_load_secret(argv[++i]) != 0) {
+                    /* Not gossiping without the secret that was asked for */
+                    fprintf(stderr, "Cannot read a gossip secret from '%s'\n", argv[i]);
+#ifdef _WIN32
+                    cleanup_winsock();
+#endif
+                    return 1;
+                }
+            }
+        } else if (strcmp(argv[i], "--gossip-state") == 0) {
+            if (i + 1 < argc) {
+                crdt_set_state_file(argv[++i]);
+            }
+        } else if (strcmp(argv[i], "--peer") == 0) {
+            if (i + 1 < argc) {
+                if (crdt_add_peer(argv[++i]) == 0) {
+                    gossip_peers++;
+                } else {
+                    fprintf(stderr, "Ignoring invalid peer '%s'\n", argv[i]);
+                }
+            }
+        } else if (strcmp(argv[i], "--upgrade-socket") == 0) {
+            if (i + 1 < argc) {
+                g_upgrade_path = argv[++i];
+            }
+        } else if (strcmp(argv[i], "--takeover") == 0) {
+            takeover = 1;
+        } else if (strcmp(argv[i], "--record") == 0) {
+            if (i + 1 < argc) {
+                record_path = argv[++i];
+            }
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            if (i + 1 < argc) {
+                seed = strtoul(argv[++i], NULL, 10);
+                seed_set = 1;
+            }
+        } else if (strcmp(argv[i], "--metrics-port") == 0) {
+            if (i + 1 < argc) {
+                metrics_port = atoi(argv[++i]);
+            }
+        } else if (strcmp(argv[i], "--metrics-socket") == 0) {
+            if (i + 1 < argc) {
+                metrics_socket = argv[++i];
+            }
+        } else if (strcmp(argv[i], "--admin-socket") == 0) {
+            if (i + 1 < argc) {
+                admin_socket = argv[++i];
+            }
+        } else if (strcmp(argv[i], "--trace-prefix") == 0) {
+            if (i + 1 < argc) {
+                trace_prefix = argv[++i];
+            }
+        } else if (strcmp(argv[i], "--log-file") == 0) {
+            if (i + 1 < argc) {
+                log_file = argv[++i];
+            }
+        } else if (strcmp(argv[i], "--log-level") == 0) {
+            if (i + 1 < argc) {
+                log_level = log_level_parse(argv[++i]);
+                if (log_level < 0) {
+                    fprintf(stderr, "Unknown log level '%s', using info\n", argv[i]);
+                    log_level = LOG_LEVEL_INFO;
+                }
+            }
+        } else if (strcmp(argv[i], "--syslog") == 0) {
+            log_syslog = 1;
+        } else if (strcmp(argv[i], "--heartbeat-interval") == 0) {
+            if (i + 1 < argc) {
+                g_heartbeat_ms = atoi(argv[++i]);
+            }
+        } else if (strcmp(argv[i], "--turn-timeout") == 0) {
+            if (i + 1 < argc) {
+                g_turn_timeout_sec = atoi(argv[++i]);
+            }
+        } else if (strcmp(argv[i], "--turn-timeout-action") == 0) {
+            if (i + 1 < argc) {
+                i++;
+                if (strcmp(argv[i], "forfeit") == 0) {
+                    g_turn_action = TURN_ACTION_FORFEIT;
+                } else if (strcmp(argv[i], "shot") == 0) {
+                    g_turn_action = TURN_ACTION_SHOT;
+                } else {
+                    fprintf(stderr, "Unknown turn timeout action '%s', using shot\n", argv[i]);
+                }
+            }
+        } else if (strcmp(argv[i], "--placement-timeout") == 0) {
+            if (i + 1 < argc) {
+                g_placement_timeout_sec = atoi(argv[++i]);
+            }
+        } else if (strcmp(argv[i], "--idle-timeout") == 0) {
+            if (i + 1 < argc) {
+                g_idle_timeout_sec = atoi(argv[++i]);
+            }
+        } else if (strcmp(argv[i], "--drain-timeout") == 0) {
+            if (i + 1 < argc) {
+                g_drain_timeout_sec = atoi(argv[++i]);
+            }
+        } else if (strcmp(argv[i], "--stall-threshold") == 0) {
+            if (i + 1 < argc) {
+                stall_threshold_ms = atoi(argv[++i]);
+            }
+        } else if (strcmp(argv[i], "--bot-threads") == 0) {
+            if (i + 1 < argc) {
+                bot_threads = atoi(argv[++i]);
+            }
+        } else if (strcmp(argv[i], "--bot-deadline") == 0) {
+            if (i + 1 < argc) {
+                g_bot_deadline_ms = atoi(argv[++i]);
+            }
+        } else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            printf("Usage: %s [-d|--daemon] [-p|--port PORT] [--snapshot PATH | --no-snapshot]\n"
+                   "          [--resume-grace SECONDS] [--upgrade-socket PATH] [--takeover]\n"
+                   "          [--leaderboard SHM_PATH] [--require-leaderboard]\n"
+                   "          [--node-id N] [--gossip-port PORT] [--peer HOST:PORT]...\n"
+                   "          [--gossip-bind ADDRESS] [--gossip-secret-file PATH] [--gossip-state PATH]\n"
+                   "          [--seed N] [--record CAPTURE_PATH]\n"
+                   "          [--bot-threads N] [--bot-deadline MS]\n"
+                   "          [--metrics-port PORT] [--metrics-socket PATH] [--trace-prefix PATH]\n"
+                   "          [--log-file PATH] [--log-level debug|info|warn|error] [--syslog]\n"
+                   "          [--stall-threshold MS] [--heartbeat-interval MS] [--admin-socket PATH]\n"
+                   "          [--turn-timeout SECONDS] [--turn-timeout-action shot|forfeit]\n"
+                   "          [--placement-timeout SECONDS] [--idle-timeout SECONDS]\n"
+                   "          [--drain-timeout SECONDS]\n"
+                   "JOIN_SESSION with arg2 \"bot[:easy|medium|hard]\" plays against a hosted bot;\n"
+                   "--bot-threads 0 disables hosted bots.\n"
+                   "Without the shared leaderboard wins go to %s, or the server exits\n"
+                   "with --require-leaderboard.\n"
+                   "SIGUSR2 or a crash dumps the flight recorder to PREFIX-<pid>-<n>.json\n"
+                   "(Chrome trace format; default prefix %s).\n"
+                   "Gossip listens on --gossip-bind (default %s); with --gossip-secret-file\n"
+                   "peers must prove they know the secret in the file. The node id and its own\n"
+                   "wins are kept in --gossip-state (default %s).\n"
+                   "Logs go to stdout, or to syslog in daemon mode; --log-file adds a file.\n"
+                   "Loop iterations longer than --stall-threshold (default %d ms, 0 disables)\n"
+                   "are logged and dump the flight recorder tail.\n"
+                   "Connections are pinged every --heartbeat-interval (default %d ms, 0 disables)\n"
+                   "and dropped after %d unanswered pings.\n"
+                   "--admin-socket serves a read-only console (send \"help\" for its commands).\n"
+                   "A player out of time (--turn-timeout, default %d s) gets a shot fired for\n"
+                   "them and loses after %d in a row, or at once with forfeit; ships not placed\n"
+                   "in --placement-timeout (default %d s) are placed for them. Connections not\n"
+                   "in a game are closed after --idle-timeout (default %d s). 0 disables each.\n"
+                   "SIGINT/SIGTERM drain: new sessions are refused and running games get up to\n"
+                   "--drain-timeout (default %d s) to finish; a second signal stops waiting.\n",
+                   argv[0], LEADERBOARD_FILE, TRACE_DEFAULT_PREFIX, GOSSIP_BIND_DEFAULT, crdt_default_state_file(),
+                   WATCHDOG_DEFAULT_THRESHOLD_MS,
+                   HEARTBEAT_INTERVAL_MS, HEARTBEAT_MISSES,
+                   TURN_TIMEOUT_SEC, TURN_FORFEIT_AFTER, PLACEMENT_TIMEOUT_SEC, IDLE_TIMEOUT_SEC,
+                   DRAIN_TIMEOUT_SEC);
+#ifdef _WIN32
+            cleanup_winsock();
+#endif
+            return 0;
+        }
+    }
+
+    if (takeover && !g_upgrade_path) {
+        g_upgrade_path = UPGRADE_SOCKET_PATH;
+    }
+
+    // Before the handlers: they write to it
+    open_signal_pipe();
+
+#ifdef _WIN32
+    if (daemon_mode) {
+        log_write(LOG_LEVEL_WARN, "Daemon mode not supported on Windows; running in foreground.");
+    }
+    daemon_mode = 0;
+    signal(SIGINT, handle_server_sigint);
+    signal(SIGTERM, handle_server_sigint);
+#else
+    openlog("battleship_server", LOG_PID | LOG_NDELAY, LOG_DAEMON);
+
+    if (daemon_mode) {
+        syslog(LOG_INFO, "Starting battleship server in daemon mode");
+        if (daemonize() < 0) {
+            syslog(LOG_ERR, "Failed to daemonize");
+            return 1;
+        }
+        signal(SIGINT, handle_server_sigint);
+        signal(SIGTERM, handle_server_sigint);
+        signal(SIGHUP, SIG_IGN);
+        signal(SIGTSTP, SIG_IGN);
+        signal(SIGQUIT, SIG_IGN);
+    } else {
+        signal(SIGINT, handle_server_sigint);
+        signal(SIGTERM, handle_server_sigint);
+        signal(SIGTSTP, handle_server_sigint);
+    }
+#endif
+
+    /* After daemonize(): the writer thread would not survive the fork */
+    int log_sinks = daemon_mode ? LOG_SINK_SYSLOG : LOG_SINK_STDOUT;
+    if (log_syslog) log_sinks |= LOG_SINK_SYSLOG;
+    if (log_file) log_sinks |= LOG_SINK_FILE;
+    log_start(log_sinks, log_file, log_level);
+
+    trace_thread_name("poll loop");
+    trace_install_signal_handlers(trace_prefix);
+    watchdog_start(stall_threshold_ms);
+
+#ifndef _WIN32
+    signal(SIGPIPE, SIG_IGN);
+    /* Large MAX_CLIENTS builds need more than the default 1024 descriptors */
+    struct rlimit rl;
+    if (MAX_CLIENTS > 512 && getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+#endif
+
+    if (seed_set) {
+        server_set_seed((unsigned int)seed);
+        log_write(LOG_LEVEL_INFO, "Deterministic placement and resume tokens (seed %lu)", seed);
+    } else {
+#ifdef _WIN32
+        g_rng = (unsigned int)time(NULL) ^ ((unsigned int)GetCurrentProcessId() << 16);
+#else
+        g_rng = (unsigned int)time(NULL) ^ ((unsigned int)getpid() << 16);
+#endif
+    }
+    /* The token fallback without /dev/urandom still uses rand() */
+    srand((unsigned int)time(NULL));
+
+    if (write_pid_file() < 0) {
+        fprintf(stderr, "Failed to write PID file\n");
 #ifdef _WIN32
         cleanup_winsock();
 #endif
-        exit(1);
+        return 1;
+    }
+
+    server_reset();
+
+    if (record_path && capture_open(record_path, g_rng, g_seeded) == 0) {
+        log_write(LOG_LEVEL_INFO, "Recording inbound traffic to %s", record_path);
     }
 
-    length = sizeof server;
-    if (getsockname(server_sock, (struct sockaddr*) &server, &length) == -1) {
-        printf("Failed to get socket name\n");
+#ifdef _WIN32
+    int leaderboard_ok = -1;
+#else
+    int leaderboard_ok = leaderboard_open(leaderboard_path);
+#endif
+    if (leaderboard_ok < 0 && leaderboard_required) {
+        log_write(LOG_LEVEL_ERROR, "Shared leaderboard %s unavailable", leaderboard_path);
+        capture_close();
+        remove_pid_file();
+        log_stop();
 #ifdef _WIN32
         cleanup_winsock();
 #endif
-        exit(1);
+        return 1;
+    }
+    if (leaderboard_ok < 0) {
+        log_write(LOG_LEVEL_WARN, "Shared leaderboard unavailable, using %s", LEADERBOARD_FILE);
+    }
+
+    if ((metrics_port > 0 || metrics_socket) && metrics_start(metrics_port, metrics_socket) == 0) {
+        if (metrics_port > 0) log_write(LOG_LEVEL_INFO, "Prometheus metrics on http://127.0.0.1:%d/metrics", metrics_port);
+        if (metrics_socket) log_write(LOG_LEVEL_INFO, "Prometheus metrics on unix socket %s", metrics_socket);
+    }
+
+    if (admin_socket) {
+        if (admin_start(admin_socket) == 0) log_write(LOG_LEVEL_INFO, "Admin console on unix socket %s", admin_socket);
+        else log_write(LOG_LEVEL_WARN, "Failed to open admin socket %s", admin_socket);
+    }
+
+    if (bot_threads > 0 && bot_pool_start(bot_threads) == 0) {
+        log_write(LOG_LEVEL_INFO, "Hosted bots enabled (%d worker thread(s), %d ms per move)", bot_threads, g_bot_deadline_ms);
+    }
+
+    if (gossip_port > 0 || gossip_peers > 0) {
+        if (crdt_start((uint32_t)node_id, gossip_port) == 0) {
+            log_write(LOG_LEVEL_INFO, "Leaderboard gossip enabled as node %u (port %d, %d peer(s))",
+                      crdt_node_id(), gossip_port, gossip_peers);
+        }
+    }
+
+    for (i = 0; i < MAX_CLIENTS + POLL_FIRST_CLIENT; i++) {
+        fds[i].fd = -1;
+        fds[i].events = POLLIN;
+        fds[i].revents = 0;
+    }
+
+    if (takeover) {
+        /* State comes from the running server, not from the snapshot */
+        server_sock = handoff_takeover(g_upgrade_path, clients, sessions);
+        if (server_sock == -1) {
+            bot_pool_stop();
+            remove_pid_file();
+            log_stop();
+            exit(1);
+        }
+        for (i = 0; i < MAX_CLIENTS; i++) {
+            if (clients[i].fd != -1) {
+                fds[nfds].fd = clients[i].fd;
+                fds[nfds].events = POLLIN;
+                nfds++;
+                capture_connect(clients[i].fd);
+                watch_idle(&clients[i]);
+                if (placing_now(&clients[i])) watch_placement(&clients[i]);
+            } else if (clients[i].session_id != -1) {
+                watch_held_seat(&clients[i]);
+            }
+        }
+        /* Deadlines are not handed over: games in progress start theirs over */
+        for (i = 0; i < MAX_SESSIONS; i++) {
+            if (sessions[i].id != -1 && sessions[i].game_started && !sessions[i].game_finished) start_turn_clock(i);
+        }
+        log_write(LOG_LEVEL_INFO, "Took over listener and %d connection(s) from running server", nfds - POLL_FIRST_CLIENT);
+        if (snapshot_path) snapshot_open(snapshot_path);
+    } else {
+        if (snapshot_path && snapshot_open(snapshot_path) == 0) {
+            restore_sessions_from_snapshot();
+        }
+        server_sock = handoff_listen_fds();
+        if (server_sock != -1) {
+            log_write(LOG_LEVEL_INFO, "Using socket-activated listener (fd %d)", server_sock);
+        } else {
+            server_sock = create_listen_socket(port);
+        }
     }
 
-    printf("Battleship server started on port %d\n", ntohs(server.sin_port));
+    if (server_sock == -1) {
+        bot_pool_stop();
+        log_stop();
+#ifdef _WIN32
+        cleanup_winsock();
+#endif
+        exit(1);
+    }
 
-    if (listen(server_sock, 5) == -1) {
-        printf("Failed to listen on socket\n");
+    length = sizeof server;
+    if (getsockname(server_sock, (struct sockaddr*) &server, &length) == -1) {
+        log_write(LOG_LEVEL_ERROR, "Failed to get socket name");
+        bot_pool_stop();
+        log_stop();
 #ifdef _WIN32
         cleanup_winsock();
 #endif
         exit(1);
     }
 
-    fds[0].fd = server_sock;
-    fds[0].events = POLLIN;
+    log_write(LOG_LEVEL_INFO, "Battleship server started on port %d", ntohs(server.sin_port));
+
+    fds[POLL_LISTENER].fd = server_sock;
+    fds[POLL_LISTENER].events = POLLIN;
 
-    printf("Waiting for connections...\n");
+    if (g_upgrade_path) {
+        g_upgrade_sock = handoff_listen(g_upgrade_path);
+        fds[POLL_UPGRADE].fd = g_upgrade_sock;
+        fds[POLL_UPGRADE].events = POLLIN;
+    }
+
+    /* Finished bot moves wake the loop; without a wake fd (Windows) the
+       loop polls briefly while moves are outstanding */
+    fds[POLL_BOTS].fd = bot_pool_wake_fd();
+    fds[POLL_BOTS].events = POLLIN;
+    fds[POLL_ADMIN].fd = admin_wake_fd();
+    fds[POLL_ADMIN].events = POLLIN;
+    /* Without the pipe (Windows) a signal is noticed by the next poll
+       timeout */
+    fds[POLL_SIGNAL].fd = g_signal_pipe[0];
+    fds[POLL_SIGNAL].events = POLLIN;
+
+    log_write(LOG_LEVEL_INFO, "Waiting for connections...");
+
+    long long last_flush_ms = monotonic_ms();
+    long long last_sample_ms = 0;
+    long long last_hot_ms = monotonic_ms();
+    long long last_heartbeat_ms = 0;
+    long long drain_deadline_ms = 0;
+    sig_atomic_t signals_seen = 0;
+    uint64_t woke_ns = 0;
 
     while (1) {
-        int poll_count = poll(fds, nfds, -1);
+        /* Measured here so iterations that "continue" early count too */
+        if (woke_ns) metrics_loop_ns(metrics_now_ns() - woke_ns);
+
+        int signalled = g_signals != signals_seen;
+        int in_progress = (g_draining || signalled) ? games_in_progress() : 0;
+        if (signalled) {
+            signals_seen = g_signals;
+            clear_signal_pipe();
+            if (g_draining) {
+                log_write(LOG_LEVEL_WARN, "Shutdown signal repeated, not waiting for %d game(s)", in_progress);
+                break;
+            }
+            g_draining = 1;
+            drain_deadline_ms = monotonic_ms() + (long long)g_drain_timeout_sec * 1000;
+            for (i = POLL_FIRST_CLIENT; i < nfds; i++) {
+                if (fds[i].fd != -1) limit_send_wait(fds[i].fd);
+            }
+            log_write(LOG_LEVEL_INFO, "=== SERVER SHUTDOWN INITIATED ===");
+            log_write(LOG_LEVEL_INFO, "Draining: no new sessions, waiting up to %d seconds for %d game(s)",
+                      g_drain_timeout_sec, in_progress);
+        }
+        long long drain_left_ms = drain_deadline_ms - monotonic_ms();
+        if (g_draining && (in_progress == 0 || drain_left_ms <= 0)) {
+            if (in_progress > 0) {
+                log_write(LOG_LEVEL_WARN, "Drain timed out with %d game(s) in progress", in_progress);
+            }
+            break;
+        }
+
+        if (g_upgrade_sock != -1) fds[POLL_UPGRADE].fd = handoff_poll_fd(g_upgrade_sock);
+        int timeout = (fds[POLL_BOTS].fd == -1 && bot_pool_pending() > 0) ? 5 : SNAPSHOT_FLUSH_MS;
+        if (g_heartbeat_ms > 0 && timeout > HEARTBEAT_CHECK_MS) timeout = HEARTBEAT_CHECK_MS;
+        if (g_draining && timeout > drain_left_ms) timeout = (int)drain_left_ms;
+        timeout = (int)timer_next_ms(wheel(), monotonic_ms(), timeout);
+        uint64_t poll_start = trace_now_ns();
+        watchdog_idle(poll_start);
+        int poll_count = poll(fds, nfds, timeout);
+        woke_ns = metrics_now_ns();
+        watchdog_busy(woke_ns);
+        trace_complete(TRACE_POLL, 0, poll_count, poll_start, woke_ns);
 
         if (poll_count == -1) {
             if (errno == EINTR) continue;
-            printf("Poll error\n");
+            log_write(LOG_LEVEL_ERROR, "Poll error");
+            bot_pool_stop();
+            log_stop();
 #ifdef _WIN32
             cleanup_winsock();
 #endif
             exit(1);
         }
 
-        if (fds[0].revents & POLLIN) {
-            int new_client = accept(server_sock, NULL, NULL);
-            if (new_client == -1) {
-                printf("Accept error\n");
-            } else if (nfds < MAX_CLIENTS + 1) {
-                int client_slot = -1;
-                for (i = 0; i < MAX_CLIENTS; i++) {
-                    if (clients[i].fd == -1) {
-                        client_slot = i;
-                        break;
-                    }
+        server_tick();
+        drop_closed_elsewhere(fds, nfds);
+
+        long long now_ms = monotonic_ms();
+        if (now_ms - last_flush_ms >= SNAPSHOT_FLUSH_MS) {
+            uint64_t outer = watchdog_enter(WATCHDOG_SNAPSHOT, 0, -1);
+            snapshot_flush(sessions);
+            watchdog_leave(outer);
+            last_flush_ms = now_ms;
+        }
+        capture_flush();
+        if (now_ms - last_sample_ms >= METRICS_SAMPLE_MS) {
+            sample_metrics();
+            last_sample_ms = now_ms;
+        }
+        if (now_ms - last_hot_ms >= HOT_WINDOW_MS) {
+            sample_hot_sessions(now_ms - last_hot_ms);
+            last_hot_ms = now_ms;
+        }
+        if (g_heartbeat_ms > 0 && now_ms - last_heartbeat_ms >= HEARTBEAT_CHECK_MS) {
+            if (send_heartbeats(now_ms) > 0) {
+                /* Dropped peers are closed: take them out of the poll set */
+                for (i = POLL_FIRST_CLIENT; i < nfds; i++) {
+                    if (fds[i].fd != -1 && !find_client_by_fd(fds[i].fd)) fds[i].fd = -1;
                 }
+            }
+            last_heartbeat_ms = now_ms;
+        }
 
-                if (client_slot != -1) {
-                    clients[client_slot].fd = new_client;
-                    clients[client_slot].session_id = -1;
-                    clients[client_slot].player_number = 0;
-                    clients[client_slot].ready = 0;
-                    create_game_field(clients[client_slot].field);
-                    initialize_ships(&clients[client_slot].ship_data);
+        if (poll_count == 0) continue;
+
+        if (fds[POLL_ADMIN].revents & POLLIN) admin_serve(admin_command);
+
+        if ((fds[POLL_UPGRADE].revents & (POLLIN | POLLHUP)) && handoff_ready(g_upgrade_sock)) {
+            uint64_t outer = watchdog_enter(WATCHDOG_HANDOFF, 0, -1);
+            snapshot_flush(sessions);
+            park_bots(1);
+            if (handoff_serve(server_sock, clients, sessions) == 0) {
+                /* The new process owns every socket now: leave without
+                   closing connections, removing the PID file or unlinking
+                   the control socket it is about to rebind. */
+                log_write(LOG_LEVEL_INFO, "Handed over %d connection(s) to new process, exiting.", nfds - POLL_FIRST_CLIENT);
+                bot_pool_stop();
+                snapshot_close();
+                capture_close();
+                log_stop();
+                exit(0);
+            }
+            park_bots(0);
+            watchdog_leave(outer);
+        }
 
+        if (fds[POLL_LISTENER].revents & POLLIN) {
+            int new_client = accept(server_sock, NULL, NULL);
+            if (new_client != -1) trace_instant(TRACE_ACCEPT, new_client);
+            if (new_client == -1) {
+                log_write(LOG_LEVEL_ERROR, "Accept error");
+            } else if (nfds < MAX_CLIENTS + POLL_FIRST_CLIENT) {
+                /* Turns are several small packets; don't let Nagle hold them */
+                int one = 1;
+                setsockopt(new_client, IPPROTO_TCP, TCP_NODELAY, (const char*)&one, sizeof(one));
+                /* Clients too old to answer PING still get half-open
+                   connections noticed, only later */
+                setsockopt(new_client, SOL_SOCKET, SO_KEEPALIVE, (const char*)&one, sizeof(one));
+#ifdef TCP_KEEPIDLE
+                int idle_s = 60, interval_s = 10, probes = 3;
+                setsockopt(new_client, IPPROTO_TCP, TCP_KEEPIDLE, &idle_s, sizeof(idle_s));
+                setsockopt(new_client, IPPROTO_TCP, TCP_KEEPINTVL, &interval_s, sizeof(interval_s));
+                setsockopt(new_client, IPPROTO_TCP, TCP_KEEPCNT, &probes, sizeof(probes));
+#endif
+                if (g_draining) limit_send_wait(new_client);
+
+                if (server_attach(new_client) != -1) {
                     fds[nfds].fd = new_client;
                     fds[nfds].events = POLLIN;
                     fds[nfds].revents = 0;
-
-                    printf("New client connected: fd=%d\n", new_client);
-
-                    send_packet_by_parts(new_client, "WELCOME", "Welcome to Battleship! Choose a session:", NULL);
-                    send_session_list(&clients[client_slot]);
-                    send_leaderboard_to_client(new_client);
-
                     nfds++;
+                    metrics_connection(1);
                 } else {
-                    printf("Max clients reached. Rejecting connection.\n");
+                    log_write(LOG_LEVEL_WARN, "Max clients reached. Rejecting connection.");
                     sock_close(new_client);
+                    metrics_connection(0);
                 }
             } else {
-                printf("Max clients reached. Rejecting connection.\n");
+                log_write(LOG_LEVEL_WARN, "Max clients reached. Rejecting connection.");
                 sock_close(new_client);
+                metrics_connection(0);
             }
         }
 
-        for (i = 1; i < nfds; i++) {
+        for (i = POLL_FIRST_CLIENT; i < nfds; i++) {
             if (fds[i].fd == -1) continue;
 
             if (fds[i].revents & (POLLIN | POLLHUP)) {
@@ -872,14 +2720,7 @@ int main(int argc, char* argv[]) {
                 memset(&pkt, 0, sizeof(pkt));
                 int got = recv_packet_fd(fds[i].fd, &pkt);
                 if (got <= 0) {
-                    printf("Client %d disconnected\n", fds[i].fd);
-
-                    for (int j = 0; j < MAX_CLIENTS; j++) {
-                        if (clients[j].fd == fds[i].fd) {
-                            disconnect_client(&clients[j]);
-                            break;
-                        }
-                    }
+                    server_detach(fds[i].fd);
 
                     for (int k = i; k < nfds - 1; k++) {
                         fds[k] = fds[k + 1];
@@ -889,21 +2730,23 @@ int main(int argc, char* argv[]) {
                     continue;
                     
                 } else {
-                    for (int j = 0; j < MAX_CLIENTS; j++) {
-                        if (clients[j].fd == fds[i].fd) {
-                            process_client_packet(&clients[j], &pkt);
-                            break;
-                        }
-                    }
+                    server_receive(fds[i].fd, &pkt);
+                    /* DISCONNECT closed it: drop the entry before the kernel
+                       hands the same fd number to a new connection */
+                    if (!find_client_by_fd(fds[i].fd)) fds[i].fd = -1;
+                    drop_closed_elsewhere(fds, nfds);
                 }
             }
         }
 
+        /* Bots answer what the packets above sent them */
+        dispatch_bots();
+
         static int compact_counter = 0;
         if (++compact_counter > 100) {
             compact_counter = 0;
-            int write_index = 1;
-            for (i = 1; i < nfds; i++) {
+            int write_index = POLL_FIRST_CLIENT;
+            for (i = POLL_FIRST_CLIENT; i < nfds; i++) {
                 if (fds[i].fd != -1) {
                     if (write_index != i) {
                         fds[write_index] = fds[i];
@@ -916,13 +2759,27 @@ int main(int argc, char* argv[]) {
         }
     }
 
-    for (i = 1; i < nfds; i++) {
-        if (fds[i].fd != -1) sock_close(fds[i].fd);
-    }
+    /* Stopped first: the linger below is a deliberate wait, not a stall */
+    watchdog_stop();
     sock_close(server_sock);
+    handoff_close(g_upgrade_sock, g_upgrade_path);
+    bot_pool_stop();
+    metrics_stop();
+    admin_stop();
+    crdt_stop();
+    close_connections(fds, nfds);
+
+    /* Sessions stay in the snapshot so a restarted server can restore them */
+    snapshot_flush(sessions);
+    snapshot_close();
+    capture_close();
     remove_pid_file();
+    log_write(LOG_LEVEL_INFO, "Server terminated.");
+    log_stop();
 #ifdef _WIN32
     cleanup_winsock();
 #endif
     return 0;
 }
+
+#endif /* BATTLESHIP_SERVER_NO_MAIN */
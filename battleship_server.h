@@ -0,0 +1,55 @@
+#ifndef BATTLESHIP_SERVER_H
+#define BATTLESHIP_SERVER_H
+
+#include "battleship.h"
+
+/* Server core without the socket loop. main() in battleship_server.cpp
+   drives it from poll(); building that file with BATTLESHIP_SERVER_NO_MAIN
+   lets another program (battleship_dsim) embed the same game logic and
+   feed it packets from a simulated network.
+
+   Connections are identified by an int "fd". With the default transport
+   these are real sockets; a custom transport may use any numbers. */
+
+struct server_transport {
+    // Delivers one packet to a connection. Returns PACKET_SIZE or -1.
+    int (*send)(int fd, const packet_t* p);
+    // The server is done with a connection (DISCONNECT, lost seat).
+    void (*close)(int fd);
+};
+
+// Monotonic time in milliseconds
+typedef long long (*server_clock_fn)();
+
+// NULL restores the socket transport / the system clock.
+void server_set_transport(const struct server_transport* transport);
+void server_set_clock(server_clock_fn now_ms);
+
+/* Derives ship placement and resume tokens from one seed instead of the
+   clock and /dev/urandom, so a run can be replayed. Tokens become
+   predictable: only for testing. */
+void server_set_seed(unsigned int seed);
+
+void server_set_resume_grace(int seconds);
+// 0 keeps finished games off the leaderboard (simulations)
+void server_set_record_wins(int enabled);
+/* Seconds a player has for a turn, for placing ships, and a connection
+   outside a game may stay silent. 0 disables one. */
+void server_set_timeouts(int turn_sec, int placement_sec, int idle_sec);
+
+// Clears every client slot and session.
+void server_reset();
+
+// A new connection: greets it and returns its slot, or -1 when full (the
+// caller then closes it).
+int server_attach(int fd);
+// One complete packet from a connection.
+void server_receive(int fd, const packet_t* p);
+// The connection dropped; its seat is held for the resume grace period.
+void server_detach(int fd);
+/* Runs the deadlines that came due (turn clocks, placement, held seats,
+   idle connections) and the hosted bots. Call a few times per second;
+   deadlines fire on the first tick at or after them. */
+void server_tick();
+
+#endif // BATTLESHIP_SERVER_H
@@ -0,0 +1,336 @@
+/* Self-play simulator: plays complete games through the battleship.cpp
+   engine in-process, on a work-stealing pool with one worker per core.
+   Each player is a shot strategy plus a placement strategy
+   (battleship_strategy.h); the report gives win rates with Wilson score
+   intervals. Every game's RNG is derived from --seed and the game index,
+   so a run is reproducible regardless of thread count. */
+
+#include "battleship.h"
+#include "battleship_strategy.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Guards against strategies that never finish a game
+#define SIM_MAX_SHOTS 400
+
+struct player_cfg {
+    const struct shot_strategy* shooter;
+    const struct placement_strategy* placer;
+};
+
+struct game_range {
+    long long begin;
+    long long end;
+};
+
+struct worker_queue {
+    std::mutex lock;
+    std::deque<struct game_range> ranges;
+};
+
+// Per-worker totals, merged once at the end; aligned to keep workers off each other's cache lines
+struct alignas(64) sim_stats {
+    long long games;
+    long long wins[2];
+    long long draws;
+    long long first_mover_wins;
+    long long shots_to_win[2];
+    long long invalid_shots;
+    long long stolen;
+};
+
+struct sim_config {
+    long long games;
+    int threads;
+    long long chunk;
+    uint64_t seed;
+    double confidence;
+    int json;
+    struct player_cfg players[2];
+    char specs[2][64];
+};
+
+static struct sim_config g_cfg;
+static std::vector<struct worker_queue> g_queues;
+static std::atomic<long long> g_games_done(0);
+
+static uint64_t splitmix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+/* Plays one game. Players alternate who moves first by game index, and a
+   hit keeps the turn as on the server. Returns the winner (0 or 1), or -1
+   when SIM_MAX_SHOTS runs out. */
+static int play_game(long long index, struct sim_stats* st) {
+    uint64_t h = splitmix64(g_cfg.seed ^ splitmix64((uint64_t)index));
+    unsigned int rng[2] = {(unsigned int)h | 1u, (unsigned int)(h >> 32) | 1u};
+
+    Field field[2];
+    Field fog[2];           // fog[p]: what player p sees of the other field
+    struct ships ship_data[2];
+    int shots[2] = {0, 0};
+
+    for (int p = 0; p < 2; p++) {
+        create_game_field(field[p]);
+        create_game_field(fog[p]);
+        initialize_ships(&ship_data[p]);
+        g_cfg.players[p].placer->place(field[p], &ship_data[p], &rng[p]);
+    }
+
+    int first = (int)(index & 1);
+    int turn = first;
+    for (int total = 0; total < SIM_MAX_SHOTS; total++) {
+        int me = turn;
+        int opp = 1 - me;
+        int x = 0, y = 0;
+        g_cfg.players[me].shooter->shoot(fog[me], &rng[me], &x, &y);
+        int result = shot_at(field[opp], &ship_data[opp], x, y);
+        shots[me]++;
+
+        if (result == 1) {
+            build_fog_field(fog[me], field[opp]);
+            if (all_ships_sunk(&ship_data[opp])) {
+                st->shots_to_win[me] += shots[me];
+                if (me == first) st->first_mover_wins++;
+                return me;
+            }
+            continue;
+        }
+        /* A repeated or off-board shot loses the turn here; the server
+           would let the client retry, which a broken bot never stops. */
+        if (result == -1) st->invalid_shots++;
+        else fog[me][x][y] = 2;
+        turn = opp;
+    }
+    return -1;
+}
+
+static int pop_range(int self, struct game_range* out, struct sim_stats* st) {
+    {
+        std::lock_guard<std::mutex> guard(g_queues[self].lock);
+        if (!g_queues[self].ranges.empty()) {
+            *out = g_queues[self].ranges.back();
+            g_queues[self].ranges.pop_back();
+            return 1;
+        }
+    }
+    // Own queue is dry: steal the oldest range from someone else
+    int n = (int)g_queues.size();
+    for (int k = 1; k < n; k++) {
+        struct worker_queue* victim = &g_queues[(self + k) % n];
+        std::lock_guard<std::mutex> guard(victim->lock);
+        if (!victim->ranges.empty()) {
+            *out = victim->ranges.front();
+            victim->ranges.pop_front();
+            st->stolen++;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void worker_main(int self, struct sim_stats* st) {
+    struct game_range r;
+    while (pop_range(self, &r, st)) {
+        for (long long g = r.begin; g < r.end; g++) {
+            int winner = play_game(g, st);
+            st->games++;
+            if (winner < 0) st->draws++;
+            else st->wins[winner]++;
+        }
+        g_games_done.fetch_add(r.end - r.begin, std::memory_order_relaxed);
+    }
+}
+
+/* z for a two-sided interval, by bisection on the normal CDF */
+static double z_for_confidence(double confidence) {
+    double target = 1.0 - (1.0 - confidence) / 2.0;
+    double lo = 0.0, hi = 10.0;
+    for (int i = 0; i < 100; i++) {
+        double mid = (lo + hi) / 2.0;
+        if (0.5 * erfc(-mid / sqrt(2.0)) < target) lo = mid;
+        else hi = mid;
+    }
+    return (lo + hi) / 2.0;
+}
+
+static void wilson_interval(long long successes, long long n, double z, double* lo, double* hi) {
+    if (n == 0) {
+        *lo = 0;
+        *hi = 1;
+        return;
+    }
+    double p = (double)successes / n;
+    double z2 = z * z;
+    double denom = 1.0 + z2 / n;
+    double center = (p + z2 / (2.0 * n)) / denom;
+    double margin = z * sqrt(p * (1.0 - p) / n + z2 / (4.0 * n * (double)n)) / denom;
+    *lo = center - margin;
+    *hi = center + margin;
+}
+
+static int parse_player(const char* spec, struct player_cfg* out) {
+    char shot[32];
+    const char* place = "random";
+    const char* colon = strchr(spec, ':');
+    size_t len = colon ? (size_t)(colon - spec) : strlen(spec);
+    if (len == 0 || len >= sizeof(shot)) return -1;
+    memcpy(shot, spec, len);
+    shot[len] = '\0';
+    if (colon) place = colon + 1;
+
+    out->shooter = find_shot_strategy(shot);
+    out->placer = find_placement_strategy(place);
+    if (!out->shooter) fprintf(stderr, "Unknown shot strategy '%s'\n", shot);
+    if (!out->placer) fprintf(stderr, "Unknown placement strategy '%s'\n", place);
+    return (out->shooter && out->placer) ? 0 : -1;
+}
+
+static void print_usage(const char* prog) {
+    printf("Usage: %s [--games N] [--threads N] [--chunk N] [--seed N]\n"
+           "          [--a SHOT[:PLACE]] [--b SHOT[:PLACE]] [--confidence P] [--json] [--list]\n", prog);
+}
+
+static void print_strategies() {
+    printf("Shot strategies:\n");
+    for (const struct shot_strategy* s = shot_strategies; s->name; s++) {
+        printf("  %-10s %s\n", s->name, s->description);
+    }
+    printf("Placement strategies:\n");
+    for (const struct placement_strategy* s = placement_strategies; s->name; s++) {
+        printf("  %-10s %s\n", s->name, s->description);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    g_cfg.games = 1000000;
+    g_cfg.threads = (int)std::thread::hardware_concurrency();
+    if (g_cfg.threads <= 0) g_cfg.threads = 1;
+    g_cfg.chunk = 1024;
+    g_cfg.seed = 1;
+    g_cfg.confidence = 0.95;
+    g_cfg.json = 0;
+    strcpy(g_cfg.specs[0], "parity");
+    strcpy(g_cfg.specs[1], "random");
+
+    for (int i = 1; i < argc; i++) {
+        const char* a = argv[i];
+        const char* v = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (strcmp(a, "--games") == 0 && v) { g_cfg.games = atoll(v); i++; }
+        else if (strcmp(a, "--threads") == 0 && v) { g_cfg.threads = atoi(v); i++; }
+        else if (strcmp(a, "--chunk") == 0 && v) { g_cfg.chunk = atoll(v); i++; }
+        else if (strcmp(a, "--seed") == 0 && v) { g_cfg.seed = strtoull(v, NULL, 10); i++; }
+        else if (strcmp(a, "--confidence") == 0 && v) { g_cfg.confidence = atof(v); i++; }
+        else if (strcmp(a, "--a") == 0 && v) { snprintf(g_cfg.specs[0], sizeof(g_cfg.specs[0]), "%s", v); i++; }
+        else if (strcmp(a, "--b") == 0 && v) { snprintf(g_cfg.specs[1], sizeof(g_cfg.specs[1]), "%s", v); i++; }
+        else if (strcmp(a, "--json") == 0) { g_cfg.json = 1; }
+        else if (strcmp(a, "--list") == 0) { print_strategies(); return 0; }
+        else { print_usage(argv[0]); return strcmp(a, "--help") == 0 ? 0 : 1; }
+    }
+    if (g_cfg.games <= 0 || g_cfg.threads <= 0 || g_cfg.chunk <= 0 ||
+        g_cfg.confidence <= 0 || g_cfg.confidence >= 1) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    if (parse_player(g_cfg.specs[0], &g_cfg.players[0]) != 0 ||
+        parse_player(g_cfg.specs[1], &g_cfg.players[1]) != 0) {
+        return 1;
+    }
+
+    // Deal chunks round-robin; idle workers steal from the others
+    g_queues = std::vector<struct worker_queue>(g_cfg.threads);
+    int q = 0;
+    for (long long b = 0; b < g_cfg.games; b += g_cfg.chunk) {
+        struct game_range r = {b, std::min(g_cfg.games, b + g_cfg.chunk)};
+        g_queues[q].ranges.push_back(r);
+        q = (q + 1) % g_cfg.threads;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<struct sim_stats> stats(g_cfg.threads);
+    memset(stats.data(), 0, sizeof(struct sim_stats) * stats.size());
+    std::vector<std::thread> workers;
+    for (int t = 0; t < g_cfg.threads; t++) {
+        workers.emplace_back(worker_main, t, &stats[t]);
+    }
+
+    if (!g_cfg.json) {
+        while (g_games_done.load(std::memory_order_relaxed) < g_cfg.games) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            long long done = g_games_done.load(std::memory_order_relaxed);
+            double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            fprintf(stderr, "\r%lld/%lld games (%.0f games/s)", done, g_cfg.games, secs > 0 ? done / secs : 0);
+        }
+        fprintf(stderr, "\n");
+    }
+    for (auto& w : workers) w.join();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    struct sim_stats total;
+    memset(&total, 0, sizeof(total));
+    for (const struct sim_stats& s : stats) {
+        total.games += s.games;
+        total.wins[0] += s.wins[0];
+        total.wins[1] += s.wins[1];
+        total.draws += s.draws;
+        total.first_mover_wins += s.first_mover_wins;
+        total.shots_to_win[0] += s.shots_to_win[0];
+        total.shots_to_win[1] += s.shots_to_win[1];
+        total.invalid_shots += s.invalid_shots;
+        total.stolen += s.stolen;
+    }
+
+    double z = z_for_confidence(g_cfg.confidence);
+    double lo[2], hi[2], first_lo, first_hi;
+    long long decided = total.wins[0] + total.wins[1];
+    wilson_interval(total.wins[0], total.games, z, &lo[0], &hi[0]);
+    wilson_interval(total.wins[1], total.games, z, &lo[1], &hi[1]);
+    wilson_interval(total.first_mover_wins, decided, z, &first_lo, &first_hi);
+
+    if (g_cfg.json) {
+        printf("{\"games\": %lld, \"threads\": %d, \"seed\": %llu, \"elapsed_s\": %.3f, "
+               "\"games_per_s\": %.1f, \"confidence\": %.4f, \"draws\": %lld, "
+               "\"invalid_shots\": %lld, \"stolen_chunks\": %lld, \"players\": [",
+               total.games, g_cfg.threads, (unsigned long long)g_cfg.seed, elapsed,
+               total.games / elapsed, g_cfg.confidence, total.draws, total.invalid_shots, total.stolen);
+        for (int p = 0; p < 2; p++) {
+            printf("%s{\"spec\": \"%s\", \"wins\": %lld, \"win_rate\": %.6f, \"ci_low\": %.6f, "
+                   "\"ci_high\": %.6f, \"mean_shots_to_win\": %.3f}",
+                   p ? ", " : "", g_cfg.specs[p], total.wins[p], (double)total.wins[p] / total.games,
+                   lo[p], hi[p], total.wins[p] ? (double)total.shots_to_win[p] / total.wins[p] : 0.0);
+        }
+        printf("], \"first_mover_win_rate\": %.6f, \"first_mover_ci_low\": %.6f, "
+               "\"first_mover_ci_high\": %.6f}\n",
+               decided ? (double)total.first_mover_wins / decided : 0.0, first_lo, first_hi);
+    } else {
+        printf("=== SELF-PLAY: %lld games on %d threads in %.2fs (%.0f games/s) ===\n",
+               total.games, g_cfg.threads, elapsed, total.games / elapsed);
+        for (int p = 0; p < 2; p++) {
+            printf("%c %-16s wins %-10lld %6.3f%%  [%6.3f%%, %6.3f%%]  mean shots to win %.2f\n",
+                   'A' + p, g_cfg.specs[p], total.wins[p], 100.0 * total.wins[p] / total.games,
+                   100.0 * lo[p], 100.0 * hi[p],
+                   total.wins[p] ? (double)total.shots_to_win[p] / total.wins[p] : 0.0);
+        }
+        printf("first mover wins %.3f%% [%.3f%%, %.3f%%]  draws %lld  invalid shots %lld\n",
+               decided ? 100.0 * total.first_mover_wins / decided : 0.0, 100.0 * first_lo,
+               100.0 * first_hi, total.draws, total.invalid_shots);
+        printf("(%.0f%% Wilson intervals; %lld chunks stolen)\n", 100.0 * g_cfg.confidence, total.stolen);
+    }
+    return 0;
+}
@@ -0,0 +1,253 @@
+#include "battleship_snapshot.h"
+#include "battleship_windows.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define SNAPSHOT_MAGIC 0x42535350u /* "BSSP" */
+#define SNAPSHOT_VERSION 1
+
+struct snapshot_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t slots;
+    uint32_t record_size;
+    uint32_t reserved;
+};
+
+struct snapshot_file {
+    struct snapshot_header header;
+    struct snapshot_record records[MAX_SESSIONS][2];
+};
+
+static struct snapshot_file* g_snap = NULL;
+static int g_dirty[MAX_SESSIONS];
+static int g_dirty_count = 0;
+
+#ifdef _WIN32
+/* No mmap here: keep the image in memory and write changed records through
+   a regular file handle. */
+static struct snapshot_file g_snap_image;
+static FILE* g_snap_fp = NULL;
+#else
+static int g_snap_fd = -1;
+#endif
+
+uint32_t snapshot_checksum(const struct snapshot_record* rec) {
+    const unsigned char* p = (const unsigned char*)rec + offsetof(struct snapshot_record, sequence);
+    size_t len = sizeof(*rec) - offsetof(struct snapshot_record, sequence);
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static int header_matches(const struct snapshot_header* h) {
+    return memcmp(h->magic, "BSSNAP\0\0", 8) == 0 &&
+           h->version == SNAPSHOT_VERSION &&
+           h->slots == MAX_SESSIONS &&
+           h->record_size == sizeof(struct snapshot_record);
+}
+
+static void init_header(struct snapshot_file* f) {
+    memset(f, 0, sizeof(*f));
+    memcpy(f->header.magic, "BSSNAP\0\0", 8);
+    f->header.version = SNAPSHOT_VERSION;
+    f->header.slots = MAX_SESSIONS;
+    f->header.record_size = sizeof(struct snapshot_record);
+}
+
+int snapshot_open(const char* path) {
+    if (g_snap) return 0;
+    memset(g_dirty, 0, sizeof(g_dirty));
+    g_dirty_count = 0;
+#ifdef _WIN32
+    g_snap_fp = fopen(path, "r+b");
+    int fresh = 0;
+    if (g_snap_fp) {
+        if (fread(&g_snap_image, sizeof(g_snap_image), 1, g_snap_fp) != 1 ||
+            !header_matches(&g_snap_image.header)) {
+            fresh = 1;
+        }
+    } else {
+        g_snap_fp = fopen(path, "w+b");
+        fresh = 1;
+    }
+    if (!g_snap_fp) {
+        fprintf(stderr, "Failed to open snapshot file '%s': %s\n", path, strerror(errno));
+        return -1;
+    }
+    if (fresh) {
+        init_header(&g_snap_image);
+        fseek(g_snap_fp, 0, SEEK_SET);
+        fwrite(&g_snap_image, sizeof(g_snap_image), 1, g_snap_fp);
+        fflush(g_snap_fp);
+    }
+    g_snap = &g_snap_image;
+    return 0;
+#else
+    /* The default lives in /tmp: never follow a planted symlink, and only
+       trust a file of our own that nobody else can read (resume tokens)
+       or write (boards restored at startup) */
+    g_snap_fd = open(path, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0600);
+    if (g_snap_fd < 0) {
+        fprintf(stderr, "Failed to open snapshot file '%s': %s\n", path, strerror(errno));
+        return -1;
+    }
+    struct stat st;
+    if (fstat(g_snap_fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_uid != geteuid() || (st.st_mode & 077)) {
+        fprintf(stderr, "Refusing snapshot file '%s': not a private file of this user\n", path);
+        close(g_snap_fd);
+        g_snap_fd = -1;
+        return -1;
+    }
+    int fresh = st.st_size != (off_t)sizeof(struct snapshot_file);
+    if (fresh && ftruncate(g_snap_fd, sizeof(struct snapshot_file)) != 0) {
+        fprintf(stderr, "Failed to size snapshot file '%s': %s\n", path, strerror(errno));
+        close(g_snap_fd);
+        g_snap_fd = -1;
+        return -1;
+    }
+    void* map = mmap(NULL, sizeof(struct snapshot_file), PROT_READ | PROT_WRITE, MAP_SHARED, g_snap_fd, 0);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "Failed to map snapshot file '%s': %s\n", path, strerror(errno));
+        close(g_snap_fd);
+        g_snap_fd = -1;
+        return -1;
+    }
+    g_snap = (struct snapshot_file*)map;
+    if (fresh || !header_matches(&g_snap->header)) {
+        init_header(g_snap);
+        msync(g_snap, sizeof(struct snapshot_file), MS_SYNC);
+    }
+    return 0;
+#endif
+}
+
+void snapshot_close() {
+    if (!g_snap) return;
+#ifdef _WIN32
+    fclose(g_snap_fp);
+    g_snap_fp = NULL;
+#else
+    msync(g_snap, sizeof(struct snapshot_file), MS_SYNC);
+    munmap(g_snap, sizeof(struct snapshot_file));
+    close(g_snap_fd);
+    g_snap_fd = -1;
+#endif
+    g_snap = NULL;
+}
+
+int snapshot_enabled() {
+    return g_snap != NULL;
+}
+
+static int record_valid(const struct snapshot_record* rec) {
+    return rec->magic == SNAPSHOT_MAGIC && rec->checksum == snapshot_checksum(rec);
+}
+
+const struct snapshot_record* snapshot_load(int session_id) {
+    if (!g_snap || session_id < 0 || session_id >= MAX_SESSIONS) return NULL;
+    const struct snapshot_record* a = &g_snap->records[session_id][0];
+    const struct snapshot_record* b = &g_snap->records[session_id][1];
+    int a_ok = record_valid(a);
+    int b_ok = record_valid(b);
+    if (a_ok && b_ok) return (a->sequence > b->sequence) ? a : b;
+    if (a_ok) return a;
+    if (b_ok) return b;
+    return NULL;
+}
+
+void snapshot_mark_dirty(int session_id) {
+    if (!g_snap || session_id < 0 || session_id >= MAX_SESSIONS) return;
+    if (!g_dirty[session_id]) {
+        g_dirty[session_id] = 1;
+        g_dirty_count++;
+    }
+}
+
+int snapshot_dirty_count() {
+    return g_dirty_count;
+}
+
+void snapshot_encode_player(const struct client_info* client, struct snapshot_player* out) {
+    memset(out, 0, sizeof(*out));
+    if (!client) return;
+    out->present = 1;
+    out->ready = client->ready;
+    memcpy(out->nickname, client->nickname, sizeof(out->nickname));
+    out->nickname[sizeof(out->nickname) - 1] = 0;
+    memcpy(out->resume_token, client->resume_token, sizeof(out->resume_token));
+    out->resume_token[sizeof(out->resume_token) - 1] = 0;
+    memcpy(out->field, client->field, sizeof(Field));
+    out->ship_data = client->ship_data;
+}
+
+void snapshot_decode_player(const struct snapshot_player* in, struct client_info* client) {
+    client->ready = in->ready;
+    memcpy(client->nickname, in->nickname, sizeof(client->nickname));
+    client->nickname[sizeof(client->nickname) - 1] = 0;
+    memcpy(client->resume_token, in->resume_token, sizeof(client->resume_token));
+    client->resume_token[sizeof(client->resume_token) - 1] = 0;
+    memcpy(client->field, in->field, sizeof(Field));
+    client->ship_data = in->ship_data;
+}
+
+void snapshot_encode(const struct game_session* session, struct snapshot_record* rec) {
+    memset(rec, 0, sizeof(*rec));
+    rec->magic = SNAPSHOT_MAGIC;
+    rec->session_id = session->id;
+    if (session->id == -1) return;
+    rec->game_started = session->game_started;
+    rec->game_finished = session->game_finished;
+    rec->current_turn = session->current_turn;
+    snapshot_encode_player(session->player1, &rec->players[0]);
+    snapshot_encode_player(session->player2, &rec->players[1]);
+}
+
+static void write_record(int session_id, const struct game_session* session) {
+    const struct snapshot_record* current = snapshot_load(session_id);
+    uint64_t next_seq = current ? current->sequence + 1 : 1;
+
+    /* Always overwrite the copy that is not the newest valid one. */
+    int target = (int)(next_seq & 1);
+    struct snapshot_record* dst = &g_snap->records[session_id][target];
+
+    struct snapshot_record rec;
+    snapshot_encode(session, &rec);
+    rec.sequence = next_seq;
+    rec.checksum = snapshot_checksum(&rec);
+    memcpy(dst, &rec, sizeof(rec));
+
+#ifdef _WIN32
+    long offset = (long)((const char*)dst - (const char*)g_snap);
+    fseek(g_snap_fp, offset, SEEK_SET);
+    fwrite(dst, sizeof(*dst), 1, g_snap_fp);
+#endif
+}
+
+void snapshot_flush(struct game_session* all_sessions) {
+    if (!g_snap || g_dirty_count == 0) return;
+    for (int i = 0; i < MAX_SESSIONS; i++) {
+        if (!g_dirty[i]) continue;
+        write_record(i, &all_sessions[i]);
+        g_dirty[i] = 0;
+    }
+    g_dirty_count = 0;
+#ifdef _WIN32
+    fflush(g_snap_fp);
+#else
+    msync(g_snap, sizeof(struct snapshot_file), MS_ASYNC);
+#endif
+}
@@ -0,0 +1,63 @@
+#ifndef BATTLESHIP_SNAPSHOT_H
+#define BATTLESHIP_SNAPSHOT_H
+
+#include "battleship.h"
+#include <stdint.h>
+
+/* Crash-consistent session snapshots.
+   Every session slot owns two fixed-size records in a memory-mapped file.
+   A flush writes the dirty session into the older record and bumps its
+   sequence number, so a torn write only ever damages one copy: on restore
+   the newest record with a valid checksum wins. The file must be a
+   regular file owned by the server's user with no group or other
+   access; anything else (a symlink, a file planted by another user) is
+   refused rather than restored from. */
+
+#ifdef _WIN32
+#define SNAPSHOT_FILE "battleship_sessions.snap"
+#else
+#define SNAPSHOT_FILE "/tmp/battleship_sessions.snap"
+#endif
+
+#define SNAPSHOT_FLUSH_MS 250
+
+struct snapshot_player {
+    int32_t present;
+    int32_t ready;
+    char nickname[64];
+    char resume_token[RESUME_TOKEN_SIZE];
+    Field field;
+    struct ships ship_data;
+};
+
+struct snapshot_record {
+    uint32_t magic;
+    uint32_t checksum;   // FNV-1a over everything after this field
+    uint64_t sequence;   // newest valid copy wins on restore
+    int32_t session_id;  // -1 when the slot is empty
+    int32_t game_started;
+    int32_t game_finished;
+    int32_t current_turn;
+    struct snapshot_player players[2];
+};
+
+// Maps (creating if needed) the snapshot file. Returns 0 on success.
+int snapshot_open(const char* path);
+void snapshot_close();
+int snapshot_enabled();
+
+// Returns the newest valid record for a session slot, or NULL.
+const struct snapshot_record* snapshot_load(int session_id);
+
+// Dirty tracking: only sessions marked since the last flush are rewritten.
+void snapshot_mark_dirty(int session_id);
+int snapshot_dirty_count();
+void snapshot_flush(struct game_session* all_sessions);
+
+// Record (de)serialization, shared with the hot-upgrade handoff.
+void snapshot_encode(const struct game_session* session, struct snapshot_record* rec);
+void snapshot_encode_player(const struct client_info* client, struct snapshot_player* out);
+void snapshot_decode_player(const struct snapshot_player* in, struct client_info* client);
+uint32_t snapshot_checksum(const struct snapshot_record* rec);
+
+#endif // BATTLESHIP_SNAPSHOT_H
@@ -0,0 +1,159 @@
+#include "battleship_strategy.h"
+#include "battleship_density.h"
+
+#include <string.h>
+
+/* Placement */
+
+static void place_random(Field field, struct ships* ship_data, unsigned int* rng) {
+    place_ships_r(field, ship_data, rng);
+}
+
+static int border_cells(Field field) {
+    int count = 0;
+    for (int i = 1; i <= PLAYABLE_SIZE; i++) {
+        for (int j = 1; j <= PLAYABLE_SIZE; j++) {
+            if (field[i][j] == 1 && (i == 1 || j == 1 || i == PLAYABLE_SIZE || j == PLAYABLE_SIZE)) {
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+// Best of several random fleets by number of decks on the border
+static void place_edge(Field field, struct ships* ship_data, unsigned int* rng) {
+    Field candidate;
+    struct ships candidate_ships;
+    int best = -1;
+
+    for (int attempt = 0; attempt < 8; attempt++) {
+        create_game_field(candidate);
+        initialize_ships(&candidate_ships);
+        place_ships_r(candidate, &candidate_ships, rng);
+        int score = border_cells(candidate);
+        if (score > best) {
+            best = score;
+            memcpy(field, candidate, sizeof(Field));
+            *ship_data = candidate_ships;
+        }
+    }
+}
+
+/* Shooting */
+
+static int pick_unknown(Field fog, unsigned int* rng, int parity_only, int* x, int* y) {
+    int cells[FIELD_PAYLOAD_SIZE];
+    int count = 0;
+    for (int i = 1; i <= PLAYABLE_SIZE; i++) {
+        for (int j = 1; j <= PLAYABLE_SIZE; j++) {
+            if (fog[i][j] != 0) continue;
+            if (parity_only && ((i + j) & 1)) continue;
+            cells[count++] = i * FIELD_SIZE + j;
+        }
+    }
+    if (count == 0) return 0;
+    int c = cells[xorshift32(rng) % (unsigned)count];
+    *x = c / FIELD_SIZE;
+    *y = c % FIELD_SIZE;
+    return 1;
+}
+
+static void shoot_random(Field fog, unsigned int* rng, int* x, int* y) {
+    pick_unknown(fog, rng, 0, x, y);
+}
+
+/* Unknown cells next to a hit that is not sunk yet (sunk ships are
+   ringed by their halo). Once two hits line up only the line's ends are
+   candidates. Returns the number of candidates written. */
+static int target_cells(Field fog, int* cells) {
+    static const int dx[4] = {-1, 1, 0, 0};
+    static const int dy[4] = {0, 0, -1, 1};
+    int count = 0;
+
+    for (int i = 1; i <= PLAYABLE_SIZE; i++) {
+        for (int j = 1; j <= PLAYABLE_SIZE; j++) {
+            if (fog[i][j] != 3) continue;
+            int vertical = fog[i - 1][j] == 3 || fog[i + 1][j] == 3;
+            int horizontal = fog[i][j - 1] == 3 || fog[i][j + 1] == 3;
+
+            for (int d = 0; d < 4; d++) {
+                if (vertical && dx[d] == 0) continue;
+                if (horizontal && dy[d] == 0) continue;
+                int nx = i + dx[d];
+                int ny = j + dy[d];
+                if (nx < 1 || nx > PLAYABLE_SIZE || ny < 1 || ny > PLAYABLE_SIZE) continue;
+                if (fog[nx][ny] == 0) cells[count++] = nx * FIELD_SIZE + ny;
+            }
+        }
+    }
+    return count;
+}
+
+static void hunt_target(Field fog, unsigned int* rng, int parity, int* x, int* y) {
+    int cells[4 * FIELD_PAYLOAD_SIZE];
+    int count = target_cells(fog, cells);
+    if (count > 0) {
+        int c = cells[xorshift32(rng) % (unsigned)count];
+        *x = c / FIELD_SIZE;
+        *y = c % FIELD_SIZE;
+        return;
+    }
+    if (parity && pick_unknown(fog, rng, 1, x, y)) return;
+    pick_unknown(fog, rng, 0, x, y);
+}
+
+static void shoot_hunt(Field fog, unsigned int* rng, int* x, int* y) {
+    hunt_target(fog, rng, 0, x, y);
+}
+
+// Hunt on a checkerboard: every ship longer than one deck covers a dark cell
+static void shoot_parity(Field fog, unsigned int* rng, int* x, int* y) {
+    hunt_target(fog, rng, 1, x, y);
+}
+
+/* Most likely cell over the fleets that fit the fog; the sampling seed
+   comes from the game's RNG so runs stay reproducible */
+static int shoot_density_timed(Field fog, unsigned int* rng, long long deadline_us, int* x, int* y) {
+    struct density_options opt;
+    struct density_result r;
+    density_default_options(&opt);
+    opt.seed = xorshift32(rng);
+    opt.deadline_us = deadline_us;
+    int rc = density_compute(fog, &opt, &r);
+    if (rc == 0 && density_best_cell(fog, &r, rng, x, y)) return !r.timed_out;
+    hunt_target(fog, rng, 1, x, y);
+    return !r.timed_out;
+}
+
+static void shoot_density(Field fog, unsigned int* rng, int* x, int* y) {
+    shoot_density_timed(fog, rng, 0, x, y);
+}
+
+const struct placement_strategy placement_strategies[] = {
+    {"random", "place_ships() layout", place_random},
+    {"edge", "best of 8 random layouts by decks on the border", place_edge},
+    {NULL, NULL, NULL}
+};
+
+const struct shot_strategy shot_strategies[] = {
+    {"random", "uniform over unknown cells", shoot_random, NULL},
+    {"hunt", "random until a hit, then finish the ship", shoot_hunt, NULL},
+    {"parity", "hunt/target, hunting on a checkerboard", shoot_parity, NULL},
+    {"density", "most likely cell over all fleets consistent with the fog", shoot_density, shoot_density_timed},
+    {NULL, NULL, NULL, NULL}
+};
+
+const struct placement_strategy* find_placement_strategy(const char* name) {
+    for (const struct placement_strategy* s = placement_strategies; s->name; s++) {
+        if (strcmp(s->name, name) == 0) return s;
+    }
+    return NULL;
+}
+
+const struct shot_strategy* find_shot_strategy(const char* name) {
+    for (const struct shot_strategy* s = shot_strategies; s->name; s++) {
+        if (strcmp(s->name, name) == 0) return s;
+    }
+    return NULL;
+}
@@ -0,0 +1,40 @@
+#ifndef BATTLESHIP_STRATEGY_H
+#define BATTLESHIP_STRATEGY_H
+
+#include "battleship.h"
+
+/* Pluggable bot strategies for the self-play simulator.
+   A placement strategy fills an empty field with a legal fleet. A shot
+   strategy picks the next target from the shooter's view of the enemy
+   field (see build_fog_field: 0 unknown, 2 miss or halo, 3 hit). Both get
+   a per-game RNG state and must not keep global state, so workers can run
+   them concurrently. */
+
+typedef void (*placement_fn)(Field field, struct ships* ship_data, unsigned int* rng);
+// Writes 1-based field indices of an unknown cell to *x, *y
+typedef void (*shot_fn)(Field fog, unsigned int* rng, int* x, int* y);
+/* As shot_fn, but a search gives up at deadline_us (steady_clock
+   microseconds) and shoots hunt/target instead. Returns 0 if it had to. */
+typedef int (*timed_shot_fn)(Field fog, unsigned int* rng, long long deadline_us, int* x, int* y);
+
+struct placement_strategy {
+    const char* name;
+    const char* description;
+    placement_fn place;
+};
+
+struct shot_strategy {
+    const char* name;
+    const char* description;
+    shot_fn shoot;
+    timed_shot_fn shoot_timed;  // NULL: shoot is cheap enough to run unbounded
+};
+
+const struct placement_strategy* find_placement_strategy(const char* name);
+const struct shot_strategy* find_shot_strategy(const char* name);
+
+// NULL-terminated tables, for listing
+extern const struct placement_strategy placement_strategies[];
+extern const struct shot_strategy shot_strategies[];
+
+#endif // BATTLESHIP_STRATEGY_H
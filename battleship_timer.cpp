@@ -0,0 +1,129 @@
+#include "battleship_timer.h"
+
+#include <stddef.h>
+
+#define SLOT_MASK (TIMER_SLOTS - 1)
+#define HORIZON_TICKS (1LL << (TIMER_SLOT_BITS * TIMER_LEVELS))
+
+static void list_init(struct timer* head) {
+    head->next = head;
+    head->prev = head;
+}
+
+static void unlink_timer(struct timer* t) {
+    t->prev->next = t->next;
+    t->next->prev = t->prev;
+    t->next = NULL;
+    t->prev = NULL;
+}
+
+/* The level is picked by distance, the slot by the deadline's own bits at
+   that level, so the slot comes up exactly when the deadline's range
+   does */
+static void insert(struct timer_wheel* w, struct timer* t) {
+    long long delta = t->due_tick - w->now_tick;
+    int level = 0;
+    while (level < TIMER_LEVELS - 1 && delta >= (1LL << (TIMER_SLOT_BITS * (level + 1)))) level++;
+    struct timer* head = &w->slots[level][(t->due_tick >> (TIMER_SLOT_BITS * level)) & SLOT_MASK];
+    t->next = head;
+    t->prev = head->prev;
+    head->prev->next = t;
+    head->prev = t;
+}
+
+void timer_wheel_init(struct timer_wheel* w, long long now_ms) {
+    for (int l = 0; l < TIMER_LEVELS; l++) {
+        for (int s = 0; s < TIMER_SLOTS; s++) list_init(&w->slots[l][s]);
+    }
+    w->now_tick = now_ms / TIMER_TICK_MS;
+    w->armed = 0;
+}
+
+void timer_init(struct timer* t, int kind, int id) {
+    t->next = NULL;
+    t->prev = NULL;
+    t->due_tick = 0;
+    t->kind = kind;
+    t->id = id;
+}
+
+int timer_pending(const struct timer* t) {
+    return t->next != NULL;
+}
+
+void timer_arm(struct timer_wheel* w, struct timer* t, long long due_ms) {
+    if (t->next) {
+        unlink_timer(t);
+        w->armed--;
+    }
+    long long due = due_ms / TIMER_TICK_MS;
+    if (due <= w->now_tick) due = w->now_tick + 1;
+    if (due - w->now_tick >= HORIZON_TICKS) due = w->now_tick + HORIZON_TICKS - 1;
+    t->due_tick = due;
+    insert(w, t);
+    w->armed++;
+}
+
+void timer_cancel(struct timer_wheel* w, struct timer* t) {
+    if (!t->next) return;
+    unlink_timer(t);
+    w->armed--;
+}
+
+// Re-hashes one slot of an upper level into the levels below
+static void cascade(struct timer_wheel* w, int level, int slot) {
+    struct timer* head = &w->slots[level][slot];
+    struct timer* t = head->next;
+    list_init(head);
+    while (t != head) {
+        struct timer* next = t->next;
+        insert(w, t);
+        t = next;
+    }
+}
+
+int timer_advance(struct timer_wheel* w, long long now_ms, timer_fire_fn fire) {
+    long long target = now_ms / TIMER_TICK_MS;
+    int fired = 0;
+    while (w->now_tick < target) {
+        // Nothing armed: nothing to visit on the way
+        if (w->armed == 0) {
+            w->now_tick = target;
+            break;
+        }
+        long long tick = ++w->now_tick;
+
+        /* On a level boundary the next slot up comes due and is spread
+           over the levels below, highest first */
+        int top = 0;
+        while (top < TIMER_LEVELS - 1 && (tick & ((1LL << (TIMER_SLOT_BITS * (top + 1))) - 1)) == 0) top++;
+        for (int l = top; l >= 1; l--) {
+            cascade(w, l, (int)((tick >> (TIMER_SLOT_BITS * l)) & SLOT_MASK));
+        }
+
+        struct timer* head = &w->slots[0][tick & SLOT_MASK];
+        while (head->next != head) {
+            struct timer* t = head->next;
+            unlink_timer(t);
+            w->armed--;
+            fired++;
+            fire(t);
+        }
+    }
+    return fired;
+}
+
+long long timer_next_ms(const struct timer_wheel* w, long long now_ms, long long max_ms) {
+    if (w->armed == 0) return max_ms;
+    long long ticks = TIMER_SLOTS - (w->now_tick & SLOT_MASK);  // next cascade
+    for (long long i = 1; i < ticks; i++) {
+        const struct timer* head = &w->slots[0][(w->now_tick + i) & SLOT_MASK];
+        if (head->next != head) {
+            ticks = i;
+            break;
+        }
+    }
+    long long wait = (w->now_tick + ticks) * TIMER_TICK_MS - now_ms;
+    if (wait < 0) wait = 0;
+    return wait < max_ms ? wait : max_ms;
+}
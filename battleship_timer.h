@@ -0,0 +1,55 @@
+#ifndef BATTLESHIP_TIMER_H
+#define BATTLESHIP_TIMER_H
+
+/* Hierarchical timing wheel for the poll loop's deadlines. TIMER_LEVELS
+   wheels of TIMER_SLOTS slots each; level 0 advances one slot per
+   TIMER_TICK_MS, and each level above covers a whole revolution of the
+   one below. A timer is hashed into the level its distance falls in and
+   moves down a level when its slot comes up, so it fires on the tick it
+   is due. Timers are nodes the caller owns (embed them next to the state
+   they guard): arming, re-arming and cancelling are O(1) list operations
+   without allocation, and advancing the wheel only visits the slots that
+   come due, however many timers are armed. Deadlines past the horizon
+   (10 ms * 64^4, about 1.9 days) fire at the horizon.
+
+   Single-threaded: the loop owns the wheel and everything in it. */
+
+#define TIMER_TICK_MS 10
+#define TIMER_SLOT_BITS 6
+#define TIMER_SLOTS (1 << TIMER_SLOT_BITS)
+#define TIMER_LEVELS 4
+
+struct timer {
+    struct timer* next;         // NULL while not armed
+    struct timer* prev;
+    long long due_tick;
+    int kind;                   // for the owner: what fired
+    int id;                     // for the owner: whose
+};
+
+struct timer_wheel {
+    struct timer slots[TIMER_LEVELS][TIMER_SLOTS];     // list heads
+    long long now_tick;
+    int armed;
+};
+
+void timer_wheel_init(struct timer_wheel* w, long long now_ms);
+void timer_init(struct timer* t, int kind, int id);
+
+// Arms t for due_ms (now or earlier: the next tick); re-arms if armed.
+void timer_arm(struct timer_wheel* w, struct timer* t, long long due_ms);
+void timer_cancel(struct timer_wheel* w, struct timer* t);
+int timer_pending(const struct timer* t);
+
+/* Advances to now_ms and calls fire for every timer that came due, in
+   deadline order. A timer is disarmed before its call, so fire may
+   re-arm it, or arm and cancel others. Returns how many fired. */
+typedef void (*timer_fire_fn)(struct timer* t);
+int timer_advance(struct timer_wheel* w, long long now_ms, timer_fire_fn fire);
+
+/* How long the loop may sleep before timer_advance() has work: the next
+   deadline on level 0, else the next move down from level 1. At most
+   max_ms. */
+long long timer_next_ms(const struct timer_wheel* w, long long now_ms, long long max_ms);
+
+#endif // BATTLESHIP_TIMER_H
@@ -0,0 +1,314 @@
+#include "battleship_trace.h"
+#include "battleship_metrics.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+
+#include <atomic>
+#include <chrono>
+
+#ifdef _WIN32
+#include <io.h>
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+struct trace_event {
+    uint64_t ts_ns;
+    uint64_t dur_ns;
+    int32_t fd;
+    int16_t command;
+    uint8_t kind;
+    uint8_t instant;
+};
+
+/* One per recording thread; only that thread writes, dumps read */
+struct trace_ring {
+    std::atomic<uint64_t> head;
+    const char* name;
+    struct trace_event events[TRACE_RING_EVENTS];
+};
+
+static std::atomic<struct trace_ring*> g_rings[TRACE_MAX_THREADS];
+static std::atomic<int> g_ring_count{0};
+static thread_local struct trace_ring* t_ring = NULL;
+static thread_local int t_ring_full = 0;    // no slot left for this thread
+
+static const char* const k_kind_names[TRACE_KINDS] = {
+    "poll", "handler", "send", "accept", "disconnect", "bot_move", "stall"
+};
+
+static char g_prefix[400] = TRACE_DEFAULT_PREFIX;
+static std::atomic<int> g_dump_seq{0};
+
+uint64_t trace_now_ns() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static struct trace_ring* my_ring() {
+    if (t_ring || t_ring_full) return t_ring;
+    int idx = g_ring_count.fetch_add(1);
+    if (idx >= TRACE_MAX_THREADS) {
+        t_ring_full = 1;
+        return NULL;
+    }
+    /* calloc: untouched pages of a quiet thread's ring cost no memory */
+    struct trace_ring* r = (struct trace_ring*)calloc(1, sizeof(struct trace_ring));
+    if (!r) {
+        t_ring_full = 1;
+        return NULL;
+    }
+    g_rings[idx].store(r, std::memory_order_release);
+    t_ring = r;
+    return r;
+}
+
+void trace_thread_name(const char* name) {
+    struct trace_ring* r = my_ring();
+    if (r) r->name = name;
+}
+
+static void record(int kind, int command_id, int fd, uint64_t ts_ns, uint64_t dur_ns, int instant) {
+    struct trace_ring* r = my_ring();
+    if (!r) return;
+    uint64_t h = r->head.load(std::memory_order_relaxed);
+    struct trace_event* e = &r->events[h & (TRACE_RING_EVENTS - 1)];
+    e->ts_ns = ts_ns;
+    e->dur_ns = dur_ns;
+    e->fd = fd;
+    e->command = (int16_t)command_id;
+    e->kind = (uint8_t)kind;
+    e->instant = (uint8_t)instant;
+    r->head.store(h + 1, std::memory_order_release);
+}
+
+void trace_complete(int kind, int command_id, int fd, uint64_t start_ns, uint64_t end_ns) {
+    record(kind, command_id, fd, start_ns, end_ns - start_ns, 0);
+}
+
+void trace_instant(int kind, int fd) {
+    record(kind, 0, fd, trace_now_ns(), 0, 1);
+}
+
+/* --- dump: write(2) and hand-rolled formatting only --- */
+
+struct dump_out {
+    int fd;
+    int len;
+    int failed;
+    char buf[8192];
+};
+
+static void out_flush(struct dump_out* o) {
+    int off = 0;
+    while (off < o->len && !o->failed) {
+        int n = (int)write(o->fd, o->buf + off, (unsigned int)(o->len - off));
+        if (n <= 0) o->failed = 1;
+        else off += n;
+    }
+    o->len = 0;
+}
+
+static void out_str(struct dump_out* o, const char* s) {
+    for (; *s; s++) {
+        if (o->len == (int)sizeof(o->buf)) out_flush(o);
+        o->buf[o->len++] = *s;
+    }
+}
+
+static void out_u64(struct dump_out* o, uint64_t v) {
+    char tmp[24];
+    int n = 0;
+    do {
+        tmp[n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    char s[24];
+    for (int i = 0; i < n; i++) s[i] = tmp[n - 1 - i];
+    s[n] = '\0';
+    out_str(o, s);
+}
+
+static void out_i64(struct dump_out* o, int64_t v) {
+    if (v < 0) {
+        out_str(o, "-");
+        out_u64(o, (uint64_t)(-v));
+    } else {
+        out_u64(o, (uint64_t)v);
+    }
+}
+
+// Nanoseconds as the microseconds Chrome traces use, three decimals
+static void out_us(struct dump_out* o, uint64_t ns) {
+    out_u64(o, ns / 1000);
+    char frac[5] = {'.', (char)('0' + ns / 100 % 10), (char)('0' + ns / 10 % 10), (char)('0' + ns % 10), '\0'};
+    out_str(o, frac);
+}
+
+static void out_event(struct dump_out* o, const struct trace_event* e, int pid, int tid, int* first) {
+    out_str(o, *first ? "\n" : ",\n");
+    *first = 0;
+    out_str(o, "{\"name\":\"");
+    if (e->kind == TRACE_HANDLER || e->kind == TRACE_SEND) out_str(o, metrics_command_name(e->command));
+    else out_str(o, k_kind_names[e->kind]);
+    out_str(o, "\",\"cat\":\"");
+    out_str(o, k_kind_names[e->kind]);
+    out_str(o, e->instant ? "\",\"ph\":\"i\",\"s\":\"t\",\"ts\":" : "\",\"ph\":\"X\",\"ts\":");
+    out_us(o, e->ts_ns);
+    if (!e->instant) {
+        out_str(o, ",\"dur\":");
+        out_us(o, e->dur_ns);
+    }
+    out_str(o, ",\"pid\":");
+    out_i64(o, pid);
+    out_str(o, ",\"tid\":");
+    out_i64(o, tid);
+    if (e->kind == TRACE_POLL) out_str(o, ",\"args\":{\"ready\":");
+    else if (e->kind == TRACE_BOT_MOVE) out_str(o, ",\"args\":{\"slot\":");
+    else if (e->kind == TRACE_STALL) out_str(o, ",\"args\":{\"phase\":");
+    else out_str(o, ",\"args\":{\"fd\":");
+    out_i64(o, e->fd);
+    out_str(o, "}}");
+}
+
+static int dump_rings(const char* path, uint64_t since_ns) {
+    struct dump_out o;
+#ifdef _WIN32
+    o.fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_BINARY, 0600);
+#else
+    /* The default prefix is in /tmp, where anyone can plant a file or a
+       symlink at the next predictable name: only ever create a new one */
+    o.fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+#endif
+    if (o.fd < 0) return -1;
+    o.len = 0;
+    o.failed = 0;
+
+    int pid = (int)getpid();
+    int first = 1;
+    out_str(&o, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+
+    int rings = g_ring_count.load();
+    if (rings > TRACE_MAX_THREADS) rings = TRACE_MAX_THREADS;
+    for (int t = 0; t < rings; t++) {
+        struct trace_ring* r = g_rings[t].load(std::memory_order_acquire);
+        if (!r) continue;
+        if (r->name) {
+            out_str(&o, first ? "\n" : ",\n");
+            first = 0;
+            out_str(&o, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":");
+            out_i64(&o, pid);
+            out_str(&o, ",\"tid\":");
+            out_i64(&o, t + 1);
+            out_str(&o, ",\"args\":{\"name\":\"");
+            out_str(&o, r->name);
+            out_str(&o, "\"}}");
+        }
+
+        /* The writer keeps going while we read: the oldest slots may be
+           overwritten mid-dump, which costs at most a few garbled events */
+        uint64_t head = r->head.load(std::memory_order_acquire);
+        uint64_t n = head < TRACE_RING_EVENTS ? head : TRACE_RING_EVENTS;
+        for (uint64_t i = head - n; i < head; i++) {
+            struct trace_event e = r->events[i & (TRACE_RING_EVENTS - 1)];
+            if (e.ts_ns == 0 || e.kind >= TRACE_KINDS || e.ts_ns + e.dur_ns < since_ns) continue;
+            out_event(&o, &e, pid, t + 1, &first);
+        }
+    }
+    out_str(&o, "\n]}\n");
+    out_flush(&o);
+    close(o.fd);
+    return o.failed ? -1 : 0;
+}
+
+int trace_dump(const char* path) {
+    return dump_rings(path, 0);
+}
+
+int trace_dump_since(const char* path, uint64_t since_ns) {
+    return dump_rings(path, since_ns);
+}
+
+void trace_next_dump_path(char* path, int size) {
+    struct dump_out name;       // reuse the formatter to build the path
+    name.fd = -1;
+    name.len = 0;
+    name.failed = 0;
+    out_str(&name, g_prefix);
+    out_str(&name, "-");
+    out_u64(&name, (uint64_t)getpid());
+    out_str(&name, "-");
+    out_u64(&name, (uint64_t)g_dump_seq.fetch_add(1));
+    out_str(&name, ".json");
+    int n = name.len < size - 1 ? name.len : size - 1;
+    memcpy(path, name.buf, (size_t)n);
+    path[n] = '\0';
+}
+
+static void set_prefix(const char* prefix) {
+    if (prefix) {
+        strncpy(g_prefix, prefix, sizeof(g_prefix) - 1);
+        g_prefix[sizeof(g_prefix) - 1] = '\0';
+    }
+}
+
+#ifndef _WIN32
+
+static void dump_from_signal() {
+    char path[sizeof(g_prefix) + 48];
+    trace_next_dump_path(path, (int)sizeof(path));
+
+    int saved_errno = errno;
+    if (trace_dump(path) == 0) {
+        static const char msg[] = "Flight recorder written to ";
+        if (write(STDERR_FILENO, msg, sizeof(msg) - 1) < 0 ||
+            write(STDERR_FILENO, path, strlen(path)) < 0 ||
+            write(STDERR_FILENO, "\n", 1) < 0) {
+            // stderr is gone (daemon); the file is what matters
+        }
+    }
+    errno = saved_errno;
+}
+
+static void on_dump_signal(int sig) {
+    (void)sig;
+    dump_from_signal();
+}
+
+static void on_fatal_signal(int sig) {
+    dump_from_signal();
+    /* SA_RESETHAND restored the default action: die the way we would have */
+    raise(sig);
+}
+
+void trace_install_signal_handlers(const char* prefix) {
+    set_prefix(prefix);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sigemptyset(&sa.sa_mask);
+    sa.sa_handler = on_dump_signal;
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGUSR2, &sa, NULL);
+
+    static const int fatal[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT};
+    sa.sa_handler = on_fatal_signal;
+    sa.sa_flags = SA_RESETHAND;
+    for (size_t i = 0; i < sizeof(fatal) / sizeof(fatal[0]); i++) {
+        sigaction(fatal[i], &sa, NULL);
+    }
+}
+
+#else
+
+void trace_install_signal_handlers(const char* prefix) {
+    // no signals to hook; watchdog dumps still use the prefix
+    set_prefix(prefix);
+}
+
+#endif
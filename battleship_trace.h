@@ -0,0 +1,54 @@
+#ifndef BATTLESHIP_TRACE_H
+#define BATTLESHIP_TRACE_H
+
+#include <stdint.h>
+
+/* Flight recorder: every thread that records gets its own ring of the
+   last TRACE_RING_EVENTS timestamped events (one writer, no locks), always
+   on. trace_dump() writes all rings as Chrome trace JSON, which loads in
+   chrome://tracing and ui.perfetto.dev. The dump only uses write(2) and
+   fixed tables, so it runs from signal handlers: SIGUSR2 dumps a live
+   server (even one stuck in a handler), and fatal signals dump before
+   the process dies.
+
+     kill -USR2 $(cat /tmp/battleship_server.pid)
+     -> /tmp/battleship_trace-<pid>-<n>.json */
+
+#define TRACE_RING_EVENTS 65536         // per thread, power of two; 2 MB, about a second under load
+#define TRACE_MAX_THREADS 32
+#define TRACE_DEFAULT_PREFIX "/tmp/battleship_trace"
+
+enum trace_kind {
+    TRACE_POLL = 0,         // poll() wait; fd holds the number of ready fds
+    TRACE_HANDLER,          // process_client_packet() for one packet
+    TRACE_SEND,             // one packet written to a connection
+    TRACE_ACCEPT,
+    TRACE_DISCONNECT,
+    TRACE_BOT_MOVE,         // a hosted bot's move on a pool worker; fd holds its slot
+    TRACE_STALL,            // the watchdog caught a stalled loop; fd holds the phase
+    TRACE_KINDS
+};
+
+uint64_t trace_now_ns();
+
+// Names this thread's track in the trace; name must stay valid.
+void trace_thread_name(const char* name);
+
+void trace_complete(int kind, int command_id, int fd, uint64_t start_ns, uint64_t end_ns);
+void trace_instant(int kind, int fd);
+
+/* Writes every ring to a new file at path (mode 0600); an existing file
+   or symlink there is an error. Async-signal-safe. Returns 0 or -1. */
+int trace_dump(const char* path);
+
+// Same, only events that end at or after since_ns
+int trace_dump_since(const char* path, uint64_t since_ns);
+
+// "<prefix>-<pid>-<n>.json" with the next n. Async-signal-safe.
+void trace_next_dump_path(char* path, int size);
+
+/* Dumps to "<prefix>-<pid>-<n>.json" on SIGUSR2 and on SIGSEGV, SIGBUS,
+   SIGFPE, SIGILL and SIGABRT (then dies as before). POSIX only. */
+void trace_install_signal_handlers(const char* prefix);
+
+#endif // BATTLESHIP_TRACE_H
@@ -0,0 +1,141 @@
+#include "battleship_watchdog.h"
+#include "battleship_trace.h"
+#include "battleship_metrics.h"
+#include "battleship_log.h"
+
+#include <stdio.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+/* The current activity packed into one word so a single relaxed load
+   sees a consistent phase, command and fd */
+#define PACK(phase, command_id, fd) \
+    (((uint64_t)(uint8_t)(phase) << 48) | ((uint64_t)(uint16_t)(command_id) << 32) | (uint32_t)(fd))
+#define PHASE_OF(a) ((int)(((a) >> 48) & 0xff))
+#define COMMAND_OF(a) ((int)(((a) >> 32) & 0xffff))
+#define FD_OF(a) ((int)(uint32_t)(a))
+
+static std::atomic<uint64_t> g_activity{PACK(WATCHDOG_LOOP, 0, -1)};
+static std::atomic<uint64_t> g_busy_since{0};       // 0 while in poll()
+static std::atomic<uint64_t> g_iteration{0};
+static std::atomic<uint64_t> g_caught_iteration{0}; // the iteration the watchdog flagged
+static std::atomic<uint64_t> g_caught_activity{0};
+static std::atomic<uint64_t> g_stalls[WATCHDOG_PHASES];
+static std::atomic<bool> g_in_episode{false};       // stalled since the last quick iteration
+static std::atomic<bool> g_running{false};
+static uint64_t g_threshold_ns = 0;
+
+static const char* const k_phase_names[WATCHDOG_PHASES] = {
+    "loop", "recv", "handler", "send", "leaderboard", "snapshot", "bots", "handoff", "admin",
+    "timers"
+};
+
+const char* watchdog_phase_name(int phase) {
+    return (phase >= 0 && phase < WATCHDOG_PHASES) ? k_phase_names[phase] : "loop";
+}
+
+uint64_t watchdog_stalls(int phase) {
+    if (phase < 0 || phase >= WATCHDOG_PHASES) return 0;
+    return g_stalls[phase].load(std::memory_order_relaxed);
+}
+
+uint64_t watchdog_enter(int phase, int command_id, int fd) {
+    uint64_t previous = g_activity.load(std::memory_order_relaxed);
+    g_activity.store(PACK(phase, command_id, fd), std::memory_order_relaxed);
+    return previous;
+}
+
+void watchdog_leave(uint64_t previous) {
+    g_activity.store(previous, std::memory_order_relaxed);
+}
+
+void watchdog_busy(uint64_t now_ns) {
+    // Only the loop writes these: plain load/store, no read-modify-write
+    g_iteration.store(g_iteration.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    g_busy_since.store(now_ns ? now_ns : 1, std::memory_order_release);
+}
+
+void watchdog_idle(uint64_t now_ns) {
+    uint64_t since = g_busy_since.load(std::memory_order_relaxed);
+    g_busy_since.store(0, std::memory_order_release);
+    g_activity.store(PACK(WATCHDOG_LOOP, 0, -1), std::memory_order_relaxed);
+    if (!since || g_caught_iteration.load(std::memory_order_acquire) != g_iteration.load(std::memory_order_relaxed)) {
+        /* A quick iteration ends the episode; only then may the next stall dump again */
+        if (since && now_ns - since < g_threshold_ns && g_in_episode.load(std::memory_order_relaxed)) {
+            g_in_episode.store(false, std::memory_order_relaxed);
+        }
+        return;
+    }
+
+    /* Flagged by the watchdog: now the whole length is known */
+    uint64_t a = g_caught_activity.load(std::memory_order_relaxed);
+    unsigned long long us = now_ns > since ? (now_ns - since) / 1000 : 0;
+    if (FD_OF(a) >= 0 && COMMAND_OF(a) > 0) {
+        log_write(LOG_LEVEL_WARN, "Event loop stalled %llu us in %s (fd %d, %s)",
+                  us, watchdog_phase_name(PHASE_OF(a)), FD_OF(a), metrics_command_name(COMMAND_OF(a)));
+    } else if (FD_OF(a) >= 0) {
+        log_write(LOG_LEVEL_WARN, "Event loop stalled %llu us in %s (fd %d)",
+                  us, watchdog_phase_name(PHASE_OF(a)), FD_OF(a));
+    } else {
+        log_write(LOG_LEVEL_WARN, "Event loop stalled %llu us in %s", us, watchdog_phase_name(PHASE_OF(a)));
+    }
+}
+
+static void watchdog_thread() {
+    trace_thread_name("watchdog");
+    uint64_t check_ms = g_threshold_ns / 2000000;
+    if (check_ms < 1) check_ms = 1;
+    uint64_t last_dump_ns = 0;
+    char kept[WATCHDOG_KEEP_DUMPS][512];   // ring of the dumps still on disk
+    int kept_count = 0;
+
+    while (g_running) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(check_ms));
+
+        uint64_t since = g_busy_since.load(std::memory_order_acquire);
+        uint64_t iteration = g_iteration.load(std::memory_order_relaxed);
+        if (!since || iteration == g_caught_iteration.load(std::memory_order_relaxed)) continue;
+        uint64_t now = trace_now_ns();
+        if (now < since + g_threshold_ns) continue;
+
+        uint64_t a = g_activity.load(std::memory_order_relaxed);
+        g_caught_activity.store(a, std::memory_order_relaxed);
+        g_caught_iteration.store(iteration, std::memory_order_release);
+        int phase = PHASE_OF(a);
+        if (phase >= WATCHDOG_PHASES) phase = WATCHDOG_LOOP;
+        g_stalls[phase].fetch_add(1, std::memory_order_relaxed);
+        trace_instant(TRACE_STALL, phase);
+
+        /* The loop is still stuck: its recent history is what explains it.
+           Stalls back to back are one episode and get one dump. */
+        if (!g_in_episode.exchange(true, std::memory_order_relaxed) &&
+            now - last_dump_ns >= (uint64_t)WATCHDOG_DUMP_INTERVAL_MS * 1000000) {
+            char* path = kept[kept_count % WATCHDOG_KEEP_DUMPS];
+            if (kept_count >= WATCHDOG_KEEP_DUMPS) remove(path);
+            trace_next_dump_path(path, (int)sizeof(kept[0]));
+            uint64_t tail_ns = (uint64_t)WATCHDOG_TAIL_MS * 1000000;
+            if (trace_dump_since(path, since > tail_ns ? since - tail_ns : 0) == 0) {
+                log_write(LOG_LEVEL_WARN, "Event loop stuck in %s for over %llu ms, flight recorder tail in %s",
+                          watchdog_phase_name(phase), (unsigned long long)((now - since) / 1000000), path);
+                kept_count++;
+            }
+            last_dump_ns = now;
+        }
+    }
+}
+
+int watchdog_start(int threshold_ms) {
+    if (threshold_ms <= 0) return -1;
+    if (g_running) return 0;
+    g_threshold_ns = (uint64_t)threshold_ms * 1000000;
+    g_running = true;
+    /* Detached: the server exits from several places and never joins */
+    std::thread(watchdog_thread).detach();
+    return 0;
+}
+
+void watchdog_stop() {
+    g_running = false;
+}
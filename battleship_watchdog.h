@@ -0,0 +1,54 @@
+#ifndef BATTLESHIP_WATCHDOG_H
+#define BATTLESHIP_WATCHDOG_H
+
+#include <stdint.h>
+
+/* Stall watchdog for the poll loop. The loop marks when it wakes up and
+   when it goes back to poll(), and tags the work in between with a phase
+   (receiving, a handler, a send, leaderboard I/O, ...) plus the fd and
+   command involved; all of that is a few relaxed stores. A separate
+   thread checks the loop every threshold / 2. An iteration that runs
+   past the threshold is counted under the phase it is stuck in, logged
+   with its connection and command, and the last moments of the flight
+   recorder are written next to the crash dumps: one file per stall
+   episode (slow iterations until a quick one), at most one per
+   WATCHDOG_DUMP_INTERVAL_MS, and only the newest WATCHDOG_KEEP_DUMPS are
+   kept. The loop logs the full length once the iteration finishes. */
+
+#define WATCHDOG_DEFAULT_THRESHOLD_MS 5
+#define WATCHDOG_DUMP_INTERVAL_MS 1000
+#define WATCHDOG_KEEP_DUMPS 4
+#define WATCHDOG_TAIL_MS 200            // flight recorder history before the stall
+
+enum watchdog_phase {
+    WATCHDOG_LOOP = 0,          // loop bookkeeping outside the phases below
+    WATCHDOG_RECV,
+    WATCHDOG_HANDLER,
+    WATCHDOG_SEND,
+    WATCHDOG_LEADERBOARD,       // leaderboard update or read (file fallback)
+    WATCHDOG_SNAPSHOT,
+    WATCHDOG_BOTS,
+    WATCHDOG_HANDOFF,
+    WATCHDOG_ADMIN,             // answering an admin console command
+    WATCHDOG_TIMERS,            // deadlines that came due (turn, placement, seat, idle)
+    WATCHDOG_PHASES
+};
+
+/* Starts the checking thread. Returns 0, or -1 if threshold_ms <= 0. */
+int watchdog_start(int threshold_ms);
+void watchdog_stop();
+
+/* The loop woke up / is about to poll again. now_ns is monotonic
+   (trace_now_ns / metrics_now_ns). */
+void watchdog_busy(uint64_t now_ns);
+void watchdog_idle(uint64_t now_ns);
+
+/* Tags the work that follows; returns what was tagged before so nested
+   phases (a send inside a handler) can put it back. */
+uint64_t watchdog_enter(int phase, int command_id, int fd);
+void watchdog_leave(uint64_t previous);
+
+uint64_t watchdog_stalls(int phase);
+const char* watchdog_phase_name(int phase);
+
+#endif // BATTLESHIP_WATCHDOG_H
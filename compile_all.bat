@@ -2,7 +2,7 @@
 echo Компиляция проекта Battleship...
 
 echo Компиляция сервера...
-g++ battleship_server.cpp battleship.cpp -o battleship_server.exe -lws2_32 -std=c++17
+g++ battleship_server.cpp battleship_capture.cpp battleship_snapshot.cpp battleship_handoff.cpp battleship_leaderboard.cpp battleship_crdt.cpp battleship_bot_pool.cpp battleship_metrics.cpp battleship_trace.cpp battleship_log.cpp battleship_watchdog.cpp battleship_alloc.cpp battleship_admin.cpp battleship_timer.cpp battleship_strategy.cpp battleship_density.cpp battleship.cpp -o battleship_server.exe -lws2_32 -std=c++17
 if errorlevel 1 (
     echo Ошибка компиляции сервера!
     pause
@@ -17,6 +17,53 @@ if errorlevel 1 (
     exit /b 1
 )
 
+echo Компиляция генератора нагрузки...
+g++ battleship_loadgen.cpp battleship_client_lib.cpp -o battleship_loadgen.exe -lws2_32 -std=c++17
+if errorlevel 1 (
+    echo Ошибка компиляции генератора нагрузки!
+    pause
+    exit /b 1
+)
+
+echo Компиляция прокси с имитацией плохой сети...
+g++ battleship_chaosproxy.cpp -o battleship_chaosproxy.exe -lws2_32 -std=c++17
+if errorlevel 1 (
+    echo Ошибка компиляции прокси!
+    pause
+    exit /b 1
+)
+
+echo Компиляция бенчмарков...
+g++ -O2 -DBATTLESHIP_ALLOC_ACCOUNTING battleship_bench.cpp battleship_alloc.cpp battleship_density.cpp battleship.cpp -o battleship_bench.exe -std=c++17
+if errorlevel 1 (
+    echo Ошибка компиляции бенчмарков!
+    pause
+    exit /b 1
+)
+
+echo Компиляция симулятора...
+g++ -O2 battleship_sim.cpp battleship_strategy.cpp battleship_density.cpp battleship.cpp -o battleship_sim.exe -std=c++17
+if errorlevel 1 (
+    echo Ошибка компиляции симулятора!
+    pause
+    exit /b 1
+)
+
+echo Компиляция детерминированного симулятора...
+g++ -O2 -DBATTLESHIP_SERVER_NO_MAIN battleship_dsim.cpp battleship_server.cpp battleship_capture.cpp battleship_snapshot.cpp battleship_handoff.cpp battleship_leaderboard.cpp battleship_crdt.cpp battleship_bot_pool.cpp battleship_metrics.cpp battleship_trace.cpp battleship_log.cpp battleship_watchdog.cpp battleship_alloc.cpp battleship_admin.cpp battleship_timer.cpp battleship_strategy.cpp battleship_density.cpp battleship.cpp -o battleship_dsim.exe -lws2_32 -std=c++17
+if errorlevel 1 (
+    echo Ошибка компиляции детерминированного симулятора!
+    pause
+    exit /b 1
+)
+
+g++ -O2 -DBATTLESHIP_SERVER_NO_MAIN battleship_replay.cpp battleship_capture.cpp battleship_server.cpp battleship_snapshot.cpp battleship_handoff.cpp battleship_leaderboard.cpp battleship_crdt.cpp battleship_bot_pool.cpp battleship_metrics.cpp battleship_trace.cpp battleship_log.cpp battleship_watchdog.cpp battleship_alloc.cpp battleship_admin.cpp battleship_timer.cpp battleship_strategy.cpp battleship_density.cpp battleship.cpp -o battleship_replay.exe -lws2_32 -std=c++17
+if errorlevel 1 (
+    echo Ошибка компиляции инструмента воспроизведения трафика!
+    pause
+    exit /b 1
+)
+
 echo Успешно!
 echo Созданы файлы:
 dir *.exe